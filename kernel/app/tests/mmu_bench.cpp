@@ -0,0 +1,129 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "tests.h"
+
+#include <arch/mmu.h>
+#include <arch/ops.h>
+#include <err.h>
+#include <inttypes.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <kernel/vm.h>
+#include <kernel/vm/vm_aspace.h>
+#include <platform.h>
+#include <stdio.h>
+
+// Measures the cost of tearing down a large run of 4K mappings in an address
+// space that is live on every cpu, which is dominated by TLB shootdowns.
+
+static const size_t kBenchSize = 1024 * 1024 * 1024; // 1GB
+static const uint kBenchMmuFlags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_USER;
+
+static volatile bool bench_running;
+static volatile int bench_threads_active;
+
+// Sit in the aspace on another cpu so unmaps have to shoot down its TLB.
+static int aspace_spinner(void* arg) {
+    vmm_set_active_aspace(reinterpret_cast<vmm_aspace_t*>(arg));
+    atomic_add(&bench_threads_active, 1);
+
+    while (bench_running) {
+        arch_spinloop_pause();
+    }
+
+    vmm_set_active_aspace(nullptr);
+    atomic_add(&bench_threads_active, -1);
+    return 0;
+}
+
+static ulong total_generic_ipis() {
+    ulong ipis = 0;
+#if WITH_SMP
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        ipis += thread_stats[i].generic_ipis;
+    }
+#endif
+    return ipis;
+}
+
+int mmu_bench(int argc, const cmd_args* argv) {
+    mxtl::RefPtr<VmAspace> aspace = VmAspace::Create(VmAspace::TYPE_USER, "mmu bench");
+    if (!aspace) {
+        printf("failed to create aspace\n");
+        return ERR_NO_MEMORY;
+    }
+    arch_aspace_t* arch_aspace = &aspace->arch_aspace();
+
+    paddr_t pa;
+    vm_page_t* page = pmm_alloc_page(0, &pa);
+    if (!page) {
+        aspace->Destroy();
+        return ERR_NO_MEMORY;
+    }
+
+    // back every page in the range with the same physical page; nothing ever touches it
+    const vaddr_t base = ROUNDUP(aspace->base(), kBenchSize);
+    const size_t page_count = kBenchSize / PAGE_SIZE;
+    for (size_t i = 0; i < page_count; i++) {
+        status_t status = arch_mmu_map(arch_aspace, base + i * PAGE_SIZE, pa, 1, kBenchMmuFlags,
+                                       nullptr);
+        if (status != NO_ERROR) {
+            printf("map failed at page %zu: %d\n", i, status);
+            arch_mmu_unmap(arch_aspace, base, i, nullptr);
+            pmm_free_page(page);
+            aspace->Destroy();
+            return status;
+        }
+    }
+
+    // make the aspace active on every other cpu
+    bench_running = true;
+    bench_threads_active = 0;
+    uint spinners = 0;
+    uint curr_cpu = arch_curr_cpu_num();
+    mp_cpu_mask_t active = mp_get_active_mask();
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (i == curr_cpu || !(active & (1u << i)))
+            continue;
+
+        thread_t* t = thread_create("mmu bench spinner", &aspace_spinner, aspace.get(),
+                                    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+        if (!t)
+            break;
+        thread_set_pinned_cpu(t, i);
+        thread_detach_and_resume(t);
+        spinners++;
+    }
+    while (bench_threads_active != (int)spinners) {
+        thread_yield();
+    }
+
+    ulong ipis_before = total_generic_ipis();
+    lk_time_t start = current_time();
+    uint64_t cycles = arch_cycle_count();
+
+    size_t unmapped = 0;
+    status_t status = arch_mmu_unmap(arch_aspace, base, page_count, &unmapped);
+
+    cycles = arch_cycle_count() - cycles;
+    lk_time_t elapsed = current_time() - start;
+    ulong ipis = total_generic_ipis() - ipis_before;
+
+    bench_running = false;
+    while (bench_threads_active != 0) {
+        thread_yield();
+    }
+
+    printf("unmapped %zu 4K pages (status %d) with %u other cpus active in the aspace:\n",
+           unmapped, status, spinners);
+    printf("\t%" PRIu64 " ns, %" PRIu64 " cycles, %" PRIu64 " cycles/page, %lu ipis received\n",
+           elapsed, cycles, cycles / page_count, ipis);
+
+    pmm_free_page(page);
+    aspace->Destroy();
+    return NO_ERROR;
+}
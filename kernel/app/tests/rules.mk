@@ -15,7 +15,9 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/clock_tests.c \
     $(LOCAL_DIR)/fibo.c \
     $(LOCAL_DIR)/mem_tests.cpp \
+    $(LOCAL_DIR)/mmu_bench.cpp \
     $(LOCAL_DIR)/printf_tests.c \
+    $(LOCAL_DIR)/sched_bench.c \
     $(LOCAL_DIR)/sync_ipi_tests.c \
     $(LOCAL_DIR)/sleep_tests.c \
     $(LOCAL_DIR)/tests.c \
@@ -0,0 +1,242 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "tests.h"
+
+#include <assert.h>
+#include <debug.h>
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <arch/ops.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <platform.h>
+
+/* scheduler scaling benchmarks: wakeup latency, context switch rate, thread
+ * lock acquisition cost and load balancing as a function of how many cpus are
+ * participating */
+
+#define WAKEUP_ITERATIONS 10000
+#define YIELD_ITERATIONS 100000
+#define SPIN_ITERATIONS 20000000
+
+struct ping_pong {
+    event_t ping;
+    event_t pong;
+    volatile lk_time_t signal_time;
+    lk_time_t total_latency;
+    uint64_t lock_acquire_cycles;
+};
+
+static int pong_thread(void *arg)
+{
+    struct ping_pong *pp = arg;
+
+    for (int i = 0; i < WAKEUP_ITERATIONS; i++) {
+        event_wait(&pp->ping);
+        pp->total_latency += current_time() - pp->signal_time;
+        event_signal(&pp->pong, true);
+    }
+
+    return 0;
+}
+
+static int ping_thread(void *arg)
+{
+    struct ping_pong *pp = arg;
+
+    for (int i = 0; i < WAKEUP_ITERATIONS; i++) {
+        pp->signal_time = current_time();
+        event_signal(&pp->ping, true);
+        event_wait(&pp->pong);
+
+        /* sample how long it takes to acquire the thread lock with everyone else
+         * churning. This is the wait for other cpus to leave their scheduler
+         * critical sections, not the hold time of those sections. */
+        spin_lock_saved_state_t state;
+        uint64_t start = arch_cycle_count();
+        spin_lock_irqsave(&thread_lock, state);
+        pp->lock_acquire_cycles += arch_cycle_count() - start;
+        spin_unlock_irqrestore(&thread_lock, state);
+    }
+
+    return 0;
+}
+
+static thread_t *create_pinned(const char *name, thread_start_routine entry, void *arg, uint cpu)
+{
+    thread_t *t = thread_create(name, entry, arg, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+    if (t)
+        thread_set_pinned_cpu(t, cpu);
+    return t;
+}
+
+/* one ping/pong pair per cpu in the first num_cpus active cpus, each pair split
+ * across neighbouring cpus so every wakeup crosses a cpu boundary */
+static void wakeup_bench(uint num_cpus, const uint *cpus)
+{
+    struct ping_pong pp[SMP_MAX_CPUS];
+    thread_t *threads[SMP_MAX_CPUS * 2];
+
+    for (uint i = 0; i < num_cpus; i++) {
+        memset(&pp[i], 0, sizeof(pp[i]));
+        event_init(&pp[i].ping, false, EVENT_FLAG_AUTOUNSIGNAL);
+        event_init(&pp[i].pong, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+        threads[i * 2] = create_pinned("ping", &ping_thread, &pp[i], cpus[i]);
+        threads[i * 2 + 1] = create_pinned("pong", &pong_thread, &pp[i], cpus[(i + 1) % num_cpus]);
+    }
+
+    lk_time_t start = current_time();
+    for (uint i = 0; i < num_cpus * 2; i++)
+        thread_resume(threads[i]);
+    for (uint i = 0; i < num_cpus * 2; i++)
+        thread_join(threads[i], NULL, INFINITE_TIME);
+    lk_time_t elapsed = current_time() - start;
+
+    lk_time_t latency = 0;
+    uint64_t lock_acquire = 0;
+    for (uint i = 0; i < num_cpus; i++) {
+        latency += pp[i].total_latency;
+        lock_acquire += pp[i].lock_acquire_cycles;
+        event_destroy(&pp[i].ping);
+        event_destroy(&pp[i].pong);
+    }
+
+    uint64_t wakeups = (uint64_t)num_cpus * WAKEUP_ITERATIONS;
+    printf("%2u cpus: wakeup latency %" PRIu64 " ns, %" PRIu64 " wakeups/sec, "
+           "thread_lock acquire %" PRIu64 " cycles\n",
+           num_cpus, latency / wakeups,
+           elapsed ? wakeups * 2 * LK_SEC(1) / elapsed : 0,
+           lock_acquire / wakeups);
+}
+
+static int yield_thread(void *arg)
+{
+    for (int i = 0; i < YIELD_ITERATIONS; i++)
+        thread_yield();
+
+    return 0;
+}
+
+/* two yielding threads on each of the first num_cpus cpus */
+static void context_switch_bench(uint num_cpus, const uint *cpus)
+{
+    thread_t *threads[SMP_MAX_CPUS * 2];
+
+    ulong switches = 0;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++)
+        switches -= thread_stats[i].context_switches;
+
+    for (uint i = 0; i < num_cpus * 2; i++)
+        threads[i] = create_pinned("yielder", &yield_thread, NULL, cpus[i / 2]);
+
+    lk_time_t start = current_time();
+    for (uint i = 0; i < num_cpus * 2; i++)
+        thread_resume(threads[i]);
+    for (uint i = 0; i < num_cpus * 2; i++)
+        thread_join(threads[i], NULL, INFINITE_TIME);
+    lk_time_t elapsed = current_time() - start;
+
+    for (uint i = 0; i < SMP_MAX_CPUS; i++)
+        switches += thread_stats[i].context_switches;
+
+    printf("%2u cpus: %lu context switches in %" PRIu64 " ns, %" PRIu64 " switches/sec\n",
+           num_cpus, switches, elapsed,
+           elapsed ? (uint64_t)switches * LK_SEC(1) / elapsed : 0);
+}
+
+struct spinner {
+    uint migrations;
+};
+
+static int spin_thread(void *arg)
+{
+    struct spinner *sp = arg;
+
+    /* we were created pinned so that every spinner starts out queued on the same
+     * cpu; drop the pin and leave it to the scheduler to spread us out */
+    THREAD_LOCK(state);
+    thread_set_pinned_cpu(get_current_thread(), -1);
+    THREAD_UNLOCK(state);
+
+    uint last_cpu = arch_curr_cpu_num();
+    for (uint i = 0; i < SPIN_ITERATIONS; i++) {
+        uint cpu = arch_curr_cpu_num();
+        if (cpu != last_cpu) {
+            sp->migrations++;
+            last_cpu = cpu;
+        }
+    }
+
+    return 0;
+}
+
+/* num_threads cpu bound threads all made runnable on the same cpu, with every
+ * active cpu available to them. Measures how quickly placement and stealing
+ * even out the imbalance. */
+static void load_balance_bench(uint num_threads, uint start_cpu)
+{
+    struct spinner sp[SMP_MAX_CPUS];
+    thread_t *threads[SMP_MAX_CPUS];
+
+    ulong steals = 0;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++)
+        steals -= thread_stats[i].steals;
+
+    for (uint i = 0; i < num_threads; i++) {
+        sp[i].migrations = 0;
+        threads[i] = create_pinned("spinner", &spin_thread, &sp[i], start_cpu);
+    }
+
+    lk_time_t start = current_time();
+    for (uint i = 0; i < num_threads; i++)
+        thread_resume(threads[i]);
+    for (uint i = 0; i < num_threads; i++)
+        thread_join(threads[i], NULL, INFINITE_TIME);
+    lk_time_t elapsed = current_time() - start;
+
+    for (uint i = 0; i < SMP_MAX_CPUS; i++)
+        steals += thread_stats[i].steals;
+
+    uint migrations = 0;
+    for (uint i = 0; i < num_threads; i++)
+        migrations += sp[i].migrations;
+
+    printf("%2u threads: %" PRIu64 " ns, %u migrations, %lu steals\n",
+           num_threads, elapsed, migrations, steals);
+}
+
+int sched_bench(int argc, const cmd_args *argv)
+{
+    uint cpus[SMP_MAX_CPUS];
+    uint num_cpus = 0;
+
+    mp_cpu_mask_t active = mp_get_active_mask();
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (active & (1u << i))
+            cpus[num_cpus++] = i;
+    }
+
+    printf("scheduler benchmark, %u active cpus\n", num_cpus);
+
+    printf("wakeup latency:\n");
+    for (uint n = 1; n <= num_cpus; n *= 2)
+        wakeup_bench(n, cpus);
+
+    printf("context switch rate:\n");
+    for (uint n = 1; n <= num_cpus; n *= 2)
+        context_switch_bench(n, cpus);
+
+    printf("load balancing from cpu %u:\n", cpus[0]);
+    for (uint n = 1; n <= num_cpus; n *= 2)
+        load_balance_bench(n, cpus[0]);
+
+    return 0;
+}
@@ -30,7 +30,7 @@ static int timer_do_one_thread(void* arg)
     event_init(&event, false, 0);
     timer_initialize(&timer);
 
-    timer_set_oneshot(&timer, current_time() + LK_MSEC(10), timer_cb, &event);
+    timer_set_oneshot(&timer, current_time() + LK_MSEC(10), 0, timer_cb, &event);
     event_wait(&event);
 
     printf("got timer on cpu %u\n", arch_curr_cpu_num());
@@ -75,8 +75,52 @@ static void timer_test_all_cpus(void)
     printf("%u threads created, %u threads joined\n", max, joined);
 }
 
+static enum handler_return timer_record_cb(struct timer* timer, lk_time_t now, void* arg)
+{
+    lk_time_t* fired = (lk_time_t*)arg;
+    *fired = now;
+
+    return INT_NO_RESCHEDULE;
+}
+
+static void timer_test_coalescing(bool slack_first)
+{
+    timer_t a, b;
+    volatile lk_time_t a_fired = 0, b_fired = 0;
+
+    timer_initialize(&a);
+    timer_initialize(&b);
+
+    // b's window covers a's deadline so it should be folded onto it, whichever
+    // of the two is set first. both timers need to land in the same cpu's queue
+    // for that
+    lk_time_t deadline = current_time() + LK_MSEC(20);
+    arch_disable_ints();
+    if (slack_first) {
+        timer_set_oneshot(&b, deadline - LK_MSEC(2), LK_MSEC(5), timer_record_cb, (void*)&b_fired);
+        timer_set_oneshot(&a, deadline, 0, timer_record_cb, (void*)&a_fired);
+    } else {
+        timer_set_oneshot(&a, deadline, 0, timer_record_cb, (void*)&a_fired);
+        timer_set_oneshot(&b, deadline - LK_MSEC(2), LK_MSEC(5), timer_record_cb, (void*)&b_fired);
+    }
+    arch_enable_ints();
+
+    thread_sleep_relative(LK_MSEC(40));
+    timer_cancel(&a);
+    timer_cancel(&b);
+
+    printf("coalesced timers (%s first): a fired at %" PRIu64 ", b fired at %" PRIu64 " (deadline %" PRIu64 ") %s\n",
+           slack_first ? "b" : "a", a_fired, b_fired, deadline,
+           (a_fired != 0 && a_fired == b_fired && b_fired >= deadline) ? "ok" : "FAIL");
+}
+
 void timer_tests(void)
 {
     // timer fires on all cpus
     timer_test_all_cpus();
+
+    // a timer with slack shares an interrupt with one already queued, or with
+    // one queued after it
+    timer_test_coalescing(false);
+    timer_test_coalescing(true);
 }
@@ -281,6 +281,61 @@ static void free_page_table(void* vaddr, paddr_t paddr, uint page_size_shift) {
     }
 }
 
+/* TLB maintenance collected over a single unmap or protect. Past a threshold
+ * the per page invalidates are skipped in favor of one asid wide (or, for the
+ * kernel, full) invalidate at the end, and page tables freed along the way are
+ * held until then. */
+struct arm64_tlb_batch {
+    list_node freed_page_tables;
+};
+
+/* past this many pages, one bulk invalidate beats broadcasting one per page */
+static const size_t kTlbBatchThresholdPages = 64;
+
+static void arm64_tlb_invalidate_page(vaddr_t vaddr, uint asid, arm64_tlb_batch* batch) {
+    if (batch)
+        return;
+
+    if (asid == MMU_ARM64_GLOBAL_ASID)
+        ARM64_TLBI(vaae1is, vaddr >> 12);
+    else
+        ARM64_TLBI(vae1is, vaddr >> 12 | (vaddr_t)asid << 48);
+}
+
+static void arm64_tlb_invalidate_all(uint asid) {
+    if (asid == MMU_ARM64_GLOBAL_ASID)
+        ARM64_TLBI_NOADDR(vmalle1is);
+    else
+        ARM64_TLBI(aside1is, (vaddr_t)asid << 48);
+    DSB;
+}
+
+static void arm64_tlb_batch_free_page_table(arm64_tlb_batch* batch, void* vaddr, paddr_t paddr,
+                                            uint page_size_shift, uint asid) {
+    if (!batch) {
+        free_page_table(vaddr, paddr, page_size_shift);
+        return;
+    }
+
+    vm_page_t* page = ((1UL << page_size_shift) >= PAGE_SIZE) ? paddr_to_vm_page(paddr) : nullptr;
+    if (page) {
+        list_add_tail(&batch->freed_page_tables, &page->free.node);
+    } else {
+        /* heap backed tables can't be queued, flush now so it can go */
+        arm64_tlb_invalidate_all(asid);
+        free_page_table(vaddr, paddr, page_size_shift);
+    }
+}
+
+static void arm64_tlb_batch_finish(arm64_tlb_batch* batch, uint asid) {
+    if (!batch)
+        return;
+
+    arm64_tlb_invalidate_all(asid);
+    if (!list_is_empty(&batch->freed_page_tables))
+        pmm_free(&batch->freed_page_tables);
+}
+
 static pte_t* arm64_mmu_get_page_table(vaddr_t index, uint page_size_shift, pte_t* page_table) {
     pte_t pte;
     paddr_t paddr;
@@ -344,7 +399,8 @@ static bool page_table_is_clear(pte_t* page_table, uint page_size_shift) {
 static ssize_t arm64_mmu_unmap_pt(vaddr_t vaddr, vaddr_t vaddr_rel,
                                   size_t size,
                                   uint index_shift, uint page_size_shift,
-                                  pte_t* page_table, uint asid) {
+                                  pte_t* page_table, uint asid,
+                                  arm64_tlb_batch* batch) {
     pte_t* next_page_table;
     vaddr_t index;
     size_t chunk_size;
@@ -375,23 +431,21 @@ static ssize_t arm64_mmu_unmap_pt(vaddr_t vaddr, vaddr_t vaddr_rel,
             arm64_mmu_unmap_pt(vaddr, vaddr_rem, chunk_size,
                                index_shift - (page_size_shift - 3),
                                page_size_shift,
-                               next_page_table, asid);
+                               next_page_table, asid, batch);
             if (chunk_size == block_size ||
                 page_table_is_clear(next_page_table, page_size_shift)) {
                 LTRACEF("pte %p[0x%lx] = 0 (was page table)\n", page_table, index);
                 page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
                 __asm__ volatile("dmb ishst" ::
                                      : "memory");
-                free_page_table(next_page_table, page_table_paddr, page_size_shift);
+                arm64_tlb_batch_free_page_table(batch, next_page_table, page_table_paddr,
+                                                page_size_shift, asid);
             }
         } else if (pte) {
             LTRACEF("pte %p[0x%lx] = 0\n", page_table, index);
             page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
             CF;
-            if (asid == MMU_ARM64_GLOBAL_ASID)
-                ARM64_TLBI(vaae1is, vaddr >> 12);
-            else
-                ARM64_TLBI(vae1is, vaddr >> 12 | (vaddr_t)asid << 48);
+            arm64_tlb_invalidate_page(vaddr, asid, batch);
         } else {
             LTRACEF("pte %p[0x%lx] already clear\n", page_table, index);
         }
@@ -484,7 +538,7 @@ static ssize_t arm64_mmu_map_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
 
 err:
     arm64_mmu_unmap_pt(vaddr_in, vaddr_rel_in, size_in - size,
-                       index_shift, page_size_shift, page_table, asid);
+                       index_shift, page_size_shift, page_table, asid, nullptr);
     DSB;
     return ERR_INTERNAL;
 }
@@ -492,7 +546,8 @@ err:
 static int arm64_mmu_protect_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
                                 size_t size_in, pte_t attrs,
                                 uint index_shift, uint page_size_shift,
-                                pte_t* page_table, uint asid) {
+                                pte_t* page_table, uint asid,
+                                arm64_tlb_batch* batch) {
     int ret;
     pte_t* next_page_table;
     vaddr_t index;
@@ -533,7 +588,7 @@ static int arm64_mmu_protect_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
                                        attrs,
                                        index_shift - (page_size_shift - 3),
                                        page_size_shift,
-                                       next_page_table, asid);
+                                       next_page_table, asid, batch);
             if (ret != 0) {
                 goto err;
             }
@@ -544,11 +599,7 @@ static int arm64_mmu_protect_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
             page_table[index] = pte;
 
             CF;
-            if (asid == MMU_ARM64_GLOBAL_ASID) {
-                ARM64_TLBI(vaae1is, vaddr >> 12);
-            } else {
-                ARM64_TLBI(vae1is, vaddr >> 12 | (vaddr_t)asid << 48);
-            }
+            arm64_tlb_invalidate_page(vaddr, asid, batch);
         } else {
             LTRACEF("page table entry does not exist, index %#" PRIxPTR
                     ", %#" PRIx64 "\n",
@@ -618,9 +669,15 @@ static ssize_t arm64_mmu_unmap(vaddr_t vaddr, size_t size,
         return ERR_INVALID_ARGS;
     }
 
+    arm64_tlb_batch batch;
+    list_initialize(&batch.freed_page_tables);
+    bool batched = (size >> page_size_shift) > kTlbBatchThresholdPages;
+
     ssize_t ret = arm64_mmu_unmap_pt(vaddr, vaddr_rel, size,
-                       top_index_shift, page_size_shift, top_page_table, asid);
+                       top_index_shift, page_size_shift, top_page_table, asid,
+                       batched ? &batch : nullptr);
     DSB;
+    arm64_tlb_batch_finish(batched ? &batch : nullptr, asid);
     return ret;
 }
 
@@ -646,9 +703,15 @@ static status_t arm64_mmu_protect(vaddr_t vaddr, size_t size, pte_t attrs,
         return ERR_INVALID_ARGS;
     }
 
+    arm64_tlb_batch batch;
+    list_initialize(&batch.freed_page_tables);
+    bool batched = (size >> page_size_shift) > kTlbBatchThresholdPages;
+
     status_t ret = arm64_mmu_protect_pt(vaddr, vaddr_rel, size, attrs,
-                           top_index_shift, page_size_shift, top_page_table, asid);
+                           top_index_shift, page_size_shift, top_page_table, asid,
+                           batched ? &batch : nullptr);
     DSB;
+    arm64_tlb_batch_finish(batched ? &batch : nullptr, asid);
     return ret;
 }
 
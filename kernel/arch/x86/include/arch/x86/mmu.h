@@ -175,6 +175,10 @@ void x86_mmu_init(void);
 
 paddr_t x86_kernel_cr3(void);
 
+/* number of large page entries currently present at |level| (PD_L or PDP_L)
+ * across all page tables */
+int64_t x86_mmu_live_large_pages(enum page_table_levels level);
+
 __END_CDECLS
 
 #endif // !ASSEMBLY
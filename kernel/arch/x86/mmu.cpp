@@ -21,6 +21,7 @@
 #include <kernel/vm.h>
 
 #include <bitmap/rle-bitmap.h>
+#include <mxtl/macros.h>
 
 #define LOCAL_TRACE 0
 
@@ -123,69 +124,129 @@ static void x86_tlb_global_invalidate() {
     }
 }
 
-/* Task used for invalidating a TLB entry on each CPU */
-struct tlb_invalidate_page_context {
+/* Pending TLB invalidations collected over a single map/unmap/protect
+ * operation, so remote CPUs are interrupted once per operation rather than
+ * once per page. Page tables freed by the operation are held here until the
+ * shootdown completes, since other CPUs may still be walking them. */
+struct PendingTlbInvalidation {
+    struct Item {
+        vaddr_t vaddr;
+        enum page_table_levels level;
+        bool global_page;
+    };
+
+    /* Past this many pages, a full TLB flush is cheaper than a run of invlpgs */
+    static constexpr size_t kMaxPages = 32;
+
+    PendingTlbInvalidation() = default;
+    ~PendingTlbInvalidation() {
+        DEBUG_ASSERT(count == 0 && !full_shootdown);
+        DEBUG_ASSERT(list_is_empty(&freed_page_tables));
+    }
+    DISALLOW_COPY_ASSIGN_AND_MOVE(PendingTlbInvalidation);
+
+    void enqueue(vaddr_t vaddr, enum page_table_levels level, bool global_page) {
+        contains_global |= global_page;
+
+        /* a top level entry covers too much to invalidate by address */
+        if (level == PML4_L || count >= kMaxPages) {
+            full_shootdown = true;
+            return;
+        }
+
+        items[count++] = { .vaddr = vaddr, .level = level, .global_page = global_page };
+    }
+
+    void defer_free(pt_entry_t* table) {
+        vm_page_t* page = paddr_to_vm_page(X86_VIRT_TO_PHYS(table));
+        DEBUG_ASSERT(page);
+        list_add_tail(&freed_page_tables, &page->free.node);
+    }
+
+    bool needs_shootdown() const { return count > 0 || full_shootdown; }
+
+    void clear() {
+        count = 0;
+        full_shootdown = false;
+        contains_global = false;
+    }
+
+    Item items[kMaxPages];
+    size_t count = 0;
+    bool full_shootdown = false;
+    bool contains_global = false;
+    list_node freed_page_tables = LIST_INITIAL_VALUE(freed_page_tables);
+};
+
+/* Task used for invalidating a set of TLB entries on each CPU */
+struct tlb_invalidate_context {
     ulong target_cr3;
-    vaddr_t vaddr;
-    enum page_table_levels level;
-    bool global_page;
+    const PendingTlbInvalidation* pending;
 };
-static void tlb_invalidate_page_task(void* raw_context) {
+static void tlb_invalidate_task(void* raw_context) {
     DEBUG_ASSERT(arch_ints_disabled());
-    tlb_invalidate_page_context* context = (tlb_invalidate_page_context*)raw_context;
+    tlb_invalidate_context* context = (tlb_invalidate_context*)raw_context;
+    const PendingTlbInvalidation* pending = context->pending;
 
     ulong cr3 = x86_get_cr3();
-    if (context->target_cr3 != cr3 && !context->global_page) {
+    if (context->target_cr3 != cr3 && !pending->contains_global) {
         /* This invalidation doesn't apply to this CPU, ignore it */
         return;
     }
 
-    switch (context->level) {
-    case PML4_L:
-        x86_tlb_global_invalidate();
-        break;
-    case PDP_L:
-    case PD_L:
-    case PT_L:
-        __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)context->vaddr));
-        break;
+    if (pending->full_shootdown) {
+        if (pending->contains_global) {
+            x86_tlb_global_invalidate();
+        } else {
+            /* reloading cr3 drops every non-global entry */
+            x86_set_cr3(cr3);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < pending->count; ++i) {
+        const PendingTlbInvalidation::Item& item = pending->items[i];
+        if (context->target_cr3 != cr3 && !item.global_page) {
+            continue;
+        }
+        __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)item.vaddr));
     }
 }
 
 /**
- * @brief Invalidate a single page at a given page table level
+ * @brief Execute a batch of pending TLB invalidations
  *
  * @param aspace The aspace we're invalidating for (if NULL, assume for current one)
- * @param vaddr The virtual address we are invalidating the TLB entry for
- * @param level The page table level that maps this vaddr
- * @param global_page True if we are invalidating a global mapping
- *
- * TODO(teisenbe): Optimize this.  This is horribly inefficient.
- * We should also change this to pool invalidations from a single
- * "transaction" and then only execute a single mp_sync_exec for that
- * transaction, rather than one per page.
+ * @param pending The invalidations to perform; cleared on return
  */
-void x86_tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, enum page_table_levels level,
-                             bool global_page) {
-    ulong cr3 = aspace ? aspace->pt_phys : x86_get_cr3();
-    struct tlb_invalidate_page_context task_context = {
-        .target_cr3 = cr3, .vaddr = vaddr, .level = level, .global_page = global_page,
-    };
+static void x86_tlb_invalidate(arch_aspace_t* aspace, PendingTlbInvalidation* pending) {
+    if (pending->needs_shootdown()) {
+        ulong cr3 = aspace ? aspace->pt_phys : x86_get_cr3();
+        struct tlb_invalidate_context task_context = {
+            .target_cr3 = cr3, .pending = pending,
+        };
+
+        /* Target only CPUs this aspace is active on.  It may be the case that some
+         * other CPU will become active in it after this load, or will have left it
+         * just before this load.  In the former case, it is becoming active after
+         * the write to the page table, so it will see the change.  In the latter
+         * case, it will get a spurious request to flush. */
+        mp_cpu_mask_t targets;
+        if (pending->contains_global || aspace == nullptr) {
+            targets = MP_CPU_ALL;
+        } else {
+            targets = atomic_load(&aspace->active_cpus);
+            static_assert(sizeof(mp_cpu_mask_t) == sizeof(aspace->active_cpus), "err");
+        }
 
-    /* Target only CPUs this aspace is active on.  It may be the case that some
-     * other CPU will become active in it after this load, or will have left it
-     * just before this load.  In the former case, it is becoming active after
-     * the write to the page table, so it will see the change.  In the latter
-     * case, it will get a spurious request to flush. */
-    mp_cpu_mask_t targets;
-    if (global_page || aspace == nullptr) {
-        targets = MP_CPU_ALL;
-    } else {
-        targets = atomic_load(&aspace->active_cpus);
-        static_assert(sizeof(mp_cpu_mask_t) == sizeof(aspace->active_cpus), "err");
+        mp_sync_exec(targets, tlb_invalidate_task, &task_context);
+        pending->clear();
     }
 
-    mp_sync_exec(targets, tlb_invalidate_page_task, &task_context);
+    /* nobody can be walking the old page tables anymore */
+    if (!list_is_empty(&pending->freed_page_tables)) {
+        pmm_free(&pending->freed_page_tables);
+    }
 }
 
 template <int Level>
@@ -373,10 +434,11 @@ struct PageTable : PageTableBase<Level> {
     }
 
     /**
-     * @brief Invalidate a single page at a given page table level
+     * @brief Queue invalidation of a single page at a given page table level
      */
-    static void tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, bool global_page) {
-        x86_tlb_invalidate_page(aspace, vaddr, Base::level, global_page);
+    static void tlb_invalidate_page(PendingTlbInvalidation* pending, vaddr_t vaddr,
+                                    bool global_page) {
+        pending->enqueue(vaddr, Base::level, global_page);
     }
 };
 
@@ -424,9 +486,10 @@ struct ExtendedPageTable : PageTableBase<Level> {
     }
 
     /**
-     * @brief Invalidate a single page at a given page table level
+     * @brief Queue invalidation of a single page at a given page table level
      */
-    static void tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, bool global_page) {
+    static void tlb_invalidate_page(PendingTlbInvalidation* pending, vaddr_t vaddr,
+                                    bool global_page) {
         // TODO(abdulla): Implement this.
     }
 };
@@ -503,9 +566,29 @@ struct MappingCursor {
     size_t size;
 };
 
+/* live large page entries, indexed by level */
+static int64_t live_large_pages[PML4_L + 1];
+
+int64_t x86_mmu_live_large_pages(enum page_table_levels level) {
+    DEBUG_ASSERT(level <= PML4_L);
+    return atomic_load_64(&live_large_pages[level]);
+}
+
+/* keep live_large_pages up to date as |olde| is replaced by |newe| */
+template <typename PageTable>
+static inline void account_large_page(pt_entry_t olde, pt_entry_t newe) {
+    /* at PT_L the PS bit position is the PAT bit */
+    if (PageTable::level == PT_L)
+        return;
+    int64_t delta = (IS_PAGE_PRESENT(newe) && IS_LARGE_PAGE(newe)) -
+                    (IS_PAGE_PRESENT(olde) && IS_LARGE_PAGE(olde));
+    if (delta)
+        atomic_add_64(&live_large_pages[PageTable::level], delta);
+}
+
 template <typename PageTable>
-static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte, paddr_t paddr,
-                         arch_flags_t flags) {
+static void update_entry(arch_aspace_t* aspace, PendingTlbInvalidation* pending, vaddr_t vaddr,
+                         pt_entry_t* pte, paddr_t paddr, arch_flags_t flags) {
     DEBUG_ASSERT(pte);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(paddr));
 
@@ -514,24 +597,27 @@ static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte,
     /* set the new entry */
     *pte = paddr;
     *pte |= flags | X86_MMU_PG_P;
+    account_large_page<PageTable>(olde, *pte);
 
     /* attempt to invalidate the page */
     if (IS_PAGE_PRESENT(olde)) {
-        PageTable::tlb_invalidate_page(aspace, vaddr, is_kernel_address(vaddr));
+        PageTable::tlb_invalidate_page(pending, vaddr, is_kernel_address(vaddr));
     }
 }
 
 template <typename PageTable>
-static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
+static void unmap_entry(arch_aspace_t* aspace, PendingTlbInvalidation* pending, vaddr_t vaddr,
+                        pt_entry_t* pte) {
     DEBUG_ASSERT(pte);
 
     pt_entry_t olde = *pte;
 
     *pte = 0;
+    account_large_page<PageTable>(olde, 0);
 
     /* attempt to invalidate the page */
     if (IS_PAGE_PRESENT(olde)) {
-        PageTable::tlb_invalidate_page(aspace, vaddr, is_kernel_address(vaddr));
+        PageTable::tlb_invalidate_page(pending, vaddr, is_kernel_address(vaddr));
     }
 }
 
@@ -555,7 +641,8 @@ static pt_entry_t* _map_alloc_page(void) {
  * @brief Split the given large page into smaller pages
  */
 template <typename PageTable>
-static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
+static status_t x86_mmu_split(arch_aspace_t* aspace, PendingTlbInvalidation* pending, vaddr_t vaddr,
+                              pt_entry_t* pte) {
     static_assert(PageTable::level != PT_L, "tried splitting PT_L");
     LTRACEF_LEVEL(2, "splitting table %p at level %d\n", pte, PageTable::level);
 
@@ -576,14 +663,15 @@ static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t*
         pt_entry_t* e = m + i;
         // If this is a PDP_L (i.e. huge page), flags will include the
         // PS bit still, so the new PD entries will be large pages.
-        update_entry<typename PageTable::LowerTable>(aspace, new_vaddr, e, new_paddr, flags);
+        update_entry<typename PageTable::LowerTable>(aspace, pending, new_vaddr, e, new_paddr,
+                                                     flags);
         new_vaddr += ps;
         new_paddr += ps;
     }
     DEBUG_ASSERT(new_vaddr == vaddr + PageTable::page_size());
 
     flags = PageTable::intermediate_arch_flags();
-    update_entry<PageTable>(aspace, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
+    update_entry<PageTable>(aspace, pending, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
     return NO_ERROR;
 }
 
@@ -679,8 +767,9 @@ status_t x86_mmu_get_mapping<ExtendedPageTable<PT_L>>(pt_entry_t* table, vaddr_t
  * @return true if at least one page was unmapped at this level
  */
 template <typename PageTable>
-static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
-                                   const MappingCursor& start_cursor, MappingCursor* new_cursor) {
+static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                   pt_entry_t* table, const MappingCursor& start_cursor,
+                                   MappingCursor* new_cursor) {
     DEBUG_ASSERT(table);
     LTRACEF("L: %d, %016" PRIxPTR " %016zx\n", PageTable::level, start_cursor.vaddr,
             start_cursor.size);
@@ -714,7 +803,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             bool vaddr_level_aligned = PageTable::page_aligned(new_cursor->vaddr);
             // If the request covers the entire large page, just unmap it
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+                unmap_entry<PageTable>(aspace, pending, new_cursor->vaddr, e);
                 unmapped = true;
 
                 new_cursor->vaddr += ps;
@@ -724,11 +813,11 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            status_t status = x86_mmu_split<PageTable>(aspace, page_vaddr, e);
+            status_t status = x86_mmu_split<PageTable>(aspace, pending, page_vaddr, e);
             if (status != NO_ERROR) {
                 // If split fails, just unmap the whole thing, and let a
                 // subsequent page fault clean it up.
-                unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+                unmap_entry<PageTable>(aspace, pending, new_cursor->vaddr, e);
                 unmapped = true;
 
                 const size_t size = (new_cursor->size > ps) ? ps : new_cursor->size;
@@ -741,7 +830,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
         MappingCursor cursor;
         pt_entry_t* next_table = get_next_table_from_entry(*e);
         bool lower_unmapped = x86_mmu_remove_mapping<typename PageTable::LowerTable>(
-            aspace, next_table, *new_cursor, &cursor);
+            aspace, pending, next_table, *new_cursor, &cursor);
 
         // If we were requesting to unmap everything in the lower page table,
         // we know we can unmap the lower level page table.  Otherwise, if
@@ -761,8 +850,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
         }
         if (unmap_page_table) {
-            unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
-            pmm_free_page(paddr_to_vm_page(X86_VIRT_TO_PHYS(next_table)));
+            unmap_entry<PageTable>(aspace, pending, new_cursor->vaddr, e);
+            pending->defer_free(next_table);
             unmapped = true;
         }
         *new_cursor = cursor;
@@ -776,8 +865,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
 
 // Base case of x86_remove_mapping for smallest page size
 template <typename PageTable>
-static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
-                                      const MappingCursor& start_cursor,
+static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                      pt_entry_t* table, const MappingCursor& start_cursor,
                                       MappingCursor* new_cursor) {
     static_assert(PageTable::level == PT_L, "x86_mmu_remove_mapping_l0 used with wrong level");
     LTRACEF("%016" PRIxPTR " %016zx\n", start_cursor.vaddr, start_cursor.size);
@@ -790,7 +879,7 @@ static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
     for (; index != NO_OF_PT_ENTRIES && new_cursor->size != 0; ++index) {
         pt_entry_t* e = table + index;
         if (IS_PAGE_PRESENT(*e)) {
-            unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+            unmap_entry<PageTable>(aspace, pending, new_cursor->vaddr, e);
             unmapped = true;
         }
 
@@ -802,17 +891,20 @@ static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
 }
 
 template <>
-bool x86_mmu_remove_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
-                                             const MappingCursor& start_cursor,
+bool x86_mmu_remove_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                             pt_entry_t* table, const MappingCursor& start_cursor,
                                              MappingCursor* new_cursor) {
-    return x86_mmu_remove_mapping_l0<PageTable<PT_L>>(aspace, table, start_cursor, new_cursor);
+    return x86_mmu_remove_mapping_l0<PageTable<PT_L>>(aspace, pending, table, start_cursor,
+                                                      new_cursor);
 }
 
 template <>
-bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
+bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace,
+                                                     PendingTlbInvalidation* pending,
+                                                     pt_entry_t* table,
                                                      const MappingCursor& start_cursor,
                                                      MappingCursor* new_cursor) {
-    return x86_mmu_remove_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, start_cursor,
+    return x86_mmu_remove_mapping_l0<ExtendedPageTable<PT_L>>(aspace, pending, table, start_cursor,
                                                               new_cursor);
 }
 
@@ -833,7 +925,8 @@ bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_e
  * @return ERR_NO_MEMORY if intermediate page tables could not be allocated
  */
 template <typename PageTable>
-static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                    pt_entry_t* table, uint mmu_flags,
                                     const MappingCursor& start_cursor, MappingCursor* new_cursor) {
     DEBUG_ASSERT(table);
     DEBUG_ASSERT(x86_mmu_check_vaddr(start_cursor.vaddr));
@@ -862,8 +955,8 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, ui
         if (level_supports_large_pages && !IS_PAGE_PRESENT(*e) && level_valigned &&
             level_paligned && new_cursor->size >= ps) {
 
-            update_entry<PageTable>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr,
-                                    arch_flags | X86_MMU_PG_PS);
+            update_entry<PageTable>(aspace, pending, new_cursor->vaddr, table + index,
+                                    new_cursor->paddr, arch_flags | X86_MMU_PG_PS);
 
             new_cursor->paddr += ps;
             new_cursor->vaddr += ps;
@@ -880,13 +973,13 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, ui
 
                 LTRACEF_LEVEL(2, "new table %p at level %d\n", m, PageTable::level);
 
-                update_entry<PageTable>(aspace, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
+                update_entry<PageTable>(aspace, pending, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
                                         interm_arch_flags);
             }
 
             MappingCursor cursor;
             ret = x86_mmu_add_mapping<typename PageTable::LowerTable>(
-                aspace, get_next_table_from_entry(*e), mmu_flags, *new_cursor, &cursor);
+                aspace, pending, get_next_table_from_entry(*e), mmu_flags, *new_cursor, &cursor);
             *new_cursor = cursor;
             DEBUG_ASSERT(new_cursor->size <= start_cursor.size);
             if (ret != NO_ERROR) {
@@ -902,7 +995,8 @@ err:
         // new_cursor->size should be how much is left to be mapped still
         cursor.size -= new_cursor->size;
         if (cursor.size > 0) {
-            x86_mmu_remove_mapping<typename PageTable::TopTable>(aspace, table, cursor, &result);
+            x86_mmu_remove_mapping<typename PageTable::TopTable>(aspace, pending, table, cursor,
+                                                                 &result);
             DEBUG_ASSERT(result.size == 0);
         }
     }
@@ -911,7 +1005,8 @@ err:
 
 // Base case of x86_mmu_add_mapping for smallest page size
 template <typename PageTable>
-static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                       pt_entry_t* table, uint mmu_flags,
                                        const MappingCursor& start_cursor,
                                        MappingCursor* new_cursor) {
     static_assert(PageTable::level == PT_L, "x86_mmu_remove_mapping_l0 used with wrong level");
@@ -928,8 +1023,8 @@ static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
             return ERR_ALREADY_EXISTS;
         }
 
-        update_entry<PageTable>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr,
-                                arch_flags);
+        update_entry<PageTable>(aspace, pending, new_cursor->vaddr, table + index,
+                                new_cursor->paddr, arch_flags);
 
         new_cursor->paddr += PAGE_SIZE;
         new_cursor->vaddr += PAGE_SIZE;
@@ -941,20 +1036,22 @@ static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
 }
 
 template <>
-status_t x86_mmu_add_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
+status_t x86_mmu_add_mapping<PageTable<PT_L>>(arch_aspace_t* aspace,
+                                              PendingTlbInvalidation* pending, pt_entry_t* table,
                                               uint mmu_flags, const MappingCursor& start_cursor,
                                               MappingCursor* new_cursor) {
-    return x86_mmu_add_mapping_l0<PageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
+    return x86_mmu_add_mapping_l0<PageTable<PT_L>>(aspace, pending, table, mmu_flags, start_cursor,
                                                    new_cursor);
 }
 
 template <>
-status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
-                                                      uint mmu_flags,
+status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace,
+                                                      PendingTlbInvalidation* pending,
+                                                      pt_entry_t* table, uint mmu_flags,
                                                       const MappingCursor& start_cursor,
                                                       MappingCursor* new_cursor) {
-    return x86_mmu_add_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                           new_cursor);
+    return x86_mmu_add_mapping_l0<ExtendedPageTable<PT_L>>(aspace, pending, table, mmu_flags,
+                                                           start_cursor, new_cursor);
 }
 
 /**
@@ -970,7 +1067,8 @@ status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_
  * completed.  Must be non-null.
  */
 template <typename PageTable>
-static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                       pt_entry_t* table, uint mmu_flags,
                                        const MappingCursor& start_cursor,
                                        MappingCursor* new_cursor) {
     DEBUG_ASSERT(table);
@@ -1006,8 +1104,8 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             // If the request covers the entire large page, just change the
             // permissions
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                update_entry<PageTable>(aspace, new_cursor->vaddr, e, PageTable::paddr_from_pte(*e),
-                                        arch_flags | X86_MMU_PG_PS);
+                update_entry<PageTable>(aspace, pending, new_cursor->vaddr, e,
+                                        PageTable::paddr_from_pte(*e), arch_flags | X86_MMU_PG_PS);
 
                 new_cursor->vaddr += ps;
                 new_cursor->size -= ps;
@@ -1016,7 +1114,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            ret = x86_mmu_split<PageTable>(aspace, page_vaddr, e);
+            ret = x86_mmu_split<PageTable>(aspace, pending, page_vaddr, e);
             if (ret != NO_ERROR) {
                 // If we failed to split the table, just unmap it.  Subsequent
                 // page faults will bring it back in.
@@ -1025,7 +1123,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
                 cursor.size = ps;
 
                 MappingCursor tmp_cursor;
-                x86_mmu_remove_mapping<PageTable>(aspace, table, cursor, &tmp_cursor);
+                x86_mmu_remove_mapping<PageTable>(aspace, pending, table, cursor, &tmp_cursor);
 
                 const size_t size = (new_cursor->size > ps) ? ps : new_cursor->size;
                 new_cursor->vaddr += size;
@@ -1035,8 +1133,9 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
 
         MappingCursor cursor;
         pt_entry_t* next_table = get_next_table_from_entry(*e);
-        ret = x86_mmu_update_mapping<typename PageTable::LowerTable>(aspace, next_table, mmu_flags,
-                                                                     *new_cursor, &cursor);
+        ret = x86_mmu_update_mapping<typename PageTable::LowerTable>(aspace, pending, next_table,
+                                                                     mmu_flags, *new_cursor,
+                                                                     &cursor);
         *new_cursor = cursor;
         if (ret != NO_ERROR) {
             // Currently this can't happen
@@ -1055,7 +1154,8 @@ err:
 
 // Base case of x86_update_mapping for smallest page size
 template <typename PageTable>
-static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                          pt_entry_t* table, uint mmu_flags,
                                           const MappingCursor& start_cursor,
                                           MappingCursor* new_cursor) {
     static_assert(PageTable::level == PT_L, "x86_mmu_update_mapping_l0 used with wrong level");
@@ -1071,8 +1171,8 @@ static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, pt_entry_t* tab
         pt_entry_t* e = table + index;
         // Skip unmapped pages (we may encounter these due to demand paging)
         if (IS_PAGE_PRESENT(*e)) {
-            update_entry<PageTable>(aspace, new_cursor->vaddr, e, PageTable::paddr_from_pte(*e),
-                                    arch_flags);
+            update_entry<PageTable>(aspace, pending, new_cursor->vaddr, e,
+                                    PageTable::paddr_from_pte(*e), arch_flags);
         }
 
         new_cursor->vaddr += PAGE_SIZE;
@@ -1083,19 +1183,21 @@ static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, pt_entry_t* tab
 }
 
 template <>
-status_t x86_mmu_update_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
+status_t x86_mmu_update_mapping<PageTable<PT_L>>(arch_aspace_t* aspace,
+                                                 PendingTlbInvalidation* pending, pt_entry_t* table,
                                                  uint mmu_flags, const MappingCursor& start_cursor,
                                                  MappingCursor* new_cursor) {
-    return x86_mmu_update_mapping_l0<PageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                      new_cursor);
+    return x86_mmu_update_mapping_l0<PageTable<PT_L>>(aspace, pending, table, mmu_flags,
+                                                      start_cursor, new_cursor);
 }
 
 template <>
-status_t x86_mmu_update_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
-                                                         uint mmu_flags,
+status_t x86_mmu_update_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace,
+                                                         PendingTlbInvalidation* pending,
+                                                         pt_entry_t* table, uint mmu_flags,
                                                          const MappingCursor& start_cursor,
                                                          MappingCursor* new_cursor) {
-    return x86_mmu_update_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, mmu_flags,
+    return x86_mmu_update_mapping_l0<ExtendedPageTable<PT_L>>(aspace, pending, table, mmu_flags,
                                                               start_cursor, new_cursor);
 }
 
@@ -1120,8 +1222,11 @@ static status_t mmu_unmap(arch_aspace_t* aspace, vaddr_t vaddr, const size_t cou
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
 
+    PendingTlbInvalidation pending;
     MappingCursor result;
-    x86_mmu_remove_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, aspace->pt_virt, start, &result);
+    x86_mmu_remove_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, &pending, aspace->pt_virt, start,
+                                                        &result);
+    x86_tlb_invalidate(aspace, &pending);
     DEBUG_ASSERT(result.size == 0);
 
     if (unmapped)
@@ -1166,9 +1271,11 @@ static status_t mmu_map(arch_aspace_t* aspace, vaddr_t vaddr, paddr_t paddr, con
     MappingCursor start = {
         .paddr = paddr, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
+    PendingTlbInvalidation pending;
     MappingCursor result;
-    status_t status = x86_mmu_add_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, aspace->pt_virt,
-                                                                       mmu_flags, start, &result);
+    status_t status = x86_mmu_add_mapping<PageTable<MAX_PAGING_LEVEL>>(
+        aspace, &pending, aspace->pt_virt, mmu_flags, start, &result);
+    x86_tlb_invalidate(aspace, &pending);
     if (status != NO_ERROR) {
         dprintf(SPEW, "Add mapping failed with err=%d\n", status);
         return status;
@@ -1214,9 +1321,11 @@ static status_t mmu_protect(arch_aspace_t* aspace, vaddr_t vaddr, size_t count,
     MappingCursor start = {
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
+    PendingTlbInvalidation pending;
     MappingCursor result;
     status_t status = x86_mmu_update_mapping<PageTable<MAX_PAGING_LEVEL>>(
-        aspace, aspace->pt_virt, mmu_flags, start, &result);
+        aspace, &pending, aspace->pt_virt, mmu_flags, start, &result);
+    x86_tlb_invalidate(aspace, &pending);
     if (status != NO_ERROR) {
         return status;
     }
@@ -1239,7 +1348,9 @@ void x86_mmu_early_init() {
     x86_mmu_percpu_init();
 
     /* unmap the lower identity mapping */
-    unmap_entry<PageTable<PML4_L>>(nullptr, 0, &pml4[0]);
+    PendingTlbInvalidation tlb;
+    unmap_entry<PageTable<PML4_L>>(nullptr, &tlb, 0, &pml4[0]);
+    x86_tlb_invalidate(nullptr, &tlb);
 
     /* get the address width from the CPU */
     uint8_t vaddr_width = x86_linear_address_width();
@@ -19,27 +19,66 @@ __BEGIN_CDECLS;
 
 #define MUTEX_MAGIC (0x6D757478)  // 'mutx'
 
+/* spin while the holder is running on another cpu before blocking */
+#define MUTEX_FLAG_ADAPTIVE (0x1)
+
+/* contention statistics shared by a group of mutexes, reported by the
+ * mutexstats console command. protected by the thread lock. */
+typedef struct mutex_class {
+    const char *name;
+    struct list_node node;
+
+    uint64_t acquires;
+    uint64_t contended;     /* found held on entry */
+    uint64_t spin_acquires; /* acquired by spinning without blocking */
+    uint64_t blocks;        /* had to block, spinning or not */
+    uint64_t spin_cycles;
+} mutex_class_t;
+
+#define MUTEX_CLASS_INITIAL_VALUE(c, _name) \
+{ \
+    .name = _name, \
+    .node = LIST_INITIAL_CLEARED_VALUE, \
+    .acquires = 0, \
+    .contended = 0, \
+    .spin_acquires = 0, \
+    .blocks = 0, \
+    .spin_cycles = 0, \
+}
+
 typedef struct TA_CAP("mutex") mutex {
     uint32_t magic;
+    uint32_t flags;
     thread_t *holder;
+    int holder_cpu; /* cpu the holder acquired it on, -1 when free */
     int count;
     wait_queue_t wait;
+    mutex_class_t *lock_class;
 } mutex_t;
 
-#define MUTEX_INITIAL_VALUE(m) \
+#define MUTEX_INITIAL_VALUE_ETC(m, _flags, _class) \
 { \
     .magic = MUTEX_MAGIC, \
+    .flags = (_flags), \
     .holder = NULL, \
+    .holder_cpu = -1, \
     .count = 0, \
     .wait = WAIT_QUEUE_INITIAL_VALUE((m).wait), \
+    .lock_class = (_class), \
 }
 
+#define MUTEX_INITIAL_VALUE(m) MUTEX_INITIAL_VALUE_ETC(m, 0, NULL)
+
 /* Rules for Mutexes:
  * - Mutexes are only safe to use from thread context.
  * - Mutexes are non-recursive.
+ * - An adaptive mutex spins for a while when its holder is running on another
+ *   cpu, which is cheaper than blocking if it is only ever held briefly.
+ * - A mutex with a class accumulates its acquire/spin/block counts there.
 */
 
 void mutex_init(mutex_t *);
+void mutex_init_etc(mutex_t *, uint32_t flags, mutex_class_t *lock_class);
 void mutex_destroy(mutex_t *);
 void mutex_acquire(mutex_t *m) TA_ACQ(m);
 void mutex_release(mutex_t *m) TA_REL(m);
@@ -48,6 +87,9 @@ void mutex_release(mutex_t *m) TA_REL(m);
 void mutex_acquire_internal(mutex_t *m) TA_ACQ(m);
 void mutex_release_internal(mutex_t *m, bool reschedule) TA_REL(m);
 
+/* print the statistics of every mutex class that has been used */
+void dump_mutex_stats(void);
+
 /* does the current thread hold the mutex? */
 static bool is_mutex_held(const mutex_t *m)
 {
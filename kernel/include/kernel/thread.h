@@ -78,6 +78,7 @@ typedef struct thread {
     enum thread_state state;
     lk_time_t last_started_running;
     lk_time_t remaining_time_slice;
+    lk_time_t timer_slack; /* how late sleep and wait deadlines may fire, to share interrupts */
     unsigned int flags;
     unsigned int signals;
 #if WITH_SMP
@@ -152,6 +153,9 @@ typedef struct thread {
 #define thread_set_pinned_cpu(t, c) do {} while(0)
 #endif
 
+/* timer slack given to the sleep and wait deadlines of user threads */
+#define THREAD_USER_TIMER_SLACK LK_USEC(50)
+
 /* thread priority */
 #define NUM_PRIORITIES 32
 #define LOWEST_PRIORITY 0
@@ -275,6 +279,17 @@ extern thread_t idle_threads[SMP_MAX_CPUS];
 /* scheduler lock */
 extern spin_lock_t thread_lock;
 
+/* the thread currently running on each cpu, written under the thread lock at
+ * every context switch. Only for comparing against a thread pointer obtained
+ * elsewhere; the thread it names may exit at any time, so never dereference it
+ * without holding the thread lock. */
+extern thread_t *running_threads[SMP_MAX_CPUS];
+
+static inline bool thread_is_running_on(const thread_t *t, uint cpu)
+{
+    return __atomic_load_n(&running_threads[cpu], __ATOMIC_RELAXED) == t;
+}
+
 #define THREAD_LOCK(state) spin_lock_saved_state_t state; spin_lock_irqsave(&thread_lock, state)
 #define THREAD_UNLOCK(state) spin_unlock_irqrestore(&thread_lock, state)
 
@@ -297,6 +312,7 @@ struct thread_stats {
     ulong interrupts; /* hardware interrupts, minus timer interrupts or inter-processor interrupts */
     ulong timer_ints; /* timer interrupts */
     ulong timers; /* timer callbacks */
+    ulong timers_coalesced; /* timers folded onto an already queued deadline */
     ulong exceptions; /* exceptions such as page fault or undefined opcode */
     ulong syscalls;
 
@@ -304,6 +320,9 @@ struct thread_stats {
     /* inter-processor interrupts */
     ulong reschedule_ipis;
     ulong generic_ipis;
+
+    /* threads pulled from another cpu's run queue */
+    ulong steals;
 #endif
 };
 
@@ -22,11 +22,21 @@ typedef enum handler_return (*timer_callback)(struct timer *, lk_time_t now, voi
 
 #define TIMER_MAGIC (0x74696D72)  //'timr'
 
+/* links in a per cpu timer queue, a treap keyed on scheduled_time */
+struct timer_node {
+    struct timer *parent;
+    struct timer *left;
+    struct timer *right;
+    uint32_t priority;
+    int cpu; // <0 if not queued
+};
+
 typedef struct timer {
     int magic;
-    struct list_node node;
+    struct timer_node node;
 
     lk_time_t scheduled_time;
+    lk_time_t slack; // how much later than scheduled_time it may still fire
     lk_time_t period;
 
     timer_callback callback;
@@ -39,8 +49,15 @@ typedef struct timer {
 #define TIMER_INITIAL_VALUE(t) \
 { \
     .magic = TIMER_MAGIC, \
-    .node = LIST_INITIAL_CLEARED_VALUE, \
+    .node = { \
+        .parent = NULL, \
+        .left = NULL, \
+        .right = NULL, \
+        .priority = 0, \
+        .cpu = -1, \
+    }, \
     .scheduled_time = 0, \
+    .slack = 0, \
     .period = 0, \
     .callback = NULL, \
     .arg = NULL, \
@@ -54,9 +71,13 @@ typedef struct timer {
  * - Timers may be canceled or reprogrammed from within their callback
  * - Setting and canceling timers is not thread safe and cannot be done concurrently
  * - timer_cancel() may spin waiting for a pending timer to complete on another cpu
+ * - A oneshot timer fires no earlier than its deadline and, given slack, no later
+ *   than deadline + slack. Slack lets it share an interrupt with a timer already
+ *   queued in that window, or with one set later that is due in it.
 */
 void timer_initialize(timer_t *);
-void timer_set_oneshot(timer_t *, lk_time_t deadline, timer_callback, void *arg);
+void timer_set_oneshot(timer_t *, lk_time_t deadline, lk_time_t slack,
+                       timer_callback, void *arg);
 void timer_set_periodic(timer_t *, lk_time_t period, timer_callback, void *arg);
 void timer_cancel(timer_t *);
 
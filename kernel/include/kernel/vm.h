@@ -38,6 +38,17 @@ __BEGIN_CDECLS
 #define ROUNDUP_PAGE_SIZE(x) ROUNDUP((x), PAGE_SIZE)
 #define IS_PAGE_ALIGNED(x) IS_ALIGNED((x), PAGE_SIZE)
 
+/* Large pages that write faults on anonymous memory are opportunistically
+ * backed with, when arch_mmu_map() builds them from aligned contiguous runs.
+ * VM_LARGE_PAGE_SIZE is 0 where that is not supported.
+ */
+#if ARCH_X86_64
+#define VM_LARGE_PAGE_SHIFT 21
+#else
+#define VM_LARGE_PAGE_SHIFT 0
+#endif
+#define VM_LARGE_PAGE_SIZE (VM_LARGE_PAGE_SHIFT ? (1UL << VM_LARGE_PAGE_SHIFT) : 0UL)
+
 struct mmu_initial_mapping {
     paddr_t phys;
     vaddr_t virt;
@@ -57,6 +57,9 @@ enum vm_page_state {
     _VM_PAGE_STATE_COUNT
 };
 
+// page flags, set once when the owning arena is initialized
+#define VM_PAGE_FLAG_PMM_CACHEABLE (1u << 0) // may be held in a pmm per cpu page cache
+
 // helpers
 static inline bool page_is_free(const vm_page_t* page) {
     return page->state == VM_PAGE_STATE_FREE;
@@ -0,0 +1,88 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <assert.h>
+#include <kernel/event.h>
+#include <kernel/mutex.h>
+#include <magenta/thread_annotations.h>
+#include <mxtl/intrusive_double_list.h>
+#include <mxtl/macros.h>
+#include <mxtl/ref_counted.h>
+#include <mxtl/ref_ptr.h>
+#include <stdint.h>
+
+// A PageSource provides the contents of a VmObjectPaged's pages on demand.
+//
+// When a pager-backed vmo is asked for a page it does not have, it queues a
+// Request with its source while still holding the vmo lock and hands the
+// Request back to the caller, who unwinds, drops every lock it holds and then
+// calls Request::Wait(). The source forwards the request to whoever is providing
+// pages (see SendRequest()), who eventually supplies the page to the vmo or
+// fails the range, at which point the vmo calls CompleteRange() to release
+// the waiters and they retry the lookup.
+class PageSource : public mxtl::RefCounted<PageSource> {
+public:
+    class Request : public mxtl::DoublyLinkedListable<Request*> {
+    public:
+        Request() { event_init(&event_, false, 0); }
+        ~Request() {
+            DEBUG_ASSERT(!InContainer());
+            event_destroy(&event_);
+        }
+
+        // Waits for a request that was queued and handed back by
+        // VmObject::GetPageLocked(). Must be called with no vm locks held.
+        status_t Wait();
+
+    private:
+        friend class PageSource;
+
+        mxtl::RefPtr<PageSource> source_;
+        uint64_t offset_ = 0;
+        bool send_ = false;
+        event_t event_;
+
+        DISALLOW_COPY_ASSIGN_AND_MOVE(Request);
+    };
+
+    // Registers |request| for the page at |offset|. Must be called with the
+    // lock of the owning vmo held, after it has found the page missing, so that
+    // a concurrent supply cannot slip in between the lookup and the request.
+    void QueueRequest(Request* request, uint64_t offset);
+
+    // Forwards |request| to the pager if nobody else is already waiting for
+    // the same page and blocks until the page has been supplied or failed.
+    // Must be called without the vmo lock held.
+    status_t WaitForRequest(Request* request);
+
+    // Releases every request for a page in [offset, offset + len) with
+    // |status|. Called by the vmo once the range has been supplied.
+    void CompleteRange(uint64_t offset, uint64_t len, status_t status);
+
+protected:
+    PageSource() = default;
+    virtual ~PageSource();
+    friend class mxtl::RefPtr<PageSource>;
+    friend class VmObjectPaged;
+
+    // Asks the pager for the page at |offset|. Called at most once for each
+    // page while there are outstanding requests for it, with no locks held.
+    virtual status_t SendRequest(uint64_t offset, uint64_t len) = 0;
+
+    // Tells the pager that the last clone of the vmo has gone away, after
+    // |clone_count| clones in total. A pager which hands out only clones can
+    // use the count to tell whether it has made a new one since, and if not,
+    // drop the vmo. Called with the vmo lock held.
+    virtual void OnZeroChildren(uint64_t clone_count) {}
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(PageSource);
+
+    Mutex lock_;
+    mxtl::DoublyLinkedList<Request*> requests_ TA_GUARDED(lock_);
+};
@@ -42,6 +42,11 @@
 // mapping can gain this permission.
 #define VMAR_FLAG_CAN_MAP_EXECUTE (1 << 6)
 
+// When a write fault is taken in a VmMapping, also commit and map the missing
+// pages in the surrounding fault-around window.  Set on a VmAddressRegion, it
+// is inherited by everything created inside the region.
+#define VMAR_FLAG_COMMIT_AROUND (1 << 7)
+
 #define VMAR_CAN_RWX_FLAGS (VMAR_FLAG_CAN_MAP_READ |  \
                             VMAR_FLAG_CAN_MAP_WRITE | \
                             VMAR_FLAG_CAN_MAP_EXECUTE)
@@ -113,10 +118,6 @@ public:
     mxtl::RefPtr<VmAddressRegion> as_vm_address_region();
     mxtl::RefPtr<VmMapping> as_vm_mapping();
 
-    // Page fault in an address within the region.  Recursively traverses
-    // the regions to find the target mapping, if it exists.
-    virtual status_t PageFault(vaddr_t va, uint pf_flags) = 0;
-
     // WAVL tree key function
     vaddr_t GetKey() const { return base(); }
 
@@ -236,7 +237,6 @@ public:
     bool is_mapping() const override { return false; }
 
     void Dump(uint depth, bool verbose) const override;
-    status_t PageFault(vaddr_t va, uint pf_flags) override;
 
 protected:
     // constructor for use in creating a VmAddressRegionDummy
@@ -273,6 +273,10 @@ private:
     // Version of FindRegion() that does not acquire the aspace lock
     mxtl::RefPtr<VmAddressRegionOrMapping> FindRegionLocked(vaddr_t addr);
 
+    // Recursively traverses the regions to find the mapping that covers
+    // |va|, if it exists.  Used by VmAspace::PageFault().
+    mxtl::RefPtr<VmMapping> FindMappingLocked(vaddr_t va);
+
     // Version of Destroy() that does not acquire the aspace lock
     status_t DestroyLocked() override;
 
@@ -367,12 +371,6 @@ public:
         return;
     }
 
-    status_t PageFault(vaddr_t va, uint pf_flags) override {
-        // We should never be trying to page fault on this...
-        ASSERT(false);
-        return ERR_BAD_STATE;
-    }
-
     size_t AllocatedPages() const override {
         return 0;
     }
@@ -413,6 +411,15 @@ public:
     // offset modification and locking.
     status_t DecommitRange(size_t offset, size_t len, size_t* decommitted);
 
+    // Moves the pages backing the writable range [va, va + len) out of vmo()
+    // and into |pages|, with the necessary offset modification and locking.
+    // See VmObject::TakePages().
+    status_t TakePages(vaddr_t va, size_t len, VmPageList* pages);
+
+    // Undoes TakePages() for the same range. If the mapping has gone away in
+    // the meantime, the pages stay in |pages|.
+    void ReturnPages(vaddr_t va, size_t len, VmPageList* pages);
+
     // Map in pages from the underlying vm object, optionally committing pages as it goes
     status_t MapRange(size_t offset, size_t len, bool commit);
 
@@ -431,7 +438,6 @@ public:
     bool is_mapping() const override { return true; }
 
     void Dump(uint depth, bool verbose) const override;
-    status_t PageFault(vaddr_t va, uint pf_flags) override;
 
 protected:
     ~VmMapping() override;
@@ -467,6 +473,43 @@ private:
     // Implementation for Protect().  This does not acquire the aspace lock.
     status_t ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags);
 
+    // Page faults are handled by VmAspace::PageFault(), which looks the
+    // mapping up under the aspace lock but only holds |vmo|'s lock while
+    // resolving the fault.
+    friend class VmAspace;
+
+    // Returns true if this mapping still maps |vmo| at |va|.  Anything that
+    // moves, shrinks or destroys a mapping holds the object lock as well as
+    // the aspace lock, so the answer is stable for as long as the object
+    // lock is held.
+    // Should be annotated TA_REQ(vmo->lock()), but see ActivateLocked().
+    bool IsFaultTargetLocked(const VmObject* vmo, vaddr_t va) const;
+
+    // Map what it can of [*offset, end) for MapRange(), advancing *offset past
+    // each page it handles.  Returns ERR_SHOULD_WAIT, with every lock dropped
+    // and *offset at the page in question, if that page has to come from a pager.
+    status_t TryMapRange(size_t* offset, size_t end, uint pf_flags, bool commit,
+                         PageSource::Request* page_request);
+
+    // Page fault in |va|, which must be covered by this mapping.  If the page
+    // has to come from a pager, |page_request| is queued and ERR_SHOULD_WAIT
+    // returned without dropping the object lock; the caller waits on it with
+    // every lock dropped and then redoes the whole fault.
+    // Should be annotated TA_REQ(object_->lock()), but see ActivateLocked().
+    status_t PageFaultLocked(vaddr_t va, uint pf_flags, PageSource::Request* page_request);
+
+    // Try to resolve a write fault at |va| by committing and mapping the whole
+    // large page around it.  Returns false if the mapping or vmo don't allow it,
+    // in which case the caller should fault in a single page as usual.
+    // Should be annotated TA_REQ(object_->lock()), but see ActivateLocked().
+    bool FaultLargePageLocked(vaddr_t va, uint mmu_flags);
+
+    // Map the pages around a just-faulted |va| that are already resident (or,
+    // with VMAR_FLAG_COMMIT_AROUND, can be committed) so that touching them
+    // does not fault.  Called from PageFaultLocked().
+    // Should be annotated TA_REQ(object_->lock()), but see ActivateLocked().
+    void FaultAroundLocked(vaddr_t va, uint pf_flags, uint mmu_flags);
+
     // Version of AllocatedPages() that does not acquire the aspace lock
     size_t AllocatedPagesLocked() const override;
 
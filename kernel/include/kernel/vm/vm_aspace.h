@@ -119,6 +119,12 @@ protected:
     friend class VmMapping;
     mutex_t* lock() { return &lock_; }
 
+    // Serializes changes to the arch page tables.  Page faults run with only
+    // the lock of the vmo they fault on, so this has to be held around every
+    // arch_mmu_*() call on this aspace from the VM layer.  It is never held
+    // across anything that can take another VM lock.
+    mutex_t* mmu_lock() { return &mmu_lock_; }
+
     // Expose the PRNG for ASLR to VmAddressRegion
     crypto::PRNG& AslrPrng() {
         DEBUG_ASSERT(aslr_enabled_);
@@ -154,6 +160,9 @@ private:
 
     mutable mutex_t lock_ = MUTEX_INITIAL_VALUE(lock_);
 
+    // see mmu_lock()
+    mutable mutex_t mmu_lock_;
+
     // root of virtual address space
     // Access to this reference is guarded by lock_.
     mxtl::RefPtr<VmAddressRegion> root_vmar_;
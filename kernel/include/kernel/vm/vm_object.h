@@ -9,6 +9,7 @@
 #include <assert.h>
 #include <kernel/mutex.h>
 #include <kernel/vm.h>
+#include <kernel/vm/page_source.h>
 #include <kernel/vm/vm_page_list.h>
 #include <lib/user_copy/user_ptr.h>
 #include <list.h>
@@ -65,6 +66,20 @@ public:
         return ERR_NOT_SUPPORTED;
     }
 
+    // remove the committed pages backing a page aligned range and move them into
+    // |pages|, at offsets relative to |offset|. the range reads back as decommitted
+    // afterwards. fails without side effects unless every page is committed locally.
+    virtual status_t TakePages(uint64_t offset, uint64_t len, VmPageList* pages) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // undo TakePages(): move the pages in |pages| back to the offsets they were
+    // taken from. pages whose slot has been filled again in the meantime, or
+    // which can't be put back, are freed. |pages| is left empty.
+    virtual void ReturnPages(uint64_t offset, uint64_t len, VmPageList* pages) {
+        pages->FreeAllPages();
+    }
+
     // read/write operators against kernel pointers only
     virtual status_t Read(void* ptr, uint64_t offset, size_t len, size_t* bytes_read) {
         return ERR_NOT_SUPPORTED;
@@ -116,13 +131,47 @@ public:
         return ERR_NOT_SUPPORTED;
     }
 
+    // provide the contents of a page aligned range of a pager-backed vmo from a user buffer.
+    // pages that are already present are left untouched.
+    virtual status_t SupplyPagesUser(uint64_t offset, uint64_t len, user_ptr<const void> data) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // fail any outstanding requests for pages in a range of a pager-backed vmo with |error|
+    virtual status_t FailPageRequests(uint64_t offset, uint64_t len, status_t error) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // true if missing pages in this vmo, or in the parent it was cloned from, are provided
+    // by a PageSource rather than zero filled
+    virtual bool IsPagerBacked() const { return false; }
+
     // get a pointer to the page structure and/or physical address at the specified offset.
     // valid flags are VMM_PF_FLAG_*
-    virtual status_t GetPageLocked(uint64_t offset, uint pf_flags,
-                                   vm_page_t** page, paddr_t* pa) TA_REQ(lock_) {
+    //
+    // if the page has to be fetched from a page source, |page_request| is queued and
+    // ERR_SHOULD_WAIT returned with the lock still held; the caller must drop all of
+    // its locks, call page_request->Wait() and start its lookup over. the lock is never
+    // dropped in here, so a caller that may fault pages of a pager-backed vmo in has
+    // to pass a request.
+    virtual status_t GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t** page, paddr_t* pa,
+                                   PageSource::Request* page_request) TA_REQ(lock_) {
         return ERR_NOT_SUPPORTED;
     }
 
+    // back the VM_LARGE_PAGE_SIZE aligned range at |offset| with one physically contiguous,
+    // aligned run of zeroed pages, returning its base address.  fails if any page in the
+    // range is already committed, or if the vmo can't be backed this way at all.
+    virtual status_t CommitLargePageLocked(uint64_t offset, paddr_t* pa) TA_REQ(lock_) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // how many pages, a power of two, to map around a page fault on a mapping of
+    // this vmo in place of the vm.fault_around default. 0 goes back to the default.
+    void SetFaultAroundPages(uint32_t pages);
+    uint32_t GetFaultAroundPages();
+    uint32_t FaultAroundPagesLocked() const TA_REQ(lock_) { return fault_around_pages_; }
+
     Mutex* lock() TA_RET_CAP(lock_) { return &lock_; }
     Mutex& lock_ref() TA_RET_CAP(lock_) { return lock_; }
 
@@ -152,6 +201,9 @@ protected:
         // Called under the parent's lock, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS { RangeChangeUpdateLocked(offset, len); }
 
+    // called once the last child has been removed
+    virtual void OnZeroChildrenLocked() TA_REQ(lock_) {}
+
     // magic value
     mxtl::Canary<mxtl::magic("VMO_")> canary_;
 
@@ -173,4 +225,7 @@ protected:
 
     // parent pointer (may be null)
     mxtl::RefPtr<VmObject> parent_ TA_GUARDED(lock_);
+
+    // fault-around window in pages, 0 to use vm_fault_around_pages
+    uint32_t fault_around_pages_ TA_GUARDED(lock_) = 0;
 };
@@ -9,6 +9,7 @@
 #include <assert.h>
 #include <kernel/mutex.h>
 #include <kernel/vm.h>
+#include <kernel/vm/page_source.h>
 #include <kernel/vm/vm_object.h>
 #include <kernel/vm/vm_page_list.h>
 #include <lib/user_copy/user_ptr.h>
@@ -29,6 +30,10 @@ public:
 
     static mxtl::RefPtr<VmObject> CreateFromROData(const void* data, size_t size);
 
+    // create a vmo whose pages are provided on demand by |source|
+    static mxtl::RefPtr<VmObject> CreatePagerBacked(uint32_t pmm_alloc_flags, uint64_t size,
+                                                    mxtl::RefPtr<PageSource> source);
+
     status_t Resize(uint64_t size) override;
     status_t ResizeLocked(uint64_t size) override TA_REQ(lock_);
     uint64_t size() const override
@@ -42,6 +47,8 @@ public:
     status_t CommitRangeContiguous(uint64_t offset, uint64_t len, uint64_t* committed,
                                    uint8_t alignment_log2) override;
     status_t DecommitRange(uint64_t offset, uint64_t len, uint64_t* decommitted) override;
+    status_t TakePages(uint64_t offset, uint64_t len, VmPageList* pages) override;
+    void ReturnPages(uint64_t offset, uint64_t len, VmPageList* pages) override;
 
     status_t Read(void* ptr, uint64_t offset, size_t len, size_t* bytes_read) override;
     status_t Write(const void* ptr, uint64_t offset, size_t len, size_t* bytes_written) override;
@@ -63,10 +70,19 @@ public:
     status_t CleanInvalidateCache(const uint64_t offset, const uint64_t len) override;
     status_t SyncCache(const uint64_t offset, const uint64_t len) override;
 
-    status_t GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t**, paddr_t*) override
+    status_t SupplyPagesUser(uint64_t offset, uint64_t len, user_ptr<const void> data) override;
+    status_t FailPageRequests(uint64_t offset, uint64_t len, status_t error) override;
+    bool IsPagerBacked() const override
+        // Walks up the parent chain, which shares our lock.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
+    status_t GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t**, paddr_t*,
+                           PageSource::Request* page_request) override
         // Calls a Locked method of the parent, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    status_t CommitLargePageLocked(uint64_t offset, paddr_t* pa) override TA_REQ(lock_);
+
     status_t CloneCOW(uint64_t offset, uint64_t size,
                       mxtl::RefPtr<VmObject>* clone_vmo) override
         // Calls a Locked method of the child, which confuses analysis.
@@ -76,9 +92,12 @@ public:
         // Called under the parent's lock, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    void OnZeroChildrenLocked() override TA_REQ(lock_);
+
 private:
     // private constructor (use Create())
-    explicit VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObject> parent);
+    VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObject> parent,
+                  mxtl::RefPtr<PageSource> page_source);
 
     // private destructor, only called from refptr
     ~VmObjectPaged() override;
@@ -118,4 +137,10 @@ private:
 
     // a tree of pages
     VmPageList page_list_ TA_GUARDED(lock_);
+
+    // if set, missing pages are requested from here instead of being zero filled
+    const mxtl::RefPtr<PageSource> page_source_;
+
+    // number of clones ever made of this vmo, reported to the page source
+    uint64_t clone_count_ TA_GUARDED(lock_) = 0;
 };
@@ -31,8 +31,8 @@ public:
 
     void Dump(uint depth, bool verbose) override;
 
-    status_t GetPageLocked(uint64_t offset, uint pf_flags,
-                           vm_page_t**, paddr_t* pa) override TA_REQ(lock_);
+    status_t GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t**, paddr_t* pa,
+                           PageSource::Request* page_request) override TA_REQ(lock_);
 
 private:
     // private constructor (use Create())
@@ -6,6 +6,9 @@
 
 #pragma once
 
+#include <err.h>
+#include <kernel/vm.h>
+#include <list.h>
 #include <mxtl/canary.h>
 #include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/macros.h>
@@ -13,6 +16,11 @@
 
 struct vm_page;
 
+// The page list is a two level radix layout: a tree keyed by offset whose
+// nodes are leaves holding a run of kPageFanOut page slots, plus a bitmap of
+// which slots are in use.  Walking a range touches each leaf once and reads
+// its slots sequentially, skipping empty slots (and empty leaves, which are
+// never kept) without looking at them.
 class VmPageListNode final : public mxtl::WAVLTreeContainable<mxtl::unique_ptr<VmPageListNode>> {
 public:
     explicit VmPageListNode(uint64_t offset);
@@ -20,29 +28,78 @@ public:
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmPageListNode);
 
-    static const size_t kPageFanOut = 16;
+    // one bit per slot in present_
+    static const size_t kPageFanOut = 64;
 
     // accessors
     uint64_t offset() const { return obj_offset_; }
     uint64_t GetKey() const { return obj_offset_; }
 
-    // for every valid page in the node call the passed in function
+    // for every valid page in the node call the passed in function. the
+    // function may take the page by reference and clear it to drop it from
+    // the node.
     template <typename T>
     void ForEveryPage(T func) {
-        for (size_t i = 0; i < kPageFanOut; i++) {
-            if (pages_[i]) {
-                func(pages_[i], obj_offset_ + i * PAGE_SIZE);
-            }
+        for (uint64_t bits = present_; bits != 0; bits &= bits - 1) {
+            size_t i = __builtin_ctzll(bits);
+            func(pages_[i], obj_offset_ + i * PAGE_SIZE);
+            if (!pages_[i])
+                present_ &= ~(1ull << i);
         }
     }
 
     // for every valid page in the node call the passed in function
     template <typename T>
     void ForEveryPage(T func) const {
-        for (size_t i = 0; i < kPageFanOut; i++) {
-            if (pages_[i]) {
-                func(pages_[i], obj_offset_ + i * PAGE_SIZE);
-            }
+        for (uint64_t bits = present_; bits != 0; bits &= bits - 1) {
+            size_t i = __builtin_ctzll(bits);
+            func(pages_[i], obj_offset_ + i * PAGE_SIZE);
+        }
+    }
+
+    // call |func(page, offset)| on the pages in slots [start_index, end_index)
+    // until it returns something other than NO_ERROR
+    template <typename T>
+    status_t ForEveryPageInRange(T func, size_t start_index, size_t end_index) const {
+        for (uint64_t bits = present_ & RangeMask(start_index, end_index); bits != 0;
+             bits &= bits - 1) {
+            size_t i = __builtin_ctzll(bits);
+            status_t status = func(pages_[i], obj_offset_ + i * PAGE_SIZE);
+            if (status != NO_ERROR)
+                return status;
+        }
+        return NO_ERROR;
+    }
+
+    // take the pages out of slots [start_index, end_index), handing each to
+    // |func(page, offset)|. returns the number of pages removed.
+    template <typename T>
+    size_t RemovePagesInRange(T func, size_t start_index, size_t end_index) {
+        uint64_t bits = present_ & RangeMask(start_index, end_index);
+        present_ &= ~bits;
+        size_t count = 0;
+        for (; bits != 0; bits &= bits - 1) {
+            size_t i = __builtin_ctzll(bits);
+            vm_page* p = pages_[i];
+            pages_[i] = nullptr;
+            func(p, obj_offset_ + i * PAGE_SIZE);
+            count++;
+        }
+        return count;
+    }
+
+    // fill the empty slots in [start_index, end_index) with pages from the
+    // head of |pages|, calling |func(page, offset)| on each before it goes in
+    template <typename T>
+    void FillRange(list_node* pages, size_t start_index, size_t end_index, T func) {
+        uint64_t bits = ~present_ & RangeMask(start_index, end_index);
+        present_ |= bits;
+        for (; bits != 0; bits &= bits - 1) {
+            size_t i = __builtin_ctzll(bits);
+            vm_page* p = list_remove_head_type(pages, vm_page, free.node);
+            ASSERT(p);
+            func(p, obj_offset_ + i * PAGE_SIZE);
+            pages_[i] = p;
         }
     }
 
@@ -50,18 +107,26 @@ public:
     vm_page* RemovePage(size_t index);
     status_t AddPage(vm_page* p, size_t index);
 
+    // number of pages in slots [start_index, end_index)
+    size_t CountPages(size_t start_index, size_t end_index) const {
+        return __builtin_popcountll(present_ & RangeMask(start_index, end_index));
+    }
+
     bool IsEmpty() const {
-        for (const auto p : pages_) {
-            if (p)
-                return false;
-        }
-        return true;
+        return present_ == 0;
     }
 
 private:
+    static uint64_t RangeMask(size_t start_index, size_t end_index) {
+        DEBUG_ASSERT(start_index <= end_index && end_index <= kPageFanOut);
+        uint64_t below_end = (end_index == kPageFanOut) ? ~0ull : (1ull << end_index) - 1;
+        return below_end & ~((1ull << start_index) - 1);
+    }
+
     mxtl::Canary<mxtl::magic("PLST")> canary_;
 
     uint64_t obj_offset_ = 0;
+    uint64_t present_ = 0;
     vm_page* pages_[kPageFanOut] = {};
 };
 
@@ -88,11 +153,110 @@ public:
         }
     }
 
+    // Calls |per_page_func(page, offset)| in order on every page at an offset
+    // in [start_offset, end_offset).  The function returns a status; anything
+    // but NO_ERROR stops the walk and is returned.  The function must not
+    // change the list; use RemovePages() to take pages out of a range.
+    template <typename T>
+    status_t ForEveryPageInRange(T per_page_func, uint64_t start_offset, uint64_t end_offset) const {
+        uint64_t first = FirstIndex(start_offset);
+        uint64_t last = FirstIndex(end_offset);
+        if (first >= last)
+            return NO_ERROR;
+        for (auto pln = list_.lower_bound(NodeOffset(first)); pln.IsValid(); ++pln) {
+            uint64_t node_first = pln->offset() >> PAGE_SIZE_SHIFT;
+            if (node_first >= last)
+                break;
+            status_t status = pln->ForEveryPageInRange(per_page_func, SpanStart(first, node_first),
+                                                       SpanEnd(last, node_first));
+            if (status != NO_ERROR)
+                return status;
+        }
+        return NO_ERROR;
+    }
+
+    // Unlinks every page at an offset in [start_offset, end_offset) and hands
+    // it to |per_page_func(page, offset)|.  Returns the number of pages.
+    template <typename T>
+    size_t RemovePages(T per_page_func, uint64_t start_offset, uint64_t end_offset) {
+        uint64_t first = FirstIndex(start_offset);
+        uint64_t last = FirstIndex(end_offset);
+        size_t count = 0;
+        if (first >= last)
+            return 0;
+        for (auto pln = list_.lower_bound(NodeOffset(first)); pln.IsValid();) {
+            uint64_t node_first = pln->offset() >> PAGE_SIZE_SHIFT;
+            if (node_first >= last)
+                break;
+            count += pln->RemovePagesInRange(per_page_func, SpanStart(first, node_first),
+                                             SpanEnd(last, node_first));
+            auto cur = pln++;
+            if (cur->IsEmpty())
+                EraseNode(&*cur);
+        }
+        return count;
+    }
+
+    // Fills every empty page slot at an offset in [start_offset, end_offset)
+    // with a page from the head of |pages|, in order, calling
+    // |per_page_func(page, offset)| on each before it is added.  |pages| must
+    // hold at least as many pages as there are empty slots.  If a tree node
+    // can't be allocated this stops with ERR_NO_MEMORY, leaving the pages
+    // added so far in place and the rest on |pages|.
+    template <typename T>
+    status_t AddPages(list_node* pages, uint64_t start_offset, uint64_t end_offset,
+                      T per_page_func) {
+        uint64_t last = FirstIndex(end_offset);
+        for (uint64_t index = FirstIndex(start_offset); index < last;) {
+            uint64_t node_first = ROUNDDOWN(index, VmPageListNode::kPageFanOut);
+            size_t span_end = SpanEnd(last, node_first);
+            VmPageListNode* node = GetOrAllocNode(NodeOffset(index));
+            if (!node)
+                return ERR_NO_MEMORY;
+            node->FillRange(pages, index - node_first, span_end, per_page_func);
+            index = node_first + span_end;
+        }
+        return NO_ERROR;
+    }
+
     status_t AddPage(vm_page*, uint64_t offset);
     vm_page* GetPage(uint64_t offset);
+    // true if any page is present in [start_offset, end_offset)
+    bool AnyPagesInRange(uint64_t start_offset, uint64_t end_offset) const;
+    // number of pages present in [start_offset, end_offset)
+    size_t CountPagesInRange(uint64_t start_offset, uint64_t end_offset) const;
+    // Unlink the page at |offset| from the list without freeing it.
+    // Returns nullptr if there is no page there.
+    vm_page* RemovePage(uint64_t offset);
     status_t FreePage(uint64_t offset);
+    // frees every page in [start_offset, end_offset), returning the count
+    size_t FreePages(uint64_t start_offset, uint64_t end_offset);
     size_t FreeAllPages();
 
 private:
+    // index of the first page at or after |offset|
+    static uint64_t FirstIndex(uint64_t offset) {
+        return ROUNDUP(offset, PAGE_SIZE) >> PAGE_SIZE_SHIFT;
+    }
+    // offset of the node holding page |index|
+    static uint64_t NodeOffset(uint64_t index) {
+        return ROUNDDOWN(index, VmPageListNode::kPageFanOut) << PAGE_SIZE_SHIFT;
+    }
+    // slot range within the node starting at page |node_first| covered by
+    // pages [first, last)
+    static size_t SpanStart(uint64_t first, uint64_t node_first) {
+        return (first > node_first) ? static_cast<size_t>(first - node_first) : 0;
+    }
+    static size_t SpanEnd(uint64_t last, uint64_t node_first) {
+        return static_cast<size_t>(MIN(last - node_first, VmPageListNode::kPageFanOut));
+    }
+
+    VmPageListNode* FindNode(uint64_t node_offset);
+    VmPageListNode* GetOrAllocNode(uint64_t node_offset);
+    void EraseNode(VmPageListNode* node);
+
     mxtl::WAVLTree<uint64_t, mxtl::unique_ptr<VmPageListNode>> list_;
+
+    // the node last looked up, so runs of sequential lookups skip the tree
+    VmPageListNode* last_node_ = nullptr;
 };
@@ -39,6 +39,11 @@ lk_time_t current_time(void);
 /* high-precision timer ticks per second */
 uint64_t ticks_per_second(void);
 
+/* if current_time() is exactly the high-precision tick count scaled by a fixed
+ * factor, store that factor and return true so user space can compute it */
+struct fp_32_64;
+bool platform_usermode_time_scale(struct fp_32_64* ns_per_tick);
+
 /* super early platform initialization, before almost everything */
 void platform_early_init(void);
 
@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include <kernel/mutex.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/mp.h>
@@ -32,6 +33,7 @@
 static int cmd_thread(int argc, const cmd_args *argv, uint32_t flags);
 static int cmd_threadstats(int argc, const cmd_args *argv, uint32_t flags);
 static int cmd_threadload(int argc, const cmd_args *argv, uint32_t flags);
+static int cmd_mutexstats(int argc, const cmd_args *argv, uint32_t flags);
 static int cmd_kill(int argc, const cmd_args *argv, uint32_t flags);
 
 STATIC_COMMAND_START
@@ -40,6 +42,7 @@ STATIC_COMMAND_MASKED("thread", "list kernel threads with options", &cmd_thread,
 #endif
 STATIC_COMMAND("threadstats", "thread level statistics", &cmd_threadstats)
 STATIC_COMMAND("threadload", "toggle thread load display", &cmd_threadload)
+STATIC_COMMAND("mutexstats", "mutex spin/block statistics by lock class", &cmd_mutexstats)
 STATIC_COMMAND("kill", "kill a thread", &cmd_kill)
 STATIC_COMMAND_END(kernel);
 
@@ -82,6 +85,7 @@ static int cmd_threadstats(int argc, const cmd_args *argv, uint32_t flags)
         printf("\treschedules: %lu\n", thread_stats[i].reschedules);
 #if WITH_SMP
         printf("\treschedule_ipis: %lu\n", thread_stats[i].reschedule_ipis);
+        printf("\tsteals: %lu\n", thread_stats[i].steals);
 #endif
         printf("\tcontext_switches: %lu\n", thread_stats[i].context_switches);
         printf("\tpreempts: %lu\n", thread_stats[i].preempts);
@@ -89,6 +93,7 @@ static int cmd_threadstats(int argc, const cmd_args *argv, uint32_t flags)
         printf("\tinterrupts: %lu\n", thread_stats[i].interrupts);
         printf("\ttimer interrupts: %lu\n", thread_stats[i].timer_ints);
         printf("\ttimers: %lu\n", thread_stats[i].timers);
+        printf("\ttimers coalesced: %lu\n", thread_stats[i].timers_coalesced);
     }
 
     return 0;
@@ -178,6 +183,13 @@ static int cmd_threadload(int argc, const cmd_args *argv, uint32_t flags)
     return 0;
 }
 
+static int cmd_mutexstats(int argc, const cmd_args *argv, uint32_t flags)
+{
+    dump_mutex_stats();
+
+    return 0;
+}
+
 static int cmd_kill(int argc, const cmd_args *argv, uint32_t flags)
 {
     if (argc < 2) {
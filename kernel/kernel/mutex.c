@@ -19,8 +19,16 @@
 #include <debug.h>
 #include <assert.h>
 #include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <kernel/thread.h>
 
+/* upper bound on spinning for an adaptive mutex whose holder stays on cpu */
+#define MUTEX_SPIN_MAX_ITERATIONS 4096
+
+/* every mutex class that has recorded an acquisition, protected by the thread lock */
+static struct list_node mutex_class_list = LIST_INITIAL_VALUE(mutex_class_list);
+
 /**
  * @brief  Initialize a mutex_t
  */
@@ -29,6 +37,14 @@ void mutex_init(mutex_t *m)
     *m = (mutex_t)MUTEX_INITIAL_VALUE(*m);
 }
 
+/**
+ * @brief  Initialize a mutex_t with flags and an optional statistics class
+ */
+void mutex_init_etc(mutex_t *m, uint32_t flags, mutex_class_t *lock_class)
+{
+    *m = (mutex_t)MUTEX_INITIAL_VALUE_ETC(*m, flags, lock_class);
+}
+
 /**
  * @brief  Destroy a mutex_t
  *
@@ -73,6 +89,60 @@ void mutex_acquire_internal(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
     }
 
     m->holder = get_current_thread();
+    __atomic_store_n(&m->holder_cpu, (int)arch_curr_cpu_num(), __ATOMIC_RELAXED);
+}
+
+/* Spin without the thread lock while an adaptive mutex is held by a thread
+ * running on another cpu. Returns once the mutex looks free, the holder stops
+ * running on the cpu it acquired the mutex on, or the spin budget runs out; the
+ * caller then takes the slow path either way. Returns the number of cycles spent
+ * spinning, 0 if it didn't.
+ *
+ * The holder may release the mutex and exit at any point, so it is only ever
+ * compared against what each cpu is running, never dereferenced. A holder that
+ * migrated while holding the mutex just ends the spin early. */
+static uint64_t mutex_adaptive_spin(const mutex_t *m)
+{
+#if WITH_SMP
+    uint64_t start = 0;
+
+    for (uint i = 0; i < MUTEX_SPIN_MAX_ITERATIONS; i++) {
+        if (__atomic_load_n(&m->count, __ATOMIC_RELAXED) == 0)
+            break;
+
+        const thread_t *holder = __atomic_load_n(&m->holder, __ATOMIC_RELAXED);
+        int holder_cpu = __atomic_load_n(&m->holder_cpu, __ATOMIC_RELAXED);
+        if (!holder || holder_cpu < 0 || (uint)holder_cpu == arch_curr_cpu_num() ||
+            !thread_is_running_on(holder, (uint)holder_cpu))
+            break;
+
+        if (i == 0)
+            start = arch_cycle_count();
+        arch_spinloop_pause();
+    }
+
+    return start ? arch_cycle_count() - start : 0;
+#else
+    return 0;
+#endif
+}
+
+static void mutex_class_record(mutex_class_t *c, bool contended, bool blocked,
+                               uint64_t spin_cycles)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    if (unlikely(!list_in_list(&c->node)))
+        list_add_tail(&mutex_class_list, &c->node);
+
+    c->acquires++;
+    if (contended)
+        c->contended++;
+    if (blocked)
+        c->blocks++;
+    else if (spin_cycles)
+        c->spin_acquires++;
+    c->spin_cycles += spin_cycles;
 }
 
 /**
@@ -91,8 +161,19 @@ void mutex_acquire(mutex_t *m)
               get_current_thread(), get_current_thread()->name, m);
 #endif
 
+    bool contended = false;
+    uint64_t spin_cycles = 0;
+    if (m->flags & MUTEX_FLAG_ADAPTIVE) {
+        contended = __atomic_load_n(&m->count, __ATOMIC_RELAXED) > 0;
+        if (contended)
+            spin_cycles = mutex_adaptive_spin(m);
+    }
+
     THREAD_LOCK(state);
+    bool blocked = m->count > 0;
     mutex_acquire_internal(m);
+    if (m->lock_class)
+        mutex_class_record(m->lock_class, contended || blocked, blocked, spin_cycles);
     THREAD_UNLOCK(state);
 }
 
@@ -103,6 +184,7 @@ void mutex_release_internal(mutex_t *m, bool reschedule) TA_NO_THREAD_SAFETY_ANA
     DEBUG_ASSERT(!arch_in_int_handler());
 
     m->holder = 0;
+    __atomic_store_n(&m->holder_cpu, -1, __ATOMIC_RELAXED);
 
     if (unlikely(--m->count >= 1)) {
         /* release a thread */
@@ -130,3 +212,16 @@ void mutex_release(mutex_t *m)
     THREAD_UNLOCK(state);
 }
 
+void dump_mutex_stats(void)
+{
+    printf("%-24s %12s %12s %12s %12s %16s\n",
+           "class", "acquires", "contended", "spun", "blocked", "spin cycles");
+
+    THREAD_LOCK(state);
+    mutex_class_t *c;
+    list_for_every_entry(&mutex_class_list, c, mutex_class_t, node) {
+        printf("%-24s %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %16" PRIu64 "\n",
+               c->name, c->acquires, c->contended, c->spin_acquires, c->blocks, c->spin_cycles);
+    }
+    THREAD_UNLOCK(state);
+}
@@ -16,89 +16,124 @@
 #include <kernel/mp.h>
 #include <kernel/thread.h>
 
-/* legacy implementation that just broadcast ipis for every reschedule */
-#define BROADCAST_RESCHEDULE 0
+/* per cpu run queues, all protected by the thread lock */
+struct run_queue {
+    struct list_node queue[NUM_PRIORITIES];
+    uint32_t bitmap;
+    uint count;
+};
 
-/* the run queue */
-static struct list_node run_queue[NUM_PRIORITIES];
-static uint32_t run_queue_bitmap;
+static struct run_queue run_queues[SMP_MAX_CPUS];
+
+/* cpus with anything in their run queue, so stealing doesn't have to look at every queue */
+static mp_cpu_mask_t nonempty_run_queues;
 
 /* make sure the bitmap is large enough to cover our number of priorities */
-static_assert(NUM_PRIORITIES <= sizeof(run_queue_bitmap) * CHAR_BIT, "");
+static_assert(NUM_PRIORITIES <= sizeof(((struct run_queue *)0)->bitmap) * CHAR_BIT, "");
 
-/* pick a 'random' cpu */
-static mp_cpu_mask_t rand_cpu(const mp_cpu_mask_t mask)
+/* highest priority with a queued thread in the bitmap, -1 if empty */
+static inline int highest_queued_priority(uint32_t bitmap)
 {
-    if (unlikely(mask == 0))
-        return 0;
-
-    /* check that the mask passed in has at least one bit set in the online mask */
-    mp_cpu_mask_t online = mp_get_online_mask();
-    if (unlikely((mask & online) == 0))
-        return 0;
+    if (bitmap == 0)
+        return -1;
 
-    /* compute the highest online cpu */
-    uint highest_cpu = (sizeof(mp_cpu_mask_t) * CHAR_BIT - 1) - __builtin_clz(online);
-
-    /* not very random, round robins a bit through the mask until it gets a hit */
-    for (;;) {
-        /* protected by THREAD_LOCK, safe to use non atomically */
-        static uint rot = 0;
+    return HIGHEST_PRIORITY - __builtin_clz(bitmap)
+           - (sizeof(bitmap) * CHAR_BIT - NUM_PRIORITIES);
+}
 
-        if (++rot > highest_cpu)
-            rot = 0;
+#if WITH_SMP
+/* of the cpus in mask, pick the one with the shortest run queue, preferring lower numbers */
+static uint least_loaded_cpu(mp_cpu_mask_t mask)
+{
+    uint best_cpu = 0;
+    uint best_count = UINT_MAX;
 
-        if ((1u << rot) & mask)
-            return (1u << rot);
+    for (uint cpu = 0; mask != 0 && cpu < SMP_MAX_CPUS; cpu++, mask >>= 1) {
+        if ((mask & 1) && run_queues[cpu].count < best_count) {
+            best_cpu = cpu;
+            best_count = run_queues[cpu].count;
+        }
     }
+
+    return best_cpu;
 }
+#endif
 
-/* find a cpu to wake up */
-static mp_cpu_mask_t find_cpu(thread_t *t)
+/* find the cpu whose run queue a newly readied thread should go on */
+static uint find_cpu(thread_t *t)
 {
-#if BROADCAST_RESCHEDULE
-    return MP_CPU_ALL_BUT_LOCAL;
-#elif WITH_SMP
-    /* get the last cpu the thread ran on */
-    mp_cpu_mask_t last_ran_cpu_mask = (1u << thread_last_cpu(t));
+#if WITH_SMP
+    uint curr_cpu = arch_curr_cpu_num();
+
+    /* pinned threads only ever go on their cpu's queue */
+    if (unlikely(thread_pinned_cpu(t) >= 0))
+        return (uint)thread_pinned_cpu(t);
+
+    mp_cpu_mask_t active_mask = mp_get_active_mask();
+    if (unlikely((active_mask & (1u << curr_cpu)) == 0)) {
+        /* early in boot the current cpu may not be marked active yet */
+        active_mask |= (1u << curr_cpu);
+    }
 
-    /* the current cpu */
-    mp_cpu_mask_t curr_cpu_mask = (1u << arch_curr_cpu_num());
+    /* the last cpu it ran on likely still has some of its cache footprint */
+    uint last_cpu = thread_last_cpu(t);
+    mp_cpu_mask_t last_cpu_mask = (1u << last_cpu) & active_mask;
 
     /* get a list of idle cpus */
-    mp_cpu_mask_t idle_cpu_mask = mp_get_idle_mask();
+    mp_cpu_mask_t idle_cpu_mask = mp_get_idle_mask() & active_mask;
     if (idle_cpu_mask != 0) {
-        if (idle_cpu_mask & curr_cpu_mask) {
-            /* the current cpu is idle, so run it here */
-            return 0;
+        if (last_cpu_mask & idle_cpu_mask) {
+            /* the last core it ran on is idle, go back there */
+            return last_cpu;
         }
 
-        if (last_ran_cpu_mask & idle_cpu_mask) {
-            /* the last core it ran on is idle and isn't the current cpu */
-            return last_ran_cpu_mask;
+        if (idle_cpu_mask & (1u << curr_cpu)) {
+            /* the current cpu is idle, so run it here */
+            return curr_cpu;
         }
 
-        /* pick an idle_cpu */
-        return rand_cpu(idle_cpu_mask);
+        /* pick the least loaded idle cpu */
+        return least_loaded_cpu(idle_cpu_mask);
     }
 
-    /* no idle cpus */
-    if (last_ran_cpu_mask == curr_cpu_mask) {
-        /* the last cpu it ran on is us */
-        /* pick a random cpu that isn't the current one */
-        return rand_cpu(mp_get_online_mask() & ~(curr_cpu_mask));
-    } else {
-        /* pick the last cpu it ran on */
-        return last_ran_cpu_mask;
-    }
+    /* no idle cpus, stick with the last cpu unless it is busy with realtime work */
+    if (last_cpu_mask & ~mp_get_realtime_mask())
+        return last_cpu;
+
+    /* otherwise spread to whichever cpu has the least queued */
+    mp_cpu_mask_t candidates = active_mask & ~mp_get_realtime_mask();
+    if (candidates == 0)
+        candidates = active_mask;
+    return least_loaded_cpu(candidates);
 #else /* !WITH_SMP */
-    /* no smp, dont send an IPI */
     return 0;
 #endif
 }
 
+/* poke the cpu we just queued a thread on, if it isn't us. if that leaves a thread
+ * waiting behind another in its queue, also wake an idle cpu to come steal it */
+static void kick_cpu(uint cpu)
+{
+#if WITH_SMP
+    uint curr_cpu = arch_curr_cpu_num();
+    mp_cpu_mask_t target = 0;
+
+    if (cpu != curr_cpu)
+        target |= (1u << cpu);
+
+    if (run_queues[cpu].count > 1) {
+        mp_cpu_mask_t idle = mp_get_idle_mask() & mp_get_online_mask() &
+                             ~((1u << cpu) | (1u << curr_cpu));
+        if (idle != 0)
+            target |= (1u << __builtin_ctz(idle));
+    }
+
+    mp_reschedule(target, 0);
+#endif
+}
+
 /* run queue manipulation */
-static void insert_in_run_queue_head(thread_t *t)
+static void insert_in_run_queue_head(uint cpu, thread_t *t)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_READY);
@@ -106,11 +141,14 @@ static void insert_in_run_queue_head(thread_t *t)
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    list_add_head(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+    struct run_queue *rq = &run_queues[cpu];
+    list_add_head(&rq->queue[t->priority], &t->queue_node);
+    rq->bitmap |= (1<<t->priority);
+    rq->count++;
+    nonempty_run_queues |= (1u << cpu);
 }
 
-static void insert_in_run_queue_tail(thread_t *t)
+static void insert_in_run_queue_tail(uint cpu, thread_t *t)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_READY);
@@ -118,36 +156,100 @@ static void insert_in_run_queue_tail(thread_t *t)
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    list_add_tail(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+    struct run_queue *rq = &run_queues[cpu];
+    list_add_tail(&rq->queue[t->priority], &t->queue_node);
+    rq->bitmap |= (1<<t->priority);
+    rq->count++;
+    nonempty_run_queues |= (1u << cpu);
 }
 
-thread_t *sched_get_top_thread(uint cpu)
+static void remove_from_run_queue(uint cpu, thread_t *t)
 {
-    thread_t *newthread;
-    uint32_t local_run_queue_bitmap = run_queue_bitmap;
-
-    while (local_run_queue_bitmap) {
-        /* find the first (remaining) queue with a thread in it */
-        uint next_queue = HIGHEST_PRIORITY - __builtin_clz(local_run_queue_bitmap)
-                          - (sizeof(run_queue_bitmap) * CHAR_BIT - NUM_PRIORITIES);
+    struct run_queue *rq = &run_queues[cpu];
+    DEBUG_ASSERT(rq->count > 0);
+
+    list_delete(&t->queue_node);
+    if (list_is_empty(&rq->queue[t->priority]))
+        rq->bitmap &= ~(1<<t->priority);
+    if (--rq->count == 0)
+        nonempty_run_queues &= ~(1u << cpu);
+}
 
-        list_for_every_entry(&run_queue[next_queue], newthread, thread_t, queue_node) {
 #if WITH_SMP
-            if (likely(newthread->pinned_cpu < 0) || (uint)newthread->pinned_cpu == cpu)
-#endif
-            {
-                list_delete(&newthread->queue_node);
+/* highest priority thread on a remote run queue that is allowed to migrate, with
+ * a priority strictly above min_priority */
+static thread_t *find_stealable_thread(struct run_queue *rq, int min_priority)
+{
+    uint32_t bitmap = rq->bitmap;
+
+    int pri;
+    while ((pri = highest_queued_priority(bitmap)) > min_priority) {
+        thread_t *t;
+        list_for_every_entry(&rq->queue[pri], t, thread_t, queue_node) {
+            if (likely(thread_pinned_cpu(t) < 0))
+                return t;
+        }
+        bitmap &= ~(1u << pri);
+    }
 
-                if (list_is_empty(&run_queue[next_queue]))
-                    run_queue_bitmap &= ~(1<<next_queue);
+    return NULL;
+}
 
-                return newthread;
-            }
+/* look across the other cpus' run queues for something better to run than what we
+ * have locally. An idle cpu will take any migratable thread. */
+static thread_t *steal_thread(uint cpu, int local_priority)
+{
+    thread_t *best = NULL;
+    uint best_cpu = 0;
+    int best_priority = local_priority;
+
+    /* only online cpus with something queued are worth a look */
+    mp_cpu_mask_t mask = nonempty_run_queues & mp_get_online_mask() & ~(1u << cpu);
+    while (mask != 0) {
+        uint i = __builtin_ctz(mask);
+        mask &= ~(1u << i);
+
+        /* cheap check before walking any lists */
+        if (highest_queued_priority(run_queues[i].bitmap) <= best_priority)
+            continue;
+
+        thread_t *t = find_stealable_thread(&run_queues[i], best_priority);
+        if (t) {
+            best = t;
+            best_cpu = i;
+            best_priority = t->priority;
         }
+    }
 
-        local_run_queue_bitmap &= ~(1<<next_queue);
+    if (best) {
+        remove_from_run_queue(best_cpu, best);
+        THREAD_STATS_INC(steals);
     }
+
+    return best;
+}
+#endif
+
+thread_t *sched_get_top_thread(uint cpu)
+{
+    struct run_queue *rq = &run_queues[cpu];
+
+    int local_priority = highest_queued_priority(rq->bitmap);
+
+#if WITH_SMP
+    /* pull in higher priority work from other cpus, or any work if we'd otherwise idle */
+    thread_t *stolen = steal_thread(cpu, local_priority);
+    if (stolen)
+        return stolen;
+#endif
+
+    if (local_priority >= 0) {
+        thread_t *newthread = list_peek_head_type(&rq->queue[local_priority], thread_t, queue_node);
+        DEBUG_ASSERT(newthread);
+        remove_from_run_queue(cpu, newthread);
+        return newthread;
+    }
+
     /* no threads to run, select the idle thread for this cpu */
     return &idle_threads[cpu];
 }
@@ -179,14 +281,15 @@ void sched_unblock(thread_t *t, bool resched)
         thread_t *current_thread = get_current_thread();
 
         current_thread->state = THREAD_READY;
-        insert_in_run_queue_head(current_thread);
+        insert_in_run_queue_head(arch_curr_cpu_num(), current_thread);
     }
 
     /* stuff the new thread in the run queue */
     t->state = THREAD_READY;
-    insert_in_run_queue_head(t);
+    uint cpu = find_cpu(t);
+    insert_in_run_queue_head(cpu, t);
 
-    mp_reschedule(find_cpu(t), 0);
+    kick_cpu(cpu);
 
     if (resched)
         thread_resched();
@@ -205,7 +308,7 @@ void sched_unblock_list(struct list_node *list, bool resched)
         thread_t *current_thread = get_current_thread();
 
         current_thread->state = THREAD_READY;
-        insert_in_run_queue_head(current_thread);
+        insert_in_run_queue_head(arch_curr_cpu_num(), current_thread);
     }
 
     /* pop the list of threads and shove into the scheduler */
@@ -216,9 +319,10 @@ void sched_unblock_list(struct list_node *list, bool resched)
 
         /* stuff the new thread in the run queue */
         t->state = THREAD_READY;
-        insert_in_run_queue_head(t);
+        uint cpu = find_cpu(t);
+        insert_in_run_queue_head(cpu, t);
 
-        mp_reschedule(find_cpu(t), 0);
+        kick_cpu(cpu);
     }
 
     if (resched)
@@ -234,7 +338,8 @@ void sched_yield(void)
     current_thread->state = THREAD_READY;
     current_thread->remaining_time_slice = 0;
     if (likely(!thread_is_idle(current_thread))) { /* idle thread doesn't go in the run queue */
-        insert_in_run_queue_tail(current_thread);
+        insert_in_run_queue_tail(arch_curr_cpu_num(), current_thread);
+        kick_cpu(arch_curr_cpu_num());
     }
     thread_resched();
 }
@@ -247,9 +352,10 @@ void sched_preempt(void)
     current_thread->state = THREAD_READY;
     if (likely(!thread_is_idle(current_thread))) { /* idle thread doesn't go in the run queue */
         if (current_thread->remaining_time_slice > 0)
-            insert_in_run_queue_head(current_thread);
+            insert_in_run_queue_head(arch_curr_cpu_num(), current_thread);
         else
-            insert_in_run_queue_tail(current_thread); /* if we're out of quantum, go to the tail of the queue */
+            insert_in_run_queue_tail(arch_curr_cpu_num(), current_thread); /* if we're out of quantum, go to the tail of the queue */
+        kick_cpu(arch_curr_cpu_num());
     }
     sched_block();
 }
@@ -257,7 +363,12 @@ void sched_preempt(void)
 void sched_init_early(void)
 {
     /* initialize the run queues */
-    for (int i=0; i < NUM_PRIORITIES; i++)
-        list_initialize(&run_queue[i]);
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        for (int i=0; i < NUM_PRIORITIES; i++)
+            list_initialize(&run_queues[cpu].queue[i]);
+        run_queues[cpu].bitmap = 0;
+        run_queues[cpu].count = 0;
+    }
+    nonempty_run_queues = 0;
 }
 
@@ -39,6 +39,8 @@
 
 struct thread_stats thread_stats[SMP_MAX_CPUS];
 
+thread_t *running_threads[SMP_MAX_CPUS];
+
 #define STACK_DEBUG_BYTE (0x99)
 #define STACK_DEBUG_WORD (0x99999999)
 
@@ -72,6 +74,12 @@ static void thread_do_suspend(void);
 static timer_t preempt_timer[SMP_MAX_CPUS];
 #endif
 
+/* real time threads always get exact deadlines */
+static lk_time_t thread_timer_slack(thread_t *t)
+{
+    return thread_is_realtime(t) ? 0 : t->timer_slack;
+}
+
 static void init_thread_struct(thread_t *t, const char *name)
 {
     memset(t, 0, sizeof(thread_t));
@@ -705,6 +713,7 @@ void thread_resched(void)
 
     /* mark the cpu ownership of the threads */
     thread_set_last_cpu(newthread, cpu);
+    __atomic_store_n(&running_threads[cpu], newthread, __ATOMIC_RELAXED);
 
     /* set the cpu state based on the new thread we've picked */
     if (thread_is_idle(newthread)) {
@@ -944,7 +953,8 @@ status_t thread_sleep_etc(lk_time_t deadline, bool interruptable)
 
     if (deadline != INFINITE_TIME) {
         /* set a one shot timer to wake us up and reschedule */
-        timer_set_oneshot(&timer, deadline, thread_sleep_handler, (void *)current_thread);
+        timer_set_oneshot(&timer, deadline, thread_timer_slack(current_thread),
+                          thread_sleep_handler, (void *)current_thread);
     }
     current_thread->state = THREAD_SLEEPING;
     current_thread->blocked_status = NO_ERROR;
@@ -1020,6 +1030,7 @@ void thread_construct_first(thread_t *t, const char *name)
     THREAD_LOCK(state);
     list_add_head(&thread_list, &t->thread_list_node);
     set_current_thread(t);
+    __atomic_store_n(&running_threads[cpu], t, __ATOMIC_RELAXED);
     THREAD_UNLOCK(state);
 }
 
@@ -1382,7 +1393,8 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t deadline)
     /* if the deadline is nonzero or noninfinite, set a callback to yank us out of the queue */
     if (deadline != INFINITE_TIME) {
         timer_initialize(&timer);
-        timer_set_oneshot(&timer, deadline, wait_queue_timeout_handler, (void *)current_thread);
+        timer_set_oneshot(&timer, deadline, thread_timer_slack(current_thread),
+                          wait_queue_timeout_handler, (void *)current_thread);
     }
 
     sched_block();
@@ -26,7 +26,6 @@
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
-#include <list.h>
 #include <platform.h>
 #include <platform/timer.h>
 #include <trace.h>
@@ -35,8 +34,13 @@
 
 spin_lock_t timer_lock;
 
+/* Each cpu's pending timers are kept in a treap: a binary search tree ordered
+ * by scheduled_time (equal times in insertion order) that is also a min heap on
+ * a random per node priority, which keeps the expected depth logarithmic. */
 struct timer_state {
-    struct list_node timer_queue;
+    timer_t *root;
+    timer_t *first; /* leftmost node, the next timer to fire */
+    uint32_t prng;
 } __CPU_ALIGN;
 
 static struct timer_state timers[SMP_MAX_CPUS];
@@ -51,33 +55,194 @@ void timer_initialize(timer_t *timer)
     *timer = (timer_t)TIMER_INITIAL_VALUE(*timer);
 }
 
+static inline bool timer_is_queued(const timer_t *timer)
+{
+    return timer->node.cpu >= 0;
+}
+
+static inline timer_t *timer_queue_peek(uint cpu)
+{
+    return timers[cpu].first;
+}
+
+static uint32_t timer_next_priority(struct timer_state *ts)
+{
+    /* xorshift32, only needs to be cheap and not correlated with deadlines */
+    uint32_t x = ts->prng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ts->prng = x;
+    return x;
+}
+
+static void timer_replace_child(struct timer_state *ts, timer_t *parent, timer_t *old, timer_t *new)
+{
+    if (!parent)
+        ts->root = new;
+    else if (parent->node.left == old)
+        parent->node.left = new;
+    else
+        parent->node.right = new;
+
+    if (new)
+        new->node.parent = parent;
+}
+
+/* lift t's right child into t's place */
+static void timer_rotate_left(struct timer_state *ts, timer_t *t)
+{
+    timer_t *r = t->node.right;
+
+    t->node.right = r->node.left;
+    if (r->node.left)
+        r->node.left->node.parent = t;
+    timer_replace_child(ts, t->node.parent, t, r);
+    r->node.left = t;
+    t->node.parent = r;
+}
+
+/* lift t's left child into t's place */
+static void timer_rotate_right(struct timer_state *ts, timer_t *t)
+{
+    timer_t *l = t->node.left;
+
+    t->node.left = l->node.right;
+    if (l->node.right)
+        l->node.right->node.parent = t;
+    timer_replace_child(ts, t->node.parent, t, l);
+    l->node.right = t;
+    t->node.parent = l;
+}
+
+/* in order successor */
+static timer_t *timer_next(timer_t *t)
+{
+    if (t->node.right) {
+        t = t->node.right;
+        while (t->node.left)
+            t = t->node.left;
+        return t;
+    }
+
+    while (t->node.parent && t->node.parent->node.right == t)
+        t = t->node.parent;
+    return t->node.parent;
+}
+
+/* earliest queued timer scheduled at or after time */
+static timer_t *timer_lower_bound(uint cpu, lk_time_t time)
+{
+    timer_t *t = timers[cpu].root;
+    timer_t *found = NULL;
+
+    while (t) {
+        if (TIME_LT(t->scheduled_time, time)) {
+            t = t->node.right;
+        } else {
+            found = t;
+            t = t->node.left;
+        }
+    }
+
+    return found;
+}
+
+/* latest queued timer scheduled before time */
+static timer_t *timer_last_before(uint cpu, lk_time_t time)
+{
+    timer_t *t = timers[cpu].root;
+    timer_t *found = NULL;
+
+    while (t) {
+        if (TIME_LT(t->scheduled_time, time)) {
+            found = t;
+            t = t->node.right;
+        } else {
+            t = t->node.left;
+        }
+    }
+
+    return found;
+}
+
 static void insert_timer_in_queue(uint cpu, timer_t *timer)
 {
-    timer_t *entry;
+    struct timer_state *ts = &timers[cpu];
 
     DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(!timer_is_queued(timer));
 
     LTRACEF("timer %p, cpu %u, scheduled %" PRIu64 ", periodic %" PRIu64 "\n", timer, cpu, timer->scheduled_time, timer->period);
 
-    list_for_every_entry(&timers[cpu].timer_queue, entry, timer_t, node) {
-        if (TIME_GT(entry->scheduled_time, timer->scheduled_time)) {
-            list_add_before(&entry->node, &timer->node);
-            return;
+    /* plain bst insert, after any timers with the same deadline */
+    timer_t *parent = NULL;
+    timer_t **link = &ts->root;
+    bool leftmost = true;
+    while (*link) {
+        parent = *link;
+        if (TIME_LT(timer->scheduled_time, parent->scheduled_time)) {
+            link = &parent->node.left;
+        } else {
+            link = &parent->node.right;
+            leftmost = false;
         }
     }
 
-    /* walked off the end of the list */
-    list_add_tail(&timers[cpu].timer_queue, &timer->node);
+    timer->node.parent = parent;
+    timer->node.left = NULL;
+    timer->node.right = NULL;
+    timer->node.priority = timer_next_priority(ts);
+    timer->node.cpu = cpu;
+    *link = timer;
+
+    if (leftmost)
+        ts->first = timer;
+
+    /* rotate it up until the heap order holds; rotations keep the in order sequence */
+    while (timer->node.parent && timer->node.parent->node.priority > timer->node.priority) {
+        if (timer->node.parent->node.left == timer)
+            timer_rotate_right(ts, timer->node.parent);
+        else
+            timer_rotate_left(ts, timer->node.parent);
+    }
 }
 
-static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, timer_callback callback, void *arg)
+static void remove_timer_from_queue(timer_t *timer)
 {
-    LTRACEF("timer %p, deadline %" PRIu64 ", period %" PRIu64 ", callback %p, arg %p\n", timer, deadline, period, callback, arg);
+    DEBUG_ASSERT(timer_is_queued(timer));
+
+    struct timer_state *ts = &timers[timer->node.cpu];
+
+    if (ts->first == timer)
+        ts->first = timer_next(timer);
+
+    /* rotate it down until it has at most one child, then splice it out */
+    while (timer->node.left && timer->node.right) {
+        if (timer->node.left->node.priority < timer->node.right->node.priority)
+            timer_rotate_right(ts, timer);
+        else
+            timer_rotate_left(ts, timer);
+    }
+    timer_replace_child(ts, timer->node.parent, timer,
+                        timer->node.left ? timer->node.left : timer->node.right);
+
+    timer->node.parent = NULL;
+    timer->node.left = NULL;
+    timer->node.right = NULL;
+    timer->node.cpu = -1;
+}
+
+static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t slack, lk_time_t period,
+                      timer_callback callback, void *arg)
+{
+    LTRACEF("timer %p, deadline %" PRIu64 ", slack %" PRIu64 ", period %" PRIu64 ", callback %p, arg %p\n",
+            timer, deadline, slack, period, callback, arg);
 
     DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
-    if (list_in_list(&timer->node)) {
-        panic("timer %p already in list\n", timer);
+    if (timer_is_queued(timer)) {
+        panic("timer %p already queued\n", timer);
     }
 
     spin_lock_saved_state_t state;
@@ -93,8 +258,40 @@ static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, time
         panic("timer %p currently active on a different cpu %d\n", timer, timer->active_cpu);
     }
 
+#if PLATFORM_HAS_DYNAMIC_TIMER
+    timer_t *old_head = timer_queue_peek(cpu);
+    lk_time_t old_head_time = old_head ? old_head->scheduled_time : 0;
+#endif
+
+    /* if a timer is already due inside our window, fire alongside it rather
+     * than taking another interrupt of our own. the slack we have left is kept
+     * so later timers can still pull us along. */
+    if (slack > 0) {
+        timer_t *match = timer_lower_bound(cpu, deadline);
+        if (match && TIME_LTE(match->scheduled_time, deadline + slack)) {
+            LTRACEF("coalescing with timer %p at %" PRIu64 "\n", match, match->scheduled_time);
+            slack -= match->scheduled_time - deadline;
+            deadline = match->scheduled_time;
+            THREAD_STATS_INC(timers_coalesced);
+        }
+    }
+
+    /* likewise, a queued timer due just before us whose window reaches our
+     * deadline is pushed back to fire alongside us */
+    timer_t *prev = timer_last_before(cpu, deadline);
+    if (prev && prev->slack > 0 && TIME_LTE(deadline, prev->scheduled_time + prev->slack)) {
+        LTRACEF("deferring timer %p from %" PRIu64 " to %" PRIu64 "\n", prev, prev->scheduled_time,
+                deadline);
+        remove_timer_from_queue(prev);
+        prev->slack -= deadline - prev->scheduled_time;
+        prev->scheduled_time = deadline;
+        insert_timer_in_queue(cpu, prev);
+        THREAD_STATS_INC(timers_coalesced);
+    }
+
     /* set up the structure */
     timer->scheduled_time = deadline;
+    timer->slack = slack;
     timer->period = period;
     timer->callback = callback;
     timer->arg = arg;
@@ -106,10 +303,11 @@ static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, time
     insert_timer_in_queue(cpu, timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    if (list_peek_head_type(&timers[cpu].timer_queue, timer_t, node) == timer) {
-        /* we just modified the head of the timer queue */
-        LTRACEF("setting new timer for %" PRIu64 " nsecs\n", deadline);
-        platform_set_oneshot_timer(timer_tick, NULL, deadline);
+    timer_t *head = timer_queue_peek(cpu);
+    if (head != old_head || head->scheduled_time != old_head_time) {
+        /* we just modified the head of the timer queue, or pushed it back */
+        LTRACEF("setting new timer for %" PRIu64 " nsecs\n", head->scheduled_time);
+        platform_set_oneshot_timer(timer_tick, NULL, head->scheduled_time);
     }
 #endif
 
@@ -125,15 +323,19 @@ out:
  *
  * @param  timer The timer to use
  * @param  deadline The deadline, in ns, after which the timer is executed
+ * @param  slack  How long after the deadline, in ns, the timer may be delayed
+ *                so that it can share an interrupt with another timer, one
+ *                already queued or one set later
  * @param  callback  The function to call when the timer expires
  * @param  arg  The argument to pass to the callback
  *
  * The timer function is declared as:
  *   enum handler_return callback(struct timer *, lk_time_t now, void *arg) { ... }
  */
-void timer_set_oneshot(timer_t *timer, lk_time_t deadline, timer_callback callback, void *arg)
+void timer_set_oneshot(timer_t *timer, lk_time_t deadline, lk_time_t slack,
+                       timer_callback callback, void *arg)
 {
-    timer_set(timer, deadline, 0, callback, arg);
+    timer_set(timer, deadline, slack, 0, callback, arg);
 }
 
 /**
@@ -154,7 +356,7 @@ void timer_set_periodic(timer_t *timer, lk_time_t period, timer_callback callbac
 {
     if (period == 0)
         period = 1;
-    timer_set(timer, current_time() + period, period, callback, arg);
+    timer_set(timer, current_time() + period, 0, period, callback, arg);
 }
 
 /**
@@ -189,18 +391,18 @@ void timer_cancel(timer_t *timer)
     }
 
     /* if the timer is in a queue, remove it and adjust hardware timers if needed */
-    if (list_in_list(&timer->node)) {
+    if (timer_is_queued(timer)) {
 #if PLATFORM_HAS_DYNAMIC_TIMER
-        timer_t *oldhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer_t *oldhead = timer_queue_peek(cpu);
 #endif
 
         /* remove it from the queue */
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
         /* see if we've just modified the head of this cpu's timer queue */
         /* if we modified another cpu's queue, we'll just let it fire and sort itself out */
-        timer_t *newhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer_t *newhead = timer_queue_peek(cpu);
         if (newhead == NULL) {
             LTRACEF("clearing old hw timer, nothing in the queue\n");
             platform_stop_timer();
@@ -242,7 +444,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
     for (;;) {
         /* see if there's an event to process */
-        timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer = timer_queue_peek(cpu);
         if (likely(timer == 0))
             break;
         LTRACEF("next item on timer queue %p at %" PRIu64 " now %" PRIu64 " (%p, arg %p)\n", timer, timer->scheduled_time, now, timer->callback, timer->arg);
@@ -254,7 +456,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
         DEBUG_ASSERT_MSG(timer && timer->magic == TIMER_MAGIC,
                 "ASSERT: timer failed magic check: timer %p, magic 0x%x\n",
                 timer, (uint)timer->magic);
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
         /* mark the timer busy */
         timer->active_cpu = cpu;
@@ -290,7 +492,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
             /* if it is a periodic timer and it hasn't been requeued
              * by the callback put it back in the list
              */
-            if (timer->period > 0 && !list_in_list(&timer->node)) {
+            if (timer->period > 0 && !timer_is_queued(timer)) {
                 LTRACEF("periodic timer, period %" PRIu64 "\n", timer->period);
                 timer->scheduled_time = now + timer->period;
                 insert_timer_in_queue(cpu, timer);
@@ -300,7 +502,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
     /* reset the timer to the next event */
-    timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer = timer_queue_peek(cpu);
     if (timer) {
         /* has to be the case or it would have fired already */
         DEBUG_ASSERT(TIME_GT(timer->scheduled_time, now));
@@ -349,17 +551,17 @@ void timer_transition_off_cpu(uint old_cpu)
     spin_lock_irqsave(&timer_lock, state);
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *old_head = list_peek_head_type(&timers[old_cpu].timer_queue, timer_t, node);
+    timer_t *old_head = timer_queue_peek(cpu);
 
-    timer_t *entry = NULL, *tmp_entry = NULL;
+    timer_t *entry;
     /* Move all timers from old_cpu to this cpu */
-    list_for_every_entry_safe(&timers[old_cpu].timer_queue, entry, tmp_entry, timer_t, node) {
-        list_delete(&entry->node);
+    while ((entry = timer_queue_peek(old_cpu)) != NULL) {
+        remove_timer_from_queue(entry);
         insert_timer_in_queue(cpu, entry);
     }
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    timer_t *new_head = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer_t *new_head = timer_queue_peek(cpu);
     if (new_head != NULL && new_head != old_head) {
         /* we just modified the head of the timer queue */
         LTRACEF("setting new timer for %" PRIu64 " nsecs\n", new_head->scheduled_time);
@@ -380,7 +582,7 @@ void timer_thaw_percpu(void)
 
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *t = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer_t *t = timer_queue_peek(cpu);
     if (t) {
         LTRACEF("rescheduling timer for %" PRIu64 " nsecs\n", t->scheduled_time);
         platform_set_oneshot_timer(timer_tick, NULL, t->scheduled_time);
@@ -394,7 +596,9 @@ void timer_init(void)
 {
     timer_lock = SPIN_LOCK_INITIAL_VALUE;
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
-        list_initialize(&timers[i].timer_queue);
+        timers[i].root = NULL;
+        timers[i].first = NULL;
+        timers[i].prng = 0x9e3779b9u * (i + 1);
     }
 #if !PLATFORM_HAS_DYNAMIC_TIMER
     /* register for a periodic timer tick */
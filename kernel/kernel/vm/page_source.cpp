@@ -0,0 +1,87 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "kernel/vm/page_source.h"
+
+#include "vm_priv.h"
+
+#include <err.h>
+#include <inttypes.h>
+#include <kernel/auto_lock.h>
+#include <kernel/vm.h>
+#include <trace.h>
+
+#define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
+
+PageSource::~PageSource() {
+    DEBUG_ASSERT(requests_.is_empty());
+}
+
+void PageSource::QueueRequest(Request* request, uint64_t offset) {
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset));
+    DEBUG_ASSERT(!request->InContainer());
+
+    AutoLock a(&lock_);
+
+    // only the first waiter for a given page asks the pager for it
+    request->source_ = mxtl::WrapRefPtr(this);
+    request->offset_ = offset;
+    request->send_ = true;
+    for (const auto& r : requests_) {
+        if (r.offset_ == offset) {
+            request->send_ = false;
+            break;
+        }
+    }
+    requests_.push_back(request);
+}
+
+status_t PageSource::WaitForRequest(Request* request) {
+    DEBUG_ASSERT(request->InContainer());
+
+    if (request->send_) {
+        LTRACEF("source %p requesting offset %#" PRIx64 "\n", this, request->offset_);
+
+        status_t status = SendRequest(request->offset_, PAGE_SIZE);
+        if (status != NO_ERROR) {
+            // nobody is going to supply this page, so fail everyone that is
+            // piggybacking on this request as well
+            CompleteRange(request->offset_, PAGE_SIZE, status);
+        }
+    }
+
+    status_t status = event_wait_deadline(&request->event_, INFINITE_TIME, true);
+    if (status != NO_ERROR) {
+        // interrupted; the page may still show up later for the other waiters
+        AutoLock a(&lock_);
+        if (request->InContainer())
+            requests_.erase(*request);
+    }
+    return status;
+}
+
+status_t PageSource::Request::Wait() {
+    DEBUG_ASSERT(source_);
+
+    mxtl::RefPtr<PageSource> source = mxtl::move(source_);
+    return source->WaitForRequest(this);
+}
+
+void PageSource::CompleteRange(uint64_t offset, uint64_t len, status_t status) {
+    LTRACEF("source %p offset %#" PRIx64 " len %#" PRIx64 " status %d\n",
+            this, offset, len, status);
+
+    AutoLock a(&lock_);
+
+    for (auto iter = requests_.begin(); iter != requests_.end();) {
+        Request* r = &*iter;
+        ++iter;
+        if (r->offset_ >= offset && r->offset_ - offset < len) {
+            requests_.erase(*r);
+            event_signal_etc(&r->event_, false, status);
+        }
+    }
+}
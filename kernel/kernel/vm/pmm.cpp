@@ -9,15 +9,18 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <arch/ops.h>
 #include <kernel/auto_lock.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
 #include <kernel/timer.h>
 #include <kernel/vm.h>
 #include <lib/console.h>
 #include <list.h>
 #include <lk/init.h>
 #include <new.h>
+#include <platform.h>
 #include <pow2.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,6 +38,35 @@ static Mutex arena_lock;
 static mxtl::DoublyLinkedList<PmmArena*> arena_list TA_GUARDED(arena_lock);
 static size_t arena_cumulative_size TA_GUARDED(arena_lock);
 
+// Per cpu caches of free pages sitting in front of the arenas, so the common
+// single page alloc/free path doesn't need arena_lock. Pages sitting in a
+// cache are off the arena free lists and marked allocated. Only pages from
+// KMAP arenas are cached, so a cached page satisfies any allocation flags.
+static const size_t kPageCacheBatch = 32;
+static const size_t kPageCacheMax = kPageCacheBatch * 4;
+
+struct pmm_page_cache {
+    spin_lock_t lock;
+    list_node pages;
+    size_t count;
+
+    // statistics
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t refills;
+    uint64_t drains;
+} __CPU_ALIGN;
+
+static pmm_page_cache page_cache[SMP_MAX_CPUS];
+
+// Minimum time between cache flushes triggered by failed contiguous allocations.
+static const lk_time_t kPageCacheDrainInterval = LK_MSEC(100);
+static lk_time_t last_contiguous_drain TA_GUARDED(arena_lock) = -kPageCacheDrainInterval;
+
+static size_t pmm_alloc_pages_locked(size_t count, uint alloc_flags, struct list_node* list)
+    TA_REQ(arena_lock);
+static size_t pmm_free_locked(struct list_node* list) TA_REQ(arena_lock);
+
 #if PMM_ENABLE_FREE_FILL
 static void pmm_enforce_fill(uint level) {
     for (auto& a : arena_list) {
@@ -82,6 +114,16 @@ status_t pmm_add_arena(const pmm_arena_info_t* info) TA_NO_THREAD_SAFETY_ANALYSI
     DEBUG_ASSERT(IS_PAGE_ALIGNED(info->size));
     DEBUG_ASSERT(info->size > 0);
 
+    // the page caches need to be ready before the first allocation
+    static bool page_cache_initialized = false;
+    if (!page_cache_initialized) {
+        for (auto& cache : page_cache) {
+            spin_lock_init(&cache.lock);
+            list_initialize(&cache.pages);
+        }
+        page_cache_initialized = true;
+    }
+
     // allocate a c++ arena object
     PmmArena* arena = new (boot_alloc_mem(sizeof(PmmArena))) PmmArena(info);
 
@@ -105,38 +147,218 @@ done_add:
     return NO_ERROR;
 }
 
-vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
-    AutoLock al(&arena_lock);
+// Lock the current cpu's page cache. Interrupts stay disabled until the
+// matching page_cache_unlock, which keeps us from migrating off the cpu.
+static pmm_page_cache* page_cache_lock(spin_lock_saved_state_t* state) {
+    arch_interrupt_save(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    pmm_page_cache* cache = &page_cache[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    return cache;
+}
+
+static void page_cache_unlock(pmm_page_cache* cache, spin_lock_saved_state_t state) {
+    spin_unlock_restore(&cache->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// Cacheability is decided per arena when its page array is set up.
+static bool page_is_cacheable(const vm_page_t* page) {
+    return (page->flags & VM_PAGE_FLAG_PMM_CACHEABLE) != 0;
+}
 
-    /* walk the arenas in order until we find one with a free page */
+#if PMM_ENABLE_FREE_FILL
+// Cached pages are poisoned on the way in and checked on the way out, same as
+// pages on the arena free lists. Arenas only change during boot, so finding
+// one doesn't need the arena lock.
+static PmmArena* page_arena(const vm_page_t* page) TA_NO_THREAD_SAFETY_ANALYSIS {
     for (auto& a : arena_list) {
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
-        }
+        if (a.page_belongs_to_arena(page))
+            return &a;
+    }
+    panic("page %p isn't in any arena\n", page);
+}
+#endif
+
+// Join all of from onto the head of to, leaving from empty.
+static void page_list_splice_head(list_node* from, list_node* to) {
+    if (list_is_empty(from))
+        return;
+    from->prev->next = to->next;
+    to->next->prev = from->prev;
+    to->next = from->next;
+    from->next->prev = to;
+    list_initialize(from);
+}
+
+// Move up to count pages out of the current cpu's cache onto the tail of list.
+static size_t page_cache_alloc(size_t count, struct list_node* list) {
+    list_node pages = LIST_INITIAL_VALUE(pages);
+
+    spin_lock_saved_state_t state;
+    pmm_page_cache* cache = page_cache_lock(&state);
 
-        // try to allocate the page out of the arena
-        vm_page_t* page = a.AllocPage(pa);
-        if (page)
-            return page;
+    size_t allocated = 0;
+    while (allocated < count && cache->count > 0) {
+        list_add_tail(&pages, list_remove_head(&cache->pages));
+        cache->count--;
+        allocated++;
     }
 
-    LTRACEF("failed to allocate page\n");
-    return nullptr;
+    if (allocated == count) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+
+    page_cache_unlock(cache, state);
+
+    vm_page_t* page;
+    while ((page = list_remove_head_type(&pages, vm_page_t, free.node))) {
+#if PMM_ENABLE_FREE_FILL
+        page_arena(page)->CheckFreeFill(page);
+#endif
+        list_add_tail(list, &page->free.node);
+    }
+    return allocated;
 }
 
-size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
-    LTRACEF("count %zu\n", count);
+// Allocate count pages from the arenas onto list, plus a batch to refill the
+// current cpu's cache with. Returns the number of pages put on list.
+static size_t page_cache_refill(size_t count, struct list_node* list) {
+    list_node batch = LIST_INITIAL_VALUE(batch);
 
-    /* list must be initialized prior to calling this */
-    DEBUG_ASSERT(list);
+    size_t allocated;
+    {
+        AutoLock al(&arena_lock);
+        allocated = pmm_alloc_pages_locked(count + kPageCacheBatch, PMM_ALLOC_FLAG_KMAP, &batch);
+    }
+
+    size_t given = 0;
+    while (given < count && given < allocated) {
+        list_add_tail(list, list_remove_head(&batch));
+        given++;
+    }
+
+    if (given == allocated)
+        return given;
+
+    // we may have migrated while we had the arena lock, stash the rest on whatever cpu we're on now
+    spin_lock_saved_state_t state;
+    pmm_page_cache* cache = page_cache_lock(&state);
+    list_node* node;
+    while (cache->count < kPageCacheMax && (node = list_remove_head(&batch))) {
+        list_add_tail(&cache->pages, node);
+        cache->count++;
+    }
+    cache->refills++;
+    page_cache_unlock(cache, state);
+
+    // return anything that didn't fit
+    if (!list_is_empty(&batch)) {
+        AutoLock al(&arena_lock);
+        pmm_free_locked(&batch);
+    }
+
+    return given;
+}
+
+// Push up to a batch of pages from list into the current cpu's cache and return
+// how many were taken. Pages that aren't cacheable or don't fit are left on list.
+static size_t page_cache_free(struct list_node* list) {
+    list_node batch = LIST_INITIAL_VALUE(batch);
+    list_node overflow = LIST_INITIAL_VALUE(overflow);
+    list_node drain = LIST_INITIAL_VALUE(drain);
+
+    // sort out and poison the pages before taking the lock, so that interrupts
+    // are only off for the splice and whatever drain it triggers
+    size_t count = 0;
+    vm_page_t* page;
+    while ((page = list_remove_head_type(list, vm_page_t, free.node))) {
+        DEBUG_ASSERT(!page_is_free(page));
+
+        if (count >= kPageCacheBatch || !page_is_cacheable(page)) {
+            list_add_tail(&overflow, &page->free.node);
+            continue;
+        }
+
+#if PMM_ENABLE_FREE_FILL
+        page_arena(page)->FreeFill(page);
+#endif
+        page->state = VM_PAGE_STATE_ALLOC;
+        list_add_tail(&batch, &page->free.node);
+        count++;
+    }
+    list_move(&overflow, list);
 
     if (count == 0)
         return 0;
 
-    AutoLock al(&arena_lock);
+    spin_lock_saved_state_t state;
+    pmm_page_cache* cache = page_cache_lock(&state);
+
+    page_list_splice_head(&batch, &cache->pages);
+    cache->count += count;
+
+    // a full cache drains its coldest batch back to the arenas
+    if (cache->count >= kPageCacheMax) {
+        for (size_t i = 0; i < kPageCacheBatch; i++) {
+            list_add_tail(&drain, list_remove_tail(&cache->pages));
+            cache->count--;
+        }
+        cache->drains++;
+    }
+
+    page_cache_unlock(cache, state);
+
+    if (!list_is_empty(&drain)) {
+        AutoLock al(&arena_lock);
+        pmm_free_locked(&drain);
+    }
+
+    return count;
+}
+
+// Return every cached page on every cpu to the arenas, used when an
+// allocation needs specific or contiguous free pages.
+static void page_cache_drain_all() {
+    list_node pages = LIST_INITIAL_VALUE(pages);
+
+    for (auto& cache : page_cache) {
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&cache.lock, state);
+        if (cache.count > 0) {
+            list_node* node;
+            while ((node = list_remove_head(&cache.pages))) {
+                list_add_tail(&pages, node);
+            }
+            cache.count = 0;
+            cache.drains++;
+        }
+        spin_unlock_irqrestore(&cache.lock, state);
+    }
+
+    if (!list_is_empty(&pages)) {
+        AutoLock al(&arena_lock);
+        pmm_free_locked(&pages);
+    }
+}
+
+vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
+    list_node list = LIST_INITIAL_VALUE(list);
 
+    if (pmm_alloc_pages(1, alloc_flags, &list) == 0) {
+        LTRACEF("failed to allocate page\n");
+        return nullptr;
+    }
+
+    vm_page_t* page = list_remove_head_type(&list, vm_page_t, free.node);
+    if (pa) {
+        *pa = vm_page_to_paddr(page);
+    }
+
+    return page;
+}
+
+static size_t pmm_alloc_pages_locked(size_t count, uint alloc_flags, struct list_node* list) {
     /* walk the arenas in order, allocating as many pages as we can from each */
     size_t allocated = 0;
     for (auto& a : arena_list) {
@@ -158,16 +380,35 @@ size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
     return allocated;
 }
 
-size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
-    LTRACEF("address %#" PRIxPTR ", count %zu\n", address, count);
+size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
+    LTRACEF("count %zu\n", count);
+
+    /* list must be initialized prior to calling this */
+    DEBUG_ASSERT(list);
 
-    uint allocated = 0;
     if (count == 0)
         return 0;
 
-    address = ROUNDDOWN(address, PAGE_SIZE);
+    /* satisfy what we can from the local cache */
+    size_t allocated = page_cache_alloc(count, list);
+    if (allocated == count)
+        return allocated;
+
+    /* small requests refill the cache on the way through */
+    if (count - allocated <= kPageCacheBatch) {
+        allocated += page_cache_refill(count - allocated, list);
+        if (allocated == count)
+            return allocated;
+    }
 
     AutoLock al(&arena_lock);
+    allocated += pmm_alloc_pages_locked(count - allocated, alloc_flags, list);
+    return allocated;
+}
+
+static size_t pmm_alloc_range_locked(paddr_t address, size_t count, struct list_node* list)
+    TA_REQ(arena_lock) {
+    uint allocated = 0;
 
     /* walk through the arenas, looking to see if the physical page belongs to it */
     for (auto& a : arena_list) {
@@ -190,17 +431,33 @@ size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
     return allocated;
 }
 
-size_t pmm_alloc_contiguous(size_t count, uint alloc_flags, uint8_t alignment_log2, paddr_t* pa,
-                            struct list_node* list) {
-    LTRACEF("count %zu, align %u\n", count, alignment_log2);
+size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
+    LTRACEF("address %#" PRIxPTR ", count %zu\n", address, count);
 
     if (count == 0)
         return 0;
-    if (alignment_log2 < PAGE_SIZE_SHIFT)
-        alignment_log2 = PAGE_SIZE_SHIFT;
 
-    AutoLock al(&arena_lock);
+    address = ROUNDDOWN(address, PAGE_SIZE);
+
+    size_t allocated;
+    {
+        AutoLock al(&arena_lock);
+        allocated = pmm_alloc_range_locked(address, count, list);
+    }
+
+    /* some of the range may be parked in a page cache, flush them and try the rest again */
+    if (allocated < count) {
+        page_cache_drain_all();
+
+        AutoLock al(&arena_lock);
+        allocated += pmm_alloc_range_locked(address + allocated * PAGE_SIZE, count - allocated, list);
+    }
+
+    return allocated;
+}
 
+static size_t pmm_alloc_contiguous_locked(size_t count, uint alloc_flags, uint8_t alignment_log2,
+                                          paddr_t* pa, struct list_node* list) TA_REQ(arena_lock) {
     for (auto& a : arena_list) {
         /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
         if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
@@ -215,10 +472,44 @@ size_t pmm_alloc_contiguous(size_t count, uint alloc_flags, uint8_t alignment_lo
         }
     }
 
-    LTRACEF("couldn't find run\n");
     return 0;
 }
 
+size_t pmm_alloc_contiguous(size_t count, uint alloc_flags, uint8_t alignment_log2, paddr_t* pa,
+                            struct list_node* list) {
+    LTRACEF("count %zu, align %u\n", count, alignment_log2);
+
+    if (count == 0)
+        return 0;
+    if (alignment_log2 < PAGE_SIZE_SHIFT)
+        alignment_log2 = PAGE_SIZE_SHIFT;
+
+    {
+        AutoLock al(&arena_lock);
+        size_t allocated = pmm_alloc_contiguous_locked(count, alloc_flags, alignment_log2, pa, list);
+        if (allocated > 0)
+            return allocated;
+
+        /* pages held in the per cpu caches may be breaking up a run. Flushing them
+         * costs every cpu its cache, so don't do it more than once per interval no
+         * matter how many contiguous allocations are failing. */
+        lk_time_t now = current_time();
+        if (now - last_contiguous_drain < kPageCacheDrainInterval) {
+            LTRACEF("couldn't find run\n");
+            return 0;
+        }
+        last_contiguous_drain = now;
+    }
+
+    page_cache_drain_all();
+
+    AutoLock al(&arena_lock);
+    size_t allocated = pmm_alloc_contiguous_locked(count, alloc_flags, alignment_log2, pa, list);
+    if (allocated == 0)
+        LTRACEF("couldn't find run\n");
+    return allocated;
+}
+
 /* physically allocate a run from arenas marked as KMAP */
 void* pmm_alloc_kpages(size_t count, struct list_node* list, paddr_t* _pa) {
     LTRACEF("count %zu\n", count);
@@ -288,13 +579,7 @@ size_t pmm_free_kpages(void* _ptr, size_t count) {
     return pmm_free(&list);
 }
 
-size_t pmm_free(struct list_node* list) {
-    LTRACEF("list %p\n", list);
-
-    DEBUG_ASSERT(list);
-
-    AutoLock al(&arena_lock);
-
+static size_t pmm_free_locked(struct list_node* list) {
     uint count = 0;
     while (!list_is_empty(list)) {
         vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
@@ -310,7 +595,22 @@ size_t pmm_free(struct list_node* list) {
         }
     }
 
-    LTRACEF("returning count %u\n", count);
+    return count;
+}
+
+size_t pmm_free(struct list_node* list) {
+    LTRACEF("list %p\n", list);
+
+    DEBUG_ASSERT(list);
+
+    /* park what we can in the local cache, anything left over goes back to the arenas */
+    size_t count = page_cache_free(list);
+    if (!list_is_empty(list)) {
+        AutoLock al(&arena_lock);
+        count += pmm_free_locked(list);
+    }
+
+    LTRACEF("returning count %zu\n", count);
 
     return count;
 }
@@ -339,9 +639,27 @@ size_t pmm_count_free_pages() {
     for (const auto& a : arena_list) {
         free += a.free_count();
     }
+    /* cached pages are free as far as anyone outside the pmm is concerned */
+    for (const auto& cache : page_cache) {
+        free += cache.count;
+    }
     return free;
 }
 
+static void page_cache_dump() {
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        const pmm_page_cache& cache = page_cache[i];
+        uint64_t total = cache.hits + cache.misses;
+        if (total == 0 && cache.count == 0)
+            continue;
+
+        printf("cpu %u: cached %zu, hits %" PRIu64 " misses %" PRIu64 " (%" PRIu64 "%% hit), "
+               "refills %" PRIu64 " drains %" PRIu64 "\n",
+               i, cache.count, cache.hits, cache.misses,
+               total ? cache.hits * 100 / total : 0, cache.refills, cache.drains);
+    }
+}
+
 size_t pmm_count_total_bytes() TA_REQ(arena_lock) {
     return arena_cumulative_size;
 }
@@ -381,6 +699,8 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
             printf("%s dump_alloced\n", argv[0].str);
             printf("%s free_alloced\n", argv[0].str);
             printf("%s free\n", argv[0].str);
+            printf("%s cache\n", argv[0].str);
+            printf("%s drain_cache\n", argv[0].str);
         }
         return ERR_INTERNAL;
     }
@@ -486,6 +806,10 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
         while ((node = list_remove_head(&list))) {
             list_add_tail(&allocated, node);
         }
+    } else if (!strcmp(argv[1].str, "cache")) {
+        page_cache_dump();
+    } else if (!strcmp(argv[1].str, "drain_cache")) {
+        page_cache_drain_all();
     } else if (!strcmp(argv[1].str, "free_alloced")) {
         size_t err = pmm_free(&allocated);
         printf("pmm_free returns %zu\n", err);
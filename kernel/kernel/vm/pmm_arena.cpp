@@ -59,10 +59,15 @@ void PmmArena::BootAllocArray() {
 
     page_array_ = (vm_page_t*)raw_page_array;
 
+    /* only pages from KMAP arenas can satisfy any allocation out of a per cpu cache */
+    uint32_t page_flags = (info_.flags & PMM_ARENA_FLAG_KMAP) ? VM_PAGE_FLAG_PMM_CACHEABLE : 0;
+
     /* add them to the free list */
     for (size_t i = 0; i < page_count; i++) {
         auto& p = page_array_[i];
 
+        p.flags = page_flags;
+
         list_add_tail(&free_list_, &p.free.node);
     }
 
@@ -26,6 +26,8 @@ public:
 
 #if PMM_ENABLE_FREE_FILL
     void EnforceFill();
+    void FreeFill(vm_page_t* page);
+    void CheckFreeFill(vm_page_t* page);
 #endif
 
     void Dump(bool dump_pages, bool dump_free_ranges);
@@ -69,11 +71,6 @@ public:
     }
 
 private:
-#if PMM_ENABLE_FREE_FILL
-    void FreeFill(vm_page_t* page);
-    void CheckFreeFill(vm_page_t* page);
-#endif
-
     const pmm_arena_info_t info_;
     vm_page_t* page_array_ = nullptr;
 
@@ -7,10 +7,12 @@
 
 #include "vm_priv.h"
 #include <arch/mmu.h>
+#include <arch/ops.h>
 #include <assert.h>
 #include <debug.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
 #include <kernel/thread.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
@@ -19,6 +21,10 @@
 #include <string.h>
 #include <trace.h>
 
+#if ARCH_X86
+#include <arch/x86/mmu.h>
+#endif
+
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
 extern int _start;
@@ -37,6 +43,14 @@ extern int __bss_end;
 vm_page_t* zero_page;
 paddr_t zero_page_paddr;
 
+#define VM_FAULT_AROUND_DEFAULT_PAGES 16
+
+size_t vm_fault_around_pages = 1;
+
+bool vm_large_pages_enabled = false;
+int64_t vm_large_page_commits;
+int64_t vm_large_page_fallbacks;
+
 namespace {
 
 // mark the physical pages backing a range of virtual as in use.
@@ -238,6 +252,11 @@ void vm_init_postheap(uint level) {
             vaddr = next_kernel_region_end;
         }
     }
+
+    vm_fault_around_pages = vm_fault_around_round(
+        cmdline_get_uint32("vm.fault_around", VM_FAULT_AROUND_DEFAULT_PAGES));
+
+    vm_large_pages_enabled = (VM_LARGE_PAGE_SIZE != 0) && cmdline_get_bool("vm.large_pages", true);
 }
 
 void* paddr_to_kvaddr(paddr_t pa) {
@@ -288,6 +307,7 @@ static int cmd_vm(int argc, const cmd_args* argv, uint32_t flags) {
         printf("%s virt2phys <address>\n", argv[0].str);
         printf("%s map <phys> <virt> <count> <flags>\n", argv[0].str);
         printf("%s unmap <virt> <count>\n", argv[0].str);
+        printf("%s largepages\n", argv[0].str);
         return ERR_INTERNAL;
     }
 
@@ -347,6 +367,17 @@ static int cmd_vm(int argc, const cmd_args* argv, uint32_t flags) {
         size_t unmapped;
         auto err = arch_mmu_unmap(&aspace->arch_aspace(), argv[2].u, (uint)argv[3].u, &unmapped);
         printf("arch_mmu_unmap returns %d, unmapped %zu\n", err, unmapped);
+    } else if (!strcmp(argv[1].str, "largepages")) {
+        printf("large page size %#lx, %s\n", VM_LARGE_PAGE_SIZE,
+               vm_large_pages_enabled ? "enabled" : "disabled");
+        printf("\tfaults resolved with a large page %" PRId64 "\n",
+               atomic_load_64(&vm_large_page_commits));
+        printf("\tfaults that fell back to small pages %" PRId64 "\n",
+               atomic_load_64(&vm_large_page_fallbacks));
+#if ARCH_X86
+        printf("\tlive 2MB mappings %" PRId64 ", 1GB mappings %" PRId64 "\n",
+               x86_mmu_live_large_pages(PD_L), x86_mmu_live_large_pages(PDP_L));
+#endif
     } else {
         printf("unknown command\n");
         goto usage;
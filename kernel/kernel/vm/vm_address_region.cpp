@@ -160,10 +160,14 @@ status_t VmAddressRegion::CreateSubVmar(size_t offset, size_t size, uint8_t alig
     }
 
     // Check that only allowed flags have been set
-    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_CAN_MAP_SPECIFIC | VMAR_FLAG_COMPACT | VMAR_CAN_RWX_FLAGS)) {
+    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_CAN_MAP_SPECIFIC | VMAR_FLAG_COMPACT |
+                       VMAR_FLAG_COMMIT_AROUND | VMAR_CAN_RWX_FLAGS)) {
         return ERR_INVALID_ARGS;
     }
 
+    // fault-around hints apply to everything created inside a region
+    vmar_flags |= flags_ & VMAR_FLAG_COMMIT_AROUND;
+
     mxtl::RefPtr<VmAddressRegionOrMapping> res;
     status_t status = CreateSubVmarInternal(offset, size, align_pow2, vmar_flags, nullptr, 0,
                                             ARCH_MMU_FLAG_INVALID, name, &res);
@@ -183,9 +187,11 @@ status_t VmAddressRegion::CreateVmMapping(size_t mapping_offset, size_t size, ui
     LTRACEF("%p %#zx %#zx %x\n", this, mapping_offset, size, vmar_flags);
 
     // Check that only allowed flags have been set
-    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_SPECIFIC_OVERWRITE | VMAR_CAN_RWX_FLAGS)) {
+    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_SPECIFIC_OVERWRITE |
+                       VMAR_FLAG_COMMIT_AROUND | VMAR_CAN_RWX_FLAGS)) {
         return ERR_INVALID_ARGS;
     }
+    vmar_flags |= flags_ & VMAR_FLAG_COMMIT_AROUND;
 
     // Validate that arch_mmu_flags does not contain any prohibited flags
     if (!is_valid_mapping_flags(arch_mmu_flags)) {
@@ -324,7 +330,7 @@ size_t VmAddressRegion::AllocatedPagesLocked() const {
     return sum;
 }
 
-status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
+mxtl::RefPtr<VmMapping> VmAddressRegion::FindMappingLocked(vaddr_t va) {
     canary_.Assert();
     DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
 
@@ -332,10 +338,10 @@ status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
          auto next = vmar->FindRegionLocked(va);
          vmar = next->as_vm_address_region()) {
         if (next->is_mapping())
-            return next->PageFault(va, pf_flags);
+            return next->as_vm_mapping();
     }
 
-    return ERR_NOT_FOUND;
+    return nullptr;
 }
 
 bool VmAddressRegion::IsRangeAvailableLocked(vaddr_t base, size_t size) {
@@ -37,6 +37,9 @@ VmAspace* VmAspace::kernel_aspace_ = nullptr;
 // pointer to the dummy root VMAR singleton
 static VmAddressRegion* dummy_root_vmar = nullptr;
 
+// contention statistics for the page table locks of every aspace
+static mutex_class_t mmu_lock_class = MUTEX_CLASS_INITIAL_VALUE(mmu_lock_class, "aspace_mmu");
+
 // list of all address spaces
 static mutex_t aspace_list_lock = MUTEX_INITIAL_VALUE(aspace_list_lock);
 static mxtl::DoublyLinkedList<VmAspace*> aspaces;
@@ -122,6 +125,9 @@ VmAspace::VmAspace(vaddr_t base, size_t size, uint32_t flags, const char* name)
     DEBUG_ASSERT(size != 0);
     DEBUG_ASSERT(base + size - 1 >= base);
 
+    // only ever held for the length of a page table update
+    mutex_init_etc(&mmu_lock_, MUTEX_FLAG_ADAPTIVE, &mmu_lock_class);
+
     Rename(name);
 
     LTRACEF("%p '%s'\n", this, name_);
@@ -352,7 +358,11 @@ status_t VmAspace::ReserveSpace(const char* name, size_t size, vaddr_t vaddr) {
 
     // lookup how it's already mapped
     uint arch_mmu_flags = 0;
-    auto err = arch_mmu_query(&arch_aspace_, vaddr, nullptr, &arch_mmu_flags);
+    status_t err;
+    {
+        AutoLock a(&mmu_lock_);
+        err = arch_mmu_query(&arch_aspace_, vaddr, nullptr, &arch_mmu_flags);
+    }
     if (err) {
         // if it wasn't already mapped, use some sort of strict default
         arch_mmu_flags = ARCH_MMU_FLAG_CACHED | ARCH_MMU_FLAG_PERM_READ;
@@ -507,12 +517,51 @@ status_t VmAspace::PageFault(vaddr_t va, uint flags) {
     DEBUG_ASSERT(!aspace_destroyed_);
     LTRACEF("va %#" PRIxPTR ", flags %#x\n", va, flags);
 
-    // for now, hold the aspace lock across the page fault operation,
-    // which stops any other operations on the address space from moving
-    // the region out from underneath it
-    AutoLock a(&lock_);
+    // Only the lookup of the mapping needs the aspace lock.  The fault itself
+    // is serialized by the lock of the vmo being mapped, so faults on
+    // unrelated mappings can proceed in parallel.  Everything that moves,
+    // shrinks or destroys a mapping holds the vmo lock too, so once we have
+    // it we can check that the mapping still covers |va|, and look it up
+    // again if it doesn't.
+    //
+    // If the page has to come from a pager, the fault hands back a queued
+    // request instead of waiting under the vmo lock.  We wait for it with
+    // nothing held, since the mapping may change or go away in the meantime,
+    // and then start over from the lookup.
+    for (;;) {
+        PageSource::Request page_request;
+        status_t status;
+        {
+            mxtl::RefPtr<VmMapping> mapping;
+            mxtl::RefPtr<VmObject> vmo;
+            {
+                AutoLock a(&lock_);
+                if (aspace_destroyed_)
+                    return ERR_NOT_FOUND;
+                mapping = root_vmar_->FindMappingLocked(va);
+                if (!mapping)
+                    return ERR_NOT_FOUND;
+                vmo = mapping->vmo();
+            }
+
+            AutoLock al(vmo->lock());
+            if (unlikely(!mapping->IsFaultTargetLocked(vmo.get(), va))) {
+                LTRACEF("mapping %p changed before fault at va %#" PRIxPTR ", retrying\n",
+                        mapping.get(), va);
+                continue;
+            }
+            status = mapping->PageFaultLocked(va, flags, &page_request);
+        }
 
-    return root_vmar_->PageFault(va, flags);
+        if (likely(status != ERR_SHOULD_WAIT))
+            return status;
+
+        status = page_request.Wait();
+        if (status != NO_ERROR)
+            return status;
+
+        LTRACEF("page for fault at va %#" PRIxPTR " supplied, retrying\n", va);
+    }
 }
 
 void VmAspace::Dump(bool verbose) const {
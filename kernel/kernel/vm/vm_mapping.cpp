@@ -7,6 +7,7 @@
 #include <kernel/vm/vm_address_region.h>
 
 #include "vm_priv.h"
+#include <arch/ops.h>
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
@@ -117,8 +118,12 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
 
     // If we're changing the whole mapping, just make the change.
     if (base_ == base && size_ == size) {
-        status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
-                                           new_arch_mmu_flags);
+        status_t status;
+        {
+            AutoLock pt(aspace_->mmu_lock());
+            status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
+                                      new_arch_mmu_flags);
+        }
         LTRACEF("arch_mmu_protect returns %d\n", status);
         arch_mmu_flags_ = new_arch_mmu_flags;
         return NO_ERROR;
@@ -135,8 +140,12 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
             return ERR_NO_MEMORY;
         }
 
-        status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
-                                           new_arch_mmu_flags);
+        status_t status;
+        {
+            AutoLock pt(aspace_->mmu_lock());
+            status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
+                                      new_arch_mmu_flags);
+        }
         LTRACEF("arch_mmu_protect returns %d\n", status);
         arch_mmu_flags_ = new_arch_mmu_flags;
 
@@ -158,8 +167,12 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
             return ERR_NO_MEMORY;
         }
 
-        status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
-                                           new_arch_mmu_flags);
+        status_t status;
+        {
+            AutoLock pt(aspace_->mmu_lock());
+            status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
+                                      new_arch_mmu_flags);
+        }
         LTRACEF("arch_mmu_protect returns %d\n", status);
 
         size_ -= size;
@@ -187,8 +200,12 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
         return ERR_NO_MEMORY;
     }
 
-    status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
-                                       new_arch_mmu_flags);
+    status_t status;
+    {
+        AutoLock pt(aspace_->mmu_lock());
+        status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
+                                  new_arch_mmu_flags);
+    }
     LTRACEF("arch_mmu_protect returns %d\n", status);
 
     // Turn us into the left half
@@ -254,7 +271,11 @@ status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
     // Check if unmapping from one of the ends
     if (base_ == base || base + size == base_ + size_) {
         LTRACEF("unmapping base %#lx size %#zx\n", base, size);
-        status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), base, size / PAGE_SIZE, nullptr);
+        status_t status;
+        {
+            AutoLock pt(aspace_->mmu_lock());
+            status = arch_mmu_unmap(&aspace_->arch_aspace(), base, size / PAGE_SIZE, nullptr);
+        }
         if (status < 0) {
             return status;
         }
@@ -289,7 +310,11 @@ status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
 
     // Unmap the middle segment
     LTRACEF("unmapping base %#lx size %#zx\n", base, size);
-    status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), base, size / PAGE_SIZE, nullptr);
+    status_t status;
+    {
+        AutoLock pt(aspace_->mmu_lock());
+        status = arch_mmu_unmap(&aspace_->arch_aspace(), base, size / PAGE_SIZE, nullptr);
+    }
     if (status < 0) {
         return status;
     }
@@ -359,6 +384,7 @@ status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const {
     LTRACEF("going to unmap %#" PRIxPTR ", len %#" PRIx64 " aspace %p\n",
             unmap_base.ValueOrDie(), len_new, aspace_.get());
 
+    AutoLock pt(aspace_->mmu_lock());
     status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), unmap_base.ValueOrDie(),
                                      static_cast<size_t>(len_new) / PAGE_SIZE, nullptr);
     if (status < 0)
@@ -370,14 +396,8 @@ status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const {
 status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     canary_.Assert();
 
-    AutoLock guard(aspace_->lock());
-    if (state_ != LifeCycleState::ALIVE) {
-        return ERR_BAD_STATE;
-    }
-
     LTRACEF("region %p '%s', offset %#zx, size %#zx, commit %d\n", this, name_, offset, len, commit);
 
-    DEBUG_ASSERT(object_);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(offset));
     DEBUG_ASSERT(IS_PAGE_ALIGNED(len));
 
@@ -387,6 +407,38 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     if (commit)
         pf_flags |= VMM_PF_FLAG_SW_FAULT;
 
+    // iterate through the range, grabbing a page from the underlying object and
+    // mapping it in.  If a page has to come from a pager, drop every lock while
+    // waiting for it, then make sure the mapping still covers the range before
+    // carrying on from where we left off.
+    size_t o = offset;
+    while (o < offset + len) {
+        PageSource::Request page_request;
+        status_t status = TryMapRange(&o, offset + len, pf_flags, commit, &page_request);
+        if (status != ERR_SHOULD_WAIT)
+            return status;
+
+        status = page_request.Wait();
+        if (status != NO_ERROR)
+            return status;
+    }
+
+    return NO_ERROR;
+}
+
+status_t VmMapping::TryMapRange(size_t* offset, size_t end, uint pf_flags, bool commit,
+                                PageSource::Request* page_request) {
+    AutoLock guard(aspace_->lock());
+    if (state_ != LifeCycleState::ALIVE) {
+        return ERR_BAD_STATE;
+    }
+    if (end > size_) {
+        // shrunk while we were waiting on a pager
+        return ERR_BAD_STATE;
+    }
+
+    DEBUG_ASSERT(object_);
+
     // grab the lock for the vmo
     AutoLock al(object_->lock());
 
@@ -395,15 +447,17 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     currently_faulting_ = true;
     auto ac = mxtl::MakeAutoCall([&]() { currently_faulting_ = false; });
 
-    // iterate through the range, grabbing a page from the underlying object and
-    // mapping it in
-    size_t o;
-    for (o = offset; o < offset + len; o += PAGE_SIZE) {
+    size_t& o = *offset;
+    for (; o < end; o += PAGE_SIZE) {
         uint64_t vmo_offset = object_offset_ + o;
 
         status_t status;
         paddr_t pa;
-        status = object_->GetPageLocked(vmo_offset, pf_flags, nullptr, &pa);
+        status = object_->GetPageLocked(vmo_offset, pf_flags, nullptr, &pa, page_request);
+        if (status == ERR_SHOULD_WAIT) {
+            // |o| is left at this page so the caller retries it
+            return status;
+        }
         if (status < 0) {
             // no page to map
             if (commit) {
@@ -419,7 +473,11 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
         LTRACEF_LEVEL(2, "mapping pa %#" PRIxPTR " to va %#" PRIxPTR "\n", pa, va);
 
         size_t mapped;
-        auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, pa, 1, arch_mmu_flags_, &mapped);
+        status_t ret;
+        {
+            AutoLock pt(aspace_->mmu_lock());
+            ret = arch_mmu_map(&aspace_->arch_aspace(), va, pa, 1, arch_mmu_flags_, &mapped);
+        }
         if (ret < 0) {
             TRACEF("error %d mapping page at va %#" PRIxPTR " pa %#" PRIxPTR "\n", ret, va, pa);
         }
@@ -448,6 +506,40 @@ status_t VmMapping::DecommitRange(size_t offset, size_t len,
     return object_->DecommitRange(object_offset_ + offset, len, decommitted);
 }
 
+status_t VmMapping::TakePages(vaddr_t va, size_t len, VmPageList* pages) {
+    canary_.Assert();
+    LTRACEF("%p '%s' [%#zx+%#zx], va %#" PRIxPTR ", len %#zx\n",
+            this, name_, base_, size_, va, len);
+
+    AutoLock guard(aspace_->lock());
+    if (state_ != LifeCycleState::ALIVE || !object_) {
+        return ERR_BAD_STATE;
+    }
+    if (va < base_ || len > size_ || va - base_ > size_ - len) {
+        return ERR_OUT_OF_RANGE;
+    }
+    if (!(arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_WRITE)) {
+        return ERR_ACCESS_DENIED;
+    }
+    // Like DecommitRange, this calls back into UnmapVmoRangeLocked.
+    return object_->TakePages(object_offset_ + (va - base_), len, pages);
+}
+
+void VmMapping::ReturnPages(vaddr_t va, size_t len, VmPageList* pages) {
+    canary_.Assert();
+    LTRACEF("%p '%s' [%#zx+%#zx], va %#" PRIxPTR ", len %#zx\n",
+            this, name_, base_, size_, va, len);
+
+    AutoLock guard(aspace_->lock());
+    if (state_ != LifeCycleState::ALIVE || !object_) {
+        return;
+    }
+    if (va < base_ || len > size_ || va - base_ > size_ - len) {
+        return;
+    }
+    object_->ReturnPages(object_offset_ + (va - base_), len, pages);
+}
+
 status_t VmMapping::DestroyLocked() {
     canary_.Assert();
     DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
@@ -467,15 +559,16 @@ status_t VmMapping::DestroyLocked() {
     // Unmap should have reset our size to 0
     DEBUG_ASSERT(size_ == 0);
 
-    // grab the object lock and remove ourself from its list
+    // grab the object lock, remove ourself from its list and detach from
+    // it.  Page faults look at object_ with only the object lock held, so it
+    // has to be cleared under that lock.
+    mxtl::RefPtr<VmObject> object;
     {
         AutoLock al(object_->lock());
         object_->RemoveMappingLocked(this);
+        object = mxtl::move(object_);
     }
 
-    // detach from any object we have mapped
-    object_.reset();
-
     // Detach the now dead region from the parent
     if (parent_) {
         DEBUG_ASSERT(subregion_list_node_.InContainer());
@@ -488,9 +581,18 @@ status_t VmMapping::DestroyLocked() {
     return NO_ERROR;
 }
 
-status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
+bool VmMapping::IsFaultTargetLocked(const VmObject* vmo, vaddr_t va) const TA_NO_THREAD_SAFETY_ANALYSIS {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+
+    // a destroyed mapping has dropped its object, and a shrunk or moved one
+    // no longer covers |va|
+    return object_.get() == vmo && va >= base_ && va - base_ < size_;
+}
+
+status_t VmMapping::PageFaultLocked(vaddr_t va, const uint pf_flags,
+                                    PageSource::Request* page_request) TA_NO_THREAD_SAFETY_ANALYSIS {
+    canary_.Assert();
+    DEBUG_ASSERT(object_->lock()->IsHeld());
 
     DEBUG_ASSERT(va >= base_ && va <= base_ + size_ - 1);
 
@@ -519,9 +621,6 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         return ERR_ACCESS_DENIED;
     }
 
-    // grab the lock for the vmo
-    AutoLock al(object_->lock());
-
     // set the currently faulting flag for any recursive calls the vmo may make back into us
     // The specific path we're avoiding is if the VMO calls back into us during vmo->GetPageLocked()
     // via UnmapVmoRangeLocked(). Since we're responsible for that page, signal to ourself to skip
@@ -530,10 +629,19 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     currently_faulting_ = true;
     auto ac = mxtl::MakeAutoCall([&]() { currently_faulting_ = false; });
 
+    // if we write faulted on untouched anonymous memory, try to back the
+    // whole large page around it in one go
+    if ((pf_flags & VMM_PF_FLAG_WRITE) && FaultLargePageLocked(va, arch_mmu_flags_))
+        return NO_ERROR;
+
     // fault in or grab an existing page
     paddr_t new_pa;
     vm_page_t* page;
-    status_t status = object_->GetPageLocked(vmo_offset, pf_flags, &page, &new_pa);
+    status_t status = object_->GetPageLocked(vmo_offset, pf_flags, &page, &new_pa, page_request);
+    if (status == ERR_SHOULD_WAIT) {
+        LTRACEF("waiting on the pager for vmo_offset %#" PRIx64 "\n", vmo_offset);
+        return status;
+    }
     if (status < 0) {
         TRACEF("ERROR: failed to fault in or grab existing page\n");
         TRACEF("%p '%s', vmo_offset %#" PRIx64 ", pf_flags %#x\n", this, name_, vmo_offset, pf_flags);
@@ -549,6 +657,10 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
     }
 
+    // the rest of this only touches the page tables, and anything else that
+    // changes them for this address holds the vmo lock too
+    AutoLock pt(aspace_->mmu_lock());
+
     // see if something is mapped here now
     // this may happen if we are one of multiple threads racing on a single address
     uint page_flags;
@@ -614,6 +726,12 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
             return ERR_NO_MEMORY;
         }
         DEBUG_ASSERT(mapped == 1);
+
+        // a fault on an unmapped page is usually followed by faults on its
+        // neighbours, so take care of them now while we hold the vmo lock.
+        // That may commit pages, which can call back into UnmapVmoRangeLocked().
+        pt.release();
+        FaultAroundLocked(va, pf_flags, mmu_flags);
     }
 
 // TODO: figure out what to do with this
@@ -624,6 +742,162 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     return NO_ERROR;
 }
 
+bool VmMapping::FaultLargePageLocked(vaddr_t va, uint mmu_flags) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+
+    if (!vm_large_pages_enabled)
+        return false;
+
+    // the large page has to lie entirely within the mapping, and line up
+    // with a large page aligned offset in the vmo
+    const vaddr_t large_va = ROUNDDOWN(va, VM_LARGE_PAGE_SIZE);
+    if (large_va < base_ || large_va + (VM_LARGE_PAGE_SIZE - 1) > base_ + size_ - 1)
+        return false;
+    const uint64_t large_offset = large_va - base_ + object_offset_;
+    if (!IS_ALIGNED(large_offset, VM_LARGE_PAGE_SIZE))
+        return false;
+    // only plain cached memory
+    if ((mmu_flags & ARCH_MMU_FLAG_CACHE_MASK) != ARCH_MMU_FLAG_CACHED)
+        return false;
+
+    paddr_t pa;
+    status_t status = object_->CommitLargePageLocked(large_offset, &pa);
+    if (status != NO_ERROR) {
+        if (status == ERR_NO_MEMORY)
+            atomic_add_64(&vm_large_page_fallbacks, 1);
+        return false;
+    }
+
+    // we may have the zero page mapped in some of the range from earlier
+    // read faults; clear it out so the arch layer can install a single entry
+    const size_t count = VM_LARGE_PAGE_SIZE / PAGE_SIZE;
+    AutoLock pt(aspace_->mmu_lock());
+    status = arch_mmu_unmap(&aspace_->arch_aspace(), large_va, count, nullptr);
+    if (status < 0) {
+        TRACEF("error %d unmapping large page range at va %#" PRIxPTR "\n", status, large_va);
+        return false;
+    }
+
+    size_t mapped;
+    status = arch_mmu_map(&aspace_->arch_aspace(), large_va, pa, count, mmu_flags, &mapped);
+    if (status < 0) {
+        // the pages are committed, so the usual path can still map them one at a time
+        TRACEF("error %d mapping large page at va %#" PRIxPTR "\n", status, large_va);
+        return false;
+    }
+    DEBUG_ASSERT(mapped == count);
+
+    LTRACEF("mapped large page pa %#" PRIxPTR " at va %#" PRIxPTR "\n", pa, large_va);
+    atomic_add_64(&vm_large_page_commits, 1);
+
+#if ARCH_ARM64
+    if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
+        arch_sync_cache_range(large_va, VM_LARGE_PAGE_SIZE);
+#endif
+    return true;
+}
+
+void VmMapping::FaultAroundLocked(vaddr_t va, uint pf_flags, uint mmu_flags) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+    const VmObject* const vmo = object_.get();
+
+    // the vmo may know better than the system default how it's going to be touched
+    const size_t pages = object_->FaultAroundPagesLocked();
+    const size_t window = (pages ? pages : vm_fault_around_pages) * PAGE_SIZE;
+    if (window <= PAGE_SIZE)
+        return;
+
+    // Only commit missing pages if asked to, and never when that could mean
+    // waiting on a pager.  Otherwise just look up pages that are already
+    // there; those may belong to a parent vmo, so they must not be mapped
+    // writable or we would lose copy-on-write.
+    const bool commit = (flags_ & VMAR_FLAG_COMMIT_AROUND) && (pf_flags & VMM_PF_FLAG_WRITE) &&
+                        !object_->IsPagerBacked();
+    const uint around_pf_flags = commit ? (VMM_PF_FLAG_WRITE | VMM_PF_FLAG_SW_FAULT) : 0;
+    const uint around_mmu_flags = commit ? mmu_flags : (mmu_flags & ~ARCH_MMU_FLAG_PERM_WRITE);
+
+    // clip the naturally aligned window to the mapping
+    const vaddr_t window_base = ROUNDDOWN(va, window);
+    const vaddr_t first = MAX(window_base, base_);
+    const vaddr_t last = MIN(window_base + (window - 1), base_ + size_ - 1);
+    const size_t count = (last - first) / PAGE_SIZE + 1;
+
+    // map physically contiguous runs of pages with one arch_mmu_map() each
+    vaddr_t run_va = 0;
+    paddr_t run_pa = 0;
+    size_t run_len = 0;
+    auto map_run = [&]() {
+        if (run_len == 0)
+            return;
+        LTRACEF_LEVEL(2, "mapping %zu pages at pa %#" PRIxPTR " to va %#" PRIxPTR "\n",
+                      run_len, run_pa, run_va);
+        size_t mapped;
+        status_t status;
+        {
+            AutoLock pt(aspace_->mmu_lock());
+            status = arch_mmu_map(&aspace_->arch_aspace(), run_va, run_pa, run_len,
+                                  around_mmu_flags, &mapped);
+        }
+        if (status < 0) {
+            TRACEF("error %d mapping %zu pages at va %#" PRIxPTR "\n", status, run_len, run_va);
+        }
+#if ARCH_ARM64
+        if (status >= 0 && (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE))
+            arch_sync_cache_range(run_va, run_len * PAGE_SIZE);
+#endif
+        run_len = 0;
+    };
+
+    for (size_t i = 0; i < count; i++) {
+        vaddr_t cur = first + i * PAGE_SIZE;
+        if (cur == va) {
+            map_run();
+            continue;
+        }
+
+        // leave alone anything that is already mapped
+        paddr_t pa;
+        uint page_flags;
+        status_t query;
+        {
+            AutoLock pt(aspace_->mmu_lock());
+            query = arch_mmu_query(&aspace_->arch_aspace(), cur, &pa, &page_flags);
+        }
+        if (query >= 0) {
+            map_run();
+            continue;
+        }
+
+        // there is no request to hand back from here, but we never ask a
+        // pager-backed vmo to fault pages in
+        status_t status = object_->GetPageLocked(cur - base_ + object_offset_, around_pf_flags,
+                                                 nullptr, &pa, nullptr);
+        if (unlikely(!IsFaultTargetLocked(vmo, cur))) {
+            // the mapping changed under us after all; what we mapped so far was valid
+            run_len = 0;
+            break;
+        }
+        if (status == ERR_NO_MEMORY) {
+            // no point carrying on, the faulting page is all that's needed
+            break;
+        } else if (status < 0) {
+            map_run();
+            continue;
+        }
+
+        if (run_len > 0 && cur == run_va + run_len * PAGE_SIZE &&
+            pa == run_pa + run_len * PAGE_SIZE) {
+            run_len++;
+        } else {
+            map_run();
+            run_va = cur;
+            run_pa = pa;
+            run_len = 1;
+        }
+    }
+    map_run();
+}
+
 // We disable thread safety analysis here because one of the common uses of this
 // function is for splitting one mapping object into several that will be backed
 // by the same VmObject.  In that case, object_->lock() gets aliased across all
@@ -65,6 +65,18 @@ void VmObject::RemoveMappingLocked(VmMapping* r) {
     mapping_list_.erase(*r);
 }
 
+void VmObject::SetFaultAroundPages(uint32_t pages) {
+    canary_.Assert();
+    AutoLock a(&lock_);
+    fault_around_pages_ = pages ? vm_fault_around_round(pages) : 0;
+}
+
+uint32_t VmObject::GetFaultAroundPages() {
+    canary_.Assert();
+    AutoLock a(&lock_);
+    return fault_around_pages_;
+}
+
 void VmObject::AddChildLocked(VmObject* o) {
     canary_.Assert();
     DEBUG_ASSERT(lock_.IsHeld());
@@ -75,6 +87,8 @@ void VmObject::RemoveChildLocked(VmObject* o) {
     canary_.Assert();
     DEBUG_ASSERT(lock_.IsHeld());
     children_list_.erase(*o);
+    if (children_list_.is_empty())
+        OnZeroChildrenLocked();
 }
 
 void VmObject::RangeChangeUpdateLocked(uint64_t offset, uint64_t len) {
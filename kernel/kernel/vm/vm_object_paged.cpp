@@ -41,8 +41,10 @@ void ZeroPage(vm_page_t* p) {
 
 } // namespace
 
-VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObject> parent)
-    : VmObject(mxtl::move(parent)), pmm_alloc_flags_(pmm_alloc_flags) {
+VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObject> parent,
+                             mxtl::RefPtr<PageSource> page_source)
+    : VmObject(mxtl::move(parent)), pmm_alloc_flags_(pmm_alloc_flags),
+      page_source_(mxtl::move(page_source)) {
     LTRACEF("%p\n", this);
 }
 
@@ -61,7 +63,7 @@ mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t
         return nullptr;
 
     AllocChecker ac;
-    auto vmo = mxtl::AdoptRef<VmObject>(new (&ac) VmObjectPaged(pmm_alloc_flags, nullptr));
+    auto vmo = mxtl::AdoptRef<VmObject>(new (&ac) VmObjectPaged(pmm_alloc_flags, nullptr, nullptr));
     if (!ac.check())
         return nullptr;
 
@@ -76,13 +78,38 @@ mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t
     return vmo;
 }
 
+mxtl::RefPtr<VmObject> VmObjectPaged::CreatePagerBacked(uint32_t pmm_alloc_flags, uint64_t size,
+                                                        mxtl::RefPtr<PageSource> source) {
+    DEBUG_ASSERT(source);
+
+    // there's a max size to keep indexes within range
+    if (size > MAX_SIZE)
+        return nullptr;
+
+    AllocChecker ac;
+    auto vmo = mxtl::AdoptRef<VmObjectPaged>(
+        new (&ac) VmObjectPaged(pmm_alloc_flags, nullptr, mxtl::move(source)));
+    if (!ac.check())
+        return nullptr;
+
+    // pager-backed vmos can't be resized through Resize(), so set the size directly
+    {
+        AutoLock a(&vmo->lock_);
+        status_t err = vmo->ResizeLocked(size);
+        if (err != NO_ERROR)
+            return nullptr;
+    }
+
+    return vmo;
+}
+
 status_t VmObjectPaged::CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<VmObject>* clone_vmo) {
     LTRACEF("vmo %p offset %#" PRIx64 " size %#" PRIx64 "\n", this, offset, size);
 
     canary_.Assert();
 
     AllocChecker ac;
-    auto vmo = mxtl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(pmm_alloc_flags_, mxtl::WrapRefPtr(this)));
+    auto vmo = mxtl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(pmm_alloc_flags_, mxtl::WrapRefPtr(this), nullptr));
     if (!ac.check())
         return ERR_NO_MEMORY;
 
@@ -101,11 +128,21 @@ status_t VmObjectPaged::CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<Vm
     if (status != NO_ERROR)
         return status;
 
+    clone_count_++;
+
     *clone_vmo = mxtl::move(vmo);
 
     return NO_ERROR;
 }
 
+void VmObjectPaged::OnZeroChildrenLocked() {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    if (page_source_)
+        page_source_->OnZeroChildren(clone_count_);
+}
+
 void VmObjectPaged::Dump(uint depth, bool verbose) {
     canary_.Assert();
 
@@ -137,14 +174,7 @@ size_t VmObjectPaged::AllocatedPagesInRange(uint64_t offset, uint64_t len) const
     if (!TrimRange(offset, len, size_, &new_len)) {
         return 0;
     }
-    size_t count = 0;
-    page_list_.ForEveryPage(
-        [&count, offset, new_len](const auto p, uint64_t off) {
-            if (off >= offset && off < offset + new_len) {
-                count++;
-            }
-        });
-    return count;
+    return page_list_.CountPagesInRange(offset, offset + new_len);
 }
 
 status_t VmObjectPaged::AddPage(vm_page_t* p, uint64_t offset) {
@@ -223,7 +253,8 @@ mxtl::RefPtr<VmObject> VmObjectPaged::CreateFromROData(const void* data, size_t
     return vmo;
 }
 
-status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t** const page_out, paddr_t* const pa_out) {
+status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t** const page_out,
+                                      paddr_t* const pa_out, PageSource::Request* page_request) {
     canary_.Assert();
     DEBUG_ASSERT(lock_.IsHeld());
 
@@ -253,10 +284,20 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
         parent_offset += offset;
         DEBUG_ASSERT(parent_offset.IsValid());
 
-        // make sure we don't cause the parent to fault in new pages, just ask for any that already exist
+        // make sure we don't cause the parent to fault in new pages, just ask for any that already exist.
+        // the exception is a pager-backed parent: its missing pages aren't zero, so have it fetch
+        // them for reading, then copy below if need be.
+        const bool parent_pager_backed = parent_->IsPagerBacked();
         uint parent_pf_flags = pf_flags & ~(VMM_PF_FLAG_FAULT_MASK);
+        if (parent_pager_backed)
+            parent_pf_flags = pf_flags & ~VMM_PF_FLAG_WRITE;
 
-        status_t status = parent_->GetPageLocked(parent_offset.ValueOrDie(), parent_pf_flags, &p, &pa);
+        status_t status = parent_->GetPageLocked(parent_offset.ValueOrDie(), parent_pf_flags, &p, &pa,
+                                                 page_request);
+        if (status != NO_ERROR && status != ERR_OUT_OF_RANGE && parent_pager_backed) {
+            // the pager couldn't provide the page, don't paper over that with a zero page
+            return status;
+        }
         if (status == NO_ERROR) {
             // we have a page from them. if we're read-only faulting, return that page so they can map
             // or read from it directly
@@ -307,6 +348,16 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
     if ((pf_flags & VMM_PF_FLAG_FAULT_MASK) == 0)
         return ERR_NOT_FOUND;
 
+    // pages of a pager-backed vmo only ever come from the pager. the caller does the
+    // waiting, once it has unwound and dropped its locks
+    if (page_source_) {
+        DEBUG_ASSERT(page_request);
+        if (!page_request)
+            return ERR_NOT_SUPPORTED;
+        page_source_->QueueRequest(page_request, offset);
+        return ERR_SHOULD_WAIT;
+    }
+
     // if we're read faulting, we don't already have a page, and the parent doesn't have it,
     // return the single global zero page
     if ((pf_flags & VMM_PF_FLAG_WRITE) == 0) {
@@ -344,6 +395,139 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
     return NO_ERROR;
 }
 
+status_t VmObjectPaged::CommitLargePageLocked(uint64_t offset, paddr_t* pa_out) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    // pages of clones and pager-backed vmos have to come from somewhere else
+    if (VM_LARGE_PAGE_SIZE == 0 || parent_ || page_source_)
+        return ERR_NOT_SUPPORTED;
+
+    DEBUG_ASSERT(IS_ALIGNED(offset, VM_LARGE_PAGE_SIZE));
+    if (!InRange(offset, static_cast<uint64_t>(VM_LARGE_PAGE_SIZE), size_))
+        return ERR_OUT_OF_RANGE;
+
+    const uint64_t end = offset + VM_LARGE_PAGE_SIZE;
+    if (page_list_.AnyPagesInRange(offset, end))
+        return ERR_ALREADY_EXISTS;
+
+    list_node page_list;
+    list_initialize(&page_list);
+
+    paddr_t pa;
+    const size_t count = VM_LARGE_PAGE_SIZE / PAGE_SIZE;
+    size_t allocated = pmm_alloc_contiguous(count, pmm_alloc_flags_, VM_LARGE_PAGE_SHIFT, &pa,
+                                            &page_list);
+    if (allocated < count) {
+        LTRACEF("no contiguous run for a large page at offset %#" PRIx64 "\n", offset);
+        pmm_free(&page_list);
+        return ERR_NO_MEMORY;
+    }
+
+    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
+        vm_page_t* p = list_remove_head_type(&page_list, vm_page_t, free.node);
+        ASSERT(p);
+
+        p->state = VM_PAGE_STATE_OBJECT;
+
+        // TODO: remove once pmm returns zeroed pages
+        ZeroPage(p);
+
+        status_t status = page_list_.AddPage(p, o);
+        if (status != NO_ERROR) {
+            // give back what we've added so far, along with the rest of the run
+            list_add_head(&page_list, &p->free.node);
+            for (uint64_t undo = offset; undo < o; undo += PAGE_SIZE) {
+                vm_page_t* added = page_list_.RemovePage(undo);
+                list_add_tail(&page_list, &added->free.node);
+            }
+            pmm_free(&page_list);
+            return status;
+        }
+    }
+
+    // other mappings may have the zero page mapped in this range
+    RangeChangeUpdateLocked(offset, VM_LARGE_PAGE_SIZE);
+
+    LTRACEF("committed large page at offset %#" PRIx64 ", pa %#" PRIxPTR "\n", offset, pa);
+
+    *pa_out = pa;
+    return NO_ERROR;
+}
+
+bool VmObjectPaged::IsPagerBacked() const {
+    return page_source_ || (parent_ && parent_->IsPagerBacked());
+}
+
+status_t VmObjectPaged::SupplyPagesUser(uint64_t offset, uint64_t len,
+                                        user_ptr<const void> data) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    if (!page_source_)
+        return ERR_NOT_SUPPORTED;
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len))
+        return ERR_INVALID_ARGS;
+
+    uint32_t pmm_alloc_flags;
+    {
+        AutoLock a(&lock_);
+        uint64_t new_len;
+        if (!TrimRange(offset, len, size_, &new_len) || new_len != len)
+            return ERR_OUT_OF_RANGE;
+        pmm_alloc_flags = pmm_alloc_flags_;
+    }
+
+    auto src = data.reinterpret<const uint8_t>();
+    status_t status = NO_ERROR;
+    uint64_t supplied = 0;
+    for (; supplied < len; supplied += PAGE_SIZE) {
+        paddr_t pa;
+        vm_page_t* p = pmm_alloc_page(pmm_alloc_flags, &pa);
+        if (!p) {
+            status = ERR_NO_MEMORY;
+            break;
+        }
+
+        // fill the page before taking the lock, the user buffer may need to be faulted in
+        status = src.copy_array_from_user(static_cast<uint8_t*>(paddr_to_kvaddr(pa)), PAGE_SIZE,
+                                          supplied);
+        if (status != NO_ERROR) {
+            pmm_free_page(p);
+            break;
+        }
+
+        AutoLock a(&lock_);
+        if (page_list_.GetPage(offset + supplied)) {
+            // already supplied, the first copy wins
+            pmm_free_page(p);
+            continue;
+        }
+        p->state = VM_PAGE_STATE_OBJECT;
+        status = AddPageLocked(p, offset + supplied);
+        DEBUG_ASSERT(status == NO_ERROR);
+    }
+
+    // wake up whoever was waiting on the pages we did manage to supply
+    if (supplied > 0)
+        page_source_->CompleteRange(offset, supplied, NO_ERROR);
+
+    return status;
+}
+
+status_t VmObjectPaged::FailPageRequests(uint64_t offset, uint64_t len, status_t error) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 ", error %d\n", offset, len, error);
+
+    if (!page_source_)
+        return ERR_NOT_SUPPORTED;
+    if (error >= 0)
+        return ERR_INVALID_ARGS;
+
+    page_source_->CompleteRange(offset, len, error);
+    return NO_ERROR;
+}
+
 status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* committed) {
     canary_.Assert();
     LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
@@ -351,6 +535,10 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     if (committed)
         *committed = 0;
 
+    // committing would fill the range with zero pages the pager never provided
+    if (page_source_)
+        return ERR_NOT_SUPPORTED;
+
     AutoLock a(&lock_);
 
     // trim the size
@@ -362,16 +550,13 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     if (new_len == 0)
         return NO_ERROR;
 
-    // compute a page aligned end to do our searches in to make sure we cover all the pages
+    // compute a page aligned range to do our searches in to make sure we cover all the pages
+    uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
     uint64_t end = ROUNDUP_PAGE_SIZE(offset + new_len);
     DEBUG_ASSERT(end > offset);
 
-    // make a pass through the list, counting the number of pages we need to allocate
-    size_t count = 0;
-    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
-        if (!page_list_.GetPage(o))
-            count++;
-    }
+    // count the number of pages we need to allocate
+    size_t count = (end - start) / PAGE_SIZE - page_list_.CountPagesInRange(start, end);
     if (count == 0)
         return NO_ERROR;
 
@@ -389,25 +574,20 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     // unmap all of the pages in this range on all the mapping regions
     RangeChangeUpdateLocked(offset, end - offset);
 
-    // add them to the appropriate range of the object
-    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
-        vm_page_t* p = page_list_.GetPage(o);
-        if (p)
-            continue;
-
-        p = list_remove_head_type(&page_list, vm_page_t, free.node);
-        ASSERT(p);
-
+    // add them to the holes in the range of the object
+    status_t status = page_list_.AddPages(&page_list, start, end, [&](vm_page_t* p, uint64_t o) {
         p->state = VM_PAGE_STATE_OBJECT;
 
         // TODO: remove once pmm returns zeroed pages
         ZeroPage(p);
 
-        status_t status = page_list_.AddPage(p, o);
-        DEBUG_ASSERT(status == NO_ERROR);
-
         if (committed)
             *committed += PAGE_SIZE;
+    });
+    if (status != NO_ERROR) {
+        // the pages that made it in stay committed
+        pmm_free(&page_list);
+        return status;
     }
 
     DEBUG_ASSERT(list_is_empty(&page_list));
@@ -426,6 +606,9 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
     if (committed)
         *committed = 0;
 
+    if (page_source_)
+        return ERR_NOT_SUPPORTED;
+
     AutoLock a(&lock_);
 
     // trim the size
@@ -437,16 +620,13 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
     if (new_len == 0)
         return NO_ERROR;
 
-    // compute a page aligned end to do our searches in to make sure we cover all the pages
+    // compute a page aligned range to do our searches in to make sure we cover all the pages
+    uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
     uint64_t end = ROUNDUP_PAGE_SIZE(offset + new_len);
     DEBUG_ASSERT(end > offset);
 
-    // make a pass through the list, making sure we have an empty run on the object
-    size_t count = 0;
-    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
-        if (!page_list_.GetPage(o))
-            count++;
-    }
+    // make sure we have an empty run on the object
+    size_t count = (end - start) / PAGE_SIZE - page_list_.CountPagesInRange(start, end);
 
     DEBUG_ASSERT(count == new_len / PAGE_SIZE);
 
@@ -466,21 +646,19 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
     // unmap all of the pages in this range on all the mapping regions
     RangeChangeUpdateLocked(offset, end - offset);
 
-    // add them to the appropriate range of the object
-    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
-        vm_page_t* p = list_remove_head_type(&page_list, vm_page_t, free.node);
-        ASSERT(p);
-
+    // add them to the appropriate range of the object, in order
+    status_t status = page_list_.AddPages(&page_list, start, end, [&](vm_page_t* p, uint64_t o) {
         p->state = VM_PAGE_STATE_OBJECT;
 
         // TODO: remove once pmm returns zeroed pages
         ZeroPage(p);
 
-        auto status = page_list_.AddPage(p, o);
-        DEBUG_ASSERT(status == NO_ERROR);
-
         if (committed)
             *committed += PAGE_SIZE;
+    });
+    if (status != NO_ERROR) {
+        pmm_free(&page_list);
+        return status;
     }
 
     // for now we only support committing as much as we were asked for
@@ -496,6 +674,11 @@ status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t* d
     if (decommitted)
         *decommitted = 0;
 
+    // the pager keeps track of which pages it has provided and won't expect to
+    // be asked for them again
+    if (page_source_)
+        return ERR_NOT_SUPPORTED;
+
     AutoLock a(&lock_);
 
     // trim the size
@@ -520,18 +703,91 @@ status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t* d
     // unmap all of the pages in this range on all the mapping regions
     RangeChangeUpdateLocked(start, page_aligned_len);
 
-    // iterate through the pages, freeing them
-    while (start < end) {
-        auto status = page_list_.FreePage(start);
-        if (status == NO_ERROR && decommitted) {
-            *decommitted += PAGE_SIZE;
+    // free the pages that are present in the range
+    size_t freed = page_list_.FreePages(start, end);
+    if (decommitted)
+        *decommitted = freed * PAGE_SIZE;
+
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::TakePages(uint64_t offset, uint64_t len, VmPageList* pages) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len) || len == 0)
+        return ERR_INVALID_ARGS;
+
+    // pager backed objects would have to be asked for the pages again, and
+    // children may still be looking through us at the pages being taken
+    if (page_source_)
+        return ERR_NOT_SUPPORTED;
+
+    AutoLock a(&lock_);
+
+    if (!children_list_.is_empty())
+        return ERR_NOT_SUPPORTED;
+
+    if (offset > size_ || len > size_ - offset)
+        return ERR_OUT_OF_RANGE;
+    uint64_t end = offset + len;
+
+    // only hand out pages we actually own; anything else would need to be
+    // faulted in or copied first, and the caller can just copy instead
+    if (page_list_.CountPagesInRange(offset, end) != len / PAGE_SIZE)
+        return ERR_NOT_FOUND;
+
+    // link the pages into |pages| first, while they are still ours, so that
+    // running out of memory for its nodes leaves everything as it was
+    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
+        status_t status = pages->AddPage(page_list_.GetPage(o), o - offset);
+        if (status != NO_ERROR) {
+            for (uint64_t undo = offset; undo < o; undo += PAGE_SIZE)
+                pages->RemovePage(undo - offset);
+            return status;
         }
-        start += PAGE_SIZE;
     }
 
+    // unmap all of the pages in this range on all the mapping regions
+    RangeChangeUpdateLocked(offset, len);
+
+    // now drop them from our list, which can't fail
+    __UNUSED size_t removed = page_list_.RemovePages([](vm_page_t*, uint64_t) {}, offset, end);
+    DEBUG_ASSERT(removed == len / PAGE_SIZE);
+
     return NO_ERROR;
 }
 
+void VmObjectPaged::ReturnPages(uint64_t offset, uint64_t len, VmPageList* pages) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset) && IS_PAGE_ALIGNED(len));
+
+    list_node freed;
+    list_initialize(&freed);
+
+    AutoLock a(&lock_);
+
+    // the pages can go back into any slot that is still empty. a slot that
+    // was faulted in again since holds newer contents than the page we have.
+    for (uint64_t o = 0; o < len; o += PAGE_SIZE) {
+        vm_page_t* p = pages->RemovePage(o);
+        if (!p)
+            continue;
+        uint64_t dst = offset + o;
+        if (dst < size_ && !page_list_.GetPage(dst) && page_list_.AddPage(p, dst) == NO_ERROR)
+            continue;
+        list_add_tail(&freed, &p->free.node);
+    }
+
+    // a read fault in the meantime may have mapped the zero page over a
+    // slot that is now filled again
+    RangeChangeUpdateLocked(offset, len);
+
+    pmm_free(&freed);
+}
+
 status_t VmObjectPaged::ResizeLocked(uint64_t s) {
     canary_.Assert();
     DEBUG_ASSERT(lock_.IsHeld());
@@ -555,11 +811,8 @@ status_t VmObjectPaged::ResizeLocked(uint64_t s) {
             // unmap all of the pages in this range on all the mapping regions
             RangeChangeUpdateLocked(start, page_aligned_len);
 
-            // iterate through the pages, freeing them
-            while (start < end) {
-                page_list_.FreePage(start);
-                start += PAGE_SIZE;
-            }
+            // free the pages that are present in the range
+            page_list_.FreePages(start, end);
         }
     } else if (s > size_) {
         // expanding
@@ -582,6 +835,10 @@ status_t VmObjectPaged::ResizeLocked(uint64_t s) {
 }
 
 status_t VmObjectPaged::Resize(uint64_t s) {
+    // the size of a pager-backed vmo is fixed by the pager at creation
+    if (page_source_)
+        return ERR_NOT_SUPPORTED;
+
     AutoLock a(&lock_);
 
     return ResizeLocked(s);
@@ -616,46 +873,58 @@ status_t VmObjectPaged::ReadWriteInternal(uint64_t offset, size_t len, size_t* b
     if (bytes_copied)
         *bytes_copied = 0;
 
-    AutoLock a(&lock_);
-
-    // trim the size
-    uint64_t new_len;
-    if (!TrimRange(offset, len, size_, &new_len))
-        return ERR_OUT_OF_RANGE;
-
-    // was in range, just zero length
-    if (new_len == 0)
-        return 0;
-
-    // walk the list of pages and do the write
+    const uint pf_flags = VMM_PF_FLAG_SW_FAULT | (write ? VMM_PF_FLAG_WRITE : 0);
     uint64_t src_offset = offset;
     size_t dest_offset = 0;
-    while (new_len > 0) {
-        size_t page_offset = src_offset % PAGE_SIZE;
-        size_t tocopy = MIN(PAGE_SIZE - page_offset, new_len);
 
-        // fault in the page
-        paddr_t pa;
-        auto status = GetPageLocked(src_offset, VMM_PF_FLAG_SW_FAULT | (write ? VMM_PF_FLAG_WRITE : 0), nullptr, &pa);
-        if (status < 0)
-            return status;
-
-        // compute the kernel mapping of this page
-        uint8_t* page_ptr = reinterpret_cast<uint8_t*>(paddr_to_kvaddr(pa));
+    // a pager-backed vmo hands back a request for any page it doesn't have yet. wait on
+    // it with the lock dropped, then carry on from the page we stopped at
+    for (;;) {
+        PageSource::Request page_request;
+        {
+            AutoLock a(&lock_);
+
+            // trim the size, again on every pass since it may have changed while we waited
+            uint64_t new_len;
+            if (!TrimRange(offset, len, size_, &new_len))
+                return (dest_offset == 0) ? ERR_OUT_OF_RANGE : NO_ERROR;
+
+            // walk the list of pages and do the write
+            status_t status = NO_ERROR;
+            while (dest_offset < new_len) {
+                size_t page_offset = src_offset % PAGE_SIZE;
+                size_t tocopy = MIN(PAGE_SIZE - page_offset, new_len - dest_offset);
+
+                // fault in the page
+                paddr_t pa;
+                status = GetPageLocked(src_offset, pf_flags, nullptr, &pa, &page_request);
+                if (status == ERR_SHOULD_WAIT)
+                    break;
+                if (status < 0)
+                    return status;
+
+                // compute the kernel mapping of this page
+                uint8_t* page_ptr = reinterpret_cast<uint8_t*>(paddr_to_kvaddr(pa));
+
+                // call the copy routine
+                auto err = copyfunc(page_ptr + page_offset, dest_offset, tocopy);
+                if (err < 0)
+                    return err;
+
+                src_offset += tocopy;
+                if (bytes_copied)
+                    *bytes_copied += tocopy;
+                dest_offset += tocopy;
+            }
 
-        // call the copy routine
-        auto err = copyfunc(page_ptr + page_offset, dest_offset, tocopy);
-        if (err < 0)
-            return err;
+            if (status != ERR_SHOULD_WAIT)
+                return NO_ERROR;
+        }
 
-        src_offset += tocopy;
-        if (bytes_copied)
-            *bytes_copied += tocopy;
-        dest_offset += tocopy;
-        new_len -= tocopy;
+        status_t status = page_request.Wait();
+        if (status != NO_ERROR)
+            return status;
     }
-
-    return NO_ERROR;
 }
 
 status_t VmObjectPaged::Read(void* _ptr, uint64_t offset, size_t len, size_t* bytes_read) {
@@ -700,28 +969,63 @@ status_t VmObjectPaged::Lookup(uint64_t offset, uint64_t len, uint pf_flags,
     if (unlikely(len == 0))
         return ERR_INVALID_ARGS;
 
-    AutoLock a(&lock_);
-
-    // verify that the range is within the object
-    if (unlikely(!InRange(offset, len, size_)))
-        return ERR_OUT_OF_RANGE;
+    // a pager-backed vmo hands back a request for any page it doesn't have yet. wait on
+    // it with the lock dropped and then start over, since the pages looked up so far may
+    // have changed hands in the meantime
+    for (;;) {
+        PageSource::Request page_request;
+        {
+            AutoLock a(&lock_);
+
+            // verify that the range is within the object
+            if (unlikely(!InRange(offset, len, size_)))
+                return ERR_OUT_OF_RANGE;
+
+            uint64_t start_page_offset = ROUNDDOWN(offset, PAGE_SIZE);
+            uint64_t end_page_offset = ROUNDUP(offset + len, PAGE_SIZE);
+
+            if (pf_flags == 0 && !parent_) {
+                // nothing will be faulted in and there is no parent to look through,
+                // so walk the pages we have rather than looking up each offset. like
+                // the lookup below, stop at the first hole.
+                uint64_t expected = start_page_offset;
+                status_t status = page_list_.ForEveryPageInRange(
+                    [&](const vm_page_t* p, uint64_t off) -> status_t {
+                        if (off != expected)
+                            return ERR_NO_MEMORY;
+                        expected += PAGE_SIZE;
+                        return lookup_fn(context, off, (off - start_page_offset) / PAGE_SIZE,
+                                         vm_page_to_paddr(p));
+                    },
+                    start_page_offset, end_page_offset);
+                if (status == NO_ERROR && expected != end_page_offset)
+                    return ERR_NO_MEMORY;
+                return status;
+            }
 
-    uint64_t start_page_offset = ROUNDDOWN(offset, PAGE_SIZE);
-    uint64_t end_page_offset = ROUNDUP(offset + len, PAGE_SIZE);
+            status_t status = NO_ERROR;
+            size_t index = 0;
+            for (uint64_t off = start_page_offset; off != end_page_offset; off += PAGE_SIZE, index++) {
+                paddr_t pa;
+                status = GetPageLocked(off, pf_flags, nullptr, &pa, &page_request);
+                if (status == ERR_SHOULD_WAIT)
+                    break;
+                if (status < 0)
+                    return ERR_NO_MEMORY;
+
+                status = lookup_fn(context, off, index, pa);
+                if (unlikely(status < 0))
+                    return status;
+            }
 
-    size_t index = 0;
-    for (uint64_t off = start_page_offset; off != end_page_offset; off += PAGE_SIZE, index++) {
-        paddr_t pa;
-        auto status = GetPageLocked(off, pf_flags, nullptr, &pa);
-        if (status < 0)
-            return ERR_NO_MEMORY;
+            if (status != ERR_SHOULD_WAIT)
+                return NO_ERROR;
+        }
 
-        status = lookup_fn(context, off, index, pa);
-        if (unlikely(status < 0))
+        status_t status = page_request.Wait();
+        if (status != NO_ERROR)
             return status;
     }
-
-    return NO_ERROR;
 }
 
 status_t VmObjectPaged::ReadUser(user_ptr<void> ptr, uint64_t offset, size_t len, size_t* bytes_read) {
@@ -805,6 +1109,43 @@ status_t VmObjectPaged::CacheOp(const uint64_t start_offset, const uint64_t len,
         return ERR_OUT_OF_RANGE;
 
     const size_t end_offset = static_cast<size_t>(start_offset + len);
+
+    // Perform the cache op against |op_len| bytes at |page_offset| into the page at |pa|.
+    auto page_cache_op = [type](paddr_t pa, size_t page_offset, size_t op_len) {
+        // Convert the page address to a Kernel virtual address.
+        const void* ptr = paddr_to_kvaddr(pa);
+        const addr_t cache_op_addr = reinterpret_cast<addr_t>(ptr) + page_offset;
+
+        switch (type) {
+        case CacheOpType::Invalidate:
+            arch_invalidate_cache_range(cache_op_addr, op_len);
+            break;
+        case CacheOpType::Clean:
+            arch_clean_cache_range(cache_op_addr, op_len);
+            break;
+        case CacheOpType::CleanInvalidate:
+            arch_clean_invalidate_cache_range(cache_op_addr, op_len);
+            break;
+        case CacheOpType::Sync:
+            arch_sync_cache_range(cache_op_addr, op_len);
+            break;
+        }
+    };
+
+    if (!parent_) {
+        // only our own pages can be in the range, so visit just those
+        page_list_.ForEveryPageInRange(
+            [&](const vm_page_t* p, uint64_t off) -> status_t {
+                const size_t op_start_offset = MAX(static_cast<size_t>(off), start_offset);
+                const size_t op_end_offset = MIN(static_cast<size_t>(off) + PAGE_SIZE, end_offset);
+                page_cache_op(vm_page_to_paddr(p), op_start_offset % PAGE_SIZE,
+                              op_end_offset - op_start_offset);
+                return NO_ERROR;
+            },
+            ROUNDDOWN(start_offset, PAGE_SIZE), end_offset);
+        return NO_ERROR;
+    }
+
     size_t op_start_offset = static_cast<size_t>(start_offset);
 
     while (op_start_offset != end_offset) {
@@ -821,28 +1162,11 @@ status_t VmObjectPaged::CacheOp(const uint64_t start_offset, const uint64_t len,
 
         // lookup the physical address of the page, careful not to fault in a new one
         paddr_t pa;
-        auto status = GetPageLocked(op_start_offset, 0, nullptr, &pa);
+        auto status = GetPageLocked(op_start_offset, 0, nullptr, &pa, nullptr);
 
         if (likely(status == NO_ERROR)) {
-            // Convert the page address to a Kernel virtual address.
-            const void* ptr = paddr_to_kvaddr(pa);
-            const addr_t cache_op_addr = reinterpret_cast<addr_t>(ptr) + page_offset;
-
             // Perform the necessary cache op against this page.
-            switch (type) {
-            case CacheOpType::Invalidate:
-                arch_invalidate_cache_range(cache_op_addr, cache_op_len);
-                break;
-            case CacheOpType::Clean:
-                arch_clean_cache_range(cache_op_addr, cache_op_len);
-                break;
-            case CacheOpType::CleanInvalidate:
-                arch_clean_invalidate_cache_range(cache_op_addr, cache_op_len);
-                break;
-            case CacheOpType::Sync:
-                arch_sync_cache_range(cache_op_addr, cache_op_len);
-                break;
-            }
+            page_cache_op(pa, page_offset, cache_op_len);
         }
 
         op_start_offset += cache_op_len;
@@ -62,7 +62,8 @@ void VmObjectPhysical::Dump(uint depth, bool verbose) {
 }
 
 // get the physical address of a page at offset
-status_t VmObjectPhysical::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t** _page, paddr_t* _pa) {
+status_t VmObjectPhysical::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t** _page, paddr_t* _pa,
+                                         PageSource::Request* page_request) {
     canary_.Assert();
 
     if (_page)
@@ -45,6 +45,7 @@ vm_page* VmPageListNode::RemovePage(size_t index) {
         return nullptr;
 
     pages_[index] = nullptr;
+    present_ &= ~(1ull << index);
 
     return p;
 }
@@ -55,6 +56,7 @@ status_t VmPageListNode::AddPage(vm_page* p, size_t index) {
     if (pages_[index])
         return ERR_ALREADY_EXISTS;
     pages_[index] = p;
+    present_ |= 1ull << index;
     return NO_ERROR;
 }
 
@@ -67,6 +69,43 @@ VmPageList::~VmPageList() {
     DEBUG_ASSERT(list_.is_empty());
 }
 
+VmPageListNode* VmPageList::FindNode(uint64_t node_offset) {
+    if (last_node_ && last_node_->offset() == node_offset)
+        return last_node_;
+
+    auto pln = list_.find(node_offset);
+    if (!pln.IsValid())
+        return nullptr;
+
+    last_node_ = &*pln;
+    return last_node_;
+}
+
+VmPageListNode* VmPageList::GetOrAllocNode(uint64_t node_offset) {
+    VmPageListNode* node = FindNode(node_offset);
+    if (node)
+        return node;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<VmPageListNode> pl =
+        mxtl::unique_ptr<VmPageListNode>(new (&ac) VmPageListNode(node_offset));
+    if (!ac.check())
+        return nullptr;
+
+    LTRACEF("allocating new inner node %p\n", pl.get());
+    last_node_ = pl.get();
+    list_.insert(mxtl::move(pl));
+
+    return last_node_;
+}
+
+void VmPageList::EraseNode(VmPageListNode* node) {
+    LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
+    if (last_node_ == node)
+        last_node_ = nullptr;
+    list_.erase(*node);
+}
+
 status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
     uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
     size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
@@ -74,25 +113,12 @@ status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
     LTRACEF_LEVEL(2, "%p page %p, offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, p, offset,
                   node_offset, index);
 
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
-        AllocChecker ac;
-        mxtl::unique_ptr<VmPageListNode> pl =
-            mxtl::unique_ptr<VmPageListNode>(new (&ac) VmPageListNode(node_offset));
-        if (!ac.check())
-            return ERR_NO_MEMORY;
-
-        LTRACEF("allocating new inner node %p\n", pl.get());
-        __UNUSED auto status = pl->AddPage(p, index);
-        DEBUG_ASSERT(status == NO_ERROR);
-
-        list_.insert(mxtl::move(pl));
-    } else {
-        pln->AddPage(p, index);
-    }
+    // lookup the tree node that holds this page, making one if need be
+    VmPageListNode* pln = GetOrAllocNode(node_offset);
+    if (!pln)
+        return ERR_NO_MEMORY;
 
-    return NO_ERROR;
+    return pln->AddPage(p, index);
 }
 
 vm_page* VmPageList::GetPage(uint64_t offset) {
@@ -103,15 +129,36 @@ vm_page* VmPageList::GetPage(uint64_t offset) {
                   index);
 
     // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    VmPageListNode* pln = FindNode(node_offset);
+    if (!pln) {
         return nullptr;
     }
 
     return pln->GetPage(index);
 }
 
-status_t VmPageList::FreePage(uint64_t offset) {
+bool VmPageList::AnyPagesInRange(uint64_t start_offset, uint64_t end_offset) const {
+    // stops at the first page found
+    return ForEveryPageInRange([](const vm_page* p, uint64_t offset) { return ERR_STOP; },
+                               start_offset, end_offset) != NO_ERROR;
+}
+
+size_t VmPageList::CountPagesInRange(uint64_t start_offset, uint64_t end_offset) const {
+    uint64_t first = FirstIndex(start_offset);
+    uint64_t last = FirstIndex(end_offset);
+    size_t count = 0;
+    if (first >= last)
+        return 0;
+    for (auto pln = list_.lower_bound(NodeOffset(first)); pln.IsValid(); ++pln) {
+        uint64_t node_first = pln->offset() >> PAGE_SIZE_SHIFT;
+        if (node_first >= last)
+            break;
+        count += pln->CountPages(SpanStart(first, node_first), SpanEnd(last, node_first));
+    }
+    return count;
+}
+
+vm_page* VmPageList::RemovePage(uint64_t offset) {
     uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
     size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
 
@@ -119,26 +166,50 @@ status_t VmPageList::FreePage(uint64_t offset) {
                   index);
 
     // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
-        return ERR_NOT_FOUND;
+    VmPageListNode* pln = FindNode(node_offset);
+    if (!pln) {
+        return nullptr;
     }
 
-    // free this page
+    // remove this page
     auto page = pln->RemovePage(index);
     if (page) {
         // if it was the last page in the node, remove the node from the tree
         if (pln->IsEmpty()) {
-            LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
-            list_.erase(*pln);
+            EraseNode(pln);
         }
+    }
+
+    return page;
+}
 
-        pmm_free_page(page);
+status_t VmPageList::FreePage(uint64_t offset) {
+    auto page = RemovePage(offset);
+    if (!page) {
+        return ERR_NOT_FOUND;
     }
 
+    pmm_free_page(page);
     return NO_ERROR;
 }
 
+size_t VmPageList::FreePages(uint64_t start_offset, uint64_t end_offset) {
+    LTRACEF("%p start %#" PRIx64 " end %#" PRIx64 "\n", this, start_offset, end_offset);
+
+    list_node list;
+    list_initialize(&list);
+
+    size_t count = RemovePages([&list](vm_page* p, uint64_t offset) {
+        list_add_tail(&list, &p->free.node);
+    }, start_offset, end_offset);
+
+    // return all the pages to the pmm at once
+    __UNUSED auto freed = pmm_free(&list);
+    DEBUG_ASSERT(freed == count);
+
+    return count;
+}
+
 size_t VmPageList::FreeAllPages() {
     LTRACEF("%p\n", this);
 
@@ -163,6 +234,7 @@ size_t VmPageList::FreeAllPages() {
     DEBUG_ASSERT(freed == count);
 
     // empty the tree
+    last_node_ = nullptr;
     list_.clear();
 
     return count;
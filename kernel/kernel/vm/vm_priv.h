@@ -29,6 +29,29 @@ void vmm_init(void);
 // global vmm lock (for now)
 extern mutex_t vmm_lock;
 
+// number of pages, a power of two, in the naturally aligned window around a
+// page fault that VmMapping::PageFault() tries to map in one pass.
+// 1 disables fault-around.  Set with the vm.fault_around= command line option,
+// and overridden per vmo by VmObject::SetFaultAroundPages().
+extern size_t vm_fault_around_pages;
+
+// one page table's worth of 4K pages
+#define VM_FAULT_AROUND_MAX_PAGES 512
+
+// clamp a fault-around window to [1, VM_FAULT_AROUND_MAX_PAGES] pages and round it
+// down to a power of two so it can be aligned
+static inline uint32_t vm_fault_around_round(uint32_t pages) {
+    pages = MIN(MAX(pages, 1u), VM_FAULT_AROUND_MAX_PAGES);
+    return 1u << (31 - __builtin_clz(pages));
+}
+
+// whether write faults try to use large pages, set with vm.large_pages=
+extern bool vm_large_pages_enabled;
+
+// large page statistics, see the "vm largepages" console command
+extern int64_t vm_large_page_commits;   // write faults resolved with a large page
+extern int64_t vm_large_page_fallbacks; // eligible faults that got no contiguous run
+
 // utility function to test that offset + len is entirely within a range
 // returns false if out of range
 // NOTE: only use unsigned lengths
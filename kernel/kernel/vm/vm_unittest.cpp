@@ -11,10 +11,15 @@
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
 #include <kernel/vm/vm_object_paged.h>
+#include <kernel/vm/vm_page_list.h>
+#include <inttypes.h>
 #include <mxtl/array.h>
 #include <new.h>
+#include <platform.h>
 #include <unittest.h>
 
+#include "vm_priv.h"
+
 static const uint kArchRwFlags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
 
 // Allocates a single page, translates it to a vm_page_t and frees it.
@@ -70,6 +75,23 @@ static bool pmm_oversized_alloc_test(void* context) {
     END_TEST;
 }
 
+// Cycles pages through the per cpu page caches.
+static bool pmm_page_cache_test(void* context) {
+    BEGIN_TEST;
+
+    for (int i = 0; i < 512; i++) {
+        list_node list = LIST_INITIAL_VALUE(list);
+        size_t want = (i % 7) + 1;
+
+        auto count = pmm_alloc_pages(want, 0, &list);
+        EXPECT_EQ(want, count, "pmm_alloc_pages through the cache");
+
+        auto ret = pmm_free(&list);
+        EXPECT_EQ(want, ret, "pmm_free through the cache");
+    }
+    END_TEST;
+}
+
 static uint32_t test_rand(uint32_t seed) {
     return (seed = seed * 1664525 + 1013904223);
 }
@@ -409,6 +431,52 @@ static bool vmo_demand_paged_map_test(void* context) {
     END_TEST;
 }
 
+// Demand faults a large page aligned mapping, which should get large pages
+// where they're supported, then decommits part of it to force a split.
+static bool vmo_large_page_map_test(void* context) {
+    BEGIN_TEST;
+    if (!vm_large_pages_enabled) {
+        unittest_printf("large pages not enabled, skipping\n");
+        END_TEST;
+    }
+
+    const size_t alloc_size = VM_LARGE_PAGE_SIZE * 2;
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    auto ret = ka->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr,
+                                     VM_LARGE_PAGE_SHIFT, 0, kArchRwFlags);
+    REQUIRE_EQ(NO_ERROR, ret, "mapping object");
+
+    // fill with known pattern and test
+    if (!fill_and_test(ptr, alloc_size))
+        all_ok = false;
+
+    // unless memory was too fragmented, each large page is one contiguous run
+    paddr_t pa_first, pa_last;
+    uint flags;
+    vaddr_t va = reinterpret_cast<vaddr_t>(ptr);
+    EXPECT_EQ(NO_ERROR, arch_mmu_query(&ka->arch_aspace(), va, &pa_first, &flags), "query");
+    EXPECT_EQ(NO_ERROR, arch_mmu_query(&ka->arch_aspace(), va + VM_LARGE_PAGE_SIZE - PAGE_SIZE,
+                                       &pa_last, &flags), "query");
+    if (pa_last != pa_first + VM_LARGE_PAGE_SIZE - PAGE_SIZE) {
+        unittest_printf("no large page was used\n");
+    }
+
+    // punch a hole in the middle of the first large page, the rest should survive
+    uint64_t decommitted;
+    ret = vmo->DecommitRange(VM_LARGE_PAGE_SIZE / 2, PAGE_SIZE, &decommitted);
+    EXPECT_EQ(NO_ERROR, ret, "decommit");
+    EXPECT_TRUE(test_region(reinterpret_cast<uintptr_t>(ptr), ptr, VM_LARGE_PAGE_SIZE / 2),
+                "testing region below the hole");
+
+    auto err = ka->FreeRegion((vaddr_t)ptr);
+    EXPECT_EQ(NO_ERROR, err, "unmapping object");
+    END_TEST;
+}
+
 // Creates a vm object, maps it, drops ref before unmapping.
 static bool vmo_dropped_ref_test(void* context) {
     BEGIN_TEST;
@@ -619,6 +687,173 @@ static bool vmo_read_write_smoke_test(void* context) {
     END_TEST;
 }
 
+// Exercises the range operations of VmPageList across node boundaries.
+static bool vmpl_range_test(void* context) {
+    BEGIN_TEST;
+    static const size_t kFanOut = VmPageListNode::kPageFanOut;
+    static const size_t kPages = kFanOut * 3;
+
+    list_node pages;
+    list_initialize(&pages);
+    size_t count = pmm_alloc_pages(kPages, 0, &pages);
+    REQUIRE_EQ(kPages, count, "allocating pages");
+
+    VmPageList pl;
+
+    // every third page, starting in the middle of the first node
+    const uint64_t first = (kFanOut / 2) * PAGE_SIZE;
+    size_t added = 0;
+    for (uint64_t o = first; o < kPages * PAGE_SIZE; o += 3 * PAGE_SIZE) {
+        vm_page_t* p = list_remove_head_type(&pages, vm_page_t, free.node);
+        EXPECT_EQ(NO_ERROR, pl.AddPage(p, o), "adding page");
+        added++;
+    }
+    EXPECT_EQ(added, pl.CountPagesInRange(0, kPages * PAGE_SIZE), "counting pages");
+    EXPECT_FALSE(pl.AnyPagesInRange(0, first), "empty range");
+    EXPECT_TRUE(pl.AnyPagesInRange(first, first + PAGE_SIZE), "one page range");
+    EXPECT_FALSE(pl.AnyPagesInRange(first + PAGE_SIZE, first + 3 * PAGE_SIZE), "gap");
+    // ranges count the pages at offsets at or after the start
+    EXPECT_EQ(0u, pl.CountPagesInRange(first + 1, first + 3 * PAGE_SIZE), "unaligned start");
+
+    // the visitor sees the pages in a range in order, and can stop early
+    uint64_t expected = first;
+    size_t visited = 0;
+    auto status = pl.ForEveryPageInRange([&](const vm_page_t* p, uint64_t o) -> status_t {
+        EXPECT_EQ(expected, o, "visiting in order");
+        expected += 3 * PAGE_SIZE;
+        return (++visited == added - 1) ? ERR_STOP : NO_ERROR;
+    }, 0, kPages * PAGE_SIZE);
+    EXPECT_EQ(ERR_STOP, status, "stopping the walk");
+    EXPECT_EQ(added - 1, visited, "stopping the walk");
+
+    // fill the holes in the second node
+    const uint64_t node1 = kFanOut * PAGE_SIZE;
+    const uint64_t node2 = 2 * kFanOut * PAGE_SIZE;
+    size_t holes = kFanOut - pl.CountPagesInRange(node1, node2);
+    size_t filled = 0;
+    status = pl.AddPages(&pages, node1, node2, [&](vm_page_t* p, uint64_t o) {
+        EXPECT_NULL(pl.GetPage(o), "filling a hole");
+        filled++;
+    });
+    EXPECT_EQ(NO_ERROR, status, "filling holes");
+    EXPECT_EQ(holes, filled, "filling holes");
+    EXPECT_EQ(kFanOut, pl.CountPagesInRange(node1, node2), "filling holes");
+
+    // take out a range spanning all three nodes
+    size_t expected_removed = pl.CountPagesInRange(first, node2 + PAGE_SIZE * 4);
+    list_node removed;
+    list_initialize(&removed);
+    size_t n = pl.RemovePages([&](vm_page_t* p, uint64_t o) {
+        list_add_tail(&removed, &p->free.node);
+    }, first, node2 + PAGE_SIZE * 4);
+    EXPECT_EQ(expected_removed, n, "removing pages");
+    EXPECT_FALSE(pl.AnyPagesInRange(0, node2 + PAGE_SIZE * 4), "removing pages");
+    pmm_free(&removed);
+
+    size_t remaining = pl.CountPagesInRange(0, kPages * PAGE_SIZE);
+    EXPECT_EQ(remaining, pl.FreePages(0, kPages * PAGE_SIZE), "freeing pages");
+    EXPECT_EQ(0u, pl.FreeAllPages(), "list is empty");
+
+    pmm_free(&pages);
+    END_TEST;
+}
+
+// Checks that range operations on a sparse vmo only see the pages it has.
+static bool vmo_sparse_range_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = 256 * 1024 * 1024;
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+
+    uint64_t committed;
+    const uint64_t stride = 4 * 1024 * 1024;
+    for (uint64_t o = 0; o < alloc_size; o += stride) {
+        auto ret = vmo->CommitRange(o, PAGE_SIZE * 3, &committed);
+        EXPECT_EQ(NO_ERROR, ret, "committing vm object\n");
+    }
+    const size_t expected = (alloc_size / stride) * 3;
+    EXPECT_EQ(expected, vmo->AllocatedPagesInRange(0, alloc_size), "counting pages");
+
+    // committing the whole thing only adds the missing pages
+    auto ret = vmo->CommitRange(0, stride, &committed);
+    EXPECT_EQ(NO_ERROR, ret, "committing vm object\n");
+    EXPECT_EQ(stride - 3 * PAGE_SIZE, committed, "committing the holes");
+
+    EXPECT_EQ(NO_ERROR, vmo->CleanCache(0, alloc_size), "cache op");
+
+    uint64_t decommitted;
+    ret = vmo->DecommitRange(0, alloc_size, &decommitted);
+    EXPECT_EQ(NO_ERROR, ret, "decommitting vm object\n");
+    EXPECT_EQ((expected - 3) * PAGE_SIZE + stride, decommitted, "decommitting vm object\n");
+    EXPECT_EQ(0u, vmo->AllocatedPagesInRange(0, alloc_size), "counting pages");
+    END_TEST;
+}
+
+static status_t count_lookup(void* context, size_t offset, size_t index, paddr_t pa) {
+    (*static_cast<size_t*>(context))++;
+    return NO_ERROR;
+}
+
+// Times the range operations of a vmo.  Not a pass/fail test, but the
+// numbers are there to compare.
+static bool vmo_range_benchmark(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = 64 * 1024 * 1024;
+    static const size_t pages = alloc_size / PAGE_SIZE;
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+
+    lk_time_t t = current_time();
+    auto ret = vmo->CommitRange(0, alloc_size, nullptr);
+    lk_time_t commit_time = current_time() - t;
+    REQUIRE_EQ(NO_ERROR, ret, "committing vm object\n");
+
+    size_t looked_up = 0;
+    t = current_time();
+    ret = vmo->Lookup(0, alloc_size, 0, count_lookup, &looked_up);
+    lk_time_t lookup_time = current_time() - t;
+    EXPECT_EQ(NO_ERROR, ret, "lookup\n");
+    EXPECT_EQ(pages, looked_up, "lookup\n");
+
+    t = current_time();
+    size_t counted = vmo->AllocatedPagesInRange(0, alloc_size);
+    lk_time_t count_time = current_time() - t;
+    EXPECT_EQ(pages, counted, "counting pages");
+
+    t = current_time();
+    ret = vmo->DecommitRange(0, alloc_size, nullptr);
+    lk_time_t decommit_time = current_time() - t;
+    EXPECT_EQ(NO_ERROR, ret, "decommitting vm object\n");
+
+    // range operations on a huge vmo with only a few pages
+    static const uint64_t sparse_size = 1ull << 36;
+    auto sparse = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, sparse_size);
+    REQUIRE_NONNULL(sparse, "vmobject creation\n");
+    for (uint64_t o = 0; o < sparse_size; o += sparse_size / 512) {
+        ret = sparse->CommitRange(o, PAGE_SIZE, nullptr);
+        REQUIRE_EQ(NO_ERROR, ret, "committing vm object\n");
+    }
+    t = current_time();
+    ret = sparse->CleanCache(0, sparse_size);
+    lk_time_t sparse_cache_time = current_time() - t;
+    EXPECT_EQ(NO_ERROR, ret, "cache op\n");
+
+    t = current_time();
+    uint64_t decommitted;
+    ret = sparse->DecommitRange(0, sparse_size, &decommitted);
+    lk_time_t sparse_decommit_time = current_time() - t;
+    EXPECT_EQ(NO_ERROR, ret, "decommitting vm object\n");
+    EXPECT_EQ(512u * PAGE_SIZE, decommitted, "decommitting vm object\n");
+
+    printf("\n%zu pages: commit %" PRIu64 " ns/page, lookup %" PRIu64 " ns/page, "
+           "count %" PRIu64 " ns, decommit %" PRIu64 " ns/page\n",
+           pages, commit_time / pages, lookup_time / pages, count_time,
+           decommit_time / pages);
+    printf("%" PRIu64 "GB vmo with 512 pages: cache op %" PRIu64 " ns, decommit %" PRIu64 " ns\n",
+           sparse_size >> 30, sparse_cache_time, sparse_decommit_time);
+    END_TEST;
+}
+
 // Use the function name as the test name
 #define VM_UNITTEST(fname) UNITTEST(#fname, fname)
 
@@ -626,6 +861,7 @@ UNITTEST_START_TESTCASE(vm_tests)
 VM_UNITTEST(pmm_smoke_test)
 VM_UNITTEST(pmm_large_alloc_test)
 VM_UNITTEST(pmm_oversized_alloc_test)
+VM_UNITTEST(pmm_page_cache_test)
 VM_UNITTEST(vmm_alloc_smoke_test)
 VM_UNITTEST(vmm_alloc_contiguous_smoke_test)
 VM_UNITTEST(multiple_regions_test)
@@ -641,9 +877,13 @@ VM_UNITTEST(vmo_odd_size_commit_test)
 VM_UNITTEST(vmo_contiguous_commit_test)
 VM_UNITTEST(vmo_precommitted_map_test)
 VM_UNITTEST(vmo_demand_paged_map_test)
+VM_UNITTEST(vmo_large_page_map_test)
 VM_UNITTEST(vmo_dropped_ref_test)
 VM_UNITTEST(vmo_remap_test)
 VM_UNITTEST(vmo_double_remap_test)
 VM_UNITTEST(vmo_read_write_smoke_test)
+VM_UNITTEST(vmpl_range_test)
+VM_UNITTEST(vmo_sparse_range_test)
+VM_UNITTEST(vmo_range_benchmark)
 VM_UNITTEST(dump_all_aspaces) // Run last
 UNITTEST_END_TESTCASE(vm_tests, "vmtests", "Virtual memory tests", nullptr, nullptr);
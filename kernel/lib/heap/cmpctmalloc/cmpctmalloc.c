@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <err.h>
+#include <arch/ops.h>
 #include <kernel/thread.h>
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
@@ -26,6 +27,11 @@
 // Allocation strategy takes place with a global mutex.  Freelist entries are
 // kept in linked lists with 8 different sizes per binary order of magnitude
 // and the header size is two words with eager coalescing on free.
+//
+// Small allocations are fronted by per-cpu caches of already-allocated
+// blocks, so that most malloc/free pairs never take the global mutex.  The
+// caches are refilled from and drained to the heap CACHE_BATCH blocks at a
+// time, and never hold more than CACHE_DEPTH blocks per bucket.
 
 #if defined(DEBUG) || LK_DEBUGLEVEL > 2
 #define CMPCT_DEBUG
@@ -86,7 +92,43 @@ struct heap {
 // Heap static vars.
 static struct heap theheap;
 
+// Allocations of up to CACHE_MAX_SIZE bytes (not including the header) go
+// through the per-cpu caches.  These are the first NUMBER_OF_CACHED_BUCKETS
+// buckets; cmpct_init checks that the two agree.
+#define CACHE_MAX_SIZE 256
+#define NUMBER_OF_CACHED_BUCKETS 24
+#define CACHE_DEPTH 32
+#define CACHE_BATCH (CACHE_DEPTH / 2)
+
+// A cached block is an allocated block, header and all; the link lives in
+// the payload.
+typedef struct cached_struct {
+    struct cached_struct *next;
+} cached_t;
+
+struct cache_stats {
+    uint64_t allocs;
+    uint64_t hits;
+    uint64_t lock_waits; // Found theheap.lock held on refill or drain.
+};
+
+// The lock is only ever contended by the cpu that owns the cache and by
+// cache_drain_all, and is always taken with interrupts disabled so that the
+// owning thread cannot migrate while it holds it.
+struct cpu_cache {
+    spin_lock_t lock;
+    cached_t *lists[NUMBER_OF_CACHED_BUCKETS];
+    uint32_t counts[NUMBER_OF_CACHED_BUCKETS];
+    struct cache_stats stats[NUMBER_OF_CACHED_BUCKETS];
+} __CPU_ALIGN;
+
+static struct cpu_cache cpu_caches[SMP_MAX_CPUS];
+
+// Cleared by the self tests, which need to see exactly what the heap does.
+static bool caches_enabled;
+
 static ssize_t heap_grow(size_t len, free_t **bucket);
+static void cache_drain_all(void);
 
 static void lock(void) TA_ACQ(theheap.lock)
 {
@@ -98,6 +140,15 @@ static void unlock(void) TA_REL(theheap.lock)
     mutex_release(&theheap.lock);
 }
 
+// Like lock(), but also reports whether someone else held the lock.
+static bool lock_and_check_contention(void) TA_ACQ(theheap.lock)
+{
+    // A racy peek is good enough for statistics.
+    bool contended = __atomic_load_n(&theheap.lock.holder, __ATOMIC_RELAXED) != NULL;
+    mutex_acquire(&theheap.lock);
+    return contended;
+}
+
 static void dump_free(header_t *header)
 {
     dprintf(INFO, "\t\tbase %p, end %#" PRIxPTR ", len %#zx (%zu)\n",
@@ -132,6 +183,39 @@ void cmpct_dump(bool panic_time) TA_NO_THREAD_SAFETY_ANALYSIS
         unlock();
 }
 
+// The size of each of the first NUMBER_OF_CACHED_BUCKETS buckets; see
+// size_to_index_helper.
+static size_t cached_bucket_size(int bucket)
+{
+    if (bucket < 15) return (size_t)(bucket + 1) << 3;
+    int row_column = bucket + 32 - 15;
+    return (size_t)(8 + (row_column & 7)) << (row_column >> 3);
+}
+
+void cmpct_dump_stats(void)
+{
+    printf("Heap cache stats (%s, %d blocks per cpu per bucket):\n",
+           caches_enabled ? "enabled" : "disabled", CACHE_DEPTH);
+    printf("\t%6s %12s %12s %6s %12s %8s\n",
+           "size", "allocs", "cache hits", "hit%", "lock waits", "cached");
+    for (int i = 0; i < NUMBER_OF_CACHED_BUCKETS; i++) {
+        struct cache_stats total = {0, 0, 0};
+        uint64_t cached = 0;
+        for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+            const struct cpu_cache *cache = &cpu_caches[cpu];
+            total.allocs += cache->stats[i].allocs;
+            total.hits += cache->stats[i].hits;
+            total.lock_waits += __atomic_load_n(&cache->stats[i].lock_waits, __ATOMIC_RELAXED);
+            cached += cache->counts[i];
+        }
+        if (total.allocs == 0 && cached == 0) continue;
+        printf("\t%6zu %12" PRIu64 " %12" PRIu64 " %5" PRIu64 "%% %12" PRIu64 " %8" PRIu64 "\n",
+               cached_bucket_size(i), total.allocs, total.hits,
+               total.allocs ? total.hits * 100 / total.allocs : 0,
+               total.lock_waits, cached);
+    }
+}
+
 // Operates in sizes that don't include the allocation header.
 static int size_to_index_helper(
     size_t size, size_t *rounded_up_out, int adjust, int increment)
@@ -565,6 +649,11 @@ static void cmpct_test_return_to_os(void)
 
 void cmpct_test(void)
 {
+    // The tests below account for every byte, which the caches would hide.
+    bool saved_caches_enabled = caches_enabled;
+    caches_enabled = false;
+    cache_drain_all();
+
     cmpct_test_buckets();
     cmpct_test_get_back_newly_freed();
     cmpct_test_return_to_os();
@@ -621,6 +710,8 @@ void cmpct_test(void)
     }
 
     cmpct_dump(false);
+
+    caches_enabled = saved_caches_enabled;
 }
 
 static void check_free_fill(void *ptr, size_t size)
@@ -672,7 +763,9 @@ void cmpct_trim(void)
 {
     // Look at free list entries that are at least as large as one page plus a
     // header. They might be at the start or the end of a block, so we can trim
-    // them and free the page(s).
+    // them and free the page(s).  Cached blocks pin their pages, so put them
+    // back first.
+    cache_drain_all();
     lock();
     for (int bucket = size_to_index_freeing(PAGE_SIZE);
             bucket < NUMBER_OF_BUCKETS;
@@ -740,18 +833,10 @@ void cmpct_trim(void)
     unlock();
 }
 
-void *cmpct_alloc(size_t size)
+// Carve an allocation out of the free lists, growing the heap if need be.
+// rounded_up includes the header.
+static void *alloc_locked(size_t size, int start_bucket, size_t rounded_up) TA_REQ(theheap.lock)
 {
-    if (size == 0u) return NULL;
-
-    if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS)) return large_alloc(size);
-
-    size_t rounded_up;
-    int start_bucket = size_to_index_allocating(size, &rounded_up);
-
-    rounded_up += sizeof(header_t);
-
-    lock();
     int bucket = find_nonempty_bucket(start_bucket);
     if (bucket == -1) {
         // Grow heap by at least 12% if we can.
@@ -760,7 +845,6 @@ void *cmpct_alloc(size_t size)
                                 MAX(HEAP_GROW_SIZE, rounded_up)));
         while (heap_grow(growby, NULL) < 0) {
             if (growby <= rounded_up) {
-                unlock();
                 return NULL;
             }
             growby = MAX(growby >> 1, rounded_up);
@@ -784,14 +868,207 @@ void *cmpct_alloc(size_t size)
     } else {
         unlink_free(head, bucket);
     }
-    void *result =
-        create_allocation_header(head, 0, head->header.size, head->header.left);
+    return create_allocation_header(head, 0, head->header.size, head->header.left);
+}
+
+static void free_locked(header_t *header) TA_REQ(theheap.lock)
+{
+    size_t size = header->size;
+    header_t *left = header->left;
+    if (left != NULL && is_tagged_as_free(left)) {
+        // Coalesce with left free object.
+        unlink_free_unknown_bucket((free_t *)left);
+        header_t *right = right_header(header);
+        if (is_tagged_as_free(right)) {
+            // Coalesce both sides.
+            unlink_free_unknown_bucket((free_t *)right);
+            header_t *right_right = right_header(right);
+            FixLeftPointer(right_right, left);
+            free_memory(left, left->left, left->size + size + right->size);
+        } else {
+            // Coalesce only left.
+            FixLeftPointer(right, left);
+            free_memory(left, left->left, left->size + size);
+        }
+    } else {
+        header_t *right = right_header(header);
+        if (is_tagged_as_free(right)) {
+            // Coalesce only right.
+            header_t *right_right = right_header(right);
+            unlink_free_unknown_bucket((free_t *)right);
+            FixLeftPointer(right_right, header);
+            free_memory(header, left, size + right->size);
+        } else {
+            free_memory(header, left, size);
+        }
+    }
+}
+
+// Interrupts stay disabled while the cache is locked so that the calling
+// thread stays on the cpu whose cache it is using.
+static struct cpu_cache *cache_lock(spin_lock_saved_state_t *state)
+{
+    arch_interrupt_save(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    struct cpu_cache *cache = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    return cache;
+}
+
+static void cache_unlock(struct cpu_cache *cache, spin_lock_saved_state_t state)
+{
+    spin_unlock(&cache->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// Hand a list of cached blocks back to the heap.
+static void free_to_heap(cached_t *list, struct cache_stats *stats)
+{
+    if (list == NULL) return;
+    bool contended = lock_and_check_contention();
+    while (list != NULL) {
+        cached_t *next = list->next;
+        free_locked((header_t *)list - 1);
+        list = next;
+    }
+    unlock();
+    if (contended && stats != NULL)
+        __atomic_fetch_add(&stats->lock_waits, 1, __ATOMIC_RELAXED);
+}
+
+static void *cache_alloc(int cached_bucket, size_t size, int start_bucket, size_t rounded_up)
+{
+    spin_lock_saved_state_t state;
+    struct cpu_cache *cache = cache_lock(&state);
+    struct cache_stats *stats = &cache->stats[cached_bucket];
+    stats->allocs++;
+    cached_t *block = cache->lists[cached_bucket];
+    if (block != NULL) {
+        cache->lists[cached_bucket] = block->next;
+        cache->counts[cached_bucket]--;
+        stats->hits++;
+        cache_unlock(cache, state);
+        return block;
+    }
+    cache_unlock(cache, state);
+
+    // Take a batch from the heap, keeping the first block for the caller.
+    cached_t *batch = NULL;
+    if (lock_and_check_contention())
+        __atomic_fetch_add(&stats->lock_waits, 1, __ATOMIC_RELAXED);
+    void *result = alloc_locked(size, start_bucket, rounded_up);
+    for (int i = 1; result != NULL && i < CACHE_BATCH; i++) {
+        cached_t *extra = alloc_locked(size, start_bucket, rounded_up);
+        if (extra == NULL) break;
+        extra->next = batch;
+        batch = extra;
+    }
+    unlock();
+
+    // We may have moved cpus, and that cpu's cache may have filled up in the
+    // meantime; anything that doesn't fit goes straight back.
+    cache = cache_lock(&state);
+    while (batch != NULL && cache->counts[cached_bucket] < CACHE_DEPTH) {
+        cached_t *next = batch->next;
+        batch->next = cache->lists[cached_bucket];
+        cache->lists[cached_bucket] = batch;
+        cache->counts[cached_bucket]++;
+        batch = next;
+    }
+    cache_unlock(cache, state);
+    free_to_heap(batch, NULL);
+
+    return result;
+}
+
+static void cache_free(header_t *header, int cached_bucket)
+{
+    cached_t *block = (cached_t *)(header + 1);
+#ifdef CMPCT_DEBUG
+    memset(block + 1, FREE_FILL, header->size - sizeof(header_t) - sizeof(cached_t));
+#endif
+    spin_lock_saved_state_t state;
+    struct cpu_cache *cache = cache_lock(&state);
+    block->next = cache->lists[cached_bucket];
+    cache->lists[cached_bucket] = block;
+    if (++cache->counts[cached_bucket] <= CACHE_DEPTH) {
+        cache_unlock(cache, state);
+        return;
+    }
+
+    // Over the limit: keep the most recently freed blocks, which are the
+    // likeliest to still be in the data cache, and drain the rest.
+    const uint32_t keep = CACHE_DEPTH + 1 - CACHE_BATCH;
+    cached_t **link = &cache->lists[cached_bucket];
+    for (uint32_t i = 0; i < keep; i++)
+        link = &(*link)->next;
+    cached_t *drain = *link;
+    *link = NULL;
+    cache->counts[cached_bucket] = keep;
+    struct cache_stats *stats = &cache->stats[cached_bucket];
+    cache_unlock(cache, state);
+
+    free_to_heap(drain, stats);
+}
+
+// Empty every cpu's cache back into the heap.
+static void cache_drain_all(void)
+{
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        struct cpu_cache *cache = &cpu_caches[cpu];
+        cached_t *drain = NULL;
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&cache->lock, state);
+        for (int i = 0; i < NUMBER_OF_CACHED_BUCKETS; i++) {
+            cached_t *block = cache->lists[i];
+            while (block != NULL) {
+                cached_t *next = block->next;
+                block->next = drain;
+                drain = block;
+                block = next;
+            }
+            cache->lists[i] = NULL;
+            cache->counts[i] = 0;
+        }
+        spin_unlock_irqrestore(&cache->lock, state);
+        free_to_heap(drain, NULL);
+    }
+}
+
+// Which per-cpu cache list, if any, a block with this much payload belongs on.
+static int cached_bucket_for_free(size_t payload_size)
+{
+    if (!caches_enabled || payload_size >= 2 * CACHE_MAX_SIZE) return -1;
+    int bucket = size_to_index_freeing(payload_size);
+    return bucket < NUMBER_OF_CACHED_BUCKETS ? bucket : -1;
+}
+
+void *cmpct_alloc(size_t size)
+{
+    if (size == 0u) return NULL;
+
+    if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS)) return large_alloc(size);
+
+    size_t rounded_up;
+    int start_bucket = size_to_index_allocating(size, &rounded_up);
+
+    void *result;
+    if (caches_enabled && rounded_up <= CACHE_MAX_SIZE) {
+        // Index by the rounded size, as cmpct_free will, so that the
+        // smallest requests share a list with the blocks they really get.
+        result = cache_alloc(size_to_index_freeing(rounded_up), size,
+                             start_bucket, rounded_up + sizeof(header_t));
+    } else {
+        lock();
+        result = alloc_locked(size, start_bucket, rounded_up + sizeof(header_t));
+        unlock();
+    }
+    if (result == NULL) return NULL;
 #ifdef CMPCT_DEBUG
+    size_t payload_size = ((header_t *)result - 1)->size - sizeof(header_t);
     check_free_fill(result, size);
     memset(result, ALLOC_FILL, size);
-    memset(((char *)result) + size, PADDING_FILL, rounded_up - size - sizeof(header_t));
+    memset(((char *)result) + size, PADDING_FILL, payload_size - size);
 #endif
-    unlock();
     return result;
 }
 
@@ -815,11 +1092,10 @@ void *cmpct_memalign(size_t size, size_t alignment)
         header_t *right = right_header(unaligned_header);
         unaligned_header->size = left_over;
         FixLeftPointer(right, header);
-        unlock();
-        cmpct_free(unaligned);
-    } else {
-        unlock();
+        // Straight back to the heap rather than a cache, so it can coalesce.
+        free_locked(unaligned_header);
     }
+    unlock();
     // TODO: Free the part after the aligned allocation.
     return payload;
 }
@@ -829,36 +1105,13 @@ void cmpct_free(void *payload)
     if (payload == NULL) return;
     header_t *header = (header_t *)payload - 1;
     DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
-    size_t size = header->size;
-    lock();
-    header_t *left = header->left;
-    if (left != NULL && is_tagged_as_free(left)) {
-        // Coalesce with left free object.
-        unlink_free_unknown_bucket((free_t *)left);
-        header_t *right = right_header(header);
-        if (is_tagged_as_free(right)) {
-            // Coalesce both sides.
-            unlink_free_unknown_bucket((free_t *)right);
-            header_t *right_right = right_header(right);
-            FixLeftPointer(right_right, left);
-            free_memory(left, left->left, left->size + size + right->size);
-        } else {
-            // Coalesce only left.
-            FixLeftPointer(right, left);
-            free_memory(left, left->left, left->size + size);
-        }
-    } else {
-        header_t *right = right_header(header);
-        if (is_tagged_as_free(right)) {
-            // Coalesce only right.
-            header_t *right_right = right_header(right);
-            unlink_free_unknown_bucket((free_t *)right);
-            FixLeftPointer(right_right, header);
-            free_memory(header, left, size + right->size);
-        } else {
-            free_memory(header, left, size);
-        }
+    int cached_bucket = cached_bucket_for_free(header->size - sizeof(header_t));
+    if (cached_bucket >= 0) {
+        cache_free(header, cached_bucket);
+        return;
     }
+    lock();
+    free_locked(header);
     unlock();
 }
 
@@ -928,4 +1181,12 @@ void cmpct_init(void)
     theheap.remaining = 0;
 
     heap_grow(initial_alloc, NULL);
+
+    // Turn on the per-cpu caches.
+    DEBUG_ASSERT(size_to_index_freeing(CACHE_MAX_SIZE) == NUMBER_OF_CACHED_BUCKETS - 1);
+    DEBUG_ASSERT(cached_bucket_size(NUMBER_OF_CACHED_BUCKETS - 1) == CACHE_MAX_SIZE);
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        spin_lock_init(&cpu_caches[cpu].lock);
+    }
+    caches_enabled = true;
 }
@@ -18,6 +18,7 @@ void *cmpct_memalign(size_t size, size_t alignment);
 
 void cmpct_init(void);
 void cmpct_dump(bool panic_time);
+void cmpct_dump_stats(void);
 void cmpct_test(void);
 void cmpct_trim(void);
 
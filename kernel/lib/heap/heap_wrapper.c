@@ -66,6 +66,10 @@ static inline void HEAP_INIT(void)
 }
 #define HEAP_DUMP miniheap_dump
 #define HEAP_TRIM miniheap_trim
+static inline void HEAP_DUMP_STATS(void)
+{
+    printf("miniheap keeps no statistics\n");
+}
 
 /* end miniheap implementation */
 #elif WITH_LIB_HEAP_CMPCTMALLOC
@@ -78,6 +82,7 @@ static inline void HEAP_INIT(void)
 #define HEAP_FREE cmpct_free
 #define HEAP_INIT cmpct_init
 #define HEAP_DUMP cmpct_dump
+#define HEAP_DUMP_STATS cmpct_dump_stats
 #define HEAP_TRIM cmpct_trim
 static inline void *HEAP_CALLOC(size_t n, size_t s)
 {
@@ -335,6 +340,7 @@ notenoughargs:
 usage:
         printf("usage:\n");
         printf("\t%s info\n", argv[0].str);
+        printf("\t%s stats\n", argv[0].str);
         if (!(flags & CMD_FLAG_PANIC)) {
             printf("\t%s trace\n", argv[0].str);
             printf("\t%s trim\n", argv[0].str);
@@ -347,6 +353,8 @@ usage:
 
     if (strcmp(argv[1].str, "info") == 0) {
         heap_dump(flags & CMD_FLAG_PANIC);
+    } else if (strcmp(argv[1].str, "stats") == 0) {
+        HEAP_DUMP_STATS();
     } else if (!(flags & CMD_FLAG_PANIC) && strcmp(argv[1].str, "test") == 0) {
         heap_test();
     } else if (!(flags & CMD_FLAG_PANIC) && strcmp(argv[1].str, "trace") == 0) {
@@ -28,6 +28,9 @@
 
 constexpr mx_rights_t kDefaultChannelRights = MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE;
 
+// Channel locks are only held to move messages on and off the queue.
+static mutex_class_t channel_lock_class = MUTEX_CLASS_INITIAL_VALUE(channel_lock_class, "channel");
+
 // static
 status_t ChannelDispatcher::Create(uint32_t flags,
                                    mxtl::RefPtr<Dispatcher>* dispatcher0,
@@ -52,7 +55,8 @@ status_t ChannelDispatcher::Create(uint32_t flags,
 }
 
 ChannelDispatcher::ChannelDispatcher(uint32_t flags)
-    : state_tracker_(MX_CHANNEL_WRITABLE) {
+    : lock_(MUTEX_FLAG_ADAPTIVE, &channel_lock_class),
+      state_tracker_(MX_CHANNEL_WRITABLE) {
     DEBUG_ASSERT(flags == 0);
 }
 
@@ -168,22 +172,21 @@ status_t ChannelDispatcher::Read(uint32_t* msg_size,
     return rv;
 }
 
-status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket> msg) {
+status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket>* msg) {
     canary_.Assert();
 
     mxtl::RefPtr<ChannelDispatcher> other;
     {
         AutoLock lock(&lock_);
         if (!other_) {
-            // |msg| will be destroyed but we want to keep the handles alive since
-            // the caller should put them back into the process table.
-            msg->set_owns_handles(false);
+            // The caller should put the handles back into the process table.
+            (*msg)->set_owns_handles(false);
             return ERR_PEER_CLOSED;
         }
         other = other_;
     }
 
-    if (other->WriteSelf(mxtl::move(msg)) > 0)
+    if (other->WriteSelf(mxtl::move(*msg)) > 0)
         thread_preempt(false);
 
     return NO_ERROR;
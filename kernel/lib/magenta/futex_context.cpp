@@ -6,6 +6,7 @@
 
 #include <assert.h>
 #include <kernel/auto_lock.h>
+#include <kernel/thread.h>
 #include <lib/user_copy.h>
 #include <lib/user_copy/user_ptr.h>
 #include <magenta/futex_context.h>
@@ -24,7 +25,12 @@ FutexContext::~FutexContext() {
 
     // All of the threads should have removed themselves from wait queues
     // by the time the process has exited.
-    DEBUG_ASSERT(futex_table_.is_empty());
+#if LK_DEBUGLEVEL > 0
+    for (auto& bucket : buckets_) {
+        AutoLock lock(&bucket.lock);
+        DEBUG_ASSERT(bucket.futex_table.is_empty());
+    }
+#endif
 }
 
 status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t deadline) {
@@ -34,6 +40,7 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     if (futex_key % sizeof(int))
         return ERR_INVALID_ARGS;
 
+    Bucket* bucket = GetBucket(futex_key);
     FutexNode* node;
 
     // FutexWait() checks that the address value_ptr still contains
@@ -42,16 +49,16 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     // If a FutexWake() operation could occur between them, a userland mutex
     // operation built on top of futexes would have a race condition that
     // could miss wakeups.
-    lock_.Acquire();
+    bucket->lock.Acquire();
 
     int value;
     status_t result = value_ptr.copy_from_user(&value);
     if (result != NO_ERROR) {
-        lock_.Release();
+        bucket->lock.Release();
         return result;
     }
     if (value != current_value) {
-        lock_.Release();
+        bucket->lock.Release();
         return ERR_BAD_STATE;
     }
 
@@ -60,26 +67,26 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     node->set_hash_key(futex_key);
     node->SetAsSingletonList();
 
-    QueueNodesLocked(node);
+    QueueNodesLocked(bucket, node);
+
+    // Block current thread.  This releases the bucket lock and does not reacquire it.
+    result = node->BlockThread(&bucket->lock, deadline);
 
-    // Block current thread.  This releases lock_ and does not reacquire it.
-    result = node->BlockThread(&lock_, deadline);
+    // Whether or not we were woken, we must take the lock of the bucket the
+    // node is now keyed to (a FutexRequeue() may have moved it):
+    //  * If we hit the deadline, we need to remove the thread's node from
+    //    the wait queue, since FutexWake() didn't do that.
+    //  * Fix/workaround for MG-624: if we were woken, this forces the thread
+    //    to wait until WakeThreads() marks it as not in the queue anymore.
+    //    Otherwise, this thread can exit before it does that, causing
+    //    WakeThreads() to scribble on memory.
+    bool unqueued = UnqueueNode(node);
     if (result == NO_ERROR) {
-        // Fix/workaround for MG-624:
-        // We must re-acquire the lock here to force this thread to wait until
-        // the WakeThreads() marks this thread as not in the queue anymore.
-        // Otherwise, this thread can exit before it does that, causing
-        // WakeThreads() to scribble on memory.
-        AutoLock lock(&lock_);
-        DEBUG_ASSERT(!node->IsInQueue());
+        DEBUG_ASSERT(!unqueued);
         // All the work necessary for removing us from the hash table was done by FutexWake()
         return NO_ERROR;
     }
-
-    AutoLock lock(&lock_);
-    // If we hit the deadline, we need to remove the thread's node from the
-    // wait queue, since FutexWake() didn't do that.
-    if (UnqueueNodeLocked(node)) {
+    if (unqueued) {
         return ERR_TIMED_OUT;
     }
     // The current thread was not found on the wait queue.  This means
@@ -114,32 +121,40 @@ status_t FutexContext::FutexWake(user_ptr<const int> value_ptr,
     if (futex_key % sizeof(int))
         return ERR_INVALID_ARGS;
 
+    Bucket* bucket = GetBucket(futex_key);
+    bool woke_threads;
     {
-        AutoLock lock(&lock_);
+        AutoLock lock(&bucket->lock);
 
-        FutexNode* node = futex_table_.erase(futex_key);
+        FutexNode* node = bucket->futex_table.erase(futex_key);
         if (!node) {
             // nothing blocked on this futex if we can't find it
             return NO_ERROR;
         }
         DEBUG_ASSERT(node->GetKey() == futex_key);
 
+        // The woken nodes keep futex_key, so that their threads can find this
+        // bucket's lock again in FutexWait().
         FutexNode* wake_head = node;
-        node = FutexNode::RemoveFromHead(node, count, futex_key, 0u);
+        node = FutexNode::RemoveFromHead(node, count, futex_key, futex_key);
         // node is now the new blocked thread list head
 
         if (node != nullptr) {
             DEBUG_ASSERT(node->GetKey() == futex_key);
-            futex_table_.insert(node);
+            bucket->futex_table.insert(node);
         }
 
         // Traversing this list of threads must be done while holding the
         // lock, because any of these threads might wake up from a timeout
         // and call FutexWait(), which would clobber the "next" pointer in
         // the thread's FutexNode.
-        FutexNode::WakeThreads(wake_head);
+        woke_threads = FutexNode::WakeThreads(wake_head);
     }
 
+    // Now that the lock is free, let the woken threads run.
+    if (woke_threads)
+        thread_preempt(false);
+
     return NO_ERROR;
 }
 
@@ -150,23 +165,46 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
     if ((requeue_ptr.get() == nullptr) && requeue_count)
         return ERR_INVALID_ARGS;
 
-    AutoLock lock(&lock_);
-
-    int value;
-    status_t result = wake_ptr.copy_from_user(&value);
-    if (result != NO_ERROR) return result;
-    if (value != current_value) return ERR_BAD_STATE;
-
     uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
     uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
     if (wake_key == requeue_key) return ERR_INVALID_ARGS;
     if (wake_key % sizeof(int) || requeue_key % sizeof(int))
         return ERR_INVALID_ARGS;
 
+    // Both buckets stay locked throughout, so that waiters moving from one
+    // futex to the other are never visible in neither.
+    Bucket* wake_bucket = GetBucket(wake_key);
+    Bucket* requeue_bucket = GetBucket(requeue_key);
+    bool woke_threads = false;
+    LockBuckets(wake_bucket, requeue_bucket);
+    status_t result = FutexRequeueLocked(wake_bucket, wake_ptr, wake_count, current_value,
+                                         requeue_bucket, requeue_ptr, requeue_count,
+                                         &woke_threads);
+    UnlockBuckets(wake_bucket, requeue_bucket);
+
+    // Now that the locks are free, let the woken threads run.
+    if (woke_threads)
+        thread_preempt(false);
+
+    return result;
+}
+
+status_t FutexContext::FutexRequeueLocked(Bucket* wake_bucket, user_ptr<int> wake_ptr,
+                                          uint32_t wake_count, int current_value,
+                                          Bucket* requeue_bucket, user_ptr<int> requeue_ptr,
+                                          uint32_t requeue_count, bool* woke_threads) {
+    uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
+    uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
+
+    int value;
+    status_t result = wake_ptr.copy_from_user(&value);
+    if (result != NO_ERROR) return result;
+    if (value != current_value) return ERR_BAD_STATE;
+
     // This must happen before RemoveFromHead() calls set_hash_key() on
-    // nodes below, because operations on futex_table_ look at the GetKey
+    // nodes below, because operations on futex_table look at the GetKey
     // field of the list head nodes for wake_key and requeue_key.
-    FutexNode* node = futex_table_.erase(wake_key);
+    FutexNode* node = wake_bucket->futex_table.erase(wake_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return NO_ERROR;
@@ -177,7 +215,7 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
         wake_head = nullptr;
     } else {
         wake_head = node;
-        node = FutexNode::RemoveFromHead(node, wake_count, wake_key, 0u);
+        node = FutexNode::RemoveFromHead(node, wake_count, wake_key, wake_key);
     }
 
     // node is now the head of wake_ptr futex after possibly removing some threads to wake
@@ -190,22 +228,40 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
 
             // now requeue our nodes to requeue_ptr mutex
             DEBUG_ASSERT(requeue_head->GetKey() == requeue_key);
-            QueueNodesLocked(requeue_head);
+            QueueNodesLocked(requeue_bucket, requeue_head);
         }
     }
 
     // add any remaining nodes back to wake_key futex
     if (node != nullptr) {
         DEBUG_ASSERT(node->GetKey() == wake_key);
-        futex_table_.insert(node);
+        wake_bucket->futex_table.insert(node);
     }
 
-    FutexNode::WakeThreads(wake_head);
+    *woke_threads = FutexNode::WakeThreads(wake_head);
     return NO_ERROR;
 }
 
-void FutexContext::QueueNodesLocked(FutexNode* head) {
-    DEBUG_ASSERT(lock_.IsHeld());
+void FutexContext::LockBuckets(Bucket* b1, Bucket* b2) TA_NO_THREAD_SAFETY_ANALYSIS {
+    if (b1 == b2) {
+        b1->lock.Acquire();
+    } else if (b1 < b2) {
+        b1->lock.Acquire();
+        b2->lock.Acquire();
+    } else {
+        b2->lock.Acquire();
+        b1->lock.Acquire();
+    }
+}
+
+void FutexContext::UnlockBuckets(Bucket* b1, Bucket* b2) TA_NO_THREAD_SAFETY_ANALYSIS {
+    b1->lock.Release();
+    if (b1 != b2)
+        b2->lock.Release();
+}
+
+void FutexContext::QueueNodesLocked(Bucket* bucket, FutexNode* head) {
+    DEBUG_ASSERT(bucket->lock.IsHeld());
 
     FutexNode::HashTable::iterator iter;
 
@@ -213,29 +269,36 @@ void FutexContext::QueueNodesLocked(FutexNode* head) {
     // succeeds, then the current thread is first to block on this futex and we
     // are finished.  If the insert fails, then there is already a thread
     // waiting on this futex.  Add ourselves to that thread's list.
-    if (!futex_table_.insert_or_find(head, &iter))
+    if (!bucket->futex_table.insert_or_find(head, &iter))
         iter->AppendList(head);
 }
 
 // This attempts to unqueue a thread (which may or may not be waiting on a
 // futex), given its FutexNode.  This returns whether the FutexNode was
-// found and removed from a futex wait queue.
-bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
-    DEBUG_ASSERT(lock_.IsHeld());
-
-    if (!node->IsInQueue())
-        return false;
-
-    // Note: When UnqueueNode() is called from FutexWait(), it might be
-    // tempting to reuse the futex key that was passed to FutexWait().
-    // However, that could be out of date if the thread was requeued by
-    // FutexRequeue(), so we need to re-get the hash table key here.
-    uintptr_t futex_key = node->GetKey();
-
-    FutexNode* old_head = futex_table_.erase(futex_key);
-    DEBUG_ASSERT(old_head);
-    FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
-    if (new_head)
-        futex_table_.insert(new_head);
-    return true;
+// found and removed from a futex wait queue.  Either way, it synchronizes
+// with whichever thread last changed the node's queue state.
+bool FutexContext::UnqueueNode(FutexNode* node) {
+    for (;;) {
+        // Note: When UnqueueNode() is called from FutexWait(), it might be
+        // tempting to reuse the futex key that was passed to FutexWait().
+        // However, that could be out of date if the thread was requeued by
+        // FutexRequeue(), so we need to re-get the hash table key here.
+        // That read races with a concurrent requeue, so it is only trusted
+        // once the lock it names is held: the key can only change under it.
+        uintptr_t futex_key = node->GetKey();
+        Bucket* bucket = GetBucket(futex_key);
+        AutoLock lock(&bucket->lock);
+        if (node->GetKey() != futex_key)
+            continue;
+
+        if (!node->IsInQueue())
+            return false;
+
+        FutexNode* old_head = bucket->futex_table.erase(futex_key);
+        DEBUG_ASSERT(old_head);
+        FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
+        if (new_head)
+            bucket->futex_table.insert(new_head);
+        return true;
+    }
 }
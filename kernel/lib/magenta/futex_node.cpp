@@ -127,18 +127,22 @@ status_t FutexNode::BlockThread(Mutex* mutex, mx_time_t deadline) TA_NO_THREAD_S
     return result;
 }
 
-void FutexNode::WakeThreads(FutexNode* head) {
+// The woken threads are not switched to here: this is called with a bucket
+// lock held, which each of them will immediately try to take.  The caller
+// preempts itself once it has dropped the lock if this returns true.
+bool FutexNode::WakeThreads(FutexNode* head) {
     if (!head)
-        return;
+        return false;
     FutexNode* node = head;
     do {
         FutexNode* next = node->queue_next_;
         THREAD_LOCK(state);
-        wait_queue_wake_one(&node->wait_queue_, true, NO_ERROR);
+        wait_queue_wake_one(&node->wait_queue_, false, NO_ERROR);
         THREAD_UNLOCK(state);
         node->MarkAsNotInQueue();
         node = next;
     } while (node != head);
+    return true;
 }
 
 // Set |node1| and |node2|'s list pointers so that |node1| is immediately
@@ -46,8 +46,10 @@ public:
                   mxtl::unique_ptr<MessagePacket>* msg,
                   bool may_disard);
 
-    // Write to the opposing endpoint's message queue.
-    status_t Write(mxtl::unique_ptr<MessagePacket> msg);
+    // Write to the opposing endpoint's message queue. On failure |*msg| is
+    // left with the caller, no longer owning its handles, so that they and
+    // anything else it carries can be given back.
+    status_t Write(mxtl::unique_ptr<MessagePacket>* msg);
     status_t Call(mxtl::unique_ptr<MessagePacket> msg,
                   mx_time_t deadline, bool* return_handles,
                   mxtl::unique_ptr<MessagePacket>* reply);
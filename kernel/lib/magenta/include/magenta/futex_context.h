@@ -13,7 +13,8 @@
 
 // FutexContext is a class that encapsulates support for futex operations.
 // FutexContext uses a hash table keyed on the futex address (a pointer to integer in userspace)
-// to contain all active futexes.
+// to contain all active futexes. The table is split into buckets, each with its own lock, so
+// that operations on unrelated futexes in the same process do not contend with each other.
 // A futex is considered active if there is one or more threads blocked on the futex.
 // After no threads are left blocked on a futex it is removed from the hash table.
 // The value in the futex hash table is the FutexNode object associated with the head
@@ -51,14 +52,40 @@ private:
     FutexContext(const FutexContext&) = delete;
     FutexContext& operator=(const FutexContext&) = delete;
 
-    void QueueNodesLocked(FutexNode* head) TA_REQ(lock_);
+    struct Bucket {
+        // protects futex_table
+        Mutex lock;
 
-    bool UnqueueNodeLocked(FutexNode* node) TA_REQ(lock_);
+        // Key is futex address, value is the FutexNode for the head of futex's blocked
+        // thread list.
+        FutexNode::HashTable futex_table TA_GUARDED(lock);
+    };
 
-    // protects futex_table_
-    Mutex lock_;
+    static constexpr size_t kBucketShift = 5;
+    static constexpr size_t kNumBuckets = 1u << kBucketShift;
 
-    // Hash table for futexes in this context.
-    // Key is futex address, value is the FutexNode for the head of futex's blocked thread list.
-    FutexNode::HashTable futex_table_ TA_GUARDED(lock_);
+    Bucket* GetBucket(uintptr_t futex_key) {
+        // Fibonacci hashing takes the top bits, which keeps the bucket choice independent
+        // of the (low bit) hash used within each bucket's table.
+        uint64_t hash = static_cast<uint64_t>(FutexNode::GetHash(futex_key)) * 0x9E3779B97F4A7C15ull;
+        return &buckets_[hash >> (64 - kBucketShift)];
+    }
+
+    // Locks the buckets for two futexes, in a consistent order; they may be the same bucket.
+    static void LockBuckets(Bucket* b1, Bucket* b2) TA_ACQ(b1->lock, b2->lock);
+    static void UnlockBuckets(Bucket* b1, Bucket* b2) TA_REL(b1->lock, b2->lock);
+
+    // Sets |woke_threads| if any thread was woken; the caller lets them run
+    // once it has dropped the bucket locks.
+    status_t FutexRequeueLocked(Bucket* wake_bucket, user_ptr<int> wake_ptr, uint32_t wake_count,
+                                int current_value, Bucket* requeue_bucket,
+                                user_ptr<int> requeue_ptr, uint32_t requeue_count,
+                                bool* woke_threads)
+        TA_REQ(wake_bucket->lock, requeue_bucket->lock);
+
+    static void QueueNodesLocked(Bucket* bucket, FutexNode* head) TA_REQ(bucket->lock);
+
+    bool UnqueueNode(FutexNode* node);
+
+    Bucket buckets_[kNumBuckets];
 };
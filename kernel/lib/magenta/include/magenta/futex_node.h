@@ -17,7 +17,9 @@
 // Intended to be embedded within a UserThread Instance
 class FutexNode : public mxtl::SinglyLinkedListable<FutexNode*> {
 public:
-    using HashTable = mxtl::HashTable<uintptr_t, FutexNode*>;
+    // Tables are per FutexContext bucket, so each only needs a few lists.
+    using HashTable = mxtl::HashTable<uintptr_t, FutexNode*,
+                                      mxtl::SinglyLinkedList<FutexNode*>, size_t, 7>;
 
     FutexNode();
     ~FutexNode();
@@ -41,8 +43,9 @@ public:
     // This must be called with |mutex| held and returns without |mutex| held.
     status_t BlockThread(Mutex* mutex, mx_time_t deadline) TA_REL(mutex);
 
-    // wakes the list of threads starting with node |head|
-    static void WakeThreads(FutexNode* head);
+    // wakes the list of threads starting with node |head|, without rescheduling;
+    // returns whether any thread was woken
+    static bool WakeThreads(FutexNode* head);
 
     void set_hash_key(uintptr_t key) {
         hash_key_ = key;
@@ -60,7 +63,9 @@ private:
 
     // hash_key_ contains the futex address.  This field has two roles:
     //  * It is used by FutexWait() to determine which queue to remove the
-    //    thread from when a wait operation times out.
+    //    thread from when a wait operation times out, and which bucket lock
+    //    to take to synchronize with the thread that woke it.  It is only
+    //    changed with the lock of the bucket it currently names held.
     //  * Additionally, when this FutexNode is the head of a futex wait
     //    queue, this field is used by the HashTable (because it uses
     //    intrusive SinglyLinkedLists).
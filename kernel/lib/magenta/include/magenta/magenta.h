@@ -8,9 +8,12 @@
 
 #include <stdint.h>
 
+#include <kernel/spinlock.h>
+
 #include <magenta/handle.h>
 #include <magenta/types.h>
 
+#include <mxtl/macros.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
@@ -33,6 +36,23 @@ void DeleteHandle(Handle* handle);
 // Maps an integer obtained by Handle->base_value() back to a Handle.
 Handle* MapU32ToHandle(uint32_t value);
 
+// Brackets a handle lookup that doesn't hold the owning process's handle
+// table lock. A Handle found while the guard is held won't be torn down
+// until the guard is released, because DeleteHandle() first waits out every
+// guard that was active when it started. Interrupts are disabled for the
+// guard's lifetime, so only copy out what is needed inside it.
+class HandleLookupGuard {
+public:
+    HandleLookupGuard();
+    ~HandleLookupGuard();
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(HandleLookupGuard);
+
+private:
+    spin_lock_saved_state_t irq_state_;
+    uint cpu_;
+};
+
 // Set/get the system exception port.
 mx_status_t SetSystemExceptionPort(mxtl::RefPtr<ExceptionPort> eport);
 // Returns true if a port had been set.
@@ -8,27 +8,52 @@
 
 #include <stdint.h>
 
+#include <lib/user_copy/user_ptr.h>
 #include <magenta/types.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/unique_ptr.h>
 
 class Handle;
+class VmPageList;
 
 class MessagePacket : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<MessagePacket>> {
 public:
-    // Creates a message packet.
+    // Creates a message packet. Payloads that don't fit in a page alongside
+    // the packet are stored in individually allocated pages, see is_paged().
     static mx_status_t Create(uint32_t data_size, uint32_t num_handles,
                               mxtl::unique_ptr<MessagePacket>* msg);
 
+    // Creates a message packet whose payload is carried by pages rather than
+    // stored inline. The caller fills mutable_pages() so that the page at
+    // offset i * PAGE_SIZE holds payload bytes [i * PAGE_SIZE, (i + 1) * PAGE_SIZE).
+    // |data_size| must be a nonzero multiple of PAGE_SIZE. The packet frees
+    // whatever pages it holds when it is destroyed.
+    static mx_status_t CreateWithPages(uint32_t data_size, uint32_t num_handles,
+                                       mxtl::unique_ptr<MessagePacket>* msg);
+
     uint32_t data_size() const { return data_size_; }
     uint32_t num_handles() const { return num_handles_; }
 
     void set_owns_handles(bool own_handles) { owns_handles_ = own_handles; }
 
+    // True if the payload lives in pages rather than inline, in which case
+    // data() and mutable_data() must not be used.
+    bool is_paged() const { return paged_; }
+
     const void* data() const { return static_cast<void*>(handles_ + num_handles_); }
     void* mutable_data() { return static_cast<void*>(handles_ + num_handles_); }
     Handle* const* handles() const { return handles_; }
     Handle** mutable_handles() { return handles_; }
+    VmPageList* mutable_pages() { return pages_.get(); }
+
+    // Copies the first |len| bytes of the payload out to |dst|, wherever
+    // they are stored.
+    mx_status_t CopyDataToUser(user_ptr<void> dst, uint32_t len) const;
+
+    // Fills the first |len| bytes of the payload from |src|, wherever they
+    // are stored.
+    mx_status_t CopyDataFromUser(user_ptr<const void> src, uint32_t len);
+    void CopyDataFromKernel(const void* src, uint32_t len);
 
     // mx_channel_call treats the leading bytes of the payload as
     // a transaction id of type mx_txid_t.
@@ -36,21 +61,54 @@ public:
         if (data_size_ < sizeof(mx_txid_t)) {
             return 0;
         } else {
-            return *(reinterpret_cast<const mx_txid_t*>(data()));
+            return *(reinterpret_cast<const mx_txid_t*>(paged_ ? first_page() : data()));
         }
     }
 
 private:
-    MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles);
+    // Where the memory backing a packet came from. Packets up to a page are
+    // carved out of size-class slabs, and the heap is the fallback when a slab
+    // class is exhausted or the handle table alone is bigger than a page.
+    enum class Storage : uint8_t {
+        kSmallSlab,
+        kMediumSlab,
+        kLargeSlab,
+        kHeap,
+    };
+
+    // Precedes the packet in its buffer and records the storage kind, so the
+    // memory can be routed back without reading the destroyed packet.
+    struct Header;
+
+    MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles,
+                  mxtl::unique_ptr<VmPageList> pages);
     ~MessagePacket();
 
-    static void operator delete(void* ptr) {
-        free(ptr);
-    }
+    static mx_status_t Allocate(uint32_t inline_data_size, uint32_t num_handles,
+                                char** ptr, Storage* storage);
+    static mx_status_t AllocatePages(uint32_t data_size, mxtl::unique_ptr<VmPageList>* pages);
+    static mx_status_t CreateInternal(uint32_t data_size, uint32_t num_handles,
+                                      mxtl::unique_ptr<VmPageList> pages,
+                                      mxtl::unique_ptr<MessagePacket>* msg);
+
+    // Calls |func(chunk, offset, chunk_len)| on successive pieces of the first
+    // |len| bytes of the payload, stopping at the first error.
+    template <typename F>
+    mx_status_t ForEachDataChunk(uint32_t len, F func) const;
+
+    const void* first_page() const;
+
+    // Routes the memory back to wherever it came from, as recorded in the
+    // Header in front of the packet.
+    static void operator delete(void* ptr);
     friend class mxtl::unique_ptr<MessagePacket>;
 
+    static size_t AllocationSize(uint32_t data_size, uint32_t num_handles);
+
     bool owns_handles_;
+    const bool paged_;
     uint32_t data_size_;
     uint32_t num_handles_;
     Handle** handles_;
+    mxtl::unique_ptr<VmPageList> pages_;
 };
@@ -88,6 +88,13 @@ struct PortPacket final : public mxtl::DoublyLinkedListable<PortPacket*> {
     void operator=(PortPacket) = delete;
 
     uint32_t type() const { return packet.type; }
+
+    // User and page request packets are allocated by the port when they are
+    // queued and freed when they are dequeued; signal packets belong to their
+    // PortObserver.
+    bool owned_by_port() const {
+        return packet.type == MX_PKT_TYPE_USER || packet.type == MX_PKT_TYPE_PAGE_REQUEST;
+    }
 };
 
 // Observers are weakly contained in state trackers until |remove_| member
@@ -136,7 +143,14 @@ public:
 
     mx_status_t Queue(PortPacket* port_packet, mx_signals_t observed, uint64_t count);
     mx_status_t QueueUser(const mx_port_packet_t& packet);
+    mx_status_t QueuePageRequest(uint64_t key, uint64_t offset, uint64_t length);
+    mx_status_t QueueZeroChildren(uint64_t key, uint64_t clone_count);
     mx_status_t DeQueue(mx_time_t deadline, mx_port_packet_t* packet);
+    // Waits like DeQueue() for the first packet, then also takes up to
+    // |count| - 1 more that are already queued. |packets| may be null to
+    // discard them.
+    mx_status_t DeQueueMany(mx_time_t deadline, mx_port_packet_t* packets, size_t count,
+                            size_t* actual);
 
     // Decides who is going to destroy the observer. If it returns |true| it
     // is the duty of the caller. If it is false it is the duty of the port.
@@ -149,6 +163,7 @@ public:
 private:
     PortDispatcherV2(uint32_t options);
     PortObserver* CopyLocked(PortPacket* port_packet, mx_port_packet_t* packet) TA_REQ(lock_);
+    mx_status_t QueueOwned(const mx_port_packet_t& packet);
 
     mxtl::Canary<mxtl::magic("POR2")> canary_;
     Mutex lock_;
@@ -0,0 +1,29 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <kernel/vm/page_source.h>
+#include <magenta/port_dispatcher_v2.h>
+#include <mxtl/ref_ptr.h>
+
+// Forwards the page requests of a pager-backed vmo to a userspace pager as
+// MX_PKT_TYPE_PAGE_REQUEST packets on a port.
+class PortPageSource final : public PageSource {
+public:
+    static status_t Create(mxtl::RefPtr<PortDispatcherV2> port, uint64_t key,
+                           mxtl::RefPtr<PageSource>* source);
+
+private:
+    PortPageSource(mxtl::RefPtr<PortDispatcherV2> port, uint64_t key);
+    ~PortPageSource() final = default;
+
+    status_t SendRequest(uint64_t offset, uint64_t len) final;
+    void OnZeroChildren(uint64_t clone_count) final;
+
+    const mxtl::RefPtr<PortDispatcherV2> port_;
+    const uint64_t key_;
+};
@@ -89,6 +89,10 @@ public:
     // it belongs to this process.
     Handle* GetHandleLocked(mx_handle_t handle_value) TA_REQ(handle_table_lock_);
 
+    // Same as GetHandleLocked(), for use inside a HandleLookupGuard instead
+    // of the handle table lock. The result is only valid inside the guard.
+    Handle* GetHandleLockFree(mx_handle_t handle_value) const;
+
     // Adds |handle| to this process handle list. The handle->process_id() is
     // set to this process id().
     void AddHandle(HandleOwner handle);
@@ -20,6 +20,10 @@ public:
     int Post();
     status_t Wait(lk_time_t deadline);
 
+    // Takes up to |count| resources that have already been posted, without
+    // blocking. Returns how many were taken.
+    uint64_t TryWaitMany(uint64_t count);
+
 private:
     int64_t count_;
     wait_queue_t waitq_;
@@ -30,6 +30,7 @@
 #include <magenta/io_mapping_dispatcher.h>
 
 #include <mxtl/arena.h>
+#include <mxtl/atomic.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/type_support.h>
 
@@ -47,7 +48,28 @@ constexpr size_t kHighHandleCount = (kMaxHandleCount * 7) / 8;
 // The handle arena and its mutex.
 static Mutex handle_mutex;
 static mxtl::Arena TA_GUARDED(handle_mutex) handle_arena;
-static size_t outstanding_handles TA_GUARDED(handle_mutex) = 0u;
+static mxtl::atomic<size_t> outstanding_handles(0u);
+
+// Per-cpu stacks of free handle_arena slots, so creating and closing
+// handles only takes |handle_mutex| once per batch. Slots move between a
+// cache and the arena |kHandleCacheBatch| at a time.
+constexpr size_t kHandleCacheBatch = 16;
+constexpr size_t kHandleCacheMax = 64;
+
+struct HandleSlotCache {
+    spin_lock_t lock;
+    size_t count;
+    void* slots[kHandleCacheMax];
+} __CPU_ALIGN;
+
+static HandleSlotCache handle_caches[SMP_MAX_CPUS];
+
+// Per-cpu counters for HandleLookupGuard, odd while the cpu is inside one.
+struct HandleLookupSeq {
+    volatile uint64_t seq;
+} __CPU_ALIGN;
+
+static HandleLookupSeq handle_lookup_seq[SMP_MAX_CPUS];
 
 // The system exception port.
 static mutex_t system_exception_mutex = MUTEX_INITIAL_VALUE(system_exception_mutex);
@@ -99,7 +121,7 @@ static_assert(((3 << 30) ^ kHandleGenerationMask ^ kHandleIndexMask) ==
 // Returns a new |base_value| based on the value stored in the free
 // |handle_arena| slot pointed to by |addr|. The new value will be different
 // from the last |base_value| used by this slot.
-static uint32_t GetNewHandleBaseValue(void* addr) TA_REQ(handle_mutex) {
+static uint32_t GetNewHandleBaseValue(void* addr) TA_NO_THREAD_SAFETY_ANALYSIS {
     // Get the index of this slot within handle_arena.
     auto va = reinterpret_cast<Handle*>(addr) -
               reinterpret_cast<Handle*>(handle_arena.start());
@@ -148,43 +170,152 @@ void internal::TearDownHandle(Handle *handle) TA_EXCL(handle_mutex) {
 
 static void high_handle_count(size_t count) {
     // TODO: Avoid calling this for every handle after kHighHandleCount;
-    // printfs are slow and |handle_mutex| is held by our caller.
+    // printfs are slow.
     printf("WARNING: High handle count: %zu handles\n", count);
 }
 
-Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
+static HandleSlotCache* LockHandleSlotCache(spin_lock_saved_state_t* state) {
+    arch_interrupt_save(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    HandleSlotCache* cache = &handle_caches[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    return cache;
+}
+
+static void UnlockHandleSlotCache(HandleSlotCache* cache, spin_lock_saved_state_t state) {
+    spin_unlock(&cache->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// Takes a free slot from another cpu's cache once the arena is exhausted.
+static void* StealHandleSlot() {
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        HandleSlotCache* cache = &handle_caches[i];
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&cache->lock, state);
+        void* addr = cache->count ? cache->slots[--cache->count] : nullptr;
+        spin_unlock_irqrestore(&cache->lock, state);
+        if (addr)
+            return addr;
+    }
+    return nullptr;
+}
+
+static void* AllocHandleSlot() {
+    spin_lock_saved_state_t state;
+    HandleSlotCache* cache = LockHandleSlotCache(&state);
+    void* addr = cache->count ? cache->slots[--cache->count] : nullptr;
+    UnlockHandleSlotCache(cache, state);
+    if (addr)
+        return addr;
+
+    // Refill from the arena, keeping one slot for ourselves.
+    void* batch[kHandleCacheBatch];
+    size_t n = 0;
+    {
+        AutoLock lock(&handle_mutex);
+        while (n < kHandleCacheBatch && (batch[n] = handle_arena.Alloc()) != nullptr)
+            n++;
+    }
+    if (n == 0)
+        return StealHandleSlot();
+    addr = batch[--n];
+
+    // We may have migrated, or raced another refill; whatever doesn't fit
+    // goes back.
+    cache = LockHandleSlotCache(&state);
+    while (n > 0 && cache->count < kHandleCacheMax)
+        cache->slots[cache->count++] = batch[--n];
+    UnlockHandleSlotCache(cache, state);
+
+    if (n > 0) {
+        AutoLock lock(&handle_mutex);
+        while (n > 0)
+            handle_arena.Free(batch[--n]);
+    }
+    return addr;
+}
+
+static void FreeHandleSlot(void* addr) {
+    spin_lock_saved_state_t state;
+    HandleSlotCache* cache = LockHandleSlotCache(&state);
+    if (cache->count < kHandleCacheMax) {
+        cache->slots[cache->count++] = addr;
+        UnlockHandleSlotCache(cache, state);
+        return;
+    }
+
+    // Full: hand the coldest batch back to the arena and keep this one.
+    void* batch[kHandleCacheBatch];
+    memcpy(batch, cache->slots, sizeof(batch));
+    memmove(cache->slots, cache->slots + kHandleCacheBatch,
+            (kHandleCacheMax - kHandleCacheBatch) * sizeof(void*));
+    cache->count -= kHandleCacheBatch;
+    cache->slots[cache->count++] = addr;
+    UnlockHandleSlotCache(cache, state);
+
     AutoLock lock(&handle_mutex);
-    void* addr = handle_arena.Alloc();
+    for (size_t i = 0; i < kHandleCacheBatch; i++)
+        handle_arena.Free(batch[i]);
+}
+
+static void* NewHandleSlot(const char* what) {
+    void* addr = AllocHandleSlot();
     if (addr == nullptr) {
-        const auto oh = outstanding_handles;
-        lock.release();
-        printf("WARNING: Could not allocate new handle (%zu outstanding)\n",
-               oh);
+        printf("WARNING: Could not allocate %s handle (%zu outstanding)\n",
+               what, outstanding_handles.load());
         return nullptr;
     }
-    if (++outstanding_handles > kHighHandleCount)
-        high_handle_count(outstanding_handles);
+    size_t count = outstanding_handles.fetch_add(1u) + 1;
+    if (count > kHighHandleCount)
+        high_handle_count(count);
+    return addr;
+}
+
+Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
+    void* addr = NewHandleSlot("new");
+    if (addr == nullptr)
+        return nullptr;
     uint32_t base_value = GetNewHandleBaseValue(addr);
     return new (addr) Handle(mxtl::move(dispatcher), rights, base_value);
 }
 
 Handle* DupHandle(Handle* source, mx_rights_t rights) {
-    AutoLock lock(&handle_mutex);
-    void* addr = handle_arena.Alloc();
-    if (addr == nullptr) {
-        const auto oh = outstanding_handles;
-        lock.release();
-        printf(
-            "WARNING: Could not allocate duplicate handle (%zu outstanding)\n",
-            oh);
+    void* addr = NewHandleSlot("duplicate");
+    if (addr == nullptr)
         return nullptr;
-    }
-    if (++outstanding_handles > kHighHandleCount)
-        high_handle_count(outstanding_handles);
     uint32_t base_value = GetNewHandleBaseValue(addr);
     return new (addr) Handle(source, rights, base_value);
 }
 
+HandleLookupGuard::HandleLookupGuard() {
+    arch_interrupt_save(&irq_state_, SPIN_LOCK_FLAG_INTERRUPTS);
+    cpu_ = arch_curr_cpu_num();
+    handle_lookup_seq[cpu_].seq++;
+    // Make the odd count visible before reading any handle; pairs with the
+    // barrier in WaitForHandleLookups().
+    smp_mb();
+}
+
+HandleLookupGuard::~HandleLookupGuard() {
+    smp_mb();
+    handle_lookup_seq[cpu_].seq++;
+    arch_interrupt_restore(irq_state_, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// Waits for every HandleLookupGuard that was active on entry to be released.
+// A handle whose process_id was cleared before this is called can't be
+// found by any guard taken afterwards.
+static void WaitForHandleLookups() {
+    smp_mb();
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        uint64_t seq = handle_lookup_seq[i].seq;
+        if (!(seq & 1))
+            continue;
+        while (handle_lookup_seq[i].seq == seq)
+            arch_spinloop_pause();
+    }
+}
+
 void DeleteHandle(Handle* handle) {
     StateTracker* state_tracker = handle->dispatcher()->get_state_tracker();
     if (state_tracker) {
@@ -206,18 +337,22 @@ void DeleteHandle(Handle* handle) {
         };
     }
 
+    // Lock-free lookups may still be looking at the handle.
+    WaitForHandleLookups();
+
     // Destroys, but does not free, the Handle, and fixes up its memory
     // to protect against stale pointers to it. Also stashes the Handle's
     // base_value for reuse the next time this slot is allocated.
     internal::TearDownHandle(handle);
 
-    AutoLock lock(&handle_mutex);
-    --outstanding_handles;
-    handle_arena.Free(handle);
+    outstanding_handles.fetch_sub(1u);
+    FreeHandleSlot(handle);
 }
 
-bool HandleInRange(void* addr) {
-    AutoLock lock(&handle_mutex);
+// The arena's data pool only ever grows, so a racy read of its bounds can at
+// worst reject a slot allocated concurrently, which no one can have a handle
+// value for yet.
+bool HandleInRange(void* addr) TA_NO_THREAD_SAFETY_ANALYSIS {
     return handle_arena.in_range(addr);
 }
 
@@ -231,8 +366,14 @@ Handle* MapU32ToHandle(uint32_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
 }
 
 void internal::DumpHandleTableInfo() {
-    AutoLock lock(&handle_mutex);
-    handle_arena.Dump();
+    {
+        AutoLock lock(&handle_mutex);
+        handle_arena.Dump();
+    }
+    printf("%zu outstanding handles, per-cpu cached slots:", outstanding_handles.load());
+    for (uint i = 0; i < SMP_MAX_CPUS; i++)
+        printf(" %zu", handle_caches[i].count);
+    printf("\n");
 }
 
 mx_status_t SetSystemExceptionPort(mxtl::RefPtr<ExceptionPort> eport) {
@@ -6,14 +6,160 @@
 
 #include <err.h>
 #include <new.h>
+#include <string.h>
 
+#include <kernel/vm.h>
+#include <kernel/vm/vm_page_list.h>
 #include <magenta/handle_reaper.h>
 #include <magenta/magenta.h>
 #include <magenta/message_packet.h>
+#include <mxtl/algorithm.h>
+#include <mxtl/slab_allocator.h>
 
 constexpr uint32_t kMaxMessageSize = 65536u;
 constexpr uint32_t kMaxMessageHandles = 1024u;
 
+namespace {
+
+// Most channel traffic is small RPCs, so packets up to a page are served out
+// of three size classes of slab-allocated buffers. Each class is capped at
+// kMaxMessageSlabs slabs; once a class is exhausted we fall back to the heap
+// rather than fail the write.
+constexpr size_t kMessageSlabSize = 64u * 1024u;
+constexpr size_t kMaxMessageSlabs = 16u;
+
+template <size_t kSize>
+struct MessageBuffer;
+
+template <size_t kSize>
+using MessageBufferTraits =
+    mxtl::StaticSlabAllocatorTraits<MessageBuffer<kSize>*, kMessageSlabSize>;
+
+template <size_t kSize>
+struct MessageBuffer : public mxtl::SlabAllocated<MessageBufferTraits<kSize>> {
+    static constexpr size_t kCapacity = kSize;
+
+    alignas(MessagePacket) char bytes[kSize];
+};
+
+using SmallMessageBuffer = MessageBuffer<256u>;
+using MediumMessageBuffer = MessageBuffer<1024u>;
+using LargeMessageBuffer = MessageBuffer<PAGE_SIZE>;
+
+template <typename Buffer>
+void* AllocBuffer() {
+    Buffer* buffer = mxtl::SlabAllocator<MessageBufferTraits<Buffer::kCapacity>>::New();
+    return buffer ? buffer->bytes : nullptr;
+}
+
+template <typename Buffer>
+void FreeBuffer(void* ptr) {
+    static_assert(offsetof(Buffer, bytes) == 0, "");
+    delete reinterpret_cast<Buffer*>(ptr);
+}
+
+}  // namespace
+
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(MessageBufferTraits<SmallMessageBuffer::kCapacity>,
+                                      kMaxMessageSlabs);
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(MessageBufferTraits<MediumMessageBuffer::kCapacity>,
+                                      kMaxMessageSlabs);
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(MessageBufferTraits<LargeMessageBuffer::kCapacity>,
+                                      kMaxMessageSlabs);
+
+struct alignas(alignof(MessagePacket)) MessagePacket::Header {
+    Storage storage;
+};
+
+// static
+size_t MessagePacket::AllocationSize(uint32_t data_size, uint32_t num_handles) {
+    return sizeof(Header) + sizeof(MessagePacket) + num_handles * sizeof(Handle*) + data_size;
+}
+
+// static
+mx_status_t MessagePacket::Allocate(uint32_t inline_data_size, uint32_t num_handles,
+                                    char** out_ptr, Storage* out_storage) {
+    // Allocate space for the Header and MessagePacket object followed by
+    // num_handles Handle*s followed by inline_data_size bytes.
+    const size_t size = AllocationSize(inline_data_size, num_handles);
+    char* ptr = nullptr;
+    Storage storage = Storage::kHeap;
+    if (size <= SmallMessageBuffer::kCapacity) {
+        ptr = static_cast<char*>(AllocBuffer<SmallMessageBuffer>());
+        storage = Storage::kSmallSlab;
+    } else if (size <= MediumMessageBuffer::kCapacity) {
+        ptr = static_cast<char*>(AllocBuffer<MediumMessageBuffer>());
+        storage = Storage::kMediumSlab;
+    } else if (size <= LargeMessageBuffer::kCapacity) {
+        ptr = static_cast<char*>(AllocBuffer<LargeMessageBuffer>());
+        storage = Storage::kLargeSlab;
+    }
+
+    if (ptr == nullptr) {
+        ptr = static_cast<char*>(malloc(size));
+        storage = Storage::kHeap;
+        if (ptr == nullptr)
+            return ERR_NO_MEMORY;
+    }
+
+    new (ptr) Header{storage};
+    *out_ptr = ptr + sizeof(Header);
+    *out_storage = storage;
+    return NO_ERROR;
+}
+
+// static
+mx_status_t MessagePacket::AllocatePages(uint32_t data_size,
+                                         mxtl::unique_ptr<VmPageList>* out_pages) {
+    AllocChecker ac;
+    mxtl::unique_ptr<VmPageList> pages(new (&ac) VmPageList());
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    // Individual pages rather than a contiguous run, so big packets don't
+    // depend on physical memory being unfragmented.
+    size_t count = ROUNDUP(data_size, PAGE_SIZE) / PAGE_SIZE;
+    list_node list = LIST_INITIAL_VALUE(list);
+    if (pmm_alloc_pages(count, PMM_ALLOC_FLAG_ANY, &list) != count) {
+        pmm_free(&list);
+        return ERR_NO_MEMORY;
+    }
+
+    mx_status_t status = pages->AddPages(&list, 0u, count * PAGE_SIZE,
+                                         [](vm_page_t*, uint64_t) {});
+    if (status != NO_ERROR) {
+        pmm_free(&list);
+        pages->FreeAllPages();
+        return status;
+    }
+
+    *out_pages = mxtl::move(pages);
+    return NO_ERROR;
+}
+
+// static
+mx_status_t MessagePacket::CreateInternal(uint32_t data_size, uint32_t num_handles,
+                                          mxtl::unique_ptr<VmPageList> pages,
+                                          mxtl::unique_ptr<MessagePacket>* msg) {
+    // A paged packet only stores the handle table inline.
+    char* ptr;
+    Storage storage;
+    mx_status_t status = Allocate(pages ? 0u : data_size, num_handles, &ptr, &storage);
+    if (status != NO_ERROR) {
+        if (pages)
+            pages->FreeAllPages();
+        return status;
+    }
+
+    // The storage space for the Handle*s and bytes is not initialized
+    // because the only creators of MessagePackets (sys_channel_write and _call)
+    // fill these arrays immediately after creation of the object.
+    msg->reset(new (ptr) MessagePacket(data_size, num_handles,
+                                       reinterpret_cast<Handle**>(ptr + sizeof(MessagePacket)),
+                                       mxtl::move(pages)));
+    return NO_ERROR;
+}
+
 // static
 mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
                                   mxtl::unique_ptr<MessagePacket>* msg) {
@@ -22,30 +168,115 @@ mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
     if (num_handles > kMaxMessageHandles)
         return ERR_OUT_OF_RANGE;
 
-    // Allocate space for the MessagePacket object followed by num_handles
-    // Handle*s followed by data_size bytes.
-    char* ptr = static_cast<char*>(malloc(sizeof(MessagePacket) +
-                                          num_handles * sizeof(Handle*) +
-                                          data_size));
-    if (ptr == nullptr)
+    mxtl::unique_ptr<VmPageList> pages;
+    if (AllocationSize(data_size, num_handles) > LargeMessageBuffer::kCapacity) {
+        mx_status_t status = AllocatePages(data_size, &pages);
+        if (status != NO_ERROR)
+            return status;
+    }
+
+    return CreateInternal(data_size, num_handles, mxtl::move(pages), msg);
+}
+
+// static
+mx_status_t MessagePacket::CreateWithPages(uint32_t data_size, uint32_t num_handles,
+                                           mxtl::unique_ptr<MessagePacket>* msg) {
+    if (data_size == 0u || !IS_PAGE_ALIGNED(data_size))
+        return ERR_INVALID_ARGS;
+    if (data_size > kMaxMessageSize)
+        return ERR_OUT_OF_RANGE;
+    if (num_handles > kMaxMessageHandles)
+        return ERR_OUT_OF_RANGE;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<VmPageList> pages(new (&ac) VmPageList());
+    if (!ac.check())
         return ERR_NO_MEMORY;
 
-    // The storage space for the Handle*s and bytes is not initialized
-    // because the only creators of MessagePackets (sys_channel_write and _call)
-    // fill these arrays immediately after creation of the object.
-    msg->reset(new (ptr) MessagePacket(data_size, num_handles,
-                                       reinterpret_cast<Handle**>(ptr + sizeof(MessagePacket))));
+    return CreateInternal(data_size, num_handles, mxtl::move(pages), msg);
+}
+
+template <typename F>
+mx_status_t MessagePacket::ForEachDataChunk(uint32_t len, F func) const {
+    DEBUG_ASSERT(len <= data_size_);
+
+    if (!paged_)
+        return func(const_cast<void*>(data()), 0u, len);
+
+    for (uint32_t offset = 0; offset < len; offset += PAGE_SIZE) {
+        vm_page_t* page = pages_->GetPage(offset);
+        DEBUG_ASSERT(page);
+        void* chunk = paddr_to_kvaddr(vm_page_to_paddr(page));
+        mx_status_t status = func(chunk, offset, mxtl::min<uint32_t>(len - offset, PAGE_SIZE));
+        if (status != NO_ERROR)
+            return status;
+    }
     return NO_ERROR;
 }
 
+mx_status_t MessagePacket::CopyDataToUser(user_ptr<void> dst, uint32_t len) const {
+    return ForEachDataChunk(len, [dst](void* chunk, uint32_t offset, uint32_t chunk_len) {
+        return make_user_ptr(static_cast<char*>(dst.get()) + offset)
+            .copy_array_to_user(static_cast<const char*>(chunk), chunk_len);
+    });
+}
+
+mx_status_t MessagePacket::CopyDataFromUser(user_ptr<const void> src, uint32_t len) {
+    return ForEachDataChunk(len, [src](void* chunk, uint32_t offset, uint32_t chunk_len) {
+        return src.copy_array_from_user(chunk, chunk_len, offset);
+    });
+}
+
+void MessagePacket::CopyDataFromKernel(const void* src, uint32_t len) {
+    ForEachDataChunk(len, [src](void* chunk, uint32_t offset, uint32_t chunk_len) {
+        memcpy(chunk, static_cast<const char*>(src) + offset, chunk_len);
+        return NO_ERROR;
+    });
+}
+
+const void* MessagePacket::first_page() const {
+    vm_page_t* page = pages_->GetPage(0u);
+    DEBUG_ASSERT(page);
+    return paddr_to_kvaddr(vm_page_to_paddr(page));
+}
+
+// static
+void MessagePacket::operator delete(void* ptr) {
+    // The packet has been destroyed; only the Header in front of it is read.
+    char* buffer = static_cast<char*>(ptr) - sizeof(Header);
+    Header* header = reinterpret_cast<Header*>(buffer);
+    Storage storage = header->storage;
+    header->~Header();
+
+    switch (storage) {
+    case Storage::kSmallSlab:
+        FreeBuffer<SmallMessageBuffer>(buffer);
+        break;
+    case Storage::kMediumSlab:
+        FreeBuffer<MediumMessageBuffer>(buffer);
+        break;
+    case Storage::kLargeSlab:
+        FreeBuffer<LargeMessageBuffer>(buffer);
+        break;
+    case Storage::kHeap:
+        free(buffer);
+        break;
+    }
+}
+
 MessagePacket::~MessagePacket() {
     if (owns_handles_) {
         // Delete handles out-of-band to avoid the worst case recursive
         // destruction behavior.
         ReapHandles(handles_, num_handles_);
     }
+    if (pages_) {
+        pages_->FreeAllPages();
+    }
 }
 
-MessagePacket::MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles)
-    : owns_handles_(false), data_size_(data_size), num_handles_(num_handles), handles_(handles) {
+MessagePacket::MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles,
+                             mxtl::unique_ptr<VmPageList> pages)
+    : owns_handles_(false), paged_(pages != nullptr), data_size_(data_size),
+      num_handles_(num_handles), handles_(handles), pages_(mxtl::move(pages)) {
 }
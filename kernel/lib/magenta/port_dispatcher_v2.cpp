@@ -21,6 +21,9 @@
 constexpr mx_rights_t kDefaultIOPortRightsV2 =
     MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE;
 
+// Port locks are only held to queue and dequeue packets.
+static mutex_class_t port_lock_class = MUTEX_CLASS_INITIAL_VALUE(port_lock_class, "port");
+
 PortPacket::PortPacket() : packet{}, observer(nullptr) {
     // Note that packet is initialized to zeros.
 }
@@ -107,7 +110,8 @@ mx_status_t PortDispatcherV2::Create(uint32_t options,
 }
 
 PortDispatcherV2::PortDispatcherV2(uint32_t /*options*/)
-    : zero_handles_(false) {
+    : lock_(MUTEX_FLAG_ADAPTIVE, &port_lock_class),
+      zero_handles_(false) {
 }
 
 PortDispatcherV2::~PortDispatcherV2() {
@@ -127,13 +131,44 @@ void PortDispatcherV2::on_zero_handles() {
 mx_status_t PortDispatcherV2::QueueUser(const mx_port_packet_t& packet) {
     canary_.Assert();
 
+    mx_port_packet_t user_packet = packet;
+    user_packet.type = MX_PKT_TYPE_USER;
+    return QueueOwned(user_packet);
+}
+
+mx_status_t PortDispatcherV2::QueuePageRequest(uint64_t key, uint64_t offset, uint64_t length) {
+    canary_.Assert();
+
+    mx_port_packet_t packet = {};
+    packet.key = key;
+    packet.type = MX_PKT_TYPE_PAGE_REQUEST;
+    packet.status = NO_ERROR;
+    packet.page_request.offset = offset;
+    packet.page_request.length = length;
+    packet.page_request.command = MX_PAGER_VMO_READ;
+    return QueueOwned(packet);
+}
+
+mx_status_t PortDispatcherV2::QueueZeroChildren(uint64_t key, uint64_t clone_count) {
+    canary_.Assert();
+
+    mx_port_packet_t packet = {};
+    packet.key = key;
+    packet.type = MX_PKT_TYPE_PAGE_REQUEST;
+    packet.status = NO_ERROR;
+    packet.page_request.command = MX_PAGER_VMO_ZERO_CHILDREN;
+    packet.page_request.clone_count = clone_count;
+    return QueueOwned(packet);
+}
+
+mx_status_t PortDispatcherV2::QueueOwned(const mx_port_packet_t& packet) {
     AllocChecker ac;
     auto port_packet = new (&ac) PortPacket();
     if (!ac.check())
         return ERR_NO_MEMORY;
 
     port_packet->packet = packet;
-    port_packet->packet.type = MX_PKT_TYPE_USER;
+    DEBUG_ASSERT(port_packet->owned_by_port());
 
     auto status = Queue(port_packet, 0u, 0u);
     if (status < 0)
@@ -170,39 +205,60 @@ mx_status_t PortDispatcherV2::Queue(PortPacket* port_packet,
 }
 
 mx_status_t PortDispatcherV2::DeQueue(mx_time_t deadline, mx_port_packet_t* packet) {
+    size_t actual;
+    return DeQueueMany(deadline, packet, 1u, &actual);
+}
+
+mx_status_t PortDispatcherV2::DeQueueMany(mx_time_t deadline, mx_port_packet_t* packets,
+                                          size_t count, size_t* actual) {
     canary_.Assert();
+    DEBUG_ASSERT(count > 0u);
 
-    PortPacket* port_packet = nullptr;
-    PortObserver* observer = nullptr;
+    // Packets whose memory we have to free once the lock is dropped.
+    mxtl::DoublyLinkedList<PortPacket*> reap;
+    size_t taken = 0u;
 
-    while (true) {
-        {
-            AutoLock al(&lock_);
-            if (packets_.is_empty())
-                goto wait;
+    while (taken == 0u) {
+        // Every queued packet posts |sema_| once and Post() wakes a single
+        // waiter, so a packet is normally there for us when this returns. A
+        // batch dequeue on another thread can get to it first though, in which
+        // case we go back to waiting.
+        status_t st = sema_.Wait(deadline);
+        if (st != NO_ERROR)
+            return st;
 
-            port_packet = packets_.pop_front();
-            observer = CopyLocked(port_packet, packet);
+        AutoLock al(&lock_);
+        while (taken < count && !packets_.is_empty()) {
+            auto port_packet = packets_.pop_front();
+            auto observer = CopyLocked(port_packet, packets ? &packets[taken] : nullptr);
+            if (observer || port_packet->owned_by_port())
+                reap.push_back(port_packet);
+            ++taken;
         }
 
-        if (observer)
-            delete observer;
-        else if (packet && packet->type == MX_PKT_TYPE_USER)
-            delete port_packet;
-        return NO_ERROR;
+        // Our wakeup paid for the first packet. Retire the posts made for the
+        // rest so they don't wake other waiters up to an empty queue.
+        if (taken > 1u)
+            sema_.TryWaitMany(taken - 1u);
+    }
 
-wait:
-        status_t st = sema_.Wait(deadline);
-        if (st != NO_ERROR)
-            return st;
+    while (!reap.is_empty()) {
+        auto port_packet = reap.pop_front();
+        if (port_packet->owned_by_port())
+            delete port_packet;
+        else
+            delete port_packet->observer;
     }
+
+    *actual = taken;
+    return NO_ERROR;
 }
 
 PortObserver* PortDispatcherV2::CopyLocked(PortPacket* port_packet, mx_port_packet_t* packet) {
     if (packet)
         *packet = port_packet->packet;
 
-    return (port_packet->type() == MX_PKT_TYPE_USER) ? nullptr : port_packet->observer;
+    return port_packet->owned_by_port() ? nullptr : port_packet->observer;
 }
 
 bool PortDispatcherV2::CanReap(PortObserver* observer, PortPacket* port_packet) {
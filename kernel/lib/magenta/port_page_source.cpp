@@ -0,0 +1,37 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/port_page_source.h>
+
+#include <err.h>
+#include <new.h>
+
+// static
+status_t PortPageSource::Create(mxtl::RefPtr<PortDispatcherV2> port, uint64_t key,
+                                mxtl::RefPtr<PageSource>* source) {
+    AllocChecker ac;
+    auto src = new (&ac) PortPageSource(mxtl::move(port), key);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    *source = mxtl::AdoptRef<PageSource>(src);
+    return NO_ERROR;
+}
+
+PortPageSource::PortPageSource(mxtl::RefPtr<PortDispatcherV2> port, uint64_t key)
+    : port_(mxtl::move(port)), key_(key) {
+}
+
+status_t PortPageSource::SendRequest(uint64_t offset, uint64_t len) {
+    // fails once the pager has closed its end of the port, which in turn
+    // fails the fault rather than leaving the thread blocked forever
+    return port_->QueuePageRequest(key_, offset, len);
+}
+
+void PortPageSource::OnZeroChildren(uint64_t clone_count) {
+    // best effort; if this is lost the pager just keeps the vmo around longer
+    port_->QueueZeroChildren(key_, clone_count);
+}
@@ -398,6 +398,16 @@ Handle* ProcessDispatcher::GetHandleLocked(mx_handle_t handle_value) {
     return (handle->process_id() == get_koid()) ? handle : nullptr;
 }
 
+Handle* ProcessDispatcher::GetHandleLockFree(mx_handle_t handle_value) const {
+    // The base_value check in map_value_to_handle() rejects recycled slots,
+    // and a handle still owned by us after that can't be torn down before
+    // the caller's guard is released.
+    auto handle = map_value_to_handle(handle_value, handle_rand_);
+    if (!handle)
+        return nullptr;
+    return (handle->process_id() == get_koid()) ? handle : nullptr;
+}
+
 void ProcessDispatcher::AddHandle(HandleOwner handle) {
     AutoLock lock(&handle_table_lock_);
     AddHandleLocked(mxtl::move(handle));
@@ -430,24 +440,35 @@ void ProcessDispatcher::UndoRemoveHandleLocked(mx_handle_t handle_value) {
 }
 
 mx_koid_t ProcessDispatcher::GetKoidForHandle(mx_handle_t handle_value) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
+    HandleLookupGuard guard;
+    Handle* handle = GetHandleLockFree(handle_value);
     if (!handle)
         return MX_KOID_INVALID;
     return handle->dispatcher()->get_koid();
 }
 
+// The lookups below take a reference to the dispatcher inside the guard,
+// but only hand it out after the guard is released: dropping whatever the
+// caller's RefPtr held before may run a destructor, which can't happen
+// with interrupts disabled.
 mx_status_t ProcessDispatcher::GetDispatcherInternal(mx_handle_t handle_value,
                                                      mxtl::RefPtr<Dispatcher>* dispatcher,
                                                      mx_rights_t* rights) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
-        return ERR_BAD_HANDLE;
+    mxtl::RefPtr<Dispatcher> disp;
+    mx_rights_t handle_rights;
+    {
+        HandleLookupGuard guard;
+        Handle* handle = GetHandleLockFree(handle_value);
+        if (!handle)
+            return ERR_BAD_HANDLE;
 
-    *dispatcher = handle->dispatcher();
+        disp = handle->dispatcher();
+        handle_rights = handle->rights();
+    }
+
+    *dispatcher = mxtl::move(disp);
     if (rights)
-        *rights = handle->rights();
+        *rights = handle_rights;
     return NO_ERROR;
 }
 
@@ -455,17 +476,24 @@ mx_status_t ProcessDispatcher::GetDispatcherWithRightsInternal(mx_handle_t handl
                                                                mx_rights_t desired_rights,
                                                                mxtl::RefPtr<Dispatcher>* dispatcher_out,
                                                                mx_rights_t* out_rights) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
-        return ERR_BAD_HANDLE;
+    mxtl::RefPtr<Dispatcher> disp;
+    mx_rights_t handle_rights;
+    {
+        HandleLookupGuard guard;
+        Handle* handle = GetHandleLockFree(handle_value);
+        if (!handle)
+            return ERR_BAD_HANDLE;
 
-    if (!magenta_rights_check(handle, desired_rights))
-        return ERR_ACCESS_DENIED;
+        if (!magenta_rights_check(handle, desired_rights))
+            return ERR_ACCESS_DENIED;
+
+        disp = handle->dispatcher();
+        handle_rights = handle->rights();
+    }
 
-    *dispatcher_out = handle->dispatcher();
+    *dispatcher_out = mxtl::move(disp);
     if (out_rights)
-        *out_rights = handle->rights();
+        *out_rights = handle_rights;
     return NO_ERROR;
 }
 
@@ -744,6 +772,6 @@ const char* StateToString(ProcessDispatcher::State state) {
 }
 
 bool ProcessDispatcher::IsHandleValid(mx_handle_t handle_value) {
-    AutoLock lock(&handle_table_lock_);
-    return (GetHandleLocked(handle_value) != nullptr);
+    HandleLookupGuard guard;
+    return (GetHandleLockFree(handle_value) != nullptr);
 }
@@ -37,6 +37,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/port_client.cpp \
     $(LOCAL_DIR)/port_dispatcher.cpp \
     $(LOCAL_DIR)/port_dispatcher_v2.cpp \
+    $(LOCAL_DIR)/port_page_source.cpp \
     $(LOCAL_DIR)/process_dispatcher.cpp \
     $(LOCAL_DIR)/resource_dispatcher.cpp \
     $(LOCAL_DIR)/semaphore.cpp \
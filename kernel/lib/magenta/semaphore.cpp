@@ -51,3 +51,14 @@ status_t Semaphore::Wait(lk_time_t deadline) {
     THREAD_UNLOCK(state);
     return ret;
 }
+
+uint64_t Semaphore::TryWaitMany(uint64_t count) {
+    uint64_t taken = 0;
+    THREAD_LOCK(state);
+    if (count_ > 0) {
+        taken = (static_cast<uint64_t>(count_) < count) ? static_cast<uint64_t>(count_) : count;
+        count_ -= static_cast<int64_t>(taken);
+    }
+    THREAD_UNLOCK(state);
+    return taken;
+}
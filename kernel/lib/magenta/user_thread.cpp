@@ -221,6 +221,9 @@ status_t UserThread::Initialize(const char* name, size_t len) {
     // set the per-thread pointer
     lkthread->user_thread = reinterpret_cast<void*>(this);
 
+    // let its sleeps and waits share timer interrupts
+    lkthread->timer_slack = THREAD_USER_TIMER_SLACK;
+
     // associate the proc's address space with this thread
     process_->aspace()->AttachToThread(lkthread);
 
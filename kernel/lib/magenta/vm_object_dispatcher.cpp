@@ -110,6 +110,14 @@ mx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t s
             return vmo_->CleanCache(offset, size);
         case MX_VMO_OP_CACHE_CLEAN_INVALIDATE:
             return vmo_->CleanInvalidateCache(offset, size);
+        case MX_VMO_OP_SUPPLY:
+            // the page contents come from the user buffer
+            if (!buffer || buffer_size < size)
+                return ERR_INVALID_ARGS;
+
+            return vmo_->SupplyPagesUser(offset, size, buffer.reinterpret<const void>());
+        case MX_VMO_OP_SUPPLY_ERROR:
+            return vmo_->FailPageRequests(offset, size, ERR_IO);
         default:
             return ERR_INVALID_ARGS;
     }
@@ -9,6 +9,9 @@
 #include <trace.h>
 
 #include <kernel/auto_lock.h>
+#include <kernel/vm/vm_address_region.h>
+#include <kernel/vm/vm_aspace.h>
+#include <kernel/vm/vm_object.h>
 
 #include <lib/ktrace.h>
 #include <lib/user_copy.h>
@@ -22,6 +25,7 @@
 #include <magenta/user_copy.h>
 
 #include <mxtl/algorithm.h>
+#include <mxtl/auto_call.h>
 #include <mxtl/inline_array.h>
 #include <mxtl/ref_ptr.h>
 
@@ -31,6 +35,7 @@
 
 constexpr size_t kChannelReadHandlesChunkCount = 16u;
 constexpr size_t kChannelWriteHandlesInlineCount = 8u;
+constexpr size_t kChannelBatchChunkCount = 8u;
 
 mx_status_t sys_channel_create(
     uint32_t options, user_ptr<mx_handle_t> _out0, user_ptr<mx_handle_t> _out1) {
@@ -99,6 +104,43 @@ void msg_get_handles(ProcessDispatcher* up, MessagePacket* msg,
     }
 }
 
+// Looks up the channel and takes its next message.  On ERR_BUFFER_TOO_SMALL, Read() gives
+// us the size of the next message (which remains unconsumed, unless |options| has
+// MX_CHANNEL_READ_MAY_DISCARD set).
+static mx_status_t channel_read_message(ProcessDispatcher* up, mx_handle_t handle_value,
+                                        uint32_t options,
+                                        mxtl::RefPtr<ChannelDispatcher>* channel,
+                                        uint32_t* num_bytes, uint32_t* num_handles,
+                                        mxtl::unique_ptr<MessagePacket>* msg) {
+    mx_status_t result = up->GetDispatcherWithRights(handle_value, MX_RIGHT_READ, channel);
+    if (result != NO_ERROR)
+        return result;
+
+    // Currently MAY_DISCARD is the only allowable option.
+    if (options & ~MX_CHANNEL_READ_MAY_DISCARD)
+        return ERR_NOT_SUPPORTED;
+
+    return (*channel)->Read(num_bytes, num_handles, msg, options & MX_CHANNEL_READ_MAY_DISCARD);
+}
+
+// Hands a message taken by channel_read_message() over to the process.
+static mx_status_t channel_deliver_message(ProcessDispatcher* up, ChannelDispatcher* channel,
+                                           MessagePacket* msg,
+                                           user_ptr<void> _bytes, user_ptr<mx_handle_t> _handles,
+                                           uint32_t num_bytes, uint32_t num_handles) {
+    if (num_bytes > 0u) {
+        if (msg->CopyDataToUser(_bytes, num_bytes) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+    }
+
+    if (num_handles > 0u) {
+        msg_get_handles(up, msg, _handles, num_handles);
+    }
+
+    ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
+    return NO_ERROR;
+}
+
 mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t options,
                              user_ptr<void> _bytes, user_ptr<mx_handle_t> _handles,
                              uint32_t num_bytes, uint32_t num_handles,
@@ -109,22 +151,12 @@ mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t options,
     auto up = ProcessDispatcher::GetCurrent();
 
     mxtl::RefPtr<ChannelDispatcher> channel;
-    mx_status_t result = up->GetDispatcherWithRights(handle_value, MX_RIGHT_READ, &channel);
-    if (result != NO_ERROR)
-        return result;
-
-    // Currently MAY_DISCARD is the only allowable option.
-    if (options & ~MX_CHANNEL_READ_MAY_DISCARD)
-        return ERR_NOT_SUPPORTED;
-
     mxtl::unique_ptr<MessagePacket> msg;
-    result = channel->Read(&num_bytes, &num_handles, &msg,
-                           options & MX_CHANNEL_READ_MAY_DISCARD);
+    mx_status_t result = channel_read_message(up, handle_value, options, &channel,
+                                              &num_bytes, &num_handles, &msg);
     if (result != NO_ERROR && result != ERR_BUFFER_TOO_SMALL)
         return result;
 
-    // On ERR_BUFFER_TOO_SMALL, Read() gives us the size of the next message (which remains
-    // unconsumed, unless |options| has MX_CHANNEL_READ_MAY_DISCARD set).
     if (_num_bytes) {
         if (_num_bytes.copy_to_user(num_bytes) != NO_ERROR)
             return ERR_INVALID_ARGS;
@@ -136,17 +168,8 @@ mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t options,
     if (result == ERR_BUFFER_TOO_SMALL)
         return result;
 
-    if (num_bytes > 0u) {
-        if (_bytes.copy_array_to_user(msg->data(), num_bytes) != NO_ERROR)
-            return ERR_INVALID_ARGS;
-    }
-
-    if (num_handles > 0u) {
-        msg_get_handles(up, msg.get(), _handles, num_handles);
-    }
-
-    ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
-    return result;
+    return channel_deliver_message(up, channel.get(), msg.get(), _bytes, _handles,
+                                   num_bytes, num_handles);
 }
 
 static mx_status_t msg_put_handles(ProcessDispatcher* up, MessagePacket* msg, mx_handle_t* handles,
@@ -198,33 +221,74 @@ static mx_status_t msg_put_handles(ProcessDispatcher* up, MessagePacket* msg, mx
     return NO_ERROR;
 }
 
-mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t options,
-                              user_ptr<const void> _bytes, uint32_t num_bytes,
-                              user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
-    LTRACEF("handle %d bytes %p num_bytes %u handles %p num_handles %u options 0x%x\n",
-            handle_value, _bytes.get(), num_bytes, _handles.get(), num_handles, options);
-
-    if (options)
+// For MX_CHANNEL_WRITE_MOVE_PAGES: builds a packet that carries the pages
+// backing the caller's buffer instead of a copy of them, leaving the buffer
+// decommitted.  Only works for a page aligned buffer that lies within one
+// writable mapping of a VMO that owns all of its pages; on any error nothing
+// has been taken and the caller should copy instead.  On success |*mapping|
+// is where the pages came from, so that they can be returned there if the
+// write goes on to fail.
+static mx_status_t msg_take_pages(ProcessDispatcher* up, user_ptr<const void> _bytes,
+                                  uint32_t num_bytes, uint32_t num_handles,
+                                  mxtl::unique_ptr<MessagePacket>* msg,
+                                  mxtl::RefPtr<VmMapping>* mapping) {
+    vaddr_t va = reinterpret_cast<vaddr_t>(_bytes.get());
+    if (!IS_PAGE_ALIGNED(va) || !IS_PAGE_ALIGNED(num_bytes) || num_bytes == 0u)
         return ERR_INVALID_ARGS;
 
-    auto up = ProcessDispatcher::GetCurrent();
+    auto region = up->aspace()->FindRegion(va);
+    if (!region || !region->is_mapping())
+        return ERR_NOT_FOUND;
 
-    mxtl::RefPtr<ChannelDispatcher> channel;
-    mx_status_t result = up->GetDispatcherWithRights(handle_value, MX_RIGHT_WRITE, &channel);
+    mx_status_t result = MessagePacket::CreateWithPages(num_bytes, num_handles, msg);
     if (result != NO_ERROR)
         return result;
 
+    *mapping = region->as_vm_mapping();
+    result = (*mapping)->TakePages(va, num_bytes, (*msg)->mutable_pages());
+    if (result != NO_ERROR) {
+        msg->reset();
+        mapping->reset();
+    }
+    return result;
+}
+
+static mx_status_t channel_write(ProcessDispatcher* up, mx_handle_t handle_value,
+                                 uint32_t options,
+                                 user_ptr<const void> _bytes, uint32_t num_bytes,
+                                 user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
+    if (options & ~MX_CHANNEL_WRITE_MOVE_PAGES)
+        return ERR_INVALID_ARGS;
 
-    mxtl::unique_ptr<MessagePacket> msg;
-    result = MessagePacket::Create(num_bytes, num_handles, &msg);
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcherWithRights(handle_value, MX_RIGHT_WRITE, &channel);
     if (result != NO_ERROR)
         return result;
 
-    if (num_bytes > 0u) {
-        if (_bytes.copy_array_from_user(msg->mutable_data(), num_bytes) != NO_ERROR)
-            return ERR_INVALID_ARGS;
+    mxtl::unique_ptr<MessagePacket> msg;
+    mxtl::RefPtr<VmMapping> taken_from;
+    if ((options & MX_CHANNEL_WRITE_MOVE_PAGES) &&
+        msg_take_pages(up, _bytes, num_bytes, num_handles, &msg, &taken_from) == NO_ERROR) {
+        // The payload moved over with the pages; nothing to copy.
+    } else {
+        result = MessagePacket::Create(num_bytes, num_handles, &msg);
+        if (result != NO_ERROR)
+            return result;
+
+        if (num_bytes > 0u) {
+            if (msg->CopyDataFromUser(_bytes, num_bytes) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+        }
     }
 
+    // A write that fails must leave the caller's buffer as it was.
+    auto return_pages = mxtl::MakeAutoCall([&]() {
+        if (taken_from) {
+            taken_from->ReturnPages(reinterpret_cast<vaddr_t>(_bytes.get()), num_bytes,
+                                    msg->mutable_pages());
+        }
+    });
+
     AllocChecker ac;
     mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(&ac, num_handles);
     if (!ac.check())
@@ -236,8 +300,10 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t options,
             return result;
     }
 
-    result = channel->Write(mxtl::move(msg));
-    if (result != NO_ERROR) {
+    result = channel->Write(&msg);
+    if (result == NO_ERROR) {
+        return_pages.cancel();
+    } else {
         // Write failed, put back the handles into this process.
         AutoLock lock(up->handle_table_lock());
         for (size_t ix = 0; ix != num_handles; ++ix) {
@@ -249,6 +315,78 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t options,
     return result;
 }
 
+mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t options,
+                              user_ptr<const void> _bytes, uint32_t num_bytes,
+                              user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
+    LTRACEF("handle %d bytes %p num_bytes %u handles %p num_handles %u options 0x%x\n",
+            handle_value, _bytes.get(), num_bytes, _handles.get(), num_handles, options);
+
+    return channel_write(ProcessDispatcher::GetCurrent(), handle_value, options,
+                         _bytes, num_bytes, _handles, num_handles);
+}
+
+static void channel_batch_item(ProcessDispatcher* up, mx_channel_batch_item_t* item) {
+    switch (item->op) {
+    case MX_CHANNEL_BATCH_READ: {
+        uint32_t num_bytes = item->num_bytes;
+        uint32_t num_handles = item->num_handles;
+        mxtl::RefPtr<ChannelDispatcher> channel;
+        mxtl::unique_ptr<MessagePacket> msg;
+        mx_status_t result = channel_read_message(up, item->handle, item->options, &channel,
+                                                  &num_bytes, &num_handles, &msg);
+        if (result == NO_ERROR || result == ERR_BUFFER_TOO_SMALL) {
+            item->num_bytes = num_bytes;
+            item->num_handles = num_handles;
+        }
+        if (result == NO_ERROR) {
+            result = channel_deliver_message(up, channel.get(), msg.get(),
+                                             make_user_ptr(item->bytes),
+                                             make_user_ptr(item->handles),
+                                             num_bytes, num_handles);
+        }
+        item->status = result;
+        break;
+    }
+    case MX_CHANNEL_BATCH_WRITE:
+        item->status = channel_write(up, item->handle, item->options,
+                                     make_user_ptr<const void>(item->bytes), item->num_bytes,
+                                     make_user_ptr<const mx_handle_t>(item->handles),
+                                     item->num_handles);
+        break;
+    default:
+        item->status = ERR_INVALID_ARGS;
+        break;
+    }
+}
+
+mx_status_t sys_channel_batch(uint32_t options, user_ptr<mx_channel_batch_item_t> _items,
+                              uint32_t count) {
+    LTRACEF("count %u\n", count);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+    if (count > MX_CHANNEL_BATCH_MAX_ITEMS)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // Each item succeeds or fails on its own, so work through them a chunk at
+    // a time rather than copying in the whole array up front.
+    mx_channel_batch_item_t items[kChannelBatchChunkCount];
+    for (uint32_t done = 0; done < count;) {
+        size_t chunk = mxtl::min<size_t>(count - done, kChannelBatchChunkCount);
+        if (_items.element_offset(done).copy_array_from_user(items, chunk) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        for (size_t i = 0; i < chunk; i++)
+            channel_batch_item(up, &items[i]);
+        if (_items.element_offset(done).copy_array_to_user(items, chunk) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        done += static_cast<uint32_t>(chunk);
+    }
+
+    return NO_ERROR;
+}
+
 mx_status_t sys_channel_call(mx_handle_t handle_value, uint32_t options,
                              mx_time_t deadline, user_ptr<const mx_channel_call_args_t> _args,
                              user_ptr<uint32_t> actual_bytes, user_ptr<uint32_t> actual_handles,
@@ -280,7 +418,7 @@ mx_status_t sys_channel_call(mx_handle_t handle_value, uint32_t options,
         return result;
 
     if (num_bytes > 0u) {
-        if (make_user_ptr(args.wr_bytes).copy_array_from_user(msg->mutable_data(), num_bytes) != NO_ERROR)
+        if (msg->CopyDataFromUser(make_user_ptr<const void>(args.wr_bytes), num_bytes) != NO_ERROR)
             return ERR_INVALID_ARGS;
     }
 
@@ -351,7 +489,7 @@ mx_status_t sys_channel_call(mx_handle_t handle_value, uint32_t options,
     }
 
     if (num_bytes > 0u) {
-        if (make_user_ptr(args.rd_bytes).copy_array_to_user(reply->data(), num_bytes) != NO_ERROR) {
+        if (reply->CopyDataToUser(make_user_ptr(args.rd_bytes), num_bytes) != NO_ERROR) {
             result = ERR_INVALID_ARGS;
             goto read_failed;
         }
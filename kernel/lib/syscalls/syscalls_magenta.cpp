@@ -15,10 +15,12 @@
 #include <trace.h>
 
 #include <kernel/auto_lock.h>
+#include <kernel/mutex.h>
 #include <kernel/thread.h>
 
 #include <lib/crypto/global_prng.h>
 #include <lib/user_copy.h>
+#include <lib/vdso.h>
 #include <lib/user_copy/user_ptr.h>
 
 #include <magenta/event_dispatcher.h>
@@ -59,6 +61,8 @@ mx_status_t sys_nanosleep(mx_time_t deadline) {
 
 // This must be accessed atomically from any given thread.
 static mxtl::atomic<int64_t> utc_offset;
+// Serializes updates so the vDSO's copy of utc_offset matches ours.
+static Mutex utc_offset_lock;
 
 uint64_t sys_time_get(uint32_t clock_id) {
     switch (clock_id) {
@@ -84,9 +88,12 @@ mx_status_t sys_clock_adjust(mx_handle_t hrsrc, uint32_t clock_id, int64_t offse
     switch (clock_id) {
     case MX_CLOCK_MONOTONIC:
         return ERR_ACCESS_DENIED;
-    case MX_CLOCK_UTC:
+    case MX_CLOCK_UTC: {
+        AutoLock lock(&utc_offset_lock);
         utc_offset.store(offset);
+        VDso::SetUtcOffset(offset);
         return NO_ERROR;
+    }
     default:
         return ERR_INVALID_ARGS;
     }
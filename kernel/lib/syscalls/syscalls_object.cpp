@@ -15,6 +15,7 @@
 #include <magenta/resource_dispatcher.h>
 #include <magenta/thread_dispatcher.h>
 #include <magenta/vm_address_region_dispatcher.h>
+#include <magenta/vm_object_dispatcher.h>
 
 #include <mxtl/ref_ptr.h>
 
@@ -428,6 +429,17 @@ mx_status_t sys_object_get_property(mx_handle_t handle_value, uint32_t property,
                 return ERR_INVALID_ARGS;
             return NO_ERROR;
         }
+        case MX_PROP_VMO_FAULT_AROUND: {
+            if (size != sizeof(uint32_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto vmo = DownCastDispatcher<VmObjectDispatcher>(&dispatcher);
+            if (!vmo)
+                return ERR_WRONG_TYPE;
+            uint32_t value = vmo->vmo()->GetFaultAroundPages();
+            if (_value.reinterpret<uint32_t>().copy_to_user(value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
         default:
             return ERR_INVALID_ARGS;
     }
@@ -492,6 +504,18 @@ mx_status_t sys_object_set_property(mx_handle_t handle_value, uint32_t property,
                 return ERR_INVALID_ARGS;
             return process->set_debug_addr(value);
         }
+        case MX_PROP_VMO_FAULT_AROUND: {
+            if (size != sizeof(uint32_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto vmo = DownCastDispatcher<VmObjectDispatcher>(&dispatcher);
+            if (!vmo)
+                return ERR_WRONG_TYPE;
+            uint32_t value;
+            if (_value.reinterpret<const uint32_t>().copy_from_user(&value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            vmo->vmo()->SetFaultAroundPages(value);
+            return NO_ERROR;
+        }
     }
 
     return ERR_INVALID_ARGS;
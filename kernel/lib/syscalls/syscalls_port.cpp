@@ -17,12 +17,15 @@
 #include <magenta/process_dispatcher.h>
 #include <magenta/user_copy.h>
 
+#include <mxtl/algorithm.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
 
 #define LOCAL_TRACE 0
 
+constexpr size_t kPortWaitManyMaxPackets = 16u;
+
 mx_status_t sys_port_create(uint32_t options, user_ptr<mx_handle_t> _out) {
     LTRACEF("options %u\n", options);
 
@@ -119,6 +122,40 @@ mx_status_t sys_port_wait2(mx_handle_t handle, mx_time_t deadline, user_ptr<void
     return NO_ERROR;
 }
 
+mx_status_t sys_port_wait_many(mx_handle_t handle, mx_time_t deadline,
+                               user_ptr<mx_port_packet_t> _packets, uint32_t count,
+                               user_ptr<uint32_t> _actual) {
+    magenta_check_deadline("port_wait_many", deadline);
+    LTRACEF("handle %d count %u\n", handle, count);
+
+    if (count == 0u)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PortDispatcherV2> port;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &port);
+    if (status != NO_ERROR)
+        return status;
+
+    // Only the first packet is waited for; the rest are whatever else is
+    // already queued, dequeued under a single acquisition of the port lock.
+    // Packets are staged on the stack so user copies happen with no port
+    // locks held, which bounds how many one call can return.
+    mx_port_packet_t packets[kPortWaitManyMaxPackets];
+    size_t actual = 0u;
+    status = port->DeQueueMany(deadline, packets,
+                               mxtl::min<size_t>(count, kPortWaitManyMaxPackets), &actual);
+    if (status != NO_ERROR)
+        return status;
+
+    if (_packets.copy_array_to_user(packets, actual) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    if (_actual.copy_to_user(static_cast<uint32_t>(actual)) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    return NO_ERROR;
+}
+
 mx_status_t sys_port_wait(mx_handle_t handle, mx_time_t deadline,
                           user_ptr<void> _packet, size_t size) {
     magenta_check_deadline("port_wait", deadline);
@@ -16,6 +16,8 @@
 
 #include <magenta/handle_owner.h>
 #include <magenta/magenta.h>
+#include <magenta/port_dispatcher_v2.h>
+#include <magenta/port_page_source.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/user_copy.h>
 #include <magenta/vm_object_dispatcher.h>
@@ -59,6 +61,48 @@ mx_status_t sys_vmo_create(uint64_t size, uint32_t options, user_ptr<mx_handle_t
     return NO_ERROR;
 }
 
+mx_status_t sys_vmo_create_paged(mx_handle_t port_handle, uint64_t key, uint64_t size,
+                                 uint32_t options, user_ptr<mx_handle_t> _out) {
+    LTRACEF("port %d key %#" PRIx64 " size %#" PRIx64 "\n", port_handle, key, size);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // page requests for the new vmo will be queued on this port
+    mxtl::RefPtr<PortDispatcherV2> port;
+    mx_status_t status = up->GetDispatcherWithRights(port_handle, MX_RIGHT_WRITE, &port);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<PageSource> source;
+    status = PortPageSource::Create(mxtl::move(port), key, &source);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<VmObject> vmo = VmObjectPaged::CreatePagerBacked(0, size, mxtl::move(source));
+    if (!vmo)
+        return ERR_NO_MEMORY;
+
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    mx_status_t result = VmObjectDispatcher::Create(mxtl::move(vmo), &dispatcher, &rights);
+    if (result != NO_ERROR)
+        return result;
+
+    HandleOwner handle(MakeHandle(mxtl::move(dispatcher), rights));
+    if (!handle)
+        return ERR_NO_MEMORY;
+
+    if (_out.copy_to_user(up->MapHandleToValue(handle)) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(handle));
+
+    return NO_ERROR;
+}
+
 mx_status_t sys_vmo_read(mx_handle_t handle, user_ptr<void> _data,
                          uint64_t offset, size_t len, user_ptr<size_t> _actual) {
     LTRACEF("handle %d, data %p, offset %#" PRIx64 ", len %#zx\n",
@@ -191,12 +235,17 @@ mx_status_t sys_vmo_op_range(mx_handle_t handle, uint32_t op, uint64_t offset, u
     auto up = ProcessDispatcher::GetCurrent();
 
     // lookup the dispatcher from handle
-    // TODO: test rights
+    // TODO: test rights for the rest of the ops
     mxtl::RefPtr<VmObjectDispatcher> vmo;
-    mx_status_t status = up->GetDispatcher(handle, &vmo);
+    mx_rights_t rights;
+    mx_status_t status = up->GetDispatcherWithRights(handle, 0, &vmo, &rights);
     if (status != NO_ERROR)
         return status;
 
+    // only the pager, which holds a writable handle, may provide a pager-backed vmo's contents
+    if ((op == MX_VMO_OP_SUPPLY || op == MX_VMO_OP_SUPPLY_ERROR) && !(rights & MX_RIGHT_WRITE))
+        return ERR_ACCESS_DENIED;
+
     return vmo->RangeOp(op, offset, size, _buffer, buffer_size);
 }
 
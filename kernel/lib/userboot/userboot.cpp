@@ -163,7 +163,7 @@ static mx_handle_t make_bootstrap_channel(
     }
 
     // Here it goes!
-    mx_status_t status = kernel_channel->Write(mxtl::move(msg));
+    mx_status_t status = kernel_channel->Write(&msg);
     if (status != NO_ERROR)
         return status;
 
@@ -200,8 +200,12 @@ static mxtl::unique_ptr<MessagePacket> prepare_bootstrap_message() {
     if (MessagePacket::Create(data_size, num_handles, &packet) != NO_ERROR)
         return nullptr;
 
-    bootstrap_message* msg =
-        reinterpret_cast<bootstrap_message*>(packet->mutable_data());
+    // The packet may keep a payload this size in pages rather than inline,
+    // so build the message separately and copy it in.
+    AllocChecker ac;
+    mxtl::unique_ptr<bootstrap_message> msg(new (&ac) bootstrap_message);
+    if (!ac.check())
+        return nullptr;
     memset(&msg->header, 0, sizeof(msg->header));
     msg->header.protocol = MX_PROCARGS_PROTOCOL;
     msg->header.version = MX_PROCARGS_VERSION;
@@ -243,6 +247,7 @@ static mxtl::unique_ptr<MessagePacket> prepare_bootstrap_message() {
     }
     memcpy(msg->cmdline, __kernel_cmdline, __kernel_cmdline_size);
 
+    packet->CopyDataFromKernel(msg.get(), data_size);
     return packet;
 }
 
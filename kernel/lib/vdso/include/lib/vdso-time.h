@@ -0,0 +1,41 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+// This file is used both in the kernel and in the vDSO implementation.
+// So it must be compatible with both the kernel and userland header
+// environments.  It must use only the basic types so that struct
+// layouts match exactly in both contexts.
+
+#include <stdint.h>
+
+// This struct lets the vDSO compute mx_time_get results for the
+// monotonic and UTC clocks without entering the kernel.  Unlike
+// vdso_constants, the kernel can change it at any time, so it is
+// protected by a sequence lock: the kernel makes seq odd, updates the
+// other members, then makes seq even again.  A reader samples seq,
+// reads the members it needs, and retries if seq was odd or has
+// changed in the meantime.
+struct vdso_time_values {
+    uint64_t seq;
+
+    // Nonzero if MX_CLOCK_MONOTONIC is exactly mx_ticks_get() scaled
+    // by ns_per_tick.  If zero, the vDSO must make the syscall.
+    uint32_t usermode_time;
+    uint32_t reserved;
+
+    // Nanoseconds per tick as a 32.64 fixed-point number (see
+    // struct fp_32_64 in <lib/fixed_point.h>).
+    uint32_t ns_per_tick_l0;
+    uint32_t ns_per_tick_l32;
+    uint32_t ns_per_tick_l64;
+    uint32_t reserved2;
+
+    // Difference between MX_CLOCK_UTC and MX_CLOCK_MONOTONIC, in
+    // nanoseconds, as set by mx_clock_adjust.
+    int64_t utc_offset;
+};
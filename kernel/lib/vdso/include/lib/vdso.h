@@ -12,4 +12,7 @@
 class VDso : public RoDso {
 public:
     VDso();
+
+    // Publish a new MX_CLOCK_UTC offset to the vDSO's mx_time_get.
+    static void SetUtcOffset(int64_t offset);
 };
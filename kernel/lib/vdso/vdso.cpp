@@ -6,12 +6,17 @@
 
 #include <lib/vdso.h>
 #include <lib/vdso-constants.h>
+#include <lib/vdso-time.h>
 
+#include <kernel/auto_lock.h>
 #include <kernel/cmdline.h>
+#include <kernel/mutex.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
+#include <lib/fixed_point.h>
 #include <mxtl/type_support.h>
+#include <new.h>
 #include <platform.h>
 
 #include "vdso-code.h"
@@ -102,6 +107,23 @@ private:
         dynsym_window.set_symbol(_ ## symbol, target);          \
     } while (0)
 
+// The vDSO's time values stay mapped into the kernel for the life of the
+// system so that VDso::SetUtcOffset can update them.  All the processes
+// share the one VMO, so there is only ever one VDso and one window.
+Mutex time_values_lock;
+KernelVmoWindow<vdso_time_values>* time_values_window TA_GUARDED(time_values_lock);
+
+// Writer side of the sequence lock described in <lib/vdso-time.h>.
+template<typename Func>
+void UpdateTimeValues(Func update) TA_REQ(time_values_lock) {
+    vdso_time_values* values = time_values_window->data();
+    uint64_t seq = values->seq;
+    __atomic_store_n(&values->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    update(values);
+    __atomic_store_n(&values->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
 }; // anonymous namespace
 
 VDso::VDso() : RoDso("vdso", vdso_image, VDSO_CODE_END, VDSO_CODE_START) {
@@ -125,7 +147,9 @@ VDso::VDso() : RoDso("vdso", vdso_image, VDSO_CODE_END, VDSO_CODE_START) {
 
     // If ticks_per_second has not been calibrated, it will return 0. In this
     // case, use soft_ticks instead.
-    if (per_second == 0 || cmdline_get_bool("vdso.soft_ticks", false)) {
+    const bool soft_ticks = (per_second == 0 ||
+                             cmdline_get_bool("vdso.soft_ticks", false));
+    if (soft_ticks) {
         // Make mx_ticks_per_second return nanoseconds per second.
         constants_window.data()->ticks_per_second = MX_SEC(1);
 
@@ -133,4 +157,46 @@ VDso::VDso() : RoDso("vdso", vdso_image, VDSO_CODE_END, VDSO_CODE_START) {
         VDsoDynSymWindow dynsym_window(vmo()->vmo());
         REDIRECT_SYSCALL(dynsym_window, mx_ticks_get, soft_ticks_get);
     }
+
+    // If the monotonic clock is just a scaled mx_ticks_get, the vDSO can
+    // read the monotonic and UTC clocks without making a syscall.
+    static_assert(sizeof(vdso_time_values) == VDSO_DATA_TIME_VALUES_SIZE,
+                  "gen-rodso-code.sh is suspect");
+    AllocChecker ac;
+    auto window = new (&ac) KernelVmoWindow<vdso_time_values>(
+        "vDSO time values", vmo()->vmo(), VDSO_DATA_TIME_VALUES);
+    ASSERT(ac.check());
+
+    fp_32_64 ns_per_tick;
+    const bool usermode_time = (!soft_ticks &&
+                                platform_usermode_time_scale(&ns_per_tick) &&
+                                !cmdline_get_bool("vdso.syscall_time", false));
+
+    AutoLock lock(&time_values_lock);
+    ASSERT(time_values_window == nullptr);
+    time_values_window = window;
+    *time_values_window->data() = (vdso_time_values) {
+        0,
+        usermode_time ? 1u : 0u,
+        0,
+        usermode_time ? ns_per_tick.l0 : 0,
+        usermode_time ? ns_per_tick.l32 : 0,
+        usermode_time ? ns_per_tick.l64 : 0,
+        0,
+        0,
+    };
+
+    if (usermode_time) {
+        VDsoDynSymWindow dynsym_window(vmo()->vmo());
+        REDIRECT_SYSCALL(dynsym_window, mx_time_get, usermode_time_get);
+    }
+}
+
+void VDso::SetUtcOffset(int64_t offset) {
+    AutoLock lock(&time_values_lock);
+    if (time_values_window == nullptr)
+        return;
+    UpdateTimeValues([offset](vdso_time_values* values) {
+        __atomic_store_n(&values->utc_offset, offset, __ATOMIC_RELAXED);
+    });
 }
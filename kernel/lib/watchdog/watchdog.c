@@ -65,7 +65,7 @@ void watchdog_set_enabled(watchdog_t *dog, bool enabled)
     dog->enabled = enabled;
     lk_time_t deadline = current_time() + dog->timeout;
     if (enabled)
-        timer_set_oneshot(&dog->expire_timer, deadline, watchdog_timer_callback, dog);
+        timer_set_oneshot(&dog->expire_timer, deadline, 0, watchdog_timer_callback, dog);
     else
         timer_cancel(&dog->expire_timer);
 
@@ -85,7 +85,7 @@ void watchdog_pet(watchdog_t *dog)
 
     timer_cancel(&dog->expire_timer);
     lk_time_t deadline = current_time() + dog->timeout;
-    timer_set_oneshot(&dog->expire_timer, deadline, watchdog_timer_callback, dog);
+    timer_set_oneshot(&dog->expire_timer, deadline, 0, watchdog_timer_callback, dog);
 
 done:
     spin_unlock_irqrestore(&lock, state);
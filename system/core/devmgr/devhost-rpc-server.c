@@ -7,6 +7,7 @@
 
 #include <assert.h>
 #include <fcntl.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,6 +21,7 @@
 #include <ddk/iotxn.h>
 #include <ddk/protocol/device.h>
 
+#include <magenta/process.h>
 #include <magenta/processargs.h>
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
@@ -196,6 +198,191 @@ static ssize_t do_sync_io(mx_device_t* dev, uint32_t opcode, void* buf, size_t c
     return actual;
 }
 
+// READ_VMO and WRITE_VMO are split into DEVHOST_IO_SIZE iotxns.  For block
+// devices that queue iotxns, up to DEVHOST_IO_DEPTH of them are in flight at
+// once, so a large read() or write() keeps the device's queue full rather than
+// waiting on one chunk at a time.  Everything else gets one chunk at a time:
+// without an iotxn_queue op each chunk is a synchronous read or write anyway,
+// and on a stream device a chunk queued behind a short one would consume data
+// the caller is never told about.
+//
+// The client's vmo is never handed to the driver: the client could shrink it
+// underneath a mapping and take down the whole devhost.  Data is staged
+// through a vmo of our own instead, which along with the iotxns that point
+// into it is allocated once and reused for every transfer.
+#define DEVHOST_IO_SIZE (64 * 1024)
+#define DEVHOST_IO_DEPTH 8
+#define DEVHOST_IO_CHUNKS (MXRIO_XFER_MAX / DEVHOST_IO_SIZE)
+
+static struct {
+    mtx_t lock;
+    mx_handle_t vmo;
+    uint8_t* buf;
+    iotxn_t txn[DEVHOST_IO_DEPTH];
+    atomic_bool done[DEVHOST_IO_DEPTH];
+    completion_t completion;
+} xfer_io = {
+    .lock = MTX_INIT,
+    .completion = COMPLETION_INIT,
+};
+
+static void xfer_io_complete(iotxn_t* txn, void* cookie) {
+    atomic_store(&xfer_io.done[(uintptr_t)cookie], true);
+    completion_signal(&xfer_io.completion);
+}
+
+static mx_status_t xfer_io_init_locked(void) {
+    if (xfer_io.buf != NULL) {
+        return NO_ERROR;
+    }
+    mx_handle_t vmo;
+    mx_status_t status;
+    if ((status = mx_vmo_create(MXRIO_XFER_MAX, 0, &vmo)) < 0) {
+        return status;
+    }
+    uintptr_t addr;
+    if ((status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, MXRIO_XFER_MAX,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &addr)) < 0) {
+        mx_handle_close(vmo);
+        return status;
+    }
+    xfer_io.vmo = vmo;
+    xfer_io.buf = (uint8_t*)addr;
+    return NO_ERROR;
+}
+
+// Transfers the first 'length' bytes of the staging vmo to or from the device
+// at 'off'.  Returns the number of bytes transferred before the first error or
+// short transfer, or the error if the very first chunk failed.
+static ssize_t do_pipelined_io_locked(mx_device_t* dev, uint32_t opcode, size_t length,
+                                      mx_off_t off) {
+    mx_status_t chunk_status[DEVHOST_IO_CHUNKS];
+    mx_off_t chunk_actual[DEVHOST_IO_CHUNKS];
+    size_t slot_chunk[DEVHOST_IO_DEPTH];
+    size_t nchunks = (length + DEVHOST_IO_SIZE - 1) / DEVHOST_IO_SIZE;
+    unsigned depth = ((dev->protocol_id == MX_PROTOCOL_BLOCK) && dev->ops->iotxn_queue) ?
+                     DEVHOST_IO_DEPTH : 1;
+    size_t next = 0;
+    uint32_t busy = 0;
+    bool failed = false;
+
+    for (;;) {
+        // reset before looking, so a completion that lands after the scan
+        // below still wakes the wait at the bottom of the loop
+        completion_reset(&xfer_io.completion);
+
+        for (unsigned i = 0; i < DEVHOST_IO_DEPTH; i++) {
+            if (!(busy & (1u << i)) || !atomic_load(&xfer_io.done[i])) {
+                continue;
+            }
+            iotxn_t* txn = &xfer_io.txn[i];
+            size_t chunk = slot_chunk[i];
+            chunk_status[chunk] = txn->status;
+            chunk_actual[chunk] = (txn->actual > txn->length) ? txn->length : txn->actual;
+            if ((txn->status != NO_ERROR) || (chunk_actual[chunk] < txn->length)) {
+                failed = true;
+            }
+            iotxn_release(txn);
+            busy &= ~(1u << i);
+        }
+
+        // once a chunk has come up short there's no point starting more
+        for (unsigned i = 0; (i < depth) && (next < nchunks) && !failed; i++) {
+            if (busy & (1u << i)) {
+                continue;
+            }
+            size_t start = next * DEVHOST_IO_SIZE;
+            size_t count = length - start;
+            if (count > DEVHOST_IO_SIZE) {
+                count = DEVHOST_IO_SIZE;
+            }
+            iotxn_t* txn = &xfer_io.txn[i];
+            iotxn_init(txn, xfer_io.vmo, start, count);
+            txn->opcode = opcode;
+            txn->offset = off + start;
+            txn->complete_cb = xfer_io_complete;
+            txn->cookie = (void*)(uintptr_t)i;
+            atomic_store(&xfer_io.done[i], false);
+            slot_chunk[i] = next++;
+            busy |= 1u << i;
+            iotxn_queue(dev, txn);
+        }
+
+        if (busy == 0) {
+            break;
+        }
+        completion_wait(&xfer_io.completion, MX_TIME_INFINITE);
+    }
+
+    ssize_t total = 0;
+    for (size_t chunk = 0; chunk < next; chunk++) {
+        if (chunk_status[chunk] != NO_ERROR) {
+            return total ? total : chunk_status[chunk];
+        }
+        total += chunk_actual[chunk];
+        if (chunk_actual[chunk] < DEVHOST_IO_SIZE) {
+            break;
+        }
+    }
+    return total;
+}
+
+// Consumes the vmo in msg->handle[0].
+static mx_status_t do_xfer_vmo(mx_device_t* dev, mxrio_msg_t* msg, uint32_t len,
+                               devhost_iostate_t* ios) {
+    mx_handle_t vmo = msg->handle[0];
+    bool read = (MXRIO_OP(msg->op) == MXRIO_READ_VMO);
+    const mxrio_xfer_data_t* xfer = (const mxrio_xfer_data_t*)msg->data;
+    mx_status_t status;
+    size_t actual;
+    ssize_t r;
+
+    if (read ? !CAN_READ(ios) : !CAN_WRITE(ios)) {
+        r = ERR_ACCESS_DENIED;
+        goto done;
+    }
+    if ((len != sizeof(mxrio_xfer_data_t)) || (xfer->length > MXRIO_XFER_MAX) ||
+        (xfer->flags & ~MXRIO_XFER_FLAG_AT)) {
+        r = ERR_INVALID_ARGS;
+        goto done;
+    }
+    bool at = xfer->flags & MXRIO_XFER_FLAG_AT;
+    mx_off_t off = at ? xfer->offset : ios->io_off;
+
+    mtx_lock(&xfer_io.lock);
+    if ((r = xfer_io_init_locked()) < 0) {
+        goto done_locked;
+    }
+    if (!read) {
+        if ((status = mx_vmo_read(vmo, xfer_io.buf, xfer->vmo_offset, xfer->length,
+                                  &actual)) < 0) {
+            r = status;
+            goto done_locked;
+        } else if (actual != xfer->length) {
+            r = ERR_IO;
+            goto done_locked;
+        }
+    }
+    r = do_pipelined_io_locked(dev, read ? IOTXN_OP_READ : IOTXN_OP_WRITE, xfer->length, off);
+    if (read && (r > 0)) {
+        if ((status = mx_vmo_write(vmo, xfer_io.buf, xfer->vmo_offset, r, &actual)) < 0) {
+            r = status;
+        } else if (actual != (size_t)r) {
+            r = ERR_IO;
+        }
+    }
+
+done_locked:
+    mtx_unlock(&xfer_io.lock);
+    if ((r >= 0) && !at) {
+        ios->io_off += r;
+        msg->arg2.off = ios->io_off;
+    }
+done:
+    mx_handle_close(vmo);
+    return r;
+}
+
 static ssize_t do_ioctl(mx_device_t* dev, uint32_t op, const void* in_buf, size_t in_len, void* out_buf, size_t out_len) {
     mx_status_t r;
     switch (op) {
@@ -348,6 +535,9 @@ mx_status_t _devhost_rio_handler(mxrio_msg_t* msg, mx_handle_t rh_unused,
         mx_status_t r = do_sync_io(dev, IOTXN_OP_WRITE, msg->data, len, msg->arg2.off);
         return r;
     }
+    case MXRIO_READ_VMO:
+    case MXRIO_WRITE_VMO:
+        return do_xfer_vmo(dev, msg, len, ios);
     case MXRIO_SEEK: {
         size_t end, n;
         end = device_op_get_size(dev);
@@ -51,6 +51,83 @@ struct bootfs_header {
     struct bootfs_file file;
 };
 
+// Orders names the same way mkbootfs sorts them, i.e. like strcmp.
+// Both lengths include the terminating NUL.
+static int bootfs_namecmp(const char* a, size_t alen, const char* b, size_t blen) {
+    int cmp = memcmp(a, b, alen < blen ? alen : blen);
+    if (cmp == 0 && alen != blen)
+        cmp = alen < blen ? -1 : 1;
+    return cmp;
+}
+
+// Reads the directory record at offset 'off', checking it lies within
+// [start, end).  Returns a pointer to its name.
+static const char* bootfs_record(mx_handle_t log, struct bootfs *fs,
+                                 size_t start, size_t end, size_t off,
+                                 struct bootfs_header* header) {
+    if (off < start || off > end || end - off < sizeof(*header))
+        fail(log, ERR_INVALID_ARGS, "bootfs has bogus record in index\n");
+    memcpy(header, &fs->contents[off], sizeof(*header));
+    off += sizeof(*header);
+    if (header->namelen == 0 || header->namelen > end - off)
+        fail(log, ERR_INVALID_ARGS, "bootfs has bogus namelen in header\n");
+    return (const char*)&fs->contents[off];
+}
+
+// Binary search through the index at the end of the directory pages,
+// which mkbootfs writes along with BOOTDATA_BOOTFS_FLAG_INDEXED.
+static struct bootfs_file bootfs_search_index(mx_handle_t log,
+                                              struct bootfs *fs,
+                                              size_t dir,
+                                              const char* filename) {
+    struct bootfs_file runt = { 0, 0 };
+    struct bootfs_header header;
+    if (fs->len - dir < sizeof(header))
+        return runt;
+    memcpy(&header, &fs->contents[dir], sizeof(header));
+    if (header.namelen == 0)
+        return runt;
+
+    // The first record's file comes right after the directory.
+    size_t end = header.file.offset;
+    if (end > fs->len || end - dir < sizeof(uint32_t))
+        fail(log, ERR_INVALID_ARGS, "bootfs has bogus directory size\n");
+    uint32_t count;
+    memcpy(&count, &fs->contents[end - sizeof(uint32_t)], sizeof(count));
+    if (count > (end - dir) / (sizeof(header) + sizeof(uint32_t)))
+        fail(log, ERR_INVALID_ARGS, "bootfs has bogus index size\n");
+    const uint8_t* index = &fs->contents[end - (count + 1) * sizeof(uint32_t)];
+
+    size_t filename_len = strlen(filename) + 1;
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t off;
+        memcpy(&off, &index[mid * sizeof(uint32_t)], sizeof(off));
+        const char* name = bootfs_record(log, fs, dir, end, off, &header);
+        int cmp = bootfs_namecmp(name, header.namelen, filename, filename_len);
+        if (cmp == 0) {
+            // Names can repeat; the first one wins, as in a linear scan.
+            while (mid > lo) {
+                struct bootfs_header prev;
+                memcpy(&off, &index[(mid - 1) * sizeof(uint32_t)], sizeof(off));
+                name = bootfs_record(log, fs, dir, end, off, &prev);
+                if (bootfs_namecmp(name, prev.namelen, filename, filename_len))
+                    break;
+                header = prev;
+                mid--;
+            }
+            return header.file;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return runt;
+}
+
 static struct bootfs_file bootfs_search(mx_handle_t log,
                                         struct bootfs *fs,
                                         const char* filename) {
@@ -65,6 +142,9 @@ static struct bootfs_file bootfs_search(mx_handle_t log,
     if (!memcmp(magic->fsmagic, FSMAGIC, sizeof(FSMAGIC))) {
         magic_size = sizeof(struct bootfs_magic);
     }
+    if (magic->boothdr.flags & BOOTDATA_BOOTFS_FLAG_INDEXED)
+        return bootfs_search_index(log, fs, magic_size, filename);
+
     const uint8_t* p = &fs->contents[magic_size];
 
     size_t filename_len = strlen(filename) + 1;
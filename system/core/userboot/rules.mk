@@ -52,6 +52,7 @@ MODULE_HEADER_DEPS := system/ulib/magenta
 MODULE_HEADER_DEPS += system/ulib/elfload
 MODULE_SRCS += system/ulib/elfload/elf-load.c
 
+# Only the serial decompressor; the parallel one needs threads.
 MODULE_HEADER_DEPS += system/ulib/bootdata
 MODULE_SRCS += system/ulib/bootdata/decompress.c
 
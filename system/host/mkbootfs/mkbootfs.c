@@ -36,6 +36,10 @@ int verbose = 0;
 //   namedata   (namelength bytes, includes \0)
 //
 // - fileoffsets must be page aligned (multiple of 4096)
+//
+// Records are sorted by name, and the directory pages end with an
+// index of record offsets so readers can binary search for a file
+// (see BOOTDATA_BOOTFS_FLAG_INDEXED).
 
 #define FSENTRYSZ 12
 
@@ -65,6 +69,7 @@ struct item {
 
     fsentry_t* first;
     fsentry_t* last;
+    uint32_t count;
 
     // size of header and total output size
     // used by bootfs items
@@ -166,9 +171,49 @@ void add_entry(item_t* fs, fsentry_t* e) {
         fs->first = e;
     }
     fs->last = e;
+    fs->count++;
     fs->hdrsize += e->namelen + FSENTRYSZ;
 }
 
+// Stable merge sort of a list of entries by name, so that when a name
+// appears more than once the first one imported still wins a lookup.
+static fsentry_t* sort_entry_list(fsentry_t* list, uint32_t count) {
+    if (count < 2) {
+        return list;
+    }
+    fsentry_t* second = list;
+    for (uint32_t n = 1; n < count / 2; n++) {
+        second = second->next;
+    }
+    fsentry_t* tail = second->next;
+    second->next = NULL;
+
+    fsentry_t* a = sort_entry_list(list, count / 2);
+    fsentry_t* b = sort_entry_list(tail, count - count / 2);
+    fsentry_t* head = NULL;
+    fsentry_t** link = &head;
+    while (a && b) {
+        if (strcmp(b->name, a->name) < 0) {
+            *link = b;
+            b = b->next;
+        } else {
+            *link = a;
+            a = a->next;
+        }
+        link = &(*link)->next;
+    }
+    *link = a ? a : b;
+    return head;
+}
+
+void sort_entries(item_t* fs) {
+    fs->first = sort_entry_list(fs->first, fs->count);
+    fs->last = fs->first;
+    while (fs->last && fs->last->next) {
+        fs->last = fs->last->next;
+    }
+}
+
 int import_manifest(FILE* fp, const char* fn, item_t* fs) {
     int lineno = 0;
     fsentry_t* e;
@@ -569,8 +614,20 @@ fail:
         CHECK(op->setup(fd, &cookie));
     }
 
+    // offset of each record, for the index
+    uint32_t* index = calloc(item->count + 1, sizeof(uint32_t));
+    if (index == NULL) {
+        fprintf(stderr, "OUT OF MEMORY\n");
+        return -1;
+    }
+    uint32_t record = sizeof(bootdata_t);
+    uint32_t i = 0;
+
     fsentry_t* last_entry = NULL;
     for (e = item->first; e != NULL; e = e->next) {
+        index[i++] = record;
+        record += FSENTRYSZ + e->namelen;
+
         uint32_t hdr[3];
         hdr[0] = e->namelen;
         hdr[1] = e->length;
@@ -585,9 +642,14 @@ fail:
     // null terminator record
     CHECK(op->write(fd, fill, 12, cookie));
 
+    // the index goes at the very end of the directory pages
     if ((n = PAGEFILL(item->hdrsize))) {
         CHECK(op->write(fd, fill, n, cookie));
     }
+    index[item->count] = item->count;
+    CHECK(op->write(fd, index, (item->count + 1) * sizeof(uint32_t), cookie));
+    free(index);
+    index = NULL;
 
     for (e = item->first; e != NULL; e = e->next) {
         if (verbose) {
@@ -634,7 +696,8 @@ fail:
                 BOOTDATA_BOOTFS_SYSTEM : BOOTDATA_BOOTFS_BOOT,
         .length = wrote,
         .extra = compressed ? item->outsize : wrote,
-        .flags = compressed ? BOOTDATA_BOOTFS_FLAG_COMPRESSED : 0
+        .flags = (compressed ? BOOTDATA_BOOTFS_FLAG_COMPRESSED : 0) |
+                 BOOTDATA_BOOTFS_FLAG_INDEXED,
     };
     if (writex(fd, &boothdr, sizeof(boothdr)) < 0) {
         return -1;
@@ -923,8 +986,11 @@ int main(int argc, char **argv) {
         switch (item->type) {
         case ITEM_BOOTFS_BOOT:
         case ITEM_BOOTFS_SYSTEM:
-            // account for bootdata plus the end record
+            sort_entries(item);
+
+            // account for bootdata plus the end record and index
             item->hdrsize += sizeof(bootdata_t) + 12;
+            item->hdrsize += (item->count + 1) * sizeof(uint32_t);
 
             size_t off = PAGEALIGN(item->hdrsize);
             fsentry_t* last_entry = NULL;
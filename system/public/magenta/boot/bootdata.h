@@ -42,6 +42,15 @@
 // Flag indicating that the bootfs is compressed.
 #define BOOTDATA_BOOTFS_FLAG_COMPRESSED  (1 << 0)
 
+// Flag indicating that the bootfs directory records are sorted by name
+// (bytewise, as strcmp) and that the directory pages end with an index
+// for binary search.  The directory ends at the file offset given in the
+// first record.  Its last 32-bit word is the number of records, and just
+// before that is one 32-bit word per record, in order, giving the
+// record's offset from the start of the bootfs (bootdata header included).
+// Readers that ignore this flag can still scan the records as usual.
+#define BOOTDATA_BOOTFS_FLAG_INDEXED     (1 << 1)
+
 
 // These items are for passing from bootloader to kernel
 
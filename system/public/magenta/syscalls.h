@@ -8,6 +8,7 @@
 #include <magenta/syscalls/types.h>
 
 #include <magenta/syscalls/pci.h>
+#include <magenta/syscalls/port.h>
 #include <magenta/syscalls/resource.h>
 
 __BEGIN_CDECLS
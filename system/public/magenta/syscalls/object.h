@@ -191,6 +191,10 @@ typedef struct mx_info_maps {
 // Argument is the value of ld.so's _dl_debug_addr, a uintptr_t.
 #define MX_PROP_PROCESS_DEBUG_ADDR          5u
 
+// Argument is a uint32_t, the number of pages mapped around a page fault on
+// a mapping of a vmo.  0 means the vm.fault_around default.
+#define MX_PROP_VMO_FAULT_AROUND            6u
+
 // Values for mx_info_thread_t.state.
 #define MX_THREAD_STATE_NEW                 0u
 #define MX_THREAD_STATE_RUNNING             1u
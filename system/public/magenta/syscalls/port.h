@@ -50,6 +50,7 @@ typedef struct mx_exception_packet {
 #define MX_PKT_TYPE_USER            0u
 #define MX_PKT_TYPE_SIGNAL_ONE      1u
 #define MX_PKT_TYPE_SIGNAL_REP      2u
+#define MX_PKT_TYPE_PAGE_REQUEST    3u
 
 // port_packet_t::type MX_PKT_TYPE_USER.
 typedef union mx_packet_user {
@@ -66,6 +67,19 @@ typedef struct mx_packet_signal {
     uint64_t count;
 } mx_packet_signal_t;
 
+// mx_packet_page_request_t::command values.
+#define MX_PAGER_VMO_READ           0u
+#define MX_PAGER_VMO_ZERO_CHILDREN  1u
+
+// port_packet_t::type MX_PKT_TYPE_PAGE_REQUEST.
+typedef struct mx_packet_page_request {
+    uint64_t offset;
+    uint64_t length;
+    uint32_t command;
+    uint32_t reserved0;
+    uint64_t clone_count;
+} mx_packet_page_request_t;
+
 typedef struct mx_port_packet {
     uint64_t key;
     uint32_t type;
@@ -73,6 +87,7 @@ typedef struct mx_port_packet {
     union {
         mx_packet_user_t user;
         mx_packet_signal_t signal;
+        mx_packet_page_request_t page_request;
     };
 } mx_port_packet_t;
 
@@ -172,6 +172,18 @@ typedef struct {
     uint32_t rd_num_handles;
 } mx_channel_call_args_t;
 
+// Structure for mx_channel_batch():
+typedef struct {
+    mx_handle_t handle;
+    uint32_t op;            // MX_CHANNEL_BATCH_READ or MX_CHANNEL_BATCH_WRITE
+    uint32_t options;       // As for mx_channel_read() or mx_channel_write()
+    mx_status_t status;     // Out: the result of this operation
+    void* bytes;
+    mx_handle_t* handles;
+    uint32_t num_bytes;     // In: buffer or message size; out: actual (reads)
+    uint32_t num_handles;   // In: buffer or message size; out: actual (reads)
+} mx_channel_batch_item_t;
+
 // Structure for mx_object_wait_many():
 typedef struct {
     mx_handle_t handle;
@@ -213,6 +225,8 @@ typedef uint32_t mx_rights_t;
 #define MX_VMO_OP_CACHE_INVALIDATE       7u
 #define MX_VMO_OP_CACHE_CLEAN            8u
 #define MX_VMO_OP_CACHE_CLEAN_INVALIDATE 9u
+#define MX_VMO_OP_SUPPLY                 10u
+#define MX_VMO_OP_SUPPLY_ERROR           11u
 
 // VM Object clone flags
 #define MX_VMO_CLONE_COPY_ON_WRITE       1u
@@ -229,6 +243,7 @@ typedef uint32_t mx_rights_t;
 #define MX_VM_FLAG_CAN_MAP_WRITE      (1u << 8)
 #define MX_VM_FLAG_CAN_MAP_EXECUTE    (1u << 9)
 #define MX_VM_FLAG_MAP_RANGE          (1u << 10)
+#define MX_VM_FLAG_COMMIT_AROUND      (1u << 11)
 
 // clock ids
 #define MX_CLOCK_MONOTONIC        (0u)
@@ -257,6 +272,11 @@ typedef int64_t mx_rel_off_t;
 
 // Channel options and limits.
 #define MX_CHANNEL_READ_MAY_DISCARD         1u
+#define MX_CHANNEL_WRITE_MOVE_PAGES         1u
+
+#define MX_CHANNEL_BATCH_READ               0u
+#define MX_CHANNEL_BATCH_WRITE              1u
+#define MX_CHANNEL_BATCH_MAX_ITEMS          64u
 
 // Socket options and limits.
 #define MX_SOCKET_HALF_CLOSE                1u
@@ -6,10 +6,14 @@
 
 #include "blobstore.h"
 
+#include <threads.h>
+
 #include <bitmap/raw-bitmap.h>
 #include <merkle/digest.h>
 #include <mxtl/algorithm.h>
+#include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/macros.h>
+#include <mxtl/mutex.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
@@ -135,12 +139,8 @@ private:
     mx_status_t Mmap(int flags, size_t len, size_t* off, mx_handle_t* out) final;
     mx_status_t Sync() final;
 
-    // Read both VMOs into memory, if we haven't already.
-    //
-    // TODO(smklein): When we have can register the Blob Store as a pager
-    // service, and it can properly handle pages faults on a vnode's contents,
-    // then we can avoid reading the entire blob up-front. Until then, read
-    // the contents of a VMO into memory when it is opened.
+    // Acquires a clone of the blob's pager-backed VMO, if we haven't already.
+    // Nothing is read from disk until the VMO's pages are touched.
     mx_status_t InitVmos();
 
     mx_status_t WriteShared(const void** data, size_t* len, size_t* actual,
@@ -180,6 +180,92 @@ struct MerkleRootTraits {
     }
 };
 
+// The pager's view of a readable blob: the backing VMO, whose pages are read
+// from disk and verified against the Merkle tree one node at a time as they
+// are first touched.
+//
+// Only clones of the VMO are handed out, so the kernel can tell the pager when
+// the last of them goes away. A PagedBlob lives until then, since clients may
+// keep the VMO mapped after closing the blob, or until the filesystem is
+// unmounted. Once its blob is deleted it is purged: every page which is still
+// missing fails from then on, since its blocks may belong to another blob.
+class PagedBlob : public mxtl::WAVLTreeContainable<mxtl::unique_ptr<PagedBlob>> {
+public:
+    static mx_status_t Create(int blockfd, mx_handle_t port, uint64_t key, size_t map_index,
+                              const blobstore_inode_t& inode, mxtl::unique_ptr<PagedBlob>* out);
+    ~PagedBlob();
+
+    // The key of the blob's page requests, unique to this PagedBlob.
+    uint64_t GetKey() const { return key_; }
+    size_t GetMapIndex() const { return map_index_; }
+    bool Purged() const { return purged_; }
+
+    // Blobs which have not been purged are also indexed by node.
+    using LiveNodeState = mxtl::WAVLTreeNodeState<PagedBlob*>;
+    struct LiveTreeTraits {
+        static LiveNodeState& node_state(PagedBlob& b) { return b.live_state_; }
+    };
+    struct LiveKeyTraits {
+        static size_t GetKey(const PagedBlob& b) { return b.map_index_; }
+        static bool LessThan(size_t k1, size_t k2) { return k1 < k2; }
+        static bool EqualTo(size_t k1, size_t k2) { return k1 == k2; }
+    };
+
+    // Returns a read-only copy-on-write clone of the VMO.
+    mx_status_t Clone(mx_handle_t* out);
+
+    // The number of clones made so far, to match against the kernel's count
+    // when it reports that the last one has gone away.
+    uint64_t CloneCount() const { return clone_count_; }
+
+    // Reads, verifies and supplies the nodes covering [offset, offset + length),
+    // reading ahead past the end of the range. Nodes which fail verification
+    // have their page requests failed instead.
+    void HandleRequest(uint64_t offset, uint64_t length);
+
+    // Supplies every node which has not been touched yet.
+    void Flush();
+
+    // Fails every request for a missing page, now and from then on, and
+    // drops everything but the VMO itself.
+    void Purge();
+
+    // Fails the requests currently waiting on any page of the VMO.
+    void FailRequests();
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(PagedBlob);
+    PagedBlob(int blockfd, uint64_t key, size_t map_index, const blobstore_inode_t& inode);
+
+    // Supplies the nodes [node, node_end) with a single read.
+    mx_status_t SupplyNodes(uint64_t node, uint64_t node_end);
+
+    LiveNodeState live_state_;
+
+    const int blockfd_;
+    const uint64_t key_;
+    const size_t map_index_;
+    const uint64_t data_start_block_;
+    const uint64_t blob_size_;
+    merkle::Digest digest_;
+
+    mxtl::unique_ptr<uint8_t[]> merkle_tree_;
+    size_t merkle_tree_size_;
+
+    // Blocks are read into the staging VMO at their offset within the blob,
+    // verified in place, then copied into |vmo_|.
+    mx_handle_t vmo_;
+    mx_handle_t staging_vmo_;
+    uintptr_t staging_addr_;
+    uint64_t vmo_size_;
+
+    // One bit per node which has been supplied to |vmo_|.
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> supplied_;
+
+    uint64_t clone_count_;
+    bool purged_;
+};
+
 class Blobstore : public mxtl::RefCounted<Blobstore> {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Blobstore);
@@ -212,6 +298,10 @@ public:
 
     mx_status_t Readdir(void* cookie, void* dirents, size_t len);
 
+    // Returns a read-only clone of the pager-backed VMO holding the contents
+    // of the readable blob at node |map_index|, creating it if necessary.
+    mx_status_t GetPagedVmo(size_t map_index, mx_handle_t* out);
+
     int blockfd_;
     blobstore_info_t info_;
 private:
@@ -238,6 +328,18 @@ private:
     // Given a node within the node map at an index, write it to disk.
     mx_status_t WriteNode(size_t map_index);
 
+    // The pager thread services page requests for every PagedBlob.
+    mx_status_t StartPager();
+    void StopPager();
+    static int PagerThread(void* arg);
+
+    // Supplies the remaining contents of a deleted blob before its blocks are
+    // freed, then fails any page of it which is still missing.
+    void PurgePagedBlob(size_t map_index);
+
+    // Drops a PagedBlob once the last clone of its VMO has gone away.
+    void EvictPagedBlob(PagedBlob* blob) __TA_REQUIRES(pager_lock_);
+
     // VnodeBlobs exist in the WAVLTree as long as one or more reference exists;
     // when the Vnode is deleted, it is immediately removed from the WAVL tree.
     using WAVLTreeByMerkle = mxtl::WAVLTree<const uint8_t*,
@@ -248,6 +350,20 @@ private:
 
     RawBitmap block_map_;
     mxtl::unique_ptr<blobstore_inode_t[]> node_map_;
+
+    mx_handle_t pager_port_;
+    thrd_t pager_thread_;
+    bool pager_running_;
+
+    // Never held while touching a paged VMO: the pager thread needs it to
+    // service the resulting fault.
+    mxtl::Mutex pager_lock_;
+    uint64_t next_pager_key_ __TA_GUARDED(pager_lock_);
+    // Every PagedBlob, by the key of its page requests.
+    mxtl::WAVLTree<uint64_t, mxtl::unique_ptr<PagedBlob>> paged_blobs_ __TA_GUARDED(pager_lock_);
+    // The PagedBlobs which have not been purged, by node.
+    mxtl::WAVLTree<size_t, PagedBlob*, PagedBlob::LiveKeyTraits,
+                   PagedBlob::LiveTreeTraits> live_blobs_ __TA_GUARDED(pager_lock_);
 };
 
 int blobstore_mkfs(int fd);
@@ -13,8 +13,10 @@
 #include <magenta/new.h>
 #include <magenta/process.h>
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
 #include <merkle/digest.h>
 #include <merkle/tree.h>
+#include <mxtl/auto_lock.h>
 #include <mxtl/ref_ptr.h>
 #include <mxio/debug.h>
 
@@ -52,6 +54,15 @@ uint64_t MerkleTreeBlocks(const blobstore_inode_t& blobNode) {
     return mxtl::roundup(size_merkle, kBlobstoreBlockSize) / kBlobstoreBlockSize;
 }
 
+// Number of nodes read past the end of a page request, so sequential access
+// to a blob doesn't take a round trip through the pager for every node.
+constexpr uint64_t kReadAheadNodes = 8;
+
+// Rights of the clones given out of a blob's pager-backed VMO; without
+// MX_RIGHT_WRITE, nobody can change what the pager provided.
+constexpr mx_rights_t kPagedVmoRights = MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER |
+                                        MX_RIGHT_READ | MX_RIGHT_EXECUTE | MX_RIGHT_MAP;
+
 // Get a pointer to the nth block of the bitmap.
 inline void* get_raw_bitmap_data(const RawBitmap& bm, uint64_t n) {
     assert(n * kBlobstoreBlockSize < bm.size()); // Accessing beyond end of bitmap
@@ -175,58 +186,7 @@ mx_status_t VnodeBlob::InitVmos() {
         return NO_ERROR;
     }
 
-    mx_status_t status;
-    int fd = blobstore_->blockfd_;
-    blobstore_inode_t* inode = &blobstore_->node_map_[map_index_];
-    uint64_t merkle_vmo_size = MerkleTreeBlocks(*inode) * kBlobstoreBlockSize;
-    uint64_t data_vmo_size = BlobDataBlocks(*inode) * kBlobstoreBlockSize;
-
-    if (merkle_vmo_size != 0) {
-        if ((status = mx_vmo_create(merkle_vmo_size, 0, &vmo_merkle_tree_)) != NO_ERROR) {
-            error("Failed to initialize vmo; error: %d\n", status);
-            goto fail;
-        }
-
-        for (uint64_t n = 0; n < MerkleTreeBlocks(*inode); n++) {
-            uint64_t bno = inode->start_block + n;
-            if ((status = vn_fill_block(fd, vmo_merkle_tree_, n, bno)) != NO_ERROR) {
-                error("Failed to fill bno\n");
-                goto fail;
-            }
-        }
-
-        if ((status = mx_vmar_map(mx_vmar_root_self(), 0, vmo_merkle_tree_, 0,
-                                  merkle_vmo_size,
-                                  MX_VM_FLAG_PERM_READ,
-                                  &vmo_merkle_tree_addr_)) != NO_ERROR) {
-            goto fail;
-        }
-    }
-
-    if ((status = mx_vmo_create(data_vmo_size, 0, &vmo_blob_)) != NO_ERROR) {
-        error("Failed to initialize vmo; error: %d\n", status);
-        goto fail;
-    }
-
-    for (uint64_t n = 0; n < BlobDataBlocks(*inode); n++) {
-        uint64_t bno = inode->start_block + n + MerkleTreeBlocks(*inode);
-        if ((status = vn_fill_block(fd, vmo_blob_, n, bno)) != NO_ERROR) {
-            error("Failed to fill bno\n");
-            goto fail;
-        }
-    }
-
-    if ((status = mx_vmar_map(mx_vmar_root_self(), 0, vmo_blob_, 0,
-                              data_vmo_size,
-                              MX_VM_FLAG_PERM_READ,
-                              &vmo_blob_addr_)) != NO_ERROR) {
-        goto fail;
-    }
-
-    return NO_ERROR;
-fail:
-    BlobCloseHandles();
-    return status;
+    return blobstore_->GetPagedVmo(map_index_, &vmo_blob_);
 }
 
 uint64_t VnodeBlob::SizeData() const {
@@ -382,10 +342,24 @@ mx_status_t VnodeBlob::WriteShared(const void** data, size_t* len, size_t* actua
 mx_status_t VnodeBlob::WriteMetadata() {
     assert(GetState() == kBlobStateDataWrite);
 
+    // Reads trust the contents of the VMO, so check that the blob we were given
+    // matches its name before making it readable.
+    merkle::Tree mt;
+    merkle::Digest d;
+    d = ((const uint8_t*) &digest_[0]);
+    auto inode = &blobstore_->node_map_[map_index_];
+    uint64_t size_merkle = merkle::Tree::GetTreeLength(inode->blob_size);
+    mx_status_t status = mt.Verify((const void*)vmo_blob_addr_, inode->blob_size,
+                                   (const void*)vmo_merkle_tree_addr_, size_merkle,
+                                   0, inode->blob_size, d);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
     // All data has been written to the containing VMO
     SetState(kBlobStateReadable);
     if (readable_event_ != MX_HANDLE_INVALID) {
-        mx_status_t status = mx_object_signal(readable_event_, 0u, MX_USER_SIGNAL_0);
+        status = mx_object_signal(readable_event_, 0u, MX_USER_SIGNAL_0);
         if (status != NO_ERROR) {
             SetState(kBlobStateError);
             return status;
@@ -399,7 +373,6 @@ mx_status_t VnodeBlob::WriteMetadata() {
     // This 'kBlobFlagSync' is currently not used, but it indicates when the sync is
     // complete.
     flags_ |= kBlobFlagSync;
-    auto inode = &blobstore_->node_map_[map_index_];
 
     // Write block allocation bitmap
     if (blobstore_->WriteBitmap(inode->num_blocks, inode->start_block) != NO_ERROR) {
@@ -501,23 +474,7 @@ mx_status_t VnodeBlob::CopyVmo(mx_rights_t rights, mx_handle_t* out) {
         return status;
     }
 
-    // TODO(smklein): We could lazily verify more of the VMO if:
-    // 1) We could fault in pages on-demand, or
-    // 2) We could create a COW subsection of the original VMO.
-    //
-    // For now, we aggressively verify the entire VMO up front.
-    merkle::Tree mt;
-    merkle::Digest d;
-    d = ((const uint8_t*) &digest_[0]);
-    auto inode = &blobstore_->node_map_[map_index_];
-    uint64_t size_merkle = merkle::Tree::GetTreeLength(inode->blob_size);
-    status = mt.Verify((const void*)vmo_blob_addr_, inode->blob_size,
-                       (const void*)vmo_merkle_tree_addr_, size_merkle,
-                       0, inode->blob_size, d);
-    if (status != NO_ERROR) {
-        return status;
-    }
-
+    // Each page is verified by the pager the first time it is touched.
     return mx_handle_duplicate(vmo_blob_, rights, out);
 }
 
@@ -531,18 +488,15 @@ mx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t*
         return status;
     }
 
-    merkle::Tree mt;
-    merkle::Digest d;
-    d = ((const uint8_t*) &digest_[0]);
+    // The VMO is rounded up to a whole block; don't read past the blob.
     auto inode = &blobstore_->node_map_[map_index_];
-    uint64_t size_merkle = merkle::Tree::GetTreeLength(inode->blob_size);
-    status = mt.Verify((const void*)vmo_blob_addr_, inode->blob_size,
-                       (const void*)vmo_merkle_tree_addr_, size_merkle,
-                       off, len, d);
-    if (status != NO_ERROR) {
-        return status;
+    if (off >= inode->blob_size) {
+        *actual = 0;
+        return NO_ERROR;
     }
+    len = mxtl::min(len, static_cast<size_t>(inode->blob_size - off));
 
+    // Pages which haven't been verified yet are faulted in through the pager.
     return mx_vmo_read(vmo_blob_, data, off, len, actual);
 }
 
@@ -588,6 +542,7 @@ void Blobstore::FreeNode(size_t node_index) {
 }
 
 mx_status_t Blobstore::Unmount() {
+    StopPager();
     close(blockfd_);
     return NO_ERROR;
 }
@@ -659,6 +614,7 @@ mx_status_t Blobstore::ReleaseBlob(VnodeBlob* vn) {
         case kBlobStateError: {
             vn->SetState(kBlobStateReleasing);
             size_t node_index = vn->GetMapIndex();
+            PurgePagedBlob(node_index);
             uint64_t start_block = node_map_[node_index].start_block;
             uint64_t nblocks = node_map_[node_index].num_blocks;
             FreeNode(node_index);
@@ -745,11 +701,300 @@ mx_status_t Blobstore::LookupBlob(const merkle::Digest& digest, mxtl::RefPtr<Vno
     return ERR_NOT_FOUND;
 }
 
-Blobstore::Blobstore(int fd, const blobstore_info_t* info) : blockfd_(fd) {
+Blobstore::Blobstore(int fd, const blobstore_info_t* info) :
+    blockfd_(fd),
+    pager_port_(MX_HANDLE_INVALID),
+    pager_running_(false),
+    next_pager_key_(0) {
     memcpy(&info_, info, sizeof(blobstore_info_t));
 }
 
-Blobstore::~Blobstore() {}
+Blobstore::~Blobstore() {
+    StopPager();
+}
+
+mx_status_t Blobstore::StartPager() {
+    mx_status_t status = mx_port_create(MX_PORT_OPT_V2, &pager_port_);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    if (thrd_create(&pager_thread_, PagerThread, this) != thrd_success) {
+        return ERR_NO_RESOURCES;
+    }
+    pager_running_ = true;
+    return NO_ERROR;
+}
+
+void Blobstore::StopPager() {
+    if (pager_running_) {
+        // Any packet other than a page request asks the pager thread to exit.
+        mx_port_packet_t packet;
+        memset(&packet, 0, sizeof(packet));
+        packet.type = MX_PKT_TYPE_USER;
+        if (mx_port_queue(pager_port_, &packet, 0) == NO_ERROR) {
+            thrd_join(pager_thread_, nullptr);
+        }
+        pager_running_ = false;
+    }
+
+    // With the port closed, new page requests fail in the kernel; fail the
+    // ones nobody is going to answer any more, too.
+    if (pager_port_ != MX_HANDLE_INVALID) {
+        mx_handle_close(pager_port_);
+        pager_port_ = MX_HANDLE_INVALID;
+    }
+
+    mxtl::AutoLock lock(&pager_lock_);
+    for (auto& blob : paged_blobs_) {
+        blob.FailRequests();
+    }
+    live_blobs_.clear();
+    paged_blobs_.clear();
+}
+
+int Blobstore::PagerThread(void* arg) {
+    Blobstore* bs = static_cast<Blobstore*>(arg);
+
+    for (;;) {
+        mx_port_packet_t packet;
+        mx_status_t status = mx_port_wait(bs->pager_port_, MX_TIME_INFINITE,
+                                          &packet, sizeof(packet));
+        if (status != NO_ERROR) {
+            error("blobstore: pager port wait failed: %d\n", status);
+            return -1;
+        } else if (packet.type != MX_PKT_TYPE_PAGE_REQUEST) {
+            return 0;
+        }
+
+        mxtl::AutoLock lock(&bs->pager_lock_);
+        auto blob = bs->paged_blobs_.find(packet.key);
+        if (!blob.IsValid()) {
+            continue;
+        }
+        if (packet.page_request.command == MX_PAGER_VMO_ZERO_CHILDREN) {
+            // Unless another clone was handed out after the kernel sent this,
+            // nobody can touch the VMO any more.
+            if (packet.page_request.clone_count == blob->CloneCount()) {
+                bs->EvictPagedBlob(&*blob);
+            }
+        } else {
+            blob->HandleRequest(packet.page_request.offset, packet.page_request.length);
+        }
+    }
+}
+
+mx_status_t Blobstore::GetPagedVmo(size_t map_index, mx_handle_t* out) {
+    mxtl::AutoLock lock(&pager_lock_);
+
+    PagedBlob* blob;
+    auto iter = live_blobs_.find(map_index);
+    if (iter.IsValid()) {
+        blob = &*iter;
+    } else {
+        // Keys aren't reused, so requests from the VMO of a purged blob can't
+        // be mistaken for ones from a new blob at the same node.
+        mxtl::unique_ptr<PagedBlob> new_blob;
+        mx_status_t status = PagedBlob::Create(blockfd_, pager_port_, next_pager_key_++,
+                                               map_index, node_map_[map_index], &new_blob);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        blob = new_blob.get();
+        live_blobs_.insert(blob);
+        paged_blobs_.insert(mxtl::move(new_blob));
+    }
+
+    return blob->Clone(out);
+}
+
+void Blobstore::PurgePagedBlob(size_t map_index) {
+    mxtl::AutoLock lock(&pager_lock_);
+
+    auto blob = live_blobs_.find(map_index);
+    if (blob.IsValid()) {
+        // Clients may still have the blob mapped; give them everything before
+        // the blocks can be reused by another blob. The PagedBlob itself goes
+        // once the last clone does.
+        blob->Flush();
+        blob->Purge();
+        live_blobs_.erase(blob);
+    }
+}
+
+void Blobstore::EvictPagedBlob(PagedBlob* blob) {
+    if (!blob->Purged()) {
+        live_blobs_.erase(*blob);
+    }
+    paged_blobs_.erase(*blob);
+}
+
+PagedBlob::PagedBlob(int blockfd, uint64_t key, size_t map_index,
+                     const blobstore_inode_t& inode) :
+    blockfd_(blockfd),
+    key_(key),
+    map_index_(map_index),
+    data_start_block_(inode.start_block + MerkleTreeBlocks(inode)),
+    blob_size_(inode.blob_size),
+    merkle_tree_size_(merkle::Tree::GetTreeLength(inode.blob_size)),
+    vmo_(MX_HANDLE_INVALID),
+    staging_vmo_(MX_HANDLE_INVALID),
+    staging_addr_(0),
+    vmo_size_(BlobDataBlocks(inode) * kBlobstoreBlockSize),
+    clone_count_(0),
+    purged_(false) {
+    digest_ = inode.merkle_root_hash;
+}
+
+PagedBlob::~PagedBlob() {
+    if (staging_addr_ != 0) {
+        mx_vmar_unmap(mx_vmar_root_self(), staging_addr_, vmo_size_);
+    }
+    if (staging_vmo_ != MX_HANDLE_INVALID) {
+        mx_handle_close(staging_vmo_);
+    }
+    if (vmo_ != MX_HANDLE_INVALID) {
+        mx_handle_close(vmo_);
+    }
+}
+
+mx_status_t PagedBlob::Create(int blockfd, mx_handle_t port, uint64_t key, size_t map_index,
+                              const blobstore_inode_t& inode, mxtl::unique_ptr<PagedBlob>* out) {
+    AllocChecker ac;
+    mxtl::unique_ptr<PagedBlob> blob(new (&ac) PagedBlob(blockfd, key, map_index, inode));
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+
+    // The Merkle tree is small relative to the blob; read all of it up front.
+    uint64_t merkle_blocks = MerkleTreeBlocks(inode);
+    if (merkle_blocks != 0) {
+        size_t len = merkle_blocks * kBlobstoreBlockSize;
+        blob->merkle_tree_.reset(new (&ac) uint8_t[len]);
+        if (!ac.check()) {
+            return ERR_NO_MEMORY;
+        }
+        if (pread(blockfd, blob->merkle_tree_.get(), len,
+                  inode.start_block * kBlobstoreBlockSize) != static_cast<ssize_t>(len)) {
+            error("blobstore: cannot read merkle tree at block %lu\n", inode.start_block);
+            return ERR_IO;
+        }
+    }
+
+    mx_status_t status;
+    if ((status = blob->supplied_.Reset(BlobDataBlocks(inode))) != NO_ERROR) {
+        return status;
+    } else if ((status = mx_vmo_create_paged(port, key, blob->vmo_size_, 0,
+                                             &blob->vmo_)) != NO_ERROR) {
+        return status;
+    } else if ((status = mx_vmo_create(blob->vmo_size_, 0, &blob->staging_vmo_)) != NO_ERROR) {
+        return status;
+    } else if ((status = mx_vmar_map(mx_vmar_root_self(), 0, blob->staging_vmo_, 0,
+                                     blob->vmo_size_,
+                                     MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                                     &blob->staging_addr_)) != NO_ERROR) {
+        return status;
+    }
+
+    *out = mxtl::move(blob);
+    return NO_ERROR;
+}
+
+mx_status_t PagedBlob::Clone(mx_handle_t* out) {
+    mx_handle_t clone;
+    mx_status_t status = mx_vmo_clone(vmo_, MX_VMO_CLONE_COPY_ON_WRITE, 0, vmo_size_, &clone);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    // Counted even if the rest fails; the clone existed, and the kernel counts it.
+    clone_count_++;
+    return mx_handle_replace(clone, kPagedVmoRights, out);
+}
+
+mx_status_t PagedBlob::SupplyNodes(uint64_t node, uint64_t node_end) {
+    uint64_t offset = node * kBlobstoreBlockSize;
+    size_t len = (node_end - node) * kBlobstoreBlockSize;
+    void* data = reinterpret_cast<void*>(staging_addr_ + offset);
+
+    mx_status_t status = NO_ERROR;
+    if (pread(blockfd_, data, len, (data_start_block_ + node) * kBlobstoreBlockSize) !=
+        static_cast<ssize_t>(len)) {
+        status = ERR_IO;
+    } else {
+        merkle::Tree mt;
+        status = mt.Verify((const void*)staging_addr_, blob_size_,
+                           merkle_tree_.get(), merkle_tree_size_,
+                           offset, mxtl::min(len, static_cast<size_t>(blob_size_ - offset)),
+                           digest_);
+    }
+    if (status == NO_ERROR) {
+        status = mx_vmo_op_range(vmo_, MX_VMO_OP_SUPPLY, offset, len, data, len);
+    }
+    if (status == NO_ERROR) {
+        supplied_.Set(node, node_end);
+    }
+
+    mx_vmo_op_range(staging_vmo_, MX_VMO_OP_DECOMMIT, offset, len, nullptr, 0);
+    return status;
+}
+
+void PagedBlob::HandleRequest(uint64_t offset, uint64_t length) {
+    if (purged_) {
+        mx_vmo_op_range(vmo_, MX_VMO_OP_SUPPLY_ERROR, offset, length, nullptr, 0);
+        return;
+    }
+
+    uint64_t node = offset / kBlobstoreBlockSize;
+    uint64_t node_end = mxtl::min(mxtl::roundup(offset + length, kBlobstoreBlockSize) /
+                                  kBlobstoreBlockSize, supplied_.size());
+    uint64_t read_ahead_end = mxtl::min(node_end + kReadAheadNodes, supplied_.size());
+
+    while (node < node_end) {
+        if (supplied_.Get(node, node + 1)) {
+            node++;
+            continue;
+        }
+
+        // Extend the read through the request and past it, up to the next
+        // node which is already present.
+        uint64_t run_end = supplied_.Scan(node, read_ahead_end, false);
+        if (SupplyNodes(node, run_end) != NO_ERROR) {
+            // Retry one node at a time so only the bad nodes are failed.
+            for (uint64_t n = node; n < run_end; n++) {
+                mx_status_t status = SupplyNodes(n, n + 1);
+                if (status != NO_ERROR && n < node_end) {
+                    error("blobstore: cannot supply node %lu of blob %zu: %d\n",
+                          n, map_index_, status);
+                    mx_vmo_op_range(vmo_, MX_VMO_OP_SUPPLY_ERROR, n * kBlobstoreBlockSize,
+                                    kBlobstoreBlockSize, nullptr, 0);
+                }
+            }
+        }
+        node = run_end;
+    }
+}
+
+void PagedBlob::Flush() {
+    HandleRequest(0, vmo_size_);
+}
+
+void PagedBlob::Purge() {
+    purged_ = true;
+    FailRequests();
+
+    merkle_tree_.reset();
+    if (staging_addr_ != 0) {
+        mx_vmar_unmap(mx_vmar_root_self(), staging_addr_, vmo_size_);
+        staging_addr_ = 0;
+    }
+    if (staging_vmo_ != MX_HANDLE_INVALID) {
+        mx_handle_close(staging_vmo_);
+        staging_vmo_ = MX_HANDLE_INVALID;
+    }
+}
+
+void PagedBlob::FailRequests() {
+    mx_vmo_op_range(vmo_, MX_VMO_OP_SUPPLY_ERROR, 0, vmo_size_, nullptr, 0);
+}
 
 mx_status_t Blobstore::Create(int fd, const blobstore_info_t* info, mxtl::RefPtr<VnodeBlob>* out) {
     uint64_t blocks = info->block_count;
@@ -786,6 +1031,11 @@ mx_status_t Blobstore::Create(int fd, const blobstore_info_t* info, mxtl::RefPtr
         return status;
     }
 
+    if ((status = fs->StartPager()) != NO_ERROR) {
+        fprintf(stderr, "blobstore: Failed to start pager\n");
+        return status;
+    }
+
     *out = mxtl::AdoptRef(new (&ac) VnodeBlob(mxtl::move(fs)));
     if (!ac.check()) {
         return ERR_NO_MEMORY;
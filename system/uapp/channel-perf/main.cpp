@@ -6,11 +6,13 @@
 #include <errno.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include <magenta/compiler.h>
+#include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <mxtl/unique_ptr.h>
 
@@ -31,6 +33,7 @@ struct TestArgs {
     uint32_t size;
     uint32_t handles;
     uint32_t queue;
+    bool move_pages;
 };
 
 void do_test(uint32_t duration, const TestArgs& test_args) {
@@ -47,13 +50,28 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     mx_handle_t event;
     assert(mx_event_create(0u, &event) == NO_ERROR);
 
-    // Storage space for our messages' stuff.
-    mxtl::unique_ptr<uint8_t[]> data;
-    if (test_args.size) {
-        data.reset(new uint8_t[test_args.size]);
-        for (uint32_t i = 0; i < test_args.size; i++)
-            data[i] = static_cast<uint8_t>(i);
+    // Storage space for our messages' stuff.  Moving pages needs a page
+    // aligned buffer in a mapped VMO; reading each message back into the same
+    // buffer recommits the pages the write took away.
+    mxtl::unique_ptr<uint8_t[]> heap_data;
+    uint8_t* data = nullptr;
+    uintptr_t mapping = 0;
+    size_t mapping_size = (test_args.size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t write_options = test_args.move_pages ? MX_CHANNEL_WRITE_MOVE_PAGES : 0u;
+    if (test_args.move_pages) {
+        mx_handle_t vmo;
+        assert(mx_vmo_create(mapping_size, 0u, &vmo) == NO_ERROR);
+        status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, mapping_size,
+                             MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &mapping);
+        assert(status == NO_ERROR);
+        mx_handle_close(vmo);
+        data = reinterpret_cast<uint8_t*>(mapping);
+    } else if (test_args.size) {
+        heap_data.reset(new uint8_t[test_args.size]);
+        data = heap_data.get();
     }
+    for (uint32_t i = 0; i < test_args.size; i++)
+        data[i] = static_cast<uint8_t>(i);
     mxtl::unique_ptr<mx_handle_t[]> handles;
     if (test_args.handles)
         handles.reset(new mx_handle_t[test_args.handles]);
@@ -61,9 +79,12 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     // Pre-queue |test_args.queue| messages (there'll always be this many messages in the queue).
     for (uint32_t i = 0; i < test_args.queue; i++) {
         duplicate_handles(test_args.handles, event, handles.get());
-        status = mx_channel_write(mp[0], 0u, data.get(), test_args.size,
+        status = mx_channel_write(mp[0], write_options, data, test_args.size,
                                   handles.get(), test_args.handles);
         assert(status == NO_ERROR);
+        // Give the next write committed pages to move.
+        for (uint32_t j = 0; test_args.move_pages && j < test_args.size; j += PAGE_SIZE)
+            data[j] = static_cast<uint8_t>(j);
     }
 
     duplicate_handles(test_args.handles, event, handles.get());
@@ -75,13 +96,13 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     for (;;) {
         big_its++;
         for (uint32_t i = 0; i < big_it_size; i++) {
-            status = mx_channel_write(mp[0], 0, data.get(), test_args.size,
+            status = mx_channel_write(mp[0], write_options, data, test_args.size,
                                       handles.get(), test_args.handles);
             assert(status == NO_ERROR);
 
             uint32_t r_size = test_args.size;
             uint32_t r_handles = test_args.handles;
-            status = mx_channel_read(mp[1], 0u, data.get(), handles.get(), r_size,
+            status = mx_channel_read(mp[1], 0u, data, handles.get(), r_size,
                                      r_handles, &r_size, &r_handles);
             assert(status == NO_ERROR);
             assert(r_size == test_args.size);
@@ -103,12 +124,18 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     assert(status == NO_ERROR);
     status = mx_handle_close(mp[1]);
     assert(status == NO_ERROR);
+    if (mapping) {
+        status = mx_vmar_unmap(mx_vmar_root_self(), mapping, mapping_size);
+        assert(status == NO_ERROR);
+    }
 
     double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
     double its_per_second = static_cast<double>(big_its) * big_it_size / real_duration;
-    printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued): "
-               "%.0f iterations/second\n",
-           test_args.size, test_args.handles, test_args.queue, its_per_second);
+    printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued%s): "
+               "%.0f iterations/second, %.0f ns/iteration\n",
+           test_args.size, test_args.handles, test_args.queue,
+           test_args.move_pages ? ", moving pages" : "", its_per_second,
+           1000000000.0 / its_per_second);
 }
 
 }  // namespace
@@ -120,12 +147,13 @@ int main(int argc, char** argv) {
         "Options:\n"
         "  -h    show help (this)\n"
         "  -o    run single test (default)\n"
-        "  -s    run suite (ignores -S/-H/-Q)\n"
+        "  -s    run suite (ignores -S/-H/-Q/-M)\n"
         "  -n N  set test repetition count to N (default: 1)\n"
         "  -d N  set test duration to N seconds (default: 5)\n"
         "  -S N  set message size to N bytes (default: 10)\n"
         "  -H N  set message handle count to N handles (default: 0)\n"
-        "  -Q N  set message pre-queue count to N messages (default: 0)\n";
+        "  -Q N  set message pre-queue count to N messages (default: 0)\n"
+        "  -M    write with MX_CHANNEL_WRITE_MOVE_PAGES from a page aligned buffer\n";
 
     bool run_suite = false;  // -o/-s
     uint32_t duration = 5;   // -d
@@ -134,11 +162,12 @@ int main(int argc, char** argv) {
     TestArgs test_args = {
         10,                  // -S (size)
         0,                   // -H (handles)
-        0                    // -Q (queue)
+        0,                   // -Q (queue)
+        false                // -M (move_pages)
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:")) != -1) {
+    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:M")) != -1) {
         // Our option values are always unsigned numbers.
         uint32_t value = 0;
         if (optarg) {
@@ -180,6 +209,9 @@ int main(int argc, char** argv) {
                 assert(optarg);
                 test_args.queue = value;
                 break;
+            case 'M':
+                test_args.move_pages = true;
+                break;
             default:  // '?'
                 argument_error(argv[0], "invalid option");
                 break;
@@ -213,6 +245,19 @@ int main(int argc, char** argv) {
                 {10, 0, 1},
                 {100, 0, 1},
                 {1000, 0, 1},
+                // Sizes straddling the kernel's message buffer classes: the
+                // largest slab class, then page-backed buffers.
+                {4000, 0, 0},
+                {4000, 5, 0},
+                {16000, 0, 0},
+                {65536, 0, 0},
+                {65536, 0, 1},
+                // Page aligned payloads, copied and then moved.
+                {16384, 0, 0},
+                {16384, 0, 0, true},
+                {32768, 0, 0},
+                {32768, 0, 0, true},
+                {65536, 0, 0, true},
             };
             for (size_t i = 0; i < countof(suite); i++)
                 do_test(duration, suite[i]);
@@ -0,0 +1,287 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures ethernet fifo throughput by pushing frames through the
+// ethmac-loopback driver, which hands every transmitted frame straight
+// back to the ethernet core as a received one.  Since no hardware is
+// involved, the result is the per-frame cost of the fifo path itself.
+
+#include <magenta/device/device.h>
+#include <magenta/device/ethernet.h>
+#include <magenta/device/test.h>
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEV_TEST "/dev/misc/test"
+#define DRIVER_NAME "ethmac_loopback"
+#define BUFSIZE 2048
+
+static int open_retry(const char* path) {
+    for (int retry = 0; retry < 100; retry++) {
+        int fd = open(path, O_RDWR);
+        if (fd >= 0) {
+            return fd;
+        }
+        usleep(1000);
+    }
+    return -1;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: eth-bench [-d <seconds>] [-s <frame size>] [-b <batch>]\n");
+}
+
+typedef struct {
+    mx_handle_t tx_fifo;
+    mx_handle_t rx_fifo;
+    char* iobuf;
+    unsigned tx_count;
+    unsigned rx_count;
+    // tx buffers not currently owned by the driver
+    uint32_t* tx_free;
+    unsigned tx_free_count;
+} bench_t;
+
+static mx_status_t run(bench_t* b, mx_time_t duration, unsigned frame_size, unsigned batch) {
+    eth_fifo_entry_t entries[batch];
+    uint64_t tx_frames = 0;
+    uint64_t rx_frames = 0;
+    uint64_t rx_reads = 0;
+    mx_status_t status;
+    uint32_t actual;
+
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_time_t deadline = start + duration;
+    while (mx_time_get(MX_CLOCK_MONOTONIC) < deadline) {
+        // queue as many frames as we have free buffers for, up to one batch
+        unsigned n = b->tx_free_count < batch ? b->tx_free_count : batch;
+        for (unsigned i = 0; i < n; i++) {
+            uint32_t offset = b->tx_free[--b->tx_free_count];
+            entries[i].offset = offset;
+            entries[i].length = frame_size;
+            entries[i].flags = 0;
+            entries[i].cookie = (void*)(uintptr_t)offset;
+        }
+        if (n > 0) {
+            status = mx_fifo_write(b->tx_fifo, entries, n * sizeof(entries[0]), &actual);
+            if (status < 0) {
+                fprintf(stderr, "eth-bench: tx fifo write failed: %d\n", status);
+                return status;
+            }
+            // anything the fifo did not take goes back on the free list
+            for (unsigned i = actual; i < n; i++) {
+                b->tx_free[b->tx_free_count++] = entries[i].offset;
+            }
+            tx_frames += actual;
+        }
+
+        mx_wait_item_t items[2] = {
+            { .handle = b->tx_fifo, .waitfor = MX_FIFO_READABLE, .pending = 0 },
+            { .handle = b->rx_fifo, .waitfor = MX_FIFO_READABLE, .pending = 0 },
+        };
+        status = mx_object_wait_many(items, 2, deadline);
+        if (status == ERR_TIMED_OUT) {
+            break;
+        } else if (status < 0) {
+            fprintf(stderr, "eth-bench: wait failed: %d\n", status);
+            return status;
+        }
+
+        if (items[0].pending & MX_FIFO_READABLE) {
+            status = mx_fifo_read(b->tx_fifo, entries, batch * sizeof(entries[0]), &actual);
+            if (status < 0) {
+                fprintf(stderr, "eth-bench: tx fifo read failed: %d\n", status);
+                return status;
+            }
+            for (unsigned i = 0; i < actual; i++) {
+                b->tx_free[b->tx_free_count++] = (uint32_t)(uintptr_t)entries[i].cookie;
+            }
+        }
+
+        if (items[1].pending & MX_FIFO_READABLE) {
+            status = mx_fifo_read(b->rx_fifo, entries, batch * sizeof(entries[0]), &actual);
+            if (status < 0) {
+                fprintf(stderr, "eth-bench: rx fifo read failed: %d\n", status);
+                return status;
+            }
+            rx_reads++;
+            for (unsigned i = 0; i < actual; i++) {
+                if (entries[i].flags & ETH_FIFO_RX_OK) {
+                    rx_frames++;
+                }
+                entries[i].length = BUFSIZE;
+                entries[i].flags = 0;
+            }
+            uint32_t written;
+            status = mx_fifo_write(b->rx_fifo, entries, actual * sizeof(entries[0]), &written);
+            if (status < 0 || written != actual) {
+                fprintf(stderr, "eth-bench: failed to requeue rx buffers: %d\n", status);
+                return status < 0 ? status : ERR_INTERNAL;
+            }
+        }
+    }
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    uint64_t usecs = elapsed / 1000u;
+    printf("eth-bench: %u byte frames, batch %u\n", frame_size, batch);
+    printf("  tx %llu frames, rx %llu frames in %llu us\n",
+           (unsigned long long)tx_frames, (unsigned long long)rx_frames,
+           (unsigned long long)usecs);
+    if (usecs > 0) {
+        printf("  %llu frames/sec, %llu KB/sec\n",
+               (unsigned long long)(rx_frames * 1000000u / usecs),
+               (unsigned long long)(rx_frames * frame_size * 1000000u / usecs / 1024u));
+    }
+    if (rx_reads > 0) {
+        printf("  %llu.%02llu frames per rx fifo read\n",
+               (unsigned long long)(rx_frames / rx_reads),
+               (unsigned long long)(rx_frames * 100u / rx_reads % 100u));
+    }
+    return NO_ERROR;
+}
+
+int main(int argc, char** argv) {
+    unsigned seconds = 5;
+    unsigned frame_size = 60;
+    unsigned batch = 32;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:s:b:h")) != -1) {
+        switch (opt) {
+        case 'd':
+            seconds = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            frame_size = strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            batch = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage();
+            return -1;
+        }
+    }
+    if (seconds == 0 || frame_size == 0 || frame_size > BUFSIZE || batch == 0) {
+        usage();
+        return -1;
+    }
+
+    int tfd = open(DEV_TEST, O_RDWR);
+    if (tfd < 0) {
+        fprintf(stderr, "eth-bench: no %s device found\n", DEV_TEST);
+        return -1;
+    }
+
+    char devpath[1024];
+    ssize_t r = ioctl_test_create_device(tfd, "eth-bench", strlen("eth-bench") + 1,
+                                         devpath, sizeof(devpath));
+    close(tfd);
+    if (r < 0) {
+        fprintf(stderr, "eth-bench: error %zd creating test device\n", r);
+        return -1;
+    }
+
+    int rc = -1;
+    int ethfd = -1;
+    int dfd = open_retry(devpath);
+    if (dfd < 0) {
+        fprintf(stderr, "eth-bench: failed to open %s\n", devpath);
+        return -1;
+    }
+    if ((r = ioctl_device_bind(dfd, DRIVER_NAME, strlen(DRIVER_NAME) + 1)) < 0) {
+        fprintf(stderr, "eth-bench: error %zd binding %s\n", r, DRIVER_NAME);
+        goto done;
+    }
+
+    char ethpath[1100];
+    snprintf(ethpath, sizeof(ethpath), "%s/ethmac-loopback/ethernet", devpath);
+    if ((ethfd = open_retry(ethpath)) < 0) {
+        fprintf(stderr, "eth-bench: failed to open %s\n", ethpath);
+        goto done;
+    }
+
+    eth_fifos_t fifos;
+    if ((r = ioctl_ethernet_get_fifos(ethfd, &fifos)) < 0) {
+        fprintf(stderr, "eth-bench: failed to get fifos: %zd\n", r);
+        goto done;
+    }
+
+    bench_t b = {
+        .tx_fifo = fifos.tx_fifo,
+        .rx_fifo = fifos.rx_fifo,
+        .tx_count = fifos.tx_depth / 2,
+        .rx_count = fifos.rx_depth / 2,
+    };
+    if (batch > fifos.tx_depth) {
+        batch = fifos.tx_depth;
+    }
+
+    size_t iosize = (b.tx_count + b.rx_count) * BUFSIZE;
+    mx_handle_t iovmo;
+    mx_status_t status;
+    if ((status = mx_vmo_create(iosize, 0, &iovmo)) < 0) {
+        fprintf(stderr, "eth-bench: failed to create io vmo: %d\n", status);
+        goto done;
+    }
+    if ((status = mx_vmar_map(mx_vmar_root_self(), 0, iovmo, 0, iosize,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                              (uintptr_t*)&b.iobuf)) < 0) {
+        fprintf(stderr, "eth-bench: failed to map io vmo: %d\n", status);
+        goto done;
+    }
+    if ((r = ioctl_ethernet_set_iobuf(ethfd, &iovmo)) < 0) {
+        fprintf(stderr, "eth-bench: failed to set iobuf: %zd\n", r);
+        goto done;
+    }
+
+    // the first tx_count buffers are for transmit, the rest for receive
+    b.tx_free = malloc(b.tx_count * sizeof(uint32_t));
+    if (b.tx_free == NULL) {
+        goto done;
+    }
+    for (unsigned n = 0; n < b.tx_count; n++) {
+        uint32_t offset = n * BUFSIZE;
+        memset(b.iobuf + offset, 0xff, 6);
+        memset(b.iobuf + offset + 6, 0x02, 6);
+        b.tx_free[b.tx_free_count++] = offset;
+    }
+    for (unsigned n = 0; n < b.rx_count; n++) {
+        eth_fifo_entry_t entry = {
+            .offset = (b.tx_count + n) * BUFSIZE,
+            .length = BUFSIZE,
+            .flags = 0,
+            .cookie = NULL,
+        };
+        uint32_t actual;
+        if ((status = mx_fifo_write(b.rx_fifo, &entry, sizeof(entry), &actual)) < 0) {
+            fprintf(stderr, "eth-bench: failed to queue rx buffer: %d\n", status);
+            goto done;
+        }
+    }
+
+    if (ioctl_ethernet_start(ethfd) < 0) {
+        fprintf(stderr, "eth-bench: failed to start network interface\n");
+        goto done;
+    }
+
+    if (run(&b, MX_SEC(seconds), frame_size, batch) == NO_ERROR) {
+        rc = 0;
+    }
+    ioctl_ethernet_stop(ethfd);
+
+done:
+    if (ethfd >= 0) {
+        close(ethfd);
+    }
+    ioctl_test_destroy_device(dfd);
+    close(dfd);
+    return rc;
+}
@@ -0,0 +1,204 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+
+// Measures the cost of syscalls that resolve handles, with N threads of one
+// process hammering the same handle table at once.
+
+namespace {
+
+constexpr uint32_t kMaxThreads = 64;
+
+void argument_error(const char* argv0, const char* message) {
+    fprintf(stderr, "%s: error: %s\nRun with -h for help.\n", argv0, message);
+    exit(EXIT_FAILURE);
+}
+
+enum class Op {
+    // mx_object_signal() on an event: a lookup plus a trivial operation.
+    kSignal,
+    // mx_object_get_info(MX_INFO_HANDLE_VALID): about as close to a bare
+    // lookup as a syscall gets.
+    kValid,
+    // mx_handle_duplicate() + mx_handle_close(): handle allocation and the
+    // handle table add/remove paths.
+    kDupClose,
+};
+
+const char* op_name(Op op) {
+    switch (op) {
+    case Op::kSignal:
+        return "object_signal";
+    case Op::kValid:
+        return "handle_valid";
+    case Op::kDupClose:
+        return "duplicate+close";
+    }
+    return "unknown";
+}
+
+struct Worker {
+    Op op;
+    mx_handle_t event;
+    uint64_t deadline_ns;
+    volatile bool* go;
+    uint64_t ops;
+};
+
+int worker_thread(void* arg) {
+    auto* w = static_cast<Worker*>(arg);
+    __UNUSED mx_status_t status;
+
+    while (!*w->go)
+        thrd_yield();
+
+    static constexpr uint32_t batch = 1000;
+    uint64_t ops = 0;
+    do {
+        for (uint32_t i = 0; i < batch; i++) {
+            switch (w->op) {
+            case Op::kSignal:
+                status = mx_object_signal(w->event, 0u, 0u);
+                assert(status == NO_ERROR);
+                break;
+            case Op::kValid:
+                status = mx_object_get_info(w->event, MX_INFO_HANDLE_VALID,
+                                            nullptr, 0u, nullptr, nullptr);
+                assert(status == NO_ERROR);
+                break;
+            case Op::kDupClose: {
+                mx_handle_t dup;
+                status = mx_handle_duplicate(w->event, MX_RIGHT_SAME_RIGHTS, &dup);
+                assert(status == NO_ERROR);
+                status = mx_handle_close(dup);
+                assert(status == NO_ERROR);
+                break;
+            }
+            }
+        }
+        ops += batch;
+    } while (mx_time_get(MX_CLOCK_MONOTONIC) < w->deadline_ns);
+
+    w->ops = ops;
+    return 0;
+}
+
+// Each thread gets its own event handle unless |shared| is set, in which
+// case all of them resolve the same one.
+void do_test(uint32_t duration, Op op, uint32_t num_threads, bool shared) {
+    __UNUSED mx_status_t status;
+
+    Worker workers[kMaxThreads];
+    thrd_t threads[kMaxThreads];
+    volatile bool go = false;
+
+    mx_handle_t shared_event;
+    status = mx_event_create(0u, &shared_event);
+    assert(status == NO_ERROR);
+
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    uint64_t deadline_ns = start_ns + duration * 1000000000ull;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        workers[i].op = op;
+        workers[i].deadline_ns = deadline_ns;
+        workers[i].go = &go;
+        workers[i].ops = 0;
+        if (shared) {
+            workers[i].event = shared_event;
+        } else {
+            status = mx_event_create(0u, &workers[i].event);
+            assert(status == NO_ERROR);
+        }
+        int ret = thrd_create(&threads[i], worker_thread, &workers[i]);
+        assert(ret == thrd_success);
+    }
+
+    go = true;
+    uint64_t total_ops = 0;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        thrd_join(threads[i], nullptr);
+        total_ops += workers[i].ops;
+        if (!shared)
+            mx_handle_close(workers[i].event);
+    }
+    uint64_t end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_handle_close(shared_event);
+
+    double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
+    double ops_per_second = static_cast<double>(total_ops) / real_duration;
+    printf("%-16s %2" PRIu32 " threads, %s handle: %.0f ops/second, %.1f ns/op/thread\n",
+           op_name(op), num_threads, shared ? "shared " : "private", ops_per_second,
+           ops_per_second > 0 ? num_threads * 1000000000.0 / ops_per_second : 0.0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    static constexpr char help[] =
+        "Usage: %s [options ...]\n"
+        "\n"
+        "Options:\n"
+        "  -h    show help (this)\n"
+        "  -d N  set test duration to N seconds (default: 2)\n"
+        "  -t N  scale up to N threads (default: number of cpus)\n";
+
+    uint32_t duration = 2;                           // -d
+    uint32_t max_threads = mx_system_get_num_cpus(); // -t
+    if (max_threads > kMaxThreads)
+        max_threads = kMaxThreads;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+hd:t:")) != -1) {
+        uint32_t value = 0;
+        if (optarg) {
+            errno = 0;
+            char* endptr = nullptr;
+            unsigned long long v = strtoull(optarg, &endptr, 10);
+            if (errno != 0 || *endptr != '\0' || v > UINT32_MAX)
+                argument_error(argv[0], "invalid numeric optional value");
+            value = static_cast<uint32_t>(v);
+        }
+
+        switch (opt) {
+            case 'h':
+                printf(help, argv[0]);
+                return EXIT_SUCCESS;
+            case 'd':
+                duration = value;
+                break;
+            case 't':
+                max_threads = value;
+                break;
+            default:  // '?'
+                argument_error(argv[0], "invalid option");
+                break;
+        }
+    }
+    if (optind < argc)
+        argument_error(argv[0], "unexpected positional argument");
+    if (max_threads == 0 || max_threads > kMaxThreads)
+        argument_error(argv[0], "thread count out of range");
+
+    static constexpr Op ops[] = {Op::kValid, Op::kSignal, Op::kDupClose};
+    for (size_t i = 0; i < countof(ops); i++) {
+        for (uint32_t n = 1; n <= max_threads; n *= 2) {
+            do_test(duration, ops[i], n, true);
+            if (ops[i] != Op::kDupClose)
+                do_test(duration, ops[i], n, false);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
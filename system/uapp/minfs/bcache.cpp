@@ -9,7 +9,13 @@
 
 #include <fs/trace.h>
 
+#ifdef __Fuchsia__
+#include <magenta/device/block.h>
+#include <magenta/syscalls.h>
+#endif
+
 #include <magenta/new.h>
+#include <mxtl/algorithm.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
@@ -18,34 +24,201 @@
 
 namespace minfs {
 
+// Dirty blocks the cache holds before writing them all back.
+constexpr uint32_t kMaxDirtyBlocks = kMinfsBlockCacheSize / 4;
+// Blocks read past a miss which follows the previous one.
+constexpr uint32_t kReadAheadBlocks = 8;
+#ifdef __Fuchsia__
+// Size of the VMO shared with the block device, in blocks.
+constexpr uint32_t kTransferBlocks = 64;
+#endif
+
 mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
-    off_t off = bno * kMinfsBlockSize;
-    trace(IO, "readblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
-    if (lseek(fd_, off, SEEK_SET) < 0) {
-        error("minfs: cannot seek to block %u\n", bno);
-        return ERR_IO;
+    BlockRun run = { bno, 1, data };
+    return ReadRuns(&run, 1);
+}
+
+mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
+    BlockRun run = { bno, 1, const_cast<void*>(data) };
+    return WriteRuns(&run, 1);
+}
+
+mx_status_t Bcache::ReadRuns(const BlockRun* runs, size_t count) {
+    mx_status_t status = Transfer(false, runs, count);
+    if (status != NO_ERROR) {
+        return status;
     }
-    if (read(fd_, data, kMinfsBlockSize) != kMinfsBlockSize) {
-        error("minfs: cannot read block %u\n", bno);
-        return ERR_IO;
+
+    // The cache may hold newer contents than the disk
+    for (size_t i = 0; i < count; i++) {
+        for (uint32_t n = 0; n < runs[i].count; n++) {
+            auto blk = hash_.find(runs[i].bno + n);
+            if (blk.IsValid() && (blk->flags_ & kBlockDirty)) {
+                memcpy(static_cast<char*>(runs[i].data) + n * blocksize_, blk->data(), blocksize_);
+            }
+        }
     }
     return NO_ERROR;
 }
 
-mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
-    off_t off = bno * kMinfsBlockSize;
-    trace(IO, "writeblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
-    if (lseek(fd_, off, SEEK_SET) < 0) {
-        error("minfs: cannot seek to block %u\n", bno);
-        return ERR_IO;
+mx_status_t Bcache::WriteRuns(const BlockRun* runs, size_t count) {
+    // This write supersedes anything cached for these blocks
+    for (size_t i = 0; i < count; i++) {
+        for (uint32_t n = 0; n < runs[i].count; n++) {
+            auto blk = hash_.find(runs[i].bno + n);
+            if (blk.IsValid()) {
+                memcpy(blk->data(), static_cast<char*>(runs[i].data) + n * blocksize_, blocksize_);
+                if (blk->flags_ & kBlockDirty) {
+                    blk->flags_ &= ~kBlockDirty;
+                    dirty_count_--;
+                }
+            }
+        }
     }
-    if (write(fd_, data, kMinfsBlockSize) != kMinfsBlockSize) {
-        error("minfs: cannot write block %u\n", bno);
-        return ERR_IO;
+
+    return Transfer(true, runs, count);
+}
+
+mx_status_t Bcache::Transfer(bool write, const BlockRun* runs, size_t count) {
+#ifdef __Fuchsia__
+    if (fifo_client_ != nullptr) {
+        return TransferFifo(write, runs, count);
+    }
+#endif
+    for (size_t i = 0; i < count; i++) {
+        off_t off = static_cast<off_t>(runs[i].bno) * blocksize_;
+        size_t len = runs[i].count * blocksize_;
+        trace(IO, "%s() bno=%u count=%u off=%#llx\n", write ? "writeblk" : "readblk",
+              runs[i].bno, runs[i].count, (unsigned long long)off);
+        ssize_t r = write ? pwrite(fd_, runs[i].data, len, off) : pread(fd_, runs[i].data, len, off);
+        if (r != static_cast<ssize_t>(len)) {
+            error("minfs: cannot %s blocks %u-%u\n", write ? "write" : "read",
+                  runs[i].bno, runs[i].bno + runs[i].count - 1);
+            return ERR_IO;
+        }
     }
     return NO_ERROR;
 }
 
+#ifdef __Fuchsia__
+mx_status_t Bcache::TransferFifo(bool write, const BlockRun* runs, size_t count) {
+    char* buffer = static_cast<char*>(transfer_vmo_->GetData());
+
+    // Pieces of runs placed in the transfer buffer by the current transaction
+    struct Staged {
+        char* data;
+        size_t buffer_off;
+        size_t len;
+    };
+    Staged staged[kTransferBlocks];
+    block_fifo_request_t requests[MAX_TXN_MESSAGES];
+
+    size_t i = 0;
+    uint32_t run_off = 0;
+    while (i < count) {
+        size_t nreq = 0;
+        size_t nstaged = 0;
+        uint32_t used = 0;
+
+        // Fill the transfer buffer, merging pieces which are contiguous on disk
+        while ((i < count) && (used < kTransferBlocks)) {
+            const BlockRun& run = runs[i];
+            uint32_t n = mxtl::min(run.count - run_off, kTransferBlocks - used);
+            uint64_t dev_offset = static_cast<uint64_t>(run.bno + run_off) * blocksize_;
+            if ((nreq > 0) &&
+                (requests[nreq - 1].dev_offset + requests[nreq - 1].length == dev_offset)) {
+                requests[nreq - 1].length += n * blocksize_;
+            } else if (nreq == MAX_TXN_MESSAGES) {
+                break;
+            } else {
+                block_fifo_request_t* request = &requests[nreq++];
+                request->txnid = txnid_;
+                request->vmoid = vmoid_;
+                request->opcode = write ? BLOCKIO_WRITE : BLOCKIO_READ;
+                request->length = n * blocksize_;
+                request->vmo_offset = used * blocksize_;
+                request->dev_offset = dev_offset;
+            }
+
+            Staged* piece = &staged[nstaged++];
+            piece->data = static_cast<char*>(run.data) + run_off * blocksize_;
+            piece->buffer_off = used * blocksize_;
+            piece->len = n * blocksize_;
+            if (write) {
+                memcpy(buffer + piece->buffer_off, piece->data, piece->len);
+            }
+
+            used += n;
+            run_off += n;
+            if (run_off == run.count) {
+                i++;
+                run_off = 0;
+            }
+        }
+
+        trace(IO, "%s() %zu requests, %u blocks\n", write ? "writeblk" : "readblk", nreq, used);
+        mx_status_t status = block_fifo_txn(fifo_client_, requests, nreq);
+        if (status != NO_ERROR) {
+            error("minfs: block fifo %s failed: %d\n", write ? "write" : "read", status);
+            return ERR_IO;
+        }
+        if (!write) {
+            for (size_t j = 0; j < nstaged; j++) {
+                memcpy(staged[j].data, buffer + staged[j].buffer_off, staged[j].len);
+            }
+        }
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Bcache::AttachFifo() {
+    mx_handle_t fifo;
+    if (ioctl_block_get_fifos(fd_, &fifo) != sizeof(fifo)) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    mx_status_t status;
+    mx_handle_t vmo;
+    if (ioctl_block_alloc_txn(fd_, &txnid_) != sizeof(txnid_)) {
+        status = ERR_NO_RESOURCES;
+        goto fail_fifo;
+    }
+    if ((status = MappedVmo::Create(kTransferBlocks * blocksize_, &transfer_vmo_)) != NO_ERROR) {
+        goto fail_txn;
+    }
+    if ((status = mx_handle_duplicate(transfer_vmo_->GetVmo(), MX_RIGHT_SAME_RIGHTS,
+                                      &vmo)) != NO_ERROR) {
+        goto fail_txn;
+    }
+    if (ioctl_block_attach_vmo(fd_, &vmo, &vmoid_) != sizeof(vmoid_)) {
+        status = ERR_IO;
+        goto fail_txn;
+    }
+    if ((status = block_fifo_create_client(fifo, &fifo_client_)) != NO_ERROR) {
+        goto fail_txn;
+    }
+    return NO_ERROR;
+
+fail_txn:
+    ioctl_block_free_txn(fd_, &txnid_);
+fail_fifo:
+    transfer_vmo_.reset();
+    mx_handle_close(fifo);
+    ioctl_block_fifo_close(fd_);
+    return status;
+}
+
+void Bcache::DetachFifo() {
+    if (fifo_client_ == nullptr) {
+        return;
+    }
+    block_fifo_release_client(fifo_client_);
+    fifo_client_ = nullptr;
+    ioctl_block_free_txn(fd_, &txnid_);
+    ioctl_block_fifo_close(fd_);
+}
+#endif
+
 constexpr uint32_t kModeFind = 0;
 constexpr uint32_t kModeLoad = 1;
 constexpr uint32_t kModeZero = 2;
@@ -60,6 +233,8 @@ static const char* modestr(uint32_t mode) {
 }
 
 void Bcache::Invalidate() {
+    Flush();
+
     mxtl::RefPtr<BlockNode> blk;
     uint32_t n = 0;
     while ((blk = lists_.PopFront(kBlockLRU)) != nullptr) {
@@ -84,7 +259,7 @@ mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno, uint32_t mode) {
         assert(!(blk->flags_ & kBlockBusy));
         lists_.Erase(blk, kBlockLRU);
         if (mode == kModeZero) {
-            blk->flags_ |= kBlockDirty;
+            MarkDirty(blk.get());
             memset(blk->data(), 0, blocksize_);
         }
         goto done;
@@ -92,21 +267,16 @@ mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno, uint32_t mode) {
     if (mode == kModeFind) {
         blk = nullptr;
     } else {
-        if ((blk = lists_.PopFront(kBlockFree)) != nullptr) {
-            // nothing extra to do
-        } else if ((blk = lists_.PopFront(kBlockLRU)) != nullptr) {
-            // remove from hash, bno to be reassigned
-            hash_.erase(*blk);
-        } else {
+        if ((blk = GetFreeNode(false)) == nullptr) {
             panic("bcache: out of blocks\n");
         }
         blk->bno_ = bno;
         hash_.insert(blk);
         assert(hash_.size() <= kMinfsBlockCacheSize);
         if (mode == kModeZero) {
-            blk->flags_ |= kBlockDirty;
+            MarkDirty(blk.get());
             memset(blk->data(), 0, blocksize_);
-        } else if (Readblk(bno, blk->data()) < 0) {
+        } else if (Load(blk) < 0) {
             panic("bcache: bno %u read error!\n", bno);
         }
     }
@@ -118,6 +288,73 @@ done:
     return blk;
 }
 
+mxtl::RefPtr<BlockNode> Bcache::GetFreeNode(bool clean_only) {
+    mxtl::RefPtr<BlockNode> blk;
+    if ((blk = lists_.PopFront(kBlockFree)) != nullptr) {
+        return blk;
+    }
+    if ((blk = lists_.PopFront(kBlockLRU)) == nullptr) {
+        return nullptr;
+    }
+    if (blk->flags_ & kBlockDirty) {
+        if (clean_only) {
+            lists_.PushFront(mxtl::move(blk), kBlockLRU);
+            return nullptr;
+        }
+        // write it back along with everything else that's dirty
+        Flush();
+    }
+    // remove from hash, bno to be reassigned
+    hash_.erase(*blk);
+    return blk;
+}
+
+mx_status_t Bcache::Load(const mxtl::RefPtr<BlockNode>& blk) {
+    BlockRun runs[1 + kReadAheadBlocks];
+    mxtl::RefPtr<BlockNode> ahead[kReadAheadBlocks];
+    runs[0] = { blk->bno_, 1, blk->data() };
+    size_t count = 1;
+
+    // Only read ahead for sequential misses, and only into blocks which can be
+    // had without writing anything back.
+    if (blk->bno_ == last_miss_ + 1) {
+        for (uint32_t bno = blk->bno_ + 1; (count <= kReadAheadBlocks) && (bno < blockmax_);
+             bno++) {
+            if (hash_.find(bno).IsValid()) {
+                break;
+            }
+            mxtl::RefPtr<BlockNode> next = GetFreeNode(true);
+            if (next == nullptr) {
+                break;
+            }
+            next->bno_ = bno;
+            runs[count] = { bno, 1, next->data() };
+            ahead[count - 1] = mxtl::move(next);
+            count++;
+        }
+    }
+    last_miss_ = blk->bno_ + static_cast<uint32_t>(count - 1);
+
+    mx_status_t status = Transfer(false, runs, count);
+    for (size_t i = 0; i < count - 1; i++) {
+        if (status == NO_ERROR) {
+            hash_.insert(ahead[i]);
+            lists_.PushBack(mxtl::move(ahead[i]), kBlockLRU);
+        } else {
+            lists_.PushBack(mxtl::move(ahead[i]), kBlockFree);
+        }
+    }
+    trace(BCACHE, "bcache_load bno=%u readahead=%zu\n", blk->bno_, count - 1);
+    return status;
+}
+
+void Bcache::MarkDirty(BlockNode* blk) {
+    if (!(blk->flags_ & kBlockDirty)) {
+        blk->flags_ |= kBlockDirty;
+        dirty_count_++;
+    }
+}
+
 mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno) {
     return Get(bno, kModeLoad);
 }
@@ -131,13 +368,51 @@ void Bcache::Put(mxtl::RefPtr<BlockNode> blk, uint32_t flags) {
     assert(blk->flags_ & kBlockBusy);
     // remove from busy list
     lists_.Erase(blk, kBlockBusy);
-    if ((flags | blk->flags_) & kBlockDirty) {
-        if (Writeblk(blk->bno_, blk->data()) < 0) {
-            error("block write error!\n");
-        }
-        blk->flags_ &= ~kBlockDirty;
+    if (flags & kBlockDirty) {
+        MarkDirty(blk.get());
     }
     lists_.PushBack(mxtl::move(blk), kBlockLRU);
+    if (dirty_count_ >= kMaxDirtyBlocks) {
+        Flush();
+    }
+}
+
+mx_status_t Bcache::Flush() {
+    if (dirty_count_ == 0) {
+        return NO_ERROR;
+    }
+
+    // Gather the dirty blocks in disk order, so contiguous ones can be
+    // written with one request. Busy blocks are still being modified and
+    // are left for a later flush.
+    BlockRun runs[kMinfsBlockCacheSize];
+    BlockNode* blocks[kMinfsBlockCacheSize];
+    size_t count = 0;
+    for (auto& blk : hash_) {
+        if (!(blk.flags_ & kBlockDirty) || (blk.flags_ & kBlockBusy)) {
+            continue;
+        }
+        size_t i = count++;
+        while ((i > 0) && (runs[i - 1].bno > blk.bno_)) {
+            runs[i] = runs[i - 1];
+            blocks[i] = blocks[i - 1];
+            i--;
+        }
+        runs[i] = { blk.bno_, 1, blk.data() };
+        blocks[i] = &blk;
+    }
+    assert(count <= dirty_count_);
+
+    trace(BCACHE, "bcache_flush() %zu blocks\n", count);
+    mx_status_t status = Transfer(true, runs, count);
+    if (status != NO_ERROR) {
+        error("block write error!\n");
+    }
+    for (size_t i = 0; i < count; i++) {
+        blocks[i]->flags_ &= ~kBlockDirty;
+    }
+    dirty_count_ -= static_cast<uint32_t>(count);
+    return status;
 }
 
 mx_status_t Bcache::Read(uint32_t bno, void* data, uint32_t off, uint32_t len) {
@@ -173,6 +448,9 @@ mx_status_t Bcache::Write(uint32_t bno, const void* data, uint32_t off, uint32_t
 }
 
 int Bcache::Sync() {
+    if (Flush() != NO_ERROR) {
+        return -1;
+    }
     return fsync(fd_);
 }
 
@@ -190,16 +468,28 @@ mx_status_t Bcache::Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blo
         }
         num--;
     }
+#ifdef __Fuchsia__
+    // Not every fd is a block device; those are read and written directly
+    bc->AttachFifo();
+#endif
     *out = bc.release();
     return NO_ERROR;
 }
 
 int Bcache::Close() {
+    Flush();
+#ifdef __Fuchsia__
+    DetachFifo();
+#endif
     return close(fd_);
 }
 
 Bcache::Bcache(int fd, uint32_t blockmax, uint32_t blocksize) :
-    fd_(fd), blockmax_(blockmax), blocksize_(blocksize) {}
+#ifdef __Fuchsia__
+    fifo_client_(nullptr),
+#endif
+    fd_(fd), blockmax_(blockmax), blocksize_(blocksize), dirty_count_(0),
+    last_miss_(UINT32_MAX - 1) {}
 Bcache::~Bcache() {}
 
 size_t BcacheLists::SizeAllSlow() const {
@@ -214,8 +504,17 @@ void BcacheLists::PushBack(mxtl::RefPtr<BlockNode> blk, uint32_t block_type) {
     ll->push_back(mxtl::move(blk));
 }
 
+void BcacheLists::PushFront(mxtl::RefPtr<BlockNode> blk, uint32_t block_type) {
+    assert(SizeAllSlow() < kMinfsBlockCacheSize);
+    block_type &= kBlockLLFlags;
+    auto ll = GetList(block_type);
+    blk->flags_ |= block_type;
+    ll->push_front(mxtl::move(blk));
+}
+
 mxtl::RefPtr<BlockNode> BcacheLists::PopFront(uint32_t block_type) {
-    assert(SizeAllSlow() == kMinfsBlockCacheSize);
+    // Read ahead may hold several blocks outside of the lists at once
+    assert(SizeAllSlow() <= kMinfsBlockCacheSize);
     block_type &= kBlockLLFlags;
     auto ll = GetList(block_type);
     auto blk = ll->pop_front();
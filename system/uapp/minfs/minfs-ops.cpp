@@ -214,21 +214,6 @@ mx_status_t VnodeMinfs::BlocksShrink(uint32_t start) {
 }
 
 #ifdef __Fuchsia__
-// Read data from disk at block 'bno', into the 'nth' logical block of the file.
-mx_status_t VnodeMinfs::FillBlock(uint32_t n, uint32_t bno) {
-    // TODO(smklein): read directly from block device into vmo; no need to copy
-    // into an intermediate buffer.
-    char bdata[kMinfsBlockSize];
-    if (fs_->bc_->Readblk(bno, bdata)) {
-        return ERR_IO;
-    }
-    mx_status_t status = vmo_write_exact(vmo_, bdata, n * kMinfsBlockSize, kMinfsBlockSize);
-    if (status != NO_ERROR) {
-        return status;
-    }
-    return NO_ERROR;
-}
-
 // Since we cannot yet register the filesystem as a paging service (and cleanly
 // fault on pages when they are actually needed), we currently read an entire
 // file to a VMO when a file's data block are accessed.
@@ -242,17 +227,64 @@ mx_status_t VnodeMinfs::InitVmo() {
     }
 
     mx_status_t status;
-    if ((status = mx_vmo_create(mxtl::roundup(inode_.size, kMinfsBlockSize), 0, &vmo_)) != NO_ERROR) {
+    const size_t vmo_size = mxtl::roundup(inode_.size, kMinfsBlockSize);
+    if ((status = mx_vmo_create(vmo_size, 0, &vmo_)) != NO_ERROR) {
         error("Failed to initialize vmo; error: %d\n", status);
         return status;
     }
+    if (vmo_size == 0) {
+        return NO_ERROR;
+    }
+
+    // Map the VMO so the block cache can read straight into it.
+    uintptr_t addr;
+    if ((status = mx_vmar_map(mx_vmar_root_self(), 0, vmo_, 0, vmo_size,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &addr)) != NO_ERROR) {
+        error("Failed to map vmo; error: %d\n", status);
+        return status;
+    }
+    status = FillVmo(addr, vmo_size);
+    mx_vmar_unmap(mx_vmar_root_self(), addr, vmo_size);
+    return status;
+}
+
+// Reads every allocated block of the file into the mapping at 'addr'. Blocks
+// which are contiguous both on disk and in the file are read as one run, and
+// runs are handed to the block cache in batches.
+mx_status_t VnodeMinfs::FillVmo(uintptr_t addr, size_t len) {
+    BlockRun runs[16];
+    size_t count = 0;
+    auto add_block = [&](uint32_t n, uint32_t bno) -> mx_status_t {
+        if ((n + 1) * kMinfsBlockSize > len) {
+            error("minfs: block %u of ino %u is past the end of the file\n", n, ino_);
+            return ERR_IO;
+        }
+        void* data = reinterpret_cast<void*>(addr + n * kMinfsBlockSize);
+        if (count > 0) {
+            BlockRun* last = &runs[count - 1];
+            if ((last->bno + last->count == bno) &&
+                (static_cast<char*>(last->data) + last->count * kMinfsBlockSize == data)) {
+                last->count++;
+                return NO_ERROR;
+            }
+            if (count == countof(runs)) {
+                mx_status_t status = fs_->bc_->ReadRuns(runs, count);
+                count = 0;
+                if (status != NO_ERROR) {
+                    return status;
+                }
+            }
+        }
+        runs[count++] = { bno, 1, data };
+        return NO_ERROR;
+    };
 
     // Initialize all direct blocks
+    mx_status_t status;
     uint32_t bno;
     for (uint32_t d = 0; d < kMinfsDirect; d++) {
         if ((bno = inode_.dnum[d]) != 0) {
-            if ((status = FillBlock(d, bno)) != NO_ERROR) {
-                error("Failed to fill bno %u; error: %d\n", bno, status);
+            if ((status = add_block(d, bno)) != NO_ERROR) {
                 return status;
             }
         }
@@ -273,7 +305,7 @@ mx_status_t VnodeMinfs::InitVmo() {
             for (uint32_t j = 0; j < direct_per_indirect; j++) {
                 if ((bno = ientry[j]) != 0) {
                     uint32_t n = kMinfsDirect + i * direct_per_indirect + j;
-                    if ((status = FillBlock(n, bno)) != NO_ERROR) {
+                    if ((status = add_block(n, bno)) != NO_ERROR) {
                         fs_->bc_->Put(iblk, 0);
                         return status;
                     }
@@ -283,6 +315,10 @@ mx_status_t VnodeMinfs::InitVmo() {
         }
     }
 
+    if ((status = fs_->bc_->ReadRuns(runs, count)) != NO_ERROR) {
+        error("Failed to fill vmo of ino %u; error: %d\n", ino_, status);
+        return status;
+    }
     return NO_ERROR;
 }
 #endif
@@ -849,6 +885,20 @@ mx_status_t VnodeMinfs::WriteInternal(const void* data, size_t len, size_t off,
     uint32_t n = static_cast<uint32_t>(off / kMinfsBlockSize);
     size_t adjust = off % kMinfsBlockSize;
 
+#ifdef __Fuchsia__
+    // Whole blocks are written straight out of 'data'. Consecutive ones
+    // which are also contiguous on disk are written as a single run.
+    BlockRun pending = { 0, 0, nullptr };
+    auto write_pending = [&]() -> mx_status_t {
+        if (pending.count == 0) {
+            return NO_ERROR;
+        }
+        mx_status_t status = fs_->bc_->WriteRuns(&pending, 1);
+        pending.count = 0;
+        return status;
+    };
+#endif
+
     while ((len > 0) && (n < kMinfsMaxFileBlock)) {
         size_t xfer;
         if (len > (kMinfsBlockSize - adjust)) {
@@ -875,26 +925,34 @@ mx_status_t VnodeMinfs::WriteInternal(const void* data, size_t len, size_t off,
 
         // Update this block of the in-memory VMO
         if ((status = vmo_write_exact(vmo_, data, xfer_off, xfer)) != NO_ERROR) {
+            write_pending();
             return ERR_IO;
         }
 
         // Update this block on-disk
-        char bdata[kMinfsBlockSize];
-        // TODO(smklein): Can we write directly from the VMO to the block device,
-        // preventing the need for a 'bdata' variable?
-        if (xfer != kMinfsBlockSize) {
-            if (vmo_read_exact(vmo_, bdata, n * kMinfsBlockSize, kMinfsBlockSize) != NO_ERROR) {
-                return ERR_IO;
-            }
-        }
-        const void* wdata = (xfer != kMinfsBlockSize) ? bdata : data;
         uint32_t bno;
         if ((status = GetBno(n, &bno, true)) != NO_ERROR) {
+            write_pending();
             return status;
         }
         assert(bno != 0);
-        if (fs_->bc_->Writeblk(bno, wdata)) {
+        if ((xfer == kMinfsBlockSize) && (pending.count > 0) &&
+            (pending.bno + pending.count == bno)) {
+            pending.count++;
+        } else if (write_pending() != NO_ERROR) {
             return ERR_IO;
+        } else if (xfer == kMinfsBlockSize) {
+            pending = { bno, 1, const_cast<void*>(data) };
+        } else {
+            // TODO(smklein): Can we write directly from the VMO to the block device,
+            // preventing the need for a 'bdata' variable?
+            char bdata[kMinfsBlockSize];
+            if (vmo_read_exact(vmo_, bdata, n * kMinfsBlockSize, kMinfsBlockSize) != NO_ERROR) {
+                return ERR_IO;
+            }
+            if (fs_->bc_->Writeblk(bno, bdata)) {
+                return ERR_IO;
+            }
         }
 #else
         uint32_t bno;
@@ -919,6 +977,11 @@ mx_status_t VnodeMinfs::WriteInternal(const void* data, size_t len, size_t off,
     }
 
 done:
+#ifdef __Fuchsia__
+    if (write_pending() != NO_ERROR) {
+        return ERR_IO;
+    }
+#endif
     len = (uintptr_t)data - (uintptr_t)start;
     if (len == 0) {
         // If more than zero bytes were requested, but zero bytes were written,
@@ -186,9 +186,8 @@ private:
     mx_status_t AttachRemote(mx_handle_t) final;
 
     mx_status_t InitVmo();
-
-    // Read data from disk at block 'bno', into the 'nth' logical block of the file.
-    mx_status_t FillBlock(uint32_t n, uint32_t bno);
+    // Read every allocated block of the file into the mapping of the VMO at 'addr'.
+    mx_status_t FillVmo(uintptr_t addr, size_t len);
 
     // Get the disk block 'bno' corresponding to the 'nth' logical block of the file.
     // Allocate the block if reqeusted.
@@ -23,6 +23,10 @@
 #include "misc.h"
 
 #ifdef __Fuchsia__
+#include <block-client/client.h>
+#include <fs/mapped-vmo.h>
+#include <mxtl/unique_ptr.h>
+
 using RawBitmap = bitmap::RawBitmapGeneric<bitmap::VmoStorage>;
 #else
 using RawBitmap = bitmap::RawBitmapGeneric<bitmap::DefaultStorage>;
@@ -211,11 +215,19 @@ private:
     mxtl::unique_free_ptr<char> data_;
 };
 
+// A run of contiguous blocks on disk, and the memory holding their contents.
+struct BlockRun {
+    uint32_t bno;
+    uint32_t count;
+    void* data; // count * blocksize bytes
+};
+
 // Contains operations that act on Bcache's linked lists, updating their flags as they move from
 // one list to another.
 class BcacheLists {
 public:
     void PushBack(mxtl::RefPtr<BlockNode> blk, uint32_t block_type);
+    void PushFront(mxtl::RefPtr<BlockNode> blk, uint32_t block_type);
     mxtl::RefPtr<BlockNode> PopFront(uint32_t block_type);
     mxtl::RefPtr<BlockNode> Erase(mxtl::RefPtr<BlockNode> blk, uint32_t block_type);
 
@@ -242,6 +254,12 @@ public:
     mx_status_t Readblk(uint32_t bno, void* data);
     mx_status_t Writeblk(uint32_t bno, const void* data);
 
+    // Raw multi-block transfers. Contiguous runs are coalesced and sent to
+    // the device in as few transactions as possible. Blocks held by the
+    // cache stay coherent: reads see cached contents, writes update them.
+    mx_status_t ReadRuns(const BlockRun* runs, size_t count);
+    mx_status_t WriteRuns(const BlockRun* runs, size_t count);
+
     uint32_t Maxblk() const { return blockmax_; };
 
     // acquire a block, reading from disk if necessary,
@@ -259,9 +277,13 @@ public:
     mx_status_t Read(uint32_t bno, void* data, uint32_t off, uint32_t len);
     mx_status_t Write(uint32_t bno, const void* data, uint32_t off, uint32_t len);
 
-    // drop all non-busy, non-dirty blocks
+    // write back all dirty blocks, then drop all non-busy blocks
     void Invalidate();
 
+    // Dirty blocks are written back in batches: when enough of them have
+    // accumulated, when one is evicted, or here.
+    mx_status_t Flush();
+
     int Sync();
     int Close();
 
@@ -272,6 +294,29 @@ private:
 
     mxtl::RefPtr<BlockNode> Get(uint32_t bno, uint32_t mode);
 
+    // Takes a node to hold a new block: a free one, else the least recently
+    // used one. With 'clean_only', fails rather than evict a dirty block.
+    mxtl::RefPtr<BlockNode> GetFreeNode(bool clean_only);
+    void MarkDirty(BlockNode* blk);
+
+    // Reads 'blk' from disk, along with the blocks following it if
+    // the access pattern looks sequential.
+    mx_status_t Load(const mxtl::RefPtr<BlockNode>& blk);
+
+    // Moves runs between memory and disk, bypassing the cache.
+    mx_status_t Transfer(bool write, const BlockRun* runs, size_t count);
+#ifdef __Fuchsia__
+    // Switches to the block device's FIFO protocol, if it supports it.
+    mx_status_t AttachFifo();
+    void DetachFifo();
+    mx_status_t TransferFifo(bool write, const BlockRun* runs, size_t count);
+
+    fifo_client_t* fifo_client_;
+    txnid_t txnid_;
+    vmoid_t vmoid_;
+    mxtl::unique_ptr<MappedVmo> transfer_vmo_;
+#endif
+
     using HashTableBucket = mxtl::DoublyLinkedList<mxtl::RefPtr<BlockNode>, BlockNode::TypeHashTraits>;
     using HashTable = mxtl::HashTable<uint32_t, mxtl::RefPtr<BlockNode>, HashTableBucket>;
     HashTable hash_; // Map of all 'in use' blocks, accessible by bno
@@ -279,6 +324,8 @@ private:
     int fd_;
     uint32_t blockmax_;
     uint32_t blocksize_;
+    uint32_t dirty_count_;
+    uint32_t last_miss_;
 };
 
 void* GetBlock(const RawBitmap& bitmap, uint32_t blkno);
@@ -21,6 +21,10 @@
 #define FIFO_DEPTH 256
 #define FIFO_ESIZE sizeof(eth_fifo_entry_t)
 
+// rx buffers are taken from the client this many at a time, and completed
+// rx entries are written back in batches of up to this many
+#define RX_BATCH (FIFO_DEPTH / 4)
+
 #define TRACE 0
 
 #if TRACE
@@ -109,6 +113,16 @@ typedef struct ethdev {
 
     mx_device_t* mxdev;
 
+    // rx buffers read from the rx fifo but not yet filled,
+    // rx_free[rx_free_next .. rx_free_count)
+    eth_fifo_entry_t rx_free[RX_BATCH];
+    uint32_t rx_free_next;
+    uint32_t rx_free_count;
+
+    // filled rx buffers waiting to be written back to the rx fifo
+    eth_fifo_entry_t rx_done[RX_BATCH];
+    uint32_t rx_done_count;
+
     uint32_t fail_rx_read;
     uint32_t fail_rx_write;
     uint32_t fail_tx_write;
@@ -116,40 +130,19 @@ typedef struct ethdev {
 
 #define FAIL_REPORT_RATE 50
 
-static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t extra) {
-    eth_fifo_entry_t e;
+// return completed rx buffers to the client
+static void eth_rx_flush(ethdev_t* edev) {
     mx_status_t status;
     uint32_t count;
 
-    // TODO: read multiple and cache locally to reduce syscalls
-    if ((status = mx_fifo_read(edev->rx_fifo, &e, sizeof(e), &count)) < 0) {
-        if (status == ERR_SHOULD_WAIT) {
-            if ((edev->fail_rx_read++ % FAIL_REPORT_RATE) == 0) {
-                printf("eth: no rx buffers available (%u times)\n",
-                       edev->fail_rx_read);
-            }
-        } else {
-            // Fatal, should force teardown
-            printf("eth: rx fifo read failed %d\n", status);
-        }
+    if (edev->rx_done_count == 0) {
         return;
     }
 
-    if ((e.offset >= edev->io_size) || ((e.length > (edev->io_size - e.offset)))) {
-        // invalid offset/length. report error. drop packet
-        e.length = 0;
-        e.flags = ETH_FIFO_INVALID;
-    } else if (len > e.length) {
-        e.length = 0;
-        e.flags = ETH_FIFO_INVALID;
-    } else {
-        // packet fits. deliver it
-        memcpy(edev->io_buf + e.offset, data, len);
-        e.length = len;
-        e.flags = ETH_FIFO_RX_OK | extra;
-    }
-
-    if ((status = mx_fifo_write(edev->rx_fifo, &e, sizeof(e), &count)) < 0) {
+    uint32_t n = edev->rx_done_count;
+    edev->rx_done_count = 0;
+    if ((status = mx_fifo_write(edev->rx_fifo, edev->rx_done, n * sizeof(eth_fifo_entry_t),
+                                &count)) < 0) {
         if (status == ERR_SHOULD_WAIT) {
             if ((edev->fail_rx_write++ % FAIL_REPORT_RATE) == 0) {
                 printf("eth: no rx_fifo space available (%u times)\n",
@@ -161,6 +154,54 @@ static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t
         }
         return;
     }
+    if (count != n) {
+        printf("eth: rx_fifo: only wrote %u of %u!\n", count, n);
+    }
+}
+
+static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t extra) {
+    mx_status_t status;
+    uint32_t count;
+
+    if (edev->rx_free_next == edev->rx_free_count) {
+        edev->rx_free_next = 0;
+        edev->rx_free_count = 0;
+        if ((status = mx_fifo_read(edev->rx_fifo, edev->rx_free, sizeof(edev->rx_free),
+                                   &count)) < 0) {
+            if (status == ERR_SHOULD_WAIT) {
+                if ((edev->fail_rx_read++ % FAIL_REPORT_RATE) == 0) {
+                    printf("eth: no rx buffers available (%u times)\n",
+                           edev->fail_rx_read);
+                }
+            } else {
+                // Fatal, should force teardown
+                printf("eth: rx fifo read failed %d\n", status);
+            }
+            return;
+        }
+        edev->rx_free_count = count;
+    }
+
+    eth_fifo_entry_t* e = &edev->rx_done[edev->rx_done_count++];
+    *e = edev->rx_free[edev->rx_free_next++];
+
+    if ((e->offset >= edev->io_size) || ((e->length > (edev->io_size - e->offset)))) {
+        // invalid offset/length. report error. drop packet
+        e->length = 0;
+        e->flags = ETH_FIFO_INVALID;
+    } else if (len > e->length) {
+        e->length = 0;
+        e->flags = ETH_FIFO_INVALID;
+    } else {
+        // packet fits. deliver it
+        memcpy(edev->io_buf + e->offset, data, len);
+        e->length = len;
+        e->flags = ETH_FIFO_RX_OK | extra;
+    }
+
+    if (edev->rx_done_count == countof(edev->rx_done)) {
+        eth_rx_flush(edev);
+    }
 }
 
 static void eth0_status(void* cookie, uint32_t status) {
@@ -176,6 +217,10 @@ static void eth0_recv(void* cookie, void* data, size_t len, uint32_t flags) {
     mtx_lock(&edev0->lock);
     list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
         eth_handle_rx(edev, data, len, 0);
+        // hold completions until the ethermac's burst is over
+        if (!(flags & ETHMAC_RECV_MORE)) {
+            eth_rx_flush(edev);
+        }
     }
     mtx_unlock(&edev0->lock);
 }
@@ -185,17 +230,33 @@ static ethmac_ifc_t ethmac_ifc = {
     .recv = eth0_recv,
 };
 
-static void eth_tx_echo(ethdev0_t* edev0, const void* data, size_t len) {
+static void eth_tx_echo(ethdev0_t* edev0, const ethmac_frame_t* frames, size_t count) {
     ethdev_t* edev;
     mtx_lock(&edev0->lock);
     list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
         if (edev->state & ETHDEV_TX_LISTEN) {
-            eth_handle_rx(edev, data, len, ETH_FIFO_RX_TX);
+            for (size_t i = 0; i < count; i++) {
+                eth_handle_rx(edev, frames[i].data, frames[i].length, ETH_FIFO_RX_TX);
+            }
+            eth_rx_flush(edev);
         }
     }
     mtx_unlock(&edev0->lock);
 }
 
+static void eth_send(ethdev0_t* edev0, const ethmac_frame_t* frames, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (edev0->macops->send_many) {
+        edev0->macops->send_many(edev0->mac, 0, frames, count);
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            edev0->macops->send(edev0->mac, 0, frames[i].data, frames[i].length);
+        }
+    }
+}
+
 static mx_status_t eth_tx_listen_locked(ethdev_t* edev, bool yes) {
     ethdev0_t* edev0 = edev->edev0;
 
@@ -230,6 +291,7 @@ static int eth_tx_thread(void* arg) {
     ethdev_t* edev = (ethdev_t*)arg;
     ethdev0_t* edev0 = edev->edev0;
     eth_fifo_entry_t entries[FIFO_DEPTH / 2];
+    ethmac_frame_t frames[FIFO_DEPTH / 2];
     mx_status_t status;
     uint32_t count;
 
@@ -252,18 +314,23 @@ static int eth_tx_thread(void* arg) {
         }
 
         uint32_t n = count;
+        size_t nframes = 0;
         for (eth_fifo_entry_t* e = entries; count-- > 0; e++) {
             if ((e->offset > edev->io_size) || ((e->length > (edev->io_size - e->offset)))) {
                 e->flags = ETH_FIFO_INVALID;
             } else {
-                edev0->macops->send(edev0->mac, 0, edev->io_buf + e->offset, e->length);
+                frames[nframes].data = edev->io_buf + e->offset;
+                frames[nframes].length = e->length;
+                nframes++;
                 e->flags = ETH_FIFO_TX_OK;
-                if (edev->state & ETHDEV_TX_LOOPBACK) {
-                    eth_tx_echo(edev0, edev->io_buf + e->offset, e->length);
-                }
             }
         }
 
+        eth_send(edev0, frames, nframes);
+        if ((edev->state & ETHDEV_TX_LOOPBACK) && (nframes > 0)) {
+            eth_tx_echo(edev0, frames, nframes);
+        }
+
         if ((status = mx_fifo_write(edev->tx_fifo, entries, sizeof(eth_fifo_entry_t) * n, &count)) < 0) {
             if (status == ERR_SHOULD_WAIT) {
                 if ((edev->fail_tx_write++ % FAIL_REPORT_RATE) == 0) {
@@ -398,6 +465,9 @@ static mx_status_t eth_stop_locked(ethdev_t* edev) {
     ethdev0_t* edev0 = edev->edev0;
 
     if (edev->state & ETHDEV_RUNNING) {
+        // hand back anything already received; unused rx buffers stay
+        // cached for when the client starts us again
+        eth_rx_flush(edev);
         edev->state &= (~ETHDEV_RUNNING);
         list_delete(&edev->node);
         list_add_tail(&edev0->list_idle, &edev->node);
@@ -0,0 +1,131 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <ddk/binding.h>
+#include <ddk/device.h>
+#include <ddk/driver.h>
+#include <ddk/protocol/ethernet.h>
+
+#include <magenta/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+// An ethermac with no hardware behind it: every frame sent is handed
+// straight back to the receive path. It never autobinds; a test device
+// has to be bound to it explicitly (see system/uapp/eth-bench), so the
+// ethernet core can be measured on its own.
+
+typedef struct loopback {
+    mx_device_t* mxdev;
+
+    // callback interface to attached ethernet layer
+    ethmac_ifc_t* ifc;
+    void* cookie;
+} loopback_t;
+
+static mx_status_t loopback_query(mx_device_t* dev, uint32_t options, ethmac_info_t* info) {
+    static const uint8_t mac[ETH_MAC_SIZE] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+    memset(info, 0, sizeof(*info));
+    info->mtu = 1500;
+    memcpy(info->mac, mac, sizeof(info->mac));
+    return NO_ERROR;
+}
+
+static void loopback_stop(mx_device_t* dev) {
+    loopback_t* lb = dev->ctx;
+    lb->ifc = NULL;
+}
+
+static mx_status_t loopback_start(mx_device_t* dev, ethmac_ifc_t* ifc, void* cookie) {
+    loopback_t* lb = dev->ctx;
+    if (lb->ifc) {
+        return ERR_BAD_STATE;
+    }
+    lb->cookie = cookie;
+    lb->ifc = ifc;
+    return NO_ERROR;
+}
+
+// The ethernet layer holds its own lock around start() and stop() and takes
+// it again in recv(), so no lock is held here while calling back into it.
+static void loopback_send(mx_device_t* dev, uint32_t options, void* data, size_t length) {
+    loopback_t* lb = dev->ctx;
+    ethmac_ifc_t* ifc = lb->ifc;
+    if (ifc) {
+        ifc->recv(lb->cookie, data, length, 0);
+    }
+}
+
+static void loopback_send_many(mx_device_t* dev, uint32_t options,
+                               const ethmac_frame_t* frames, size_t count) {
+    loopback_t* lb = dev->ctx;
+    ethmac_ifc_t* ifc = lb->ifc;
+    if (ifc == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint32_t flags = (i + 1 < count) ? ETHMAC_RECV_MORE : 0;
+        ifc->recv(lb->cookie, frames[i].data, frames[i].length, flags);
+    }
+}
+
+static ethmac_protocol_t loopback_ethmac_ops = {
+    .query = loopback_query,
+    .stop = loopback_stop,
+    .start = loopback_start,
+    .send = loopback_send,
+    .send_many = loopback_send_many,
+};
+
+static void loopback_unbind(void* ctx) {
+    loopback_t* lb = ctx;
+    device_remove(lb->mxdev);
+}
+
+static void loopback_release(void* ctx) {
+    free(ctx);
+}
+
+static mx_protocol_device_t loopback_device_ops = {
+    .version = DEVICE_OPS_VERSION,
+    .unbind = loopback_unbind,
+    .release = loopback_release,
+};
+
+static mx_status_t loopback_bind(mx_driver_t* drv, mx_device_t* dev, void** cookie) {
+    loopback_t* lb;
+    if ((lb = calloc(1, sizeof(loopback_t))) == NULL) {
+        return ERR_NO_MEMORY;
+    }
+
+    device_add_args_t args = {
+        .version = DEVICE_ADD_ARGS_VERSION,
+        .name = "ethmac-loopback",
+        .ctx = lb,
+        .driver = drv,
+        .ops = &loopback_device_ops,
+        .proto_id = MX_PROTOCOL_ETHERMAC,
+        .proto_ops = &loopback_ethmac_ops,
+    };
+
+    mx_status_t status;
+    if ((status = device_add(dev, &args, &lb->mxdev)) < 0) {
+        free(lb);
+        return status;
+    }
+
+    return NO_ERROR;
+}
+
+static mx_driver_ops_t loopback_driver_ops = {
+    .version = DRIVER_OPS_VERSION,
+    .bind = loopback_bind,
+};
+
+MAGENTA_DRIVER_BEGIN(ethmac_loopback, loopback_driver_ops, "magenta", "0.1", 2)
+    BI_ABORT_IF_AUTOBIND,
+    BI_MATCH_IF(EQ, BIND_PROTOCOL, MX_PROTOCOL_TEST),
+MAGENTA_DRIVER_END(ethmac_loopback)
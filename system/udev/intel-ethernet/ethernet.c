@@ -57,7 +57,8 @@ static int irq_thread(void* arg) {
 
             while (eth_rx(&edev->eth, &data, &len) == NO_ERROR) {
                 if (edev->ifc) {
-                    edev->ifc->recv(edev->cookie, data, len, 0);
+                    uint32_t flags = eth_rx_more(&edev->eth) ? ETHMAC_RECV_MORE : 0;
+                    edev->ifc->recv(edev->cookie, data, len, flags);
                 }
                 eth_rx_ack(&edev->eth);
             }
@@ -112,11 +113,18 @@ static void eth_send(mx_device_t* dev, uint32_t options, void* data, size_t leng
     eth_tx(&edev->eth, data, length);
 }
 
+static void eth_send_many(mx_device_t* dev, uint32_t options,
+                          const ethmac_frame_t* frames, size_t count) {
+    ethernet_device_t* edev = dev->ctx;
+    eth_tx_many(&edev->eth, frames, count);
+}
+
 static ethmac_protocol_t ethmac_ops = {
     .query = eth_query,
     .stop = eth_stop,
     .start = eth_start,
     .send = eth_send,
+    .send_many = eth_send_many,
 };
 
 static void eth_release(void* ctx) {
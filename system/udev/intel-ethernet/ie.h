@@ -67,8 +67,13 @@ void eth_dump_regs(ethdev_t* eth);
 
 status_t eth_rx(ethdev_t* eth, void** data, size_t* len);
 void eth_rx_ack(ethdev_t* eth);
+// true if the frame after the one eth_rx() returned has also arrived
+bool eth_rx_more(ethdev_t* eth);
 
 status_t eth_tx(ethdev_t* eth, const void* data, size_t len);
+// transmit frames in order, skipping invalid ones, until the tx ring fills
+// returns the number queued
+size_t eth_tx_many(ethdev_t* eth, const ethmac_frame_t* frames, size_t count);
 
 #define ETH_IRQ_RX IE_INT_RXT0
 unsigned eth_handle_irq(ethdev_t* eth);
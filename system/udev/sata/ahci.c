@@ -59,9 +59,12 @@
 #define AHCI_PORT_FLAG_SYNC_PAUSED (1 << 2) // port is paused until pending xfers are done
 //clang-format on
 
+typedef struct ahci_device ahci_device_t;
+
 typedef struct ahci_port {
     int nr; // 0-based
     int flags;
+    ahci_device_t* dev;
 
     ahci_port_reg_t* regs;
     ahci_cl_t* cl;
@@ -75,9 +78,14 @@ typedef struct ahci_port {
 
     list_node_t txn_list;
     io_buffer_t buffer;
+
+    // each present port submits its own txns, so one busy disk
+    // never waits behind another
+    thrd_t worker_thread;
+    completion_t worker_completion;
 } ahci_port_t;
 
-typedef struct ahci_device {
+struct ahci_device {
     mx_device_t* mxdev;
 
     ahci_hba_t* regs;
@@ -89,16 +97,13 @@ typedef struct ahci_device {
     mx_handle_t irq_handle;
     thrd_t irq_thread;
 
-    thrd_t worker_thread;
-    completion_t worker_completion;
-
     thrd_t watchdog_thread;
     completion_t watchdog_completion;
 
     uint32_t cap;
 
     ahci_port_t ports[AHCI_MAX_PORTS];
-} ahci_device_t;
+};
 
 static inline mx_status_t ahci_wait_for_clear(const volatile uint32_t* reg, uint32_t mask, mx_time_t timeout) {
     int i = 0;
@@ -184,10 +189,6 @@ static void ahci_port_reset(ahci_port_t* port) {
     ahci_write(&port->regs->serr, ahci_read(&port->regs->serr));
 }
 
-static bool ahci_port_cmd_busy(ahci_port_t* port, int slot) {
-    return ((ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci)) & (1 << slot)) || (port->commands[slot] != NULL) || (port->running & (1 << slot));
-}
-
 static bool cmd_is_read(uint8_t cmd) {
     if (cmd == SATA_CMD_READ_DMA ||
         cmd == SATA_CMD_READ_DMA_EXT ||
@@ -212,36 +213,48 @@ static bool cmd_is_queued(uint8_t cmd) {
     return (cmd == SATA_CMD_READ_FPDMA_QUEUED) || (cmd == SATA_CMD_WRITE_FPDMA_QUEUED);
 }
 
+// Completes every running command the device has finished with.  One
+// interrupt often covers several NCQ completions, so this looks at all of
+// them at once rather than assuming one command per interrupt.
 static void ahci_port_complete_txn(ahci_device_t* dev, ahci_port_t* port, mx_status_t status) {
-    iotxn_t* txn;
-    uint32_t sact = ahci_read(&port->regs->sact);
+    iotxn_t* done[AHCI_MAX_COMMANDS];
+    int count = 0;
+
+    mtx_lock(&port->lock);
+    // queued commands are outstanding until their SACT bit clears, others
+    // until their CI bit clears
+    uint32_t active = ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci);
+    uint32_t finished = port->running & ~active;
     for (int i = 0; i < AHCI_MAX_COMMANDS; i++) {
-        txn = port->commands[i];
-        if (txn == NULL) {
-            continue;
-        }
-        if (!(sact & (1 << i))) {
-            mtx_lock(&port->lock);
-            // clear state before calling the complete() hook
-            port->running &= ~(1 << i);
+        if ((finished & (1u << i)) && port->commands[i]) {
+            done[count++] = port->commands[i];
             port->commands[i] = NULL;
+        }
+    }
+    // clear state before calling the complete() hook
+    port->running &= ~finished;
 
-            // resume the port if paused for sync and no outstanding transactions
-            if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
-                port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
-            }
-            mtx_unlock(&port->lock);
+    // resume the port if paused for sync and no outstanding transactions
+    if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
+        port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
+    }
+    mtx_unlock(&port->lock);
 
-            iotxn_complete(txn, status, txn->length);
-        }
+    for (int i = 0; i < count; i++) {
+        iotxn_complete(done[i], status, done[i]->length);
+    }
+    // hit the port's worker thread to fill the freed slots
+    if (count) {
+        completion_signal(&port->worker_completion);
     }
-    // hit the worker thread to do the next txn
-    completion_signal(&dev->worker_completion);
 }
 
-static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot, iotxn_t* txn) {
+// Builds the command for txn in slot and marks the slot running, but does
+// not issue it; the caller issues a whole batch of slots at once.  Returns
+// false if the txn was completed without needing the slot.
+static bool ahci_port_build_txn(ahci_device_t* dev, ahci_port_t* port, int slot, iotxn_t* txn) {
     assert(slot < AHCI_MAX_COMMANDS);
-    assert(!ahci_port_cmd_busy(port, slot));
+    assert(!(port->running & (1u << slot)));
 
     sata_pdata_t* pdata = sata_iotxn_pdata(txn);
     if ((cmd_is_read(pdata->cmd) || cmd_is_write(pdata->cmd)) && pdata->count == 0) {
@@ -252,15 +265,13 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
             port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
         }
         iotxn_complete(txn, NO_ERROR, txn->length);
-        completion_signal(&dev->worker_completion);
-        return NO_ERROR;
+        return false;
     }
 
     mx_status_t status = iotxn_physmap(txn);
     if (status != NO_ERROR) {
         iotxn_complete(txn, status, 0);
-        completion_signal(&dev->worker_completion);
-        return status;
+        return false;
     }
     iotxn_phys_iter_t iter;
     iotxn_phys_iter_init(&iter, txn, AHCI_PRD_MAX_SIZE);
@@ -325,14 +336,12 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
             printf("ahci.%d: chunk size > %zu is unsupported\n", port->nr, length);
             status = ERR_NOT_SUPPORTED;
             iotxn_complete(txn, status, 0);
-            completion_signal(&dev->worker_completion);
-            return status;
+            return false;
         } else if (cl->prdtl == AHCI_MAX_PRDS) {
             printf("ahci.%d: txn with more than %d chunks is unsupported\n", port->nr, cl->prdtl);
             status = ERR_NOT_SUPPORTED;
             iotxn_complete(txn, status, 0);
-            completion_signal(&dev->worker_completion);
-            return status;
+            return false;
         }
 
         prd->dba = LO32(paddr);
@@ -347,17 +356,61 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
     port->running |= (1 << slot);
     port->commands[slot] = txn;
 
-    // start command
-    if (cmd_is_queued(pdata->cmd)) {
-        ahci_write(&port->regs->sact, ahci_read(&port->regs->sact) | (1 << slot));
-    }
-    ahci_write(&port->regs->ci, ahci_read(&port->regs->ci) | (1 << slot));
-
     // set the watchdog
     // TODO: general timeout mechanism
     pdata->timeout = mx_time_get(MX_CLOCK_MONOTONIC) + MX_SEC(1);
-    completion_signal(&dev->watchdog_completion);
-    return NO_ERROR;
+    return true;
+}
+
+// Moves as many txns from the port's queue into free command slots as the
+// device allows, then issues them all with one write each to SACT and CI.
+static void ahci_port_submit_locked(ahci_device_t* dev, ahci_port_t* port) {
+    // slots the hardware still owns, e.g. after a watchdog timeout
+    uint32_t hw_busy = ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci);
+    uint32_t issue = 0;
+    uint32_t queued = 0;
+    iotxn_t* txn;
+
+    while (!(port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) &&
+           (txn = list_peek_head_type(&port->txn_list, iotxn_t, node)) != NULL) {
+        // if IOTXN_SYNC_BEFORE, pause the port if there are transactions in flight
+        if ((txn->flags & IOTXN_SYNC_BEFORE) && port->running) {
+            port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+            break;
+        }
+
+        // find a free command tag
+        sata_pdata_t* pdata = sata_iotxn_pdata(txn);
+        int max = MIN(pdata->max_cmd, (int)((dev->cap >> 8) & 0x1f));
+        uint32_t slots = (max >= AHCI_MAX_COMMANDS - 1) ? ~0u : ((1u << (max + 1)) - 1);
+        uint32_t free_slots = slots & ~(port->running | hw_busy);
+        if (!free_slots) {
+            break;
+        }
+        int slot = __builtin_ctz(free_slots);
+
+        list_delete(&txn->node);
+        // if IOTXN_SYNC_AFTER, pause the port until this command is complete
+        if (txn->flags & IOTXN_SYNC_AFTER) {
+            port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+        }
+        if (ahci_port_build_txn(dev, port, slot, txn)) {
+            issue |= 1u << slot;
+            if (cmd_is_queued(pdata->cmd)) {
+                queued |= 1u << slot;
+            }
+        }
+    }
+
+    if (issue) {
+        // writing 0 bits to SACT and CI has no effect, so no need to
+        // read-modify-write them
+        if (queued) {
+            ahci_write(&port->regs->sact, queued);
+        }
+        ahci_write(&port->regs->ci, issue);
+        completion_signal(&dev->watchdog_completion);
+    }
 }
 
 static mx_status_t ahci_port_initialize(ahci_port_t* port) {
@@ -468,8 +521,8 @@ static void ahci_iotxn_queue(void* ctx, iotxn_t* txn) {
     list_add_tail(&port->txn_list, &txn->node);
     mtx_unlock(&port->lock);
 
-    // hit the worker thread
-    completion_signal(&device->worker_completion);
+    // hit the port's worker thread
+    completion_signal(&port->worker_completion);
 }
 
 static void ahci_release(void* ctx) {
@@ -478,59 +531,18 @@ static void ahci_release(void* ctx) {
     free(device);
 }
 
-// worker thread (for iotxn queue):
+// per-port worker thread (for iotxn queue):
 
-static int ahci_worker_thread(void* arg) {
-    ahci_device_t* dev = (ahci_device_t*)arg;
-    ahci_port_t* port;
-    iotxn_t* txn;
+static int ahci_port_worker_thread(void* arg) {
+    ahci_port_t* port = (ahci_port_t*)arg;
     for (;;) {
-        // iterate all the ports and run commands
-        for (int i = 0; i < AHCI_MAX_PORTS; i++) {
-            port = &dev->ports[i];
-            mtx_lock(&port->lock);
-            if (!(port->flags & (AHCI_PORT_FLAG_IMPLEMENTED | AHCI_PORT_FLAG_PRESENT))) {
-                goto next;
-            }
-            if (port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) {
-                goto next;
-            }
-
-            txn = list_peek_head_type(&port->txn_list, iotxn_t, node);
-            if (!txn) {
-                goto next;
-            }
+        mtx_lock(&port->lock);
+        ahci_port_submit_locked(port->dev, port);
+        mtx_unlock(&port->lock);
 
-            // if IOTXN_SYNC_BEFORE, pause the port if there are transactions in flight
-            if ((txn->flags & IOTXN_SYNC_BEFORE) && port->running) {
-                port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
-                goto next;
-            }
-
-            // find a free command tag
-            sata_pdata_t* pdata = sata_iotxn_pdata(txn);
-            int max = MIN(pdata->max_cmd, (int)((dev->cap >> 8) & 0x1f));
-            int i = 0;
-            for (i = 0; i <= max; i++) {
-                if (!ahci_port_cmd_busy(port, i)) break;
-            }
-            if (i > max) {
-                goto next;
-            }
-
-            list_delete(&txn->node);
-            // if IOTXN_SYNC_AFTER, pause the port until this command is complete
-            if (txn->flags & IOTXN_SYNC_AFTER) {
-                port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
-            }
-            // run the command
-            ahci_do_txn(dev, port, i, txn);
-next:
-            mtx_unlock(&port->lock);
-        }
-        // wait here until more commands are queued, or a port becomes idle
-        completion_wait(&dev->worker_completion, MX_TIME_INFINITE);
-        completion_reset(&dev->worker_completion);
+        // wait here until more commands are queued, or slots free up
+        completion_wait(&port->worker_completion, MX_TIME_INFINITE);
+        completion_reset(&port->worker_completion);
     }
     return 0;
 }
@@ -584,13 +596,9 @@ static void ahci_port_irq(ahci_device_t* dev, int nr) {
     uint32_t is = ahci_read(&port->regs->is);
     ahci_write(&port->regs->is, is);
 
-    if (is & AHCI_PORT_INT_DHR) { // RFIS received
-        ahci_port_complete_txn(dev, port, NO_ERROR);
-    }
-    if (is & AHCI_PORT_INT_PS) { // PSFIS rcv
-        ahci_port_complete_txn(dev, port, NO_ERROR);
-    }
-    if (is & AHCI_PORT_INT_SDB) { // SDBFIS
+    // RFIS, PSFIS or SDBFIS received; a single SDBFIS can complete
+    // many queued commands
+    if (is & (AHCI_PORT_INT_DHR | AHCI_PORT_INT_PS | AHCI_PORT_INT_SDB)) {
         ahci_port_complete_txn(dev, port, NO_ERROR);
     }
     if (is & AHCI_PORT_INT_PRC) { // PhyRdy change
@@ -668,8 +676,10 @@ static int ahci_init_thread(void* arg) {
         if (!(port_map & (1 << i))) continue; // port not implemented
 
         port->flags = AHCI_PORT_FLAG_IMPLEMENTED;
+        port->dev = dev;
         port->regs = &dev->regs->ports[i];
         list_initialize(&port->txn_list);
+        port->worker_completion = COMPLETION_INIT;
 
         status = ahci_port_initialize(port);
         if (status) goto fail;
@@ -699,6 +709,12 @@ static int ahci_init_thread(void* arg) {
 
         // FIXME proper layering?
         if (ahci_read(&port->regs->ssts) & AHCI_PORT_SSTS_DET_PRESENT) {
+            int ret = thrd_create_with_name(&port->worker_thread, ahci_port_worker_thread,
+                                            port, "ahci-port-worker");
+            if (ret != thrd_success) {
+                xprintf("ahci.%d: error %d in worker thread create\n", port->nr, ret);
+                continue;
+            }
             port->flags |= AHCI_PORT_FLAG_PRESENT;
             if (ahci_read(&port->regs->sig) == AHCI_PORT_SIG_SATA) {
                 sata_bind(dev->mxdev, port->nr);
@@ -789,14 +805,6 @@ static mx_status_t ahci_bind(mx_driver_t* drv, mx_device_t* dev, void** cookie)
     device->watchdog_completion = COMPLETION_INIT;
     thrd_create_with_name(&device->watchdog_thread, ahci_watchdog_thread, device, "ahci-watchdog");
 
-    // start worker thread (for iotxn queue)
-    device->worker_completion = COMPLETION_INIT;
-    ret = thrd_create_with_name(&device->worker_thread, ahci_worker_thread, device, "ahci-worker");
-    if (ret != thrd_success) {
-        xprintf("ahci: error %d in worker thread create\n", ret);
-        goto fail;
-    }
-
     // add the device for the controller
     device_add_args_t args = {
         .version = DEVICE_ADD_ARGS_VERSION,
@@ -0,0 +1,174 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <bootdata/decompress.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include <magenta/syscalls.h>
+
+#include "decompress-private.h"
+
+// Every block but the last decompresses to exactly BOOTDATA_LZ4_BLOCK_MAX
+// bytes, so block i lands at a known offset in the output and the blocks
+// can be handed out to threads without any coordination.
+
+typedef struct {
+    const uint8_t* src;
+    uint32_t blocksize;
+} lz4_block_t;
+
+typedef struct {
+    const lz4_block_t* blocks;
+    size_t count;
+    uint8_t* dst;
+    size_t dstlen;
+
+    // this worker does blocks first, first + stride, ...
+    size_t first;
+    size_t stride;
+
+    mx_status_t status;
+    const char* err;
+    // set if a block other than the last came up short, meaning the
+    // image was not laid out the way mkbootfs does it
+    bool short_block;
+    size_t last_actual;
+} lz4_worker_t;
+
+static int lz4_worker(void* arg) {
+    lz4_worker_t* w = arg;
+    for (size_t i = w->first; i < w->count; i += w->stride) {
+        size_t off = i * BOOTDATA_LZ4_BLOCK_MAX;
+        size_t len = w->dstlen - off;
+        if (len > BOOTDATA_LZ4_BLOCK_MAX) {
+            len = BOOTDATA_LZ4_BLOCK_MAX;
+        }
+        size_t actual;
+        w->status = bootdata_lz4_block(w->blocks[i].src, w->blocks[i].blocksize,
+                                       w->dst + off, len, &actual, &w->err);
+        if (w->status < 0) {
+            break;
+        }
+        if (i + 1 == w->count) {
+            w->last_actual = actual;
+        } else if (actual != BOOTDATA_LZ4_BLOCK_MAX) {
+            w->short_block = true;
+            break;
+        }
+    }
+    return 0;
+}
+
+static mx_status_t decompress_parallel(const uint8_t* data, const uint8_t* end,
+                                       uint8_t* dst, size_t* remaining,
+                                       const char** err, void* arg) {
+    unsigned threads = *(const unsigned*)arg;
+
+    // Find the blocks.  Only their size words need to be read for this.
+    size_t count = 0;
+    for (const uint8_t* p = data;;) {
+        if ((size_t)(end - p) < sizeof(uint32_t)) {
+            *err = "lz4 frame truncated";
+            return ERR_INVALID_ARGS;
+        }
+        uint32_t blocksize = *(const uint32_t*)p;
+        if (blocksize == 0) {
+            break;
+        }
+        p += sizeof(uint32_t);
+        if ((size_t)(end - p) < (blocksize & 0x7fffffff)) {
+            *err = "lz4 frame truncated";
+            return ERR_INVALID_ARGS;
+        }
+        p += blocksize & 0x7fffffff;
+        count++;
+    }
+    if (count == 0) {
+        return NO_ERROR;
+    }
+    if ((count - 1) * BOOTDATA_LZ4_BLOCK_MAX >= *remaining) {
+        *err = "bootdata outsize too small for lz4 decompression";
+        return ERR_INVALID_ARGS;
+    }
+
+    lz4_block_t* blocks = malloc(count * sizeof(lz4_block_t));
+    if (blocks == NULL) {
+        *err = "out of memory for lz4 block list";
+        return ERR_NO_MEMORY;
+    }
+    const uint8_t* p = data;
+    for (size_t i = 0; i < count; i++) {
+        blocks[i].blocksize = *(const uint32_t*)p;
+        blocks[i].src = p + sizeof(uint32_t);
+        p = blocks[i].src + (blocks[i].blocksize & 0x7fffffff);
+    }
+
+    if (threads > count) {
+        threads = count;
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+    lz4_worker_t workers[threads];
+    thrd_t tids[threads];
+    bool started[threads];
+    for (unsigned t = 0; t < threads; t++) {
+        workers[t] = (lz4_worker_t){
+            .blocks = blocks,
+            .count = count,
+            .dst = dst,
+            .dstlen = *remaining,
+            .first = t,
+            .stride = threads,
+            .status = NO_ERROR,
+        };
+        // worker 0 runs on this thread once the others are going
+        started[t] = (t > 0) && (thrd_create_with_name(&tids[t], lz4_worker, &workers[t],
+                                                       "bootfs-lz4") == thrd_success);
+    }
+    for (unsigned t = 0; t < threads; t++) {
+        if (!started[t]) {
+            lz4_worker(&workers[t]);
+        }
+    }
+
+    mx_status_t status = NO_ERROR;
+    bool short_block = false;
+    size_t last_actual = 0;
+    for (unsigned t = 0; t < threads; t++) {
+        if (started[t]) {
+            thrd_join(tids[t], NULL);
+        }
+        if ((workers[t].status < 0) && (status == NO_ERROR)) {
+            status = workers[t].status;
+            *err = workers[t].err;
+        }
+        short_block |= workers[t].short_block;
+        if ((count - 1) % threads == t) {
+            last_actual = workers[t].last_actual;
+        }
+    }
+    free(blocks);
+
+    if (short_block && (status == NO_ERROR)) {
+        // Not an image we can split up; do it the slow way.
+        return bootdata_lz4_serial(data, end, dst, remaining, err, NULL);
+    }
+    if (status < 0) {
+        return status;
+    }
+    *remaining -= (count - 1) * BOOTDATA_LZ4_BLOCK_MAX + last_actual;
+    return NO_ERROR;
+}
+
+mx_status_t decompress_bootdata_parallel(mx_handle_t vmar, mx_handle_t vmo,
+                                         size_t offset, size_t length,
+                                         unsigned threads,
+                                         mx_handle_t* out, const char** err) {
+    return decompress_bootdata_with(vmar, vmo, offset, length,
+                                    decompress_parallel, &threads, out, err);
+}
@@ -0,0 +1,43 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#pragma GCC visibility push(hidden)
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <magenta/types.h>
+
+// mkbootfs compresses bootfs images as an LZ4 frame of independent
+// blocks, each of which holds this much uncompressed data except for
+// the last one.
+#define BOOTDATA_LZ4_BLOCK_MAX (64 * 1024)
+
+// Decompresses the LZ4 blocks starting at 'data' (the first block size
+// word) and ending before 'end' into 'dst', which has room for
+// '*remaining' bytes.  On return '*remaining' is the room left over.
+typedef mx_status_t (*bootdata_lz4_fn)(const uint8_t* data, const uint8_t* end,
+                                       uint8_t* dst, size_t* remaining,
+                                       const char** err, void* arg);
+
+// decompress_bootdata, with the block loop supplied by the caller.
+mx_status_t decompress_bootdata_with(mx_handle_t vmar, mx_handle_t vmo,
+                                     size_t offset, size_t length,
+                                     bootdata_lz4_fn decompress, void* arg,
+                                     mx_handle_t* out, const char** err);
+
+// Decompresses one LZ4 block of 'blocksize' (as it appears in the frame,
+// with the high bit set for stored blocks) into at most 'dstlen' bytes.
+mx_status_t bootdata_lz4_block(const uint8_t* src, uint32_t blocksize,
+                               uint8_t* dst, size_t dstlen, size_t* actual,
+                               const char** err);
+
+// Decompresses the blocks one after another; a bootdata_lz4_fn.
+mx_status_t bootdata_lz4_serial(const uint8_t* data, const uint8_t* end,
+                                uint8_t* dst, size_t* remaining,
+                                const char** err, void* arg);
+
+#pragma GCC visibility pop
@@ -4,6 +4,8 @@
 
 #include <bootdata/decompress.h>
 
+#include "decompress-private.h"
+
 #include <limits.h>
 #include <string.h>
 
@@ -85,9 +87,56 @@ static mx_status_t check_lz4_frame(const lz4_frame_desc* fd,
     return NO_ERROR;
 }
 
+mx_status_t bootdata_lz4_block(const uint8_t* src, uint32_t blocksize,
+                               uint8_t* dst, size_t dstlen, size_t* actual,
+                               const char** err) {
+    // If the data is uncompressed, the high bit is 1.
+    if (blocksize >> 31) {
+        uint32_t len = blocksize & 0x7fffffff;
+        if (len > dstlen) {
+            *err = "bootdata outsize too small for lz4 decompression";
+            return ERR_INVALID_ARGS;
+        }
+        memcpy(dst, src, len);
+        *actual = len;
+    } else {
+        int dcmp = LZ4_decompress_safe((const char*)src, (char*)dst, blocksize, dstlen);
+        if (dcmp < 0) {
+            *err = "lz4 decompression failed";
+            return ERR_BAD_STATE;
+        }
+        *actual = dcmp;
+    }
+    return NO_ERROR;
+}
+
+// Read each LZ4 block and decompress it. Block sizes are 32 bits.
+mx_status_t bootdata_lz4_serial(const uint8_t* data, const uint8_t* end,
+                                uint8_t* dst, size_t* remaining,
+                                const char** err, void* arg) {
+    uint32_t blocksize = *(const uint32_t*)data;
+    data += sizeof(uint32_t);
+    while (blocksize) {
+        size_t actual;
+        mx_status_t status = bootdata_lz4_block(data, blocksize, dst, *remaining,
+                                                &actual, err);
+        if (status < 0) {
+            return status;
+        }
+        dst += actual;
+        data += blocksize & 0x7fffffff;
+        *remaining -= actual;
+
+        blocksize = *(uint32_t*)data;
+        data += sizeof(uint32_t);
+    }
+    return NO_ERROR;
+}
+
 static mx_status_t decompress_bootfs_vmo(mx_handle_t vmar,
-                                         const uint8_t* data, mx_handle_t* out,
-                                         const char** err) {
+                                         const uint8_t* data, const uint8_t* end,
+                                         bootdata_lz4_fn decompress, void* arg,
+                                         mx_handle_t* out, const char** err) {
     const bootdata_t* hdr = (bootdata_t*)data;
 
     // Skip past the bootdata header
@@ -135,40 +184,9 @@ static mx_status_t decompress_bootfs_vmo(mx_handle_t vmar,
     dst += sizeof(bootdata_t);
     remaining -= sizeof(bootdata_t);
 
-    // Read each LZ4 block and decompress it. Block sizes are 32 bits.
-    uint32_t blocksize = *(const uint32_t*)data;
-    data += sizeof(uint32_t);
-    while (blocksize) {
-        // If the data is uncompressed, the high bit is 1.
-        if (blocksize >> 31) {
-            uint32_t actual = blocksize & 0x7fffffff;
-            memcpy(dst, data, actual);
-            dst += actual;
-            data += actual;
-            if (remaining - actual > remaining) {
-                // Remaining wrapped around (would be negative if signed)
-                *err = "bootdata outsize too small for lz4 decompression";
-                return ERR_INVALID_ARGS;
-            }
-            remaining -= actual;
-        } else {
-            int dcmp = LZ4_decompress_safe((const char*)data, (char*)dst, blocksize, remaining);
-            if (dcmp < 0) {
-                *err = "lz4 decompression failed";
-                return ERR_BAD_STATE;
-            }
-            dst += dcmp;
-            data += blocksize;
-            if (remaining - dcmp > remaining) {
-                // Remaining wrapped around (would be negative if signed)
-                *err = "bootdata outsize too small for lz4 decompression";
-                return ERR_INVALID_ARGS;
-            }
-            remaining -= dcmp;
-        }
-
-        blocksize = *(uint32_t*)data;
-        data += sizeof(uint32_t);
+    status = decompress(data, end, dst, &remaining, err, arg);
+    if (status < 0) {
+        return status;
     }
 
     // Sanity check: verify that we didn't have more than one page leftover.
@@ -188,9 +206,10 @@ static mx_status_t decompress_bootfs_vmo(mx_handle_t vmar,
     return NO_ERROR;
 }
 
-mx_status_t decompress_bootdata(mx_handle_t vmar, mx_handle_t vmo,
-                                size_t offset, size_t length,
-                                mx_handle_t* out, const char** err) {
+mx_status_t decompress_bootdata_with(mx_handle_t vmar, mx_handle_t vmo,
+                                     size_t offset, size_t length,
+                                     bootdata_lz4_fn decompress, void* arg,
+                                     mx_handle_t* out, const char** err) {
     *err = "none";
 
     if (length > SIZE_MAX) {
@@ -214,7 +233,9 @@ mx_status_t decompress_bootdata(mx_handle_t vmar, mx_handle_t vmo,
     case BOOTDATA_BOOTFS_BOOT:
     case BOOTDATA_BOOTFS_SYSTEM:
         if (hdr->flags & BOOTDATA_BOOTFS_FLAG_COMPRESSED) {
-            status = decompress_bootfs_vmo(vmar, (const uint8_t*)addr, out, err);
+            status = decompress_bootfs_vmo(vmar, (const uint8_t*)addr,
+                                           (const uint8_t*)addr + length - align_shift,
+                                           decompress, arg, out, err);
         }
         break;
     default:
@@ -226,3 +247,10 @@ mx_status_t decompress_bootdata(mx_handle_t vmar, mx_handle_t vmo,
 
     return status;
 }
+
+mx_status_t decompress_bootdata(mx_handle_t vmar, mx_handle_t vmo,
+                                size_t offset, size_t length,
+                                mx_handle_t* out, const char** err) {
+    return decompress_bootdata_with(vmar, vmo, offset, length,
+                                    bootdata_lz4_serial, NULL, out, err);
+}
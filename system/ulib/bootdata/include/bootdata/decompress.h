@@ -16,4 +16,11 @@ mx_status_t decompress_bootdata(mx_handle_t vmar, mx_handle_t vmo,
                                 size_t offset, size_t length,
                                 mx_handle_t* out, const char** errmsg);
 
+// As above, but spreads the independent LZ4 blocks of the image across
+// up to 'threads' threads.  Not available in userboot.
+mx_status_t decompress_bootdata_parallel(mx_handle_t vmar, mx_handle_t vmo,
+                                         size_t offset, size_t length,
+                                         unsigned threads,
+                                         mx_handle_t* out, const char** errmsg);
+
 #pragma GCC visibility pop
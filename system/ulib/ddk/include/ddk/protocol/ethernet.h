@@ -41,6 +41,18 @@ typedef struct ethmac_info {
 
 #define ETHMAC_STATUS_ONLINE (1u)
 
+// Passed to recv() for every frame of a burst (for example, all the
+// frames drained by one interrupt) except the last, so that the
+// ethernet layer can batch its per-frame work until the burst ends.
+// Drivers that never set it get a completion per frame.
+#define ETHMAC_RECV_MORE (1u)
+
+// One frame of a send_many() batch.
+typedef struct ethmac_frame {
+    void* data;
+    size_t length;
+} ethmac_frame_t;
+
 typedef struct ethmac_ifc_virt {
     void (*status)(void* cookie, uint32_t status);
 
@@ -80,6 +92,13 @@ typedef struct ethmac_protocol {
                      uintptr_t pa0, uintptr_t pa1, size_t length);
     void (*queue_rx)(mx_device_t* dev, uint32_t options,
                      uintptr_t pa0, uintptr_t pa1, size_t length);
+
+    // send_many() is optional and follows the same rules as send(). It
+    // transmits |count| frames in order, letting the driver reclaim
+    // descriptors and notify the hardware once for the whole batch.
+    // If it is NULL the ethernet layer calls send() once per frame.
+    void (*send_many)(mx_device_t* dev, uint32_t options,
+                      const ethmac_frame_t* frames, size_t count);
 } ethmac_protocol_t;
 
 
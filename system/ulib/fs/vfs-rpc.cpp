@@ -173,6 +173,66 @@ static mx_status_t iostate_get_token(uint64_t vnode_cookie, vfs_iostate* ios, mx
     return sizeof(mx_handle_t);
 }
 
+// Staging buffer for READ_VMO / WRITE_VMO, protected by vfs_big_lock.
+// The client's vmo is deliberately never mapped: the client could shrink
+// it underneath us, and a fault here would take down the whole server.
+static uint8_t xfer_buffer[MXRIO_XFER_MAX];
+
+// Consumes the vmo in msg->handle[0].
+static mx_status_t iostate_xfer_vmo(mxrio_msg_t* msg, uint32_t len, mxtl::RefPtr<Vnode> vn,
+                                    vfs_iostate* ios) {
+    mx_handle_t vmo = msg->handle[0];
+    auto close_vmo = mxtl::MakeAutoCall([vmo]() { mx_handle_close(vmo); });
+
+    if (len != sizeof(mxrio_xfer_data_t)) {
+        return ERR_INVALID_ARGS;
+    }
+    const mxrio_xfer_data_t* xfer = reinterpret_cast<const mxrio_xfer_data_t*>(msg->data);
+    if ((xfer->length > MXRIO_XFER_MAX) || (xfer->flags & ~MXRIO_XFER_FLAG_AT)) {
+        return ERR_INVALID_ARGS;
+    }
+    bool at = xfer->flags & MXRIO_XFER_FLAG_AT;
+
+    mx_status_t status;
+    size_t actual;
+    ssize_t r;
+    if (MXRIO_OP(msg->op) == MXRIO_READ_VMO) {
+        r = vn->Read(xfer_buffer, xfer->length, at ? xfer->offset : ios->io_off);
+        if (r < 0) {
+            return static_cast<mx_status_t>(r);
+        }
+        if ((status = mx_vmo_write(vmo, xfer_buffer, xfer->vmo_offset, r, &actual)) < 0) {
+            return status;
+        } else if (actual != static_cast<size_t>(r)) {
+            return ERR_IO;
+        }
+    } else {
+        if ((status = mx_vmo_read(vmo, xfer_buffer, xfer->vmo_offset, xfer->length,
+                                  &actual)) < 0) {
+            return status;
+        } else if (actual != xfer->length) {
+            return ERR_IO;
+        }
+        if (!at && (ios->io_flags & O_APPEND)) {
+            vnattr_t attr;
+            if ((status = vn->Getattr(&attr)) < 0) {
+                return status;
+            }
+            ios->io_off = attr.size;
+        }
+        r = vn->Write(xfer_buffer, xfer->length, at ? xfer->offset : ios->io_off);
+        if (r < 0) {
+            return static_cast<mx_status_t>(r);
+        }
+    }
+
+    if (!at) {
+        ios->io_off += r;
+        msg->arg2.off = ios->io_off;
+    }
+    return static_cast<mx_status_t>(r);
+}
+
 mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode> vn, vfs_iostate* ios) {
     uint32_t len = msg->datalen;
     int32_t arg = msg->arg;
@@ -269,6 +329,9 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
         ssize_t r = vn->Write(msg->data, len, msg->arg2.off);
         return static_cast<mx_status_t>(r);
     }
+    case MXRIO_READ_VMO:
+    case MXRIO_WRITE_VMO:
+        return iostate_xfer_vmo(msg, len, mxtl::move(vn), ios);
     case MXRIO_SEEK: {
         vnattr_t attr;
         mx_status_t r;
@@ -14,3 +14,17 @@ const struct vdso_constants DATA_CONSTANTS = {
     0,
     0,
 };
+
+// The kernel fills this in at boot and updates it under its sequence
+// lock; see <lib/vdso-time.h>.  As above, the nonzero initializer keeps
+// it out of .bss.  seq must start out even.
+const struct vdso_time_values DATA_TIME_VALUES = {
+    0,
+    0,
+    0,
+    0xdeadbeef,
+    0,
+    0,
+    0,
+    0,
+};
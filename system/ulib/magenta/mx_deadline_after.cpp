@@ -7,7 +7,7 @@
 #include "private.h"
 
 mx_time_t _mx_deadline_after(mx_duration_t nanoseconds) {
-    return nanoseconds + VDSO_mx_time_get(MX_CLOCK_MONOTONIC);
+    return nanoseconds + CODE_usermode_time_get(MX_CLOCK_MONOTONIC);
 }
 
 VDSO_PUBLIC_ALIAS(mx_deadline_after);
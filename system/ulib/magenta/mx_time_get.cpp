@@ -0,0 +1,42 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/fixed_point.h>
+#include <magenta/syscalls.h>
+
+#include "private.h"
+
+// At boot time the kernel can decide to redirect the {_,}mx_time_get
+// dynamic symbol table entries to point to this instead.  See VDso::VDso.
+// mx_deadline_after always calls it, so it must still work (by making
+// the syscall) when the kernel has not enabled it.
+mx_time_t CODE_usermode_time_get(uint32_t clock_id) {
+    if (clock_id != MX_CLOCK_MONOTONIC && clock_id != MX_CLOCK_UTC)
+        return VDSO_mx_time_get(clock_id);
+
+    const vdso_time_values* values = &DATA_TIME_VALUES;
+    uint64_t seq;
+    uint32_t usermode_time;
+    fp_32_64 ns_per_tick;
+    int64_t utc_offset;
+    mx_time_t ticks;
+    do {
+        seq = __atomic_load_n(&values->seq, __ATOMIC_ACQUIRE);
+        usermode_time = __atomic_load_n(&values->usermode_time, __ATOMIC_RELAXED);
+        ns_per_tick.l0 = __atomic_load_n(&values->ns_per_tick_l0, __ATOMIC_RELAXED);
+        ns_per_tick.l32 = __atomic_load_n(&values->ns_per_tick_l32, __ATOMIC_RELAXED);
+        ns_per_tick.l64 = __atomic_load_n(&values->ns_per_tick_l64, __ATOMIC_RELAXED);
+        utc_offset = __atomic_load_n(&values->utc_offset, __ATOMIC_RELAXED);
+        ticks = VDSO_mx_ticks_get();
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) != 0 || seq != __atomic_load_n(&values->seq, __ATOMIC_RELAXED));
+
+    if (!usermode_time)
+        return VDSO_mx_time_get(clock_id);
+
+    mx_time_t now = u64_mul_u64_fp32_64(ticks, ns_per_tick);
+    if (clock_id == MX_CLOCK_UTC)
+        now += utc_offset;
+    return now;
+}
@@ -9,8 +9,10 @@
 
 // This defines the struct shared with the kernel.
 #include <lib/vdso-constants.h>
+#include <lib/vdso-time.h>
 
 extern __LOCAL const struct vdso_constants DATA_CONSTANTS;
+extern __LOCAL const struct vdso_time_values DATA_TIME_VALUES;
 
 extern "C" {
 
@@ -20,6 +22,7 @@ extern "C" {
 #include <magenta/syscall-vdso-definitions.h>
 
 __LOCAL decltype(mx_ticks_get) CODE_soft_ticks_get;
+__LOCAL decltype(mx_time_get) CODE_usermode_time_get;
 
 };
 
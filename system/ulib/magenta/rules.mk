@@ -11,7 +11,7 @@ MODULE_TYPE := userlib
 # This library should not depend on libc.
 MODULE_COMPILEFLAGS := -ffreestanding
 
-MODULE_HEADER_DEPS := kernel/lib/vdso
+MODULE_HEADER_DEPS := kernel/lib/vdso kernel/lib/fixed_point
 
 MODULE_SRCS := \
     $(LOCAL_DIR)/data.cpp \
@@ -23,6 +23,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/mx_system_get_version.cpp \
     $(LOCAL_DIR)/mx_ticks_get.cpp \
     $(LOCAL_DIR)/mx_ticks_per_second.cpp \
+    $(LOCAL_DIR)/mx_time_get.cpp \
 
 ifeq ($(ARCH),arm64)
 MODULE_SRCS += \
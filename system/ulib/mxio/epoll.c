@@ -9,79 +9,25 @@
 #include <sys/epoll.h>
 #include <threads.h>
 
-#include <magenta/listnode.h>
 #include <magenta/syscalls.h>
 #include <mxio/io.h>
 #include <mxio/util.h>
 
 #include "private.h"
 #include "unistd.h"
+#include "waitport.h"
 
-// TODO: should use a system default
-#define MAX_WAIT_EVENTS 1024
-
-typedef struct mxio_epoll_cookie {
-    list_node_t node;
-    mxio_t* io;
-    struct epoll_event ep_event;
-    int fd;
-} mxio_epoll_cookie_t;
+// results handled per mxio_waitport_wait()
+#define EPOLL_BATCH 64
 
 typedef struct mxio_epoll {
     mxio_t io;
-    mx_handle_t h;
-    mtx_t cookies_lock;
-    list_node_t cookies;
+    mxio_waitport_t wp;
 } mxio_epoll_t;
 
-static void mxio_epoll_cookie_add(mxio_epoll_t* epio,
-                                  mxio_epoll_cookie_t* cookie) {
-    mtx_lock(&epio->cookies_lock);
-    list_add_head(&epio->cookies, &cookie->node);
-    mtx_unlock(&epio->cookies_lock);
-}
-
-static mxio_epoll_cookie_t* mxio_epoll_cookie_get(mxio_epoll_t* epio, int fd,
-                                                  bool remove) {
-    mxio_epoll_cookie_t* cookie = NULL;
-    mxio_epoll_cookie_t* entry = NULL;
-    mtx_lock(&epio->cookies_lock);
-    list_for_every_entry(&epio->cookies, entry, mxio_epoll_cookie_t, node) {
-        // doesn't have to be _safe as we break immediately after deletion
-        if (entry->fd == fd) {
-            if (remove) {
-                list_delete(&entry->node);
-            }
-            cookie = entry;
-            break;
-        }
-    }
-    mtx_unlock(&epio->cookies_lock);
-    return cookie;
-}
-
-static mxio_epoll_cookie_t* mxio_epoll_cookie_find(mxio_epoll_t* epio, int fd) {
-    return mxio_epoll_cookie_get(epio, fd, false);
-}
-
-static mxio_epoll_cookie_t* mxio_epoll_cookie_remove(mxio_epoll_t* epio, int fd) {
-    return mxio_epoll_cookie_get(epio, fd, true);
-}
-
 static mx_status_t mxio_epoll_close(mxio_t* io) {
     mxio_epoll_t* epio = (mxio_epoll_t*)io;
-    mx_handle_t h = epio->h;
-    epio->h = MX_HANDLE_INVALID;
-    mx_handle_close(h);
-
-    mxio_epoll_cookie_t* cookie;
-    mtx_lock(&epio->cookies_lock);
-    while ((cookie = list_remove_head_type(&epio->cookies, mxio_epoll_cookie_t,
-                                           node))) {
-        mxio_release(cookie->io);
-        free(cookie);
-    }
-    mtx_unlock(&epio->cookies_lock);
+    mxio_waitport_destroy(&epio->wp);
     return NO_ERROR;
 }
 
@@ -101,34 +47,21 @@ static mxio_ops_t mxio_epoll_ops = {
     .posix_ioctl = mxio_default_posix_ioctl,
 };
 
-// Takes ownership of h.
-static mxio_t* mxio_epoll_create(mx_handle_t h) {
+mx_status_t mxio_epoll(mxio_t** out) {
     mxio_epoll_t* epio = calloc(1, sizeof(*epio));
     if (epio == NULL) {
-        mx_handle_close(h);
-        return NULL;
+        return ERR_NO_MEMORY;
+    }
+    mx_status_t status;
+    if ((status = mxio_waitport_init(&epio->wp)) < 0) {
+        free(epio);
+        return status;
     }
     epio->io.ops = &mxio_epoll_ops;
     epio->io.magic = MXIO_MAGIC;
     atomic_init(&epio->io.refcount, 1);
     epio->io.flags |= MXIO_FLAG_EPOLL;
-    epio->h = h;
-    mtx_init(&epio->cookies_lock, mtx_plain);
-    list_initialize(&epio->cookies);
-    return &epio->io;
-}
-
-mx_status_t mxio_epoll(mxio_t** out) {
-    mx_handle_t h;
-    mx_status_t status;
-    if ((status = mx_waitset_create(0, &h)) < 0) {
-        return status;
-    }
-    mxio_t* io;
-    if ((io = mxio_epoll_create(h)) == NULL) {
-        return ERR_NO_MEMORY;
-    }
-    *out = io;
+    *out = &epio->io;
     return NO_ERROR;
 }
 
@@ -176,66 +109,30 @@ int epoll_ctl(int epfd, int op, int fd, struct epoll_event* ep_event) {
         goto fail_no_io;
     }
 
-    mxio_epoll_cookie_t* cookie;
+    uint32_t mode = MXIO_WAIT_LEVEL;
+    if (op != EPOLL_CTL_DEL) {
+        if (ep_event->events & EPOLLONESHOT) {
+            mode = MXIO_WAIT_ONESHOT;
+        } else if (ep_event->events & EPOLLET) {
+            mode = MXIO_WAIT_EDGE;
+        }
+    }
+
     switch (op) {
     case EPOLL_CTL_ADD:
-        if (mxio_epoll_cookie_find(epio, fd) != NULL)  {
-            r = ERR_ALREADY_EXISTS;
-            goto end;
-        }
-        // create a new cookie
-        cookie = calloc(1, sizeof(mxio_epoll_cookie_t));
-        if (cookie == NULL) {
-            r = ERR_NO_MEMORY;
-            goto end;
-        }
-        mxio_acquire(io);
-        cookie->io = io;
-        cookie->fd = fd;
+        r = mxio_waitport_add(&epio->wp, fd, io, ep_event->events, mode, ep_event->data.u64);
         break;
     case EPOLL_CTL_MOD:
+        r = mxio_waitport_modify(&epio->wp, fd, ep_event->events, mode, ep_event->data.u64);
+        break;
     case EPOLL_CTL_DEL:
-        // or retrieve an existing cookie and remove the current epoll event
-        cookie = mxio_epoll_cookie_remove(epio, fd);
-        if (cookie == NULL) {
-            r = ERR_NOT_FOUND;
-            goto end;
-        }
-        if ((r = mx_waitset_remove(epio->h, (uint64_t)(uintptr_t)cookie)) < 0) {
-            mxio_epoll_cookie_add(epio, cookie);
-            goto end;
-        }
+        r = mxio_waitport_remove(&epio->wp, fd);
         break;
     default:
         r = ERR_INVALID_ARGS;
-        goto end;
-    }
-
-    if (op == EPOLL_CTL_DEL) {
-        // free the cookie
-        mxio_release(cookie->io);
-        free(cookie);
-    } else {
-        // or add a new epoll event and put the cookie into the list
-        mx_handle_t h = MX_HANDLE_INVALID;
-        mx_signals_t signals = 0;
-        io->ops->wait_begin(io, ep_event->events, &h, &signals);
-        if (h == MX_HANDLE_INVALID) {
-            // wait operation is not applicable to the handle
-            r = ERR_INVALID_ARGS;
-            goto end;
-        }
-
-        cookie->ep_event = *ep_event;
-        if ((r = mx_waitset_add(epio->h, (uint64_t)(uintptr_t)cookie, h, signals)) < 0) {
-            mxio_release(cookie->io);
-            free(cookie);
-            goto end;
-        }
-        mxio_epoll_cookie_add(epio, cookie);
+        break;
     }
 
- end:
     mxio_release(io);
  fail_no_io:
     mxio_release(&epio->io);
@@ -250,9 +147,6 @@ int epoll_wait(int epfd, struct epoll_event* ep_events, int maxevents, int timeo
     if (ep_events == NULL) {
         return ERRNO(EFAULT);
     }
-    if (maxevents > MAX_WAIT_EVENTS) {
-        return ERRNO(EINVAL);
-    }
     mxio_t* io;
     if ((io = fd_to_io(epfd)) == NULL) {
         return ERROR(ERR_BAD_HANDLE);
@@ -263,29 +157,39 @@ int epoll_wait(int epfd, struct epoll_event* ep_events, int maxevents, int timeo
     }
     mxio_epoll_t* epio = (mxio_epoll_t*)io;
 
-    mx_status_t r;
-    uint32_t num_results = maxevents;
-    mx_waitset_result_t results[maxevents];
     mx_time_t tmo = (timeout >= 0) ? mx_deadline_after(MX_MSEC(timeout)) : MX_TIME_INFINITE;
-
-    if ((r = mx_waitset_wait(epio->h, tmo, results, &num_results)) < 0) {
-        mxio_release(io);
-        return (r == ERR_TIMED_OUT) ? 0 : ERROR(r);
+    mx_status_t r = NO_ERROR;
+    int n = 0;
+
+    // level triggered fds reported last time get reported again if they
+    // are still ready
+    mxio_waitport_rearm(&epio->wp);
+
+    while (n < maxevents) {
+        mxio_wait_result_t results[EPOLL_BATCH];
+        size_t count = (size_t)(maxevents - n) < EPOLL_BATCH ? (size_t)(maxevents - n) : EPOLL_BATCH;
+        size_t actual;
+        // only the first round waits
+        if ((r = mxio_waitport_wait(&epio->wp, (n == 0) ? tmo : 0, results, count, &actual)) < 0) {
+            break;
+        }
+        for (size_t i = 0; i < actual; i++) {
+            // mask unrequested events except HUP/ERR
+            ep_events[n].events = results[i].events &
+                (results[i].requested | EPOLLHUP | EPOLLERR);
+            ep_events[n].data.u64 = results[i].data;
+            n++;
+        }
+        if (actual < count) {
+            break;
+        }
     }
+    mxio_release(io);
 
-    for (uint32_t i = 0; i < num_results; i++) {
-        mxio_epoll_cookie_t* cookie = (mxio_epoll_cookie_t*)(uintptr_t)results[i].cookie;
-        mxio_t* io = cookie->io;
-        uint32_t events;
-
-        io->ops->wait_end(io, results[i].observed, &events);
-        // mask unrequested events except HUP/ERR
-        ep_events[i].events = events & (cookie->ep_event.events | EPOLLHUP | EPOLLERR);
-
-        ep_events[i].data = cookie->ep_event.data;
+    if (n > 0 || r == ERR_TIMED_OUT) {
+        return n;
     }
-    mxio_release(io);
-    return (int)num_results;
+    return ERROR(r);
 }
 
 int epoll_pwait(int epfd, struct epoll_event* events, int maxevents, int timeout, const sigset_t* sigmask) {
@@ -50,7 +50,9 @@ __BEGIN_CDECLS
 #define MXRIO_SYNC         0x00000019
 #define MXRIO_LINK        (0x0000001a | MXRIO_ONE_HANDLE)
 #define MXRIO_MMAP         0x0000001b
-#define MXRIO_NUM_OPS      28
+#define MXRIO_READ_VMO    (0x0000001c | MXRIO_ONE_HANDLE)
+#define MXRIO_WRITE_VMO   (0x0000001d | MXRIO_ONE_HANDLE)
+#define MXRIO_NUM_OPS      30
 
 #define MXRIO_OP(n)        ((n) & 0x3FF) // opcode
 #define MXRIO_HC(n)        (((n) >> 8) & 3) // handle count
@@ -63,7 +65,8 @@ __BEGIN_CDECLS
     "read_at", "write_at", "truncate", "rename", \
     "connect", "bind", "listen", "getsockname", \
     "getpeername", "getsockopt", "setsockopt", "getaddrinfo", \
-    "setattr", "sync", "link", "mmap" }
+    "setattr", "sync", "link", "mmap", \
+    "read_vmo", "write_vmo" }
 
 const char* mxio_opname(uint32_t op);
 
@@ -156,6 +159,22 @@ typedef struct mxrio_mmap_data {
     int32_t flags;
 } mxrio_mmap_data_t;
 
+// READ_VMO and WRITE_VMO move bulk data through a VMO supplied by the
+// client rather than through the message payload, so a large read() or
+// write() needs one round trip per MXRIO_XFER_MAX bytes instead of one
+// per MXIO_CHUNK_SIZE.
+#define MXRIO_XFER_MAX       (1024 * 1024)
+
+#define MXRIO_XFER_FLAG_AT   (1u << 0) // use 'offset' rather than the seek pointer
+
+typedef struct mxrio_xfer_data {
+    uint64_t vmo_offset;  // where the data lives within the vmo
+    uint64_t length;      // at most MXRIO_XFER_MAX
+    int64_t offset;       // file offset, with MXRIO_XFER_FLAG_AT
+    uint32_t flags;
+    uint32_t reserved;
+} mxrio_xfer_data_t;
+
 static_assert(MXIO_CHUNK_SIZE >= PATH_MAX, "MXIO_CHUNK_SIZE must be large enough to contain paths");
 
 #define READDIR_CMD_NONE  0
@@ -199,6 +218,12 @@ static_assert(MXIO_CHUNK_SIZE >= PATH_MAX, "MXIO_CHUNK_SIZE must be large enough
 // SYNC        0          0        0                 0           -               -
 // LINK        0          0        <name1>0<name2>0  0           -               -
 // MMAP        maxreply   0        mmap_data_msg     0           mmap_data_msg   vmohandle
+// READ_VMO    0          0        <xfer_data>       newoffset   -               -
+// WRITE_VMO   0          0        <xfer_data>       newoffset   -               -
+//
+// READ_VMO and WRITE_VMO carry the vmo in handle[0] of the request, and
+// return the number of bytes transferred. Servers which do not implement
+// them reply ERR_NOT_SUPPORTED.
 //
 // proposed:
 //
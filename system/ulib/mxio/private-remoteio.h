@@ -19,6 +19,9 @@ struct mxrio {
 
     // transaction id used for synchronous remoteio calls
     _Atomic mx_txid_t txid;
+
+    // set once the server has rejected READ_VMO / WRITE_VMO
+    atomic_bool no_vmo_xfer;
 };
 
 // These are for the benefit of namespace.c
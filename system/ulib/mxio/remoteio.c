@@ -53,9 +53,40 @@ static void rchannel_cleanup(void* data) {
     free(handles);
 }
 
+// Each thread keeps one VMO of MXRIO_XFER_MAX bytes around for bulk
+// reads and writes, created the first time it needs one.
+static pthread_key_t xfer_vmo_key;
+
+#define XFER_VMO_RIGHTS (MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE)
+
+// reads and writes at least this large go through a vmo
+#define XFER_VMO_THRESHOLD (4 * MXIO_CHUNK_SIZE)
+
+static void xfer_vmo_cleanup(void* data) {
+    mx_handle_close((mx_handle_t)(uintptr_t)data);
+}
+
 void __mxio_rchannel_init(void) {
     if (pthread_key_create(&rchannel_key, &rchannel_cleanup) != 0)
         abort();
+    if (pthread_key_create(&xfer_vmo_key, &xfer_vmo_cleanup) != 0)
+        abort();
+}
+
+static mx_status_t get_xfer_vmo(mx_handle_t* out) {
+    mx_handle_t vmo = (mx_handle_t)(uintptr_t)pthread_getspecific(xfer_vmo_key);
+    if (vmo == MX_HANDLE_INVALID) {
+        mx_status_t r;
+        if ((r = mx_vmo_create(MXRIO_XFER_MAX, 0, &vmo)) < 0) {
+            return r;
+        }
+        if (pthread_setspecific(xfer_vmo_key, (void*)(uintptr_t)vmo) != 0) {
+            mx_handle_close(vmo);
+            return ERR_NO_MEMORY;
+        }
+    }
+    *out = vmo;
+    return NO_ERROR;
 }
 
 static const char* _opnames[] = MXRIO_OPNAMES;
@@ -329,6 +360,85 @@ ssize_t mxrio_ioctl(mxio_t* io, uint32_t op, const void* in_buf,
     return r;
 }
 
+// Moves data between 'data' and the thread's transfer vmo, which the server
+// reads from or writes into, MXRIO_XFER_MAX bytes per round trip.
+// Returns ERR_NOT_SUPPORTED, having transferred nothing, if the server does
+// not speak READ_VMO / WRITE_VMO.
+static ssize_t xfer_vmo_common(uint32_t op, mxrio_t* rio, uint8_t* data, size_t len,
+                               off_t offset, bool at) {
+    mx_handle_t vmo;
+    mx_status_t r;
+    if ((r = get_xfer_vmo(&vmo)) < 0) {
+        return r;
+    }
+
+    ssize_t count = 0;
+    mxrio_msg_t msg;
+    size_t xfer, actual;
+
+    while (len > 0) {
+        xfer = (len > MXRIO_XFER_MAX) ? MXRIO_XFER_MAX : len;
+
+        if (op == MXRIO_WRITE_VMO) {
+            if ((r = mx_vmo_write(vmo, data, 0, xfer, &actual)) < 0) {
+                break;
+            }
+            if (actual != xfer) {
+                r = ERR_IO;
+                break;
+            }
+        }
+
+        memset(&msg, 0, MXRIO_HDR_SZ);
+        msg.op = op;
+        msg.datalen = sizeof(mxrio_xfer_data_t);
+        mxrio_xfer_data_t* xd = (mxrio_xfer_data_t*)msg.data;
+        memset(xd, 0, sizeof(*xd));
+        xd->length = xfer;
+        xd->offset = offset;
+        xd->flags = at ? MXRIO_XFER_FLAG_AT : 0;
+        if ((r = mx_handle_duplicate(vmo, XFER_VMO_RIGHTS, &msg.handle[0])) < 0) {
+            break;
+        }
+        msg.hcount = 1;
+
+        if ((r = mxrio_txn(rio, &msg)) < 0) {
+            break;
+        }
+        discard_handles(msg.handle, msg.hcount);
+
+        if ((size_t)r > xfer) {
+            r = ERR_IO;
+            break;
+        }
+        if ((op == MXRIO_READ_VMO) && (r > 0)) {
+            if ((r = mx_vmo_read(vmo, data, 0, r, &actual)) < 0) {
+                break;
+            }
+            r = actual;
+        }
+        count += r;
+        data += r;
+        len -= r;
+        if (at)
+            offset += r;
+
+        // stop at short read or write
+        if ((size_t)r < xfer) {
+            break;
+        }
+    }
+
+    if ((count == 0) && (r == ERR_NOT_SUPPORTED)) {
+        atomic_store(&rio->no_vmo_xfer, true);
+    }
+    return count ? count : r;
+}
+
+static bool use_xfer_vmo(mxrio_t* rio, size_t len) {
+    return (len >= XFER_VMO_THRESHOLD) && !atomic_load(&rio->no_vmo_xfer);
+}
+
 static ssize_t write_common(uint32_t op, mxio_t* io, const void* _data, size_t len, off_t offset) {
     mxrio_t* rio = (mxrio_t*)io;
     const uint8_t* data = _data;
@@ -337,6 +447,14 @@ static ssize_t write_common(uint32_t op, mxio_t* io, const void* _data, size_t l
     mxrio_msg_t msg;
     ssize_t xfer;
 
+    if (use_xfer_vmo(rio, len)) {
+        ssize_t n = xfer_vmo_common(MXRIO_WRITE_VMO, rio, (uint8_t*)data, len, offset,
+                                    op == MXRIO_WRITE_AT);
+        if (n != ERR_NOT_SUPPORTED) {
+            return n;
+        }
+    }
+
     while (len > 0) {
         xfer = (len > MXIO_CHUNK_SIZE) ? MXIO_CHUNK_SIZE : len;
 
@@ -385,6 +503,14 @@ static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off
     mxrio_msg_t msg;
     ssize_t xfer;
 
+    if (use_xfer_vmo(rio, len)) {
+        ssize_t n = xfer_vmo_common(MXRIO_READ_VMO, rio, data, len, offset,
+                                    op == MXRIO_READ_AT);
+        if (n != ERR_NOT_SUPPORTED) {
+            return n;
+        }
+    }
+
     while (len > 0) {
         xfer = (len > MXIO_CHUNK_SIZE) ? MXIO_CHUNK_SIZE : len;
 
@@ -25,6 +25,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/stubs.c \
     $(LOCAL_DIR)/loader-service.c \
     $(LOCAL_DIR)/waitable.c \
+    $(LOCAL_DIR)/waitport.c \
     $(LOCAL_DIR)/watcher.c \
     $(LOCAL_DIR)/get-vmo.c \
 
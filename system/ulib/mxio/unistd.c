@@ -39,6 +39,7 @@
 
 #include "private.h"
 #include "unistd.h"
+#include "waitport.h"
 
 static_assert(MXIO_FLAG_CLOEXEC == FD_CLOEXEC, "Unexpected mxio flags value");
 
@@ -548,7 +549,7 @@ void __libc_extensions_init(uint32_t handle_count,
         handle_info[n] = 0;
     }
 
-    // Set up thread local storage for rchannels.
+    // Set up thread local storage for rchannels and bulk transfer vmos.
     __mxio_rchannel_init();
 
     // TODO(abarth): The cwd path string should be more tightly coupled with
@@ -1680,11 +1681,144 @@ void __mxio_release(mxio_t* io) {
 // TODO: getrlimit(RLIMIT_NOFILE, ...)
 #define MAX_POLL_NFDS 1024
 
+// poll() and select() keep the waits for the descriptors they were last
+// called with registered on a port.  Programs almost always poll the same
+// descriptors over and over, and then a call costs a port wait plus work
+// for the descriptors that are ready, rather than a kernel wait set up and
+// torn down for each one.  One caller at a time gets the cache; others, and
+// calls it can't handle, take the uncached path.
+static mtx_t poll_cache_lock = MTX_INIT;
+static mxio_waitport_t* poll_cache;
+static uint32_t poll_cache_epoch;
+
+// results taken off the poll cache per mxio_waitport_wait()
+#define POLL_CACHE_BATCH 64
+
+// The data of a cache entry is the epoch of the last call that used it in
+// the high 32 bits and the index of its pollfd in that call in the low ones.
+static bool poll_cache_current(const mxio_wait_entry_t* entry, void* arg) {
+    return (uint32_t)(entry->data >> 32) == *(uint32_t*)arg;
+}
+
+// Polls |fds| through the cache.  Returns false, without having waited, if
+// the cache can't be used for this call.  Otherwise stores the number of
+// ready descriptors in |nready| and the wait status in |status|.  If
+// |strict|, an fd that is not open fails the call with ERR_BAD_HANDLE
+// rather than being reported as POLLNVAL.
+static bool poll_cached(struct pollfd* fds, nfds_t n, mx_time_t deadline, bool strict,
+                        int* nready, mx_status_t* status) {
+    if (mtx_trylock(&poll_cache_lock) != thrd_success) {
+        return false;
+    }
+    if (poll_cache == NULL) {
+        mxio_waitport_t* wp = malloc(sizeof(*wp));
+        if ((wp == NULL) || (mxio_waitport_init(wp) < 0)) {
+            free(wp);
+            mtx_unlock(&poll_cache_lock);
+            return false;
+        }
+        poll_cache = wp;
+    }
+    mxio_waitport_t* wp = poll_cache;
+    uint32_t epoch = ++poll_cache_epoch;
+
+    mx_status_t r = NO_ERROR;
+    nfds_t nvalid = 0;
+    for (nfds_t i = 0; i < n; i++) {
+        struct pollfd* pfd = &fds[i];
+        pfd->revents = 0;
+        if (pfd->fd < 0) {
+            continue;
+        }
+        mxio_t* io;
+        if ((io = fd_to_io(pfd->fd)) == NULL) {
+            if (strict) {
+                r = ERR_BAD_HANDLE;
+                break;
+            }
+            pfd->revents = POLLNVAL;
+            continue;
+        }
+
+        uint64_t data = ((uint64_t)epoch << 32) | (uint32_t)i;
+        mxio_wait_entry_t* entry = mxio_waitport_lookup(wp, pfd->fd);
+        if (entry != NULL && poll_cache_current(entry, &epoch)) {
+            // the same fd more than once; leave that to the uncached path
+            mxio_release(io);
+            mtx_unlock(&poll_cache_lock);
+            return false;
+        }
+        if (entry != NULL && entry->io == io && entry->events == (uint32_t)pfd->events) {
+            // still registered from an earlier call; nothing else can see
+            // the entry while we hold poll_cache_lock
+            entry->data = data;
+        } else {
+            if (entry != NULL) {
+                mxio_waitport_remove(wp, pfd->fd);
+            }
+            r = mxio_waitport_add(wp, pfd->fd, io, pfd->events, MXIO_WAIT_LEVEL, data);
+        }
+        mxio_release(io);
+        if (r < 0) {
+            break;
+        }
+        nvalid++;
+    }
+    // stop waiting on whatever the previous call had that this one doesn't
+    mxio_waitport_prune(wp, poll_cache_current, &epoch);
+
+    if (r == NO_ERROR && nvalid == 0) {
+        // like the uncached path, don't wait when there is nothing to wait on
+        mtx_unlock(&poll_cache_lock);
+        return false;
+    }
+
+    int nfds = 0;
+    if (r == NO_ERROR) {
+        mxio_wait_result_t results[POLL_CACHE_BATCH];
+        size_t actual;
+        bool first = true;
+        mxio_waitport_rearm(wp);
+        do {
+            // only the first batch waits; the rest is whatever is queued
+            r = mxio_waitport_wait(wp, first ? deadline : 0,
+                                   results, POLL_CACHE_BATCH, &actual);
+            first = false;
+            if (r < 0) {
+                break;
+            }
+            for (size_t k = 0; k < actual; k++) {
+                struct pollfd* pfd = &fds[(uint32_t)results[k].data];
+                // mask unrequested events except HUP/ERR
+                pfd->revents = results[k].events & (pfd->events | EPOLLHUP | EPOLLERR);
+                if (pfd->revents != 0) {
+                    nfds++;
+                }
+            }
+        } while (actual == POLL_CACHE_BATCH);
+        if (r == ERR_TIMED_OUT && nfds > 0) {
+            r = NO_ERROR;
+        }
+    }
+    mtx_unlock(&poll_cache_lock);
+
+    *nready = nfds;
+    *status = r;
+    return true;
+}
+
 int poll(struct pollfd* fds, nfds_t n, int timeout) {
     if (n > MAX_POLL_NFDS) {
         return ERRNO(EINVAL);
     }
 
+    mx_time_t deadline = (timeout >= 0) ? mx_deadline_after(MX_MSEC(timeout)) : MX_TIME_INFINITE;
+    int nready;
+    mx_status_t status;
+    if (poll_cached(fds, n, deadline, false, &nready, &status)) {
+        return (status == NO_ERROR || status == ERR_TIMED_OUT) ? nready : ERROR(status);
+    }
+
     mxio_t* ios[n];
     int ios_used_max = -1;
 
@@ -1727,8 +1861,7 @@ int poll(struct pollfd* fds, nfds_t n, int timeout) {
 
     int nfds = 0;
     if (r == NO_ERROR && nvalid > 0) {
-        mx_time_t tmo = (timeout >= 0) ? mx_deadline_after(MX_MSEC(timeout)) : MX_TIME_INFINITE;
-        r = mx_object_wait_many(items, nvalid, tmo);
+        r = mx_object_wait_many(items, nvalid, deadline);
         // pending signals could be reported on ERR_TIMED_OUT case as well
         if (r == NO_ERROR || r == ERR_TIMED_OUT) {
             nfds_t j = 0; // j counts up on a valid entry
@@ -1770,6 +1903,60 @@ int select(int n, fd_set* restrict rfds, fd_set* restrict wfds, fd_set* restrict
         return ERRNO(EINVAL);
     }
 
+    mx_time_t deadline = (tv == NULL) ? MX_TIME_INFINITE :
+        mx_deadline_after(MX_SEC(tv->tv_sec) + MX_USEC(tv->tv_usec));
+
+    struct pollfd pfds[n];
+    nfds_t npfds = 0;
+    for (int fd = 0; fd < n; fd++) {
+        short events = 0;
+        if (rfds && FD_ISSET(fd, rfds))
+            events |= EPOLLIN;
+        if (wfds && FD_ISSET(fd, wfds))
+            events |= EPOLLOUT;
+        if (efds && FD_ISSET(fd, efds))
+            events |= EPOLLERR;
+        if (events != 0) {
+            pfds[npfds].fd = fd;
+            pfds[npfds].events = events;
+            npfds++;
+        }
+    }
+    int nready;
+    mx_status_t status;
+    if (poll_cached(pfds, npfds, deadline, true, &nready, &status)) {
+        if (status != NO_ERROR && status != ERR_TIMED_OUT) {
+            return ERROR(status);
+        }
+        int nfds = 0;
+        for (nfds_t i = 0; i < npfds; i++) {
+            int fd = pfds[i].fd;
+            uint32_t events = pfds[i].revents;
+            if (rfds && FD_ISSET(fd, rfds)) {
+                if (events & EPOLLIN) {
+                    nfds++;
+                } else {
+                    FD_CLR(fd, rfds);
+                }
+            }
+            if (wfds && FD_ISSET(fd, wfds)) {
+                if (events & EPOLLOUT) {
+                    nfds++;
+                } else {
+                    FD_CLR(fd, wfds);
+                }
+            }
+            if (efds && FD_ISSET(fd, efds)) {
+                if (events & EPOLLERR) {
+                    nfds++;
+                } else {
+                    FD_CLR(fd, efds);
+                }
+            }
+        }
+        return nfds;
+    }
+
     mxio_t* ios[n];
     int ios_used_max = -1;
 
@@ -1815,9 +2002,7 @@ int select(int n, fd_set* restrict rfds, fd_set* restrict wfds, fd_set* restrict
 
     int nfds = 0;
     if (r == NO_ERROR && nvalid > 0) {
-        mx_time_t tmo = (tv == NULL) ? MX_TIME_INFINITE :
-            mx_deadline_after(MX_SEC(tv->tv_sec) + MX_USEC(tv->tv_usec));
-        r = mx_object_wait_many(items, nvalid, tmo);
+        r = mx_object_wait_many(items, nvalid, deadline);
         // pending signals could be reported on ERR_TIMED_OUT case as well
         if (r == NO_ERROR || r == ERR_TIMED_OUT) {
             int j = 0; // j counts up on a valid entry
@@ -0,0 +1,269 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdlib.h>
+
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
+
+#include "private.h"
+#include "waitport.h"
+
+// packets taken off the port per mx_port_wait_many()
+#define WAITPORT_BATCH 64
+
+mx_status_t mxio_waitport_init(mxio_waitport_t* wp) {
+    mx_status_t r;
+    if ((r = mx_port_create(MX_PORT_OPT_V2, &wp->port)) < 0) {
+        return r;
+    }
+    mtx_init(&wp->lock, mtx_plain);
+    wp->gen = 0;
+    list_initialize(&wp->entries);
+    list_initialize(&wp->rearm);
+    for (int fd = 0; fd < MAX_MXIO_FD; fd++) {
+        wp->fds[fd] = NULL;
+    }
+    return NO_ERROR;
+}
+
+static mx_status_t arm(mxio_waitport_t* wp, mxio_wait_entry_t* entry) {
+    uint32_t options = (entry->mode == MXIO_WAIT_EDGE) ?
+        MX_WAIT_ASYNC_REPEATING : MX_WAIT_ASYNC_ONCE;
+    mx_status_t r = mx_object_wait_async(entry->handle, wp->port, entry->key,
+                                         entry->signals, options);
+    entry->armed = (r == NO_ERROR);
+    return r;
+}
+
+static void disarm(mxio_waitport_t* wp, mxio_wait_entry_t* entry) {
+    if (list_in_list(&entry->rearm_node)) {
+        list_delete(&entry->rearm_node);
+    }
+    if (entry->armed) {
+        // A packet may already be queued for this registration.  It will
+        // carry a key that no entry has any more, and be dropped.
+        mx_port_cancel(wp->port, entry->handle, entry->key);
+        entry->armed = false;
+    }
+}
+
+// Looks up the events to wait for and gives the entry a fresh key, so that
+// packets from an earlier registration can be told apart.
+static mx_status_t prepare(mxio_waitport_t* wp, mxio_wait_entry_t* entry, uint32_t events) {
+    mx_handle_t h = MX_HANDLE_INVALID;
+    mx_signals_t signals = 0;
+    entry->io->ops->wait_begin(entry->io, events, &h, &signals);
+    if (h == MX_HANDLE_INVALID) {
+        // wait operation is not applicable to the handle
+        return ERR_INVALID_ARGS;
+    }
+    entry->events = events;
+    entry->handle = h;
+    entry->signals = signals;
+    entry->key = ((uint64_t)++wp->gen << 32) | (uint32_t)entry->fd;
+    return NO_ERROR;
+}
+
+static void free_entry(mxio_waitport_t* wp, mxio_wait_entry_t* entry) {
+    list_delete(&entry->node);
+    wp->fds[entry->fd] = NULL;
+    mxio_release(entry->io);
+    free(entry);
+}
+
+void mxio_waitport_destroy(mxio_waitport_t* wp) {
+    // closing the port takes down every async wait on it
+    mx_handle_close(wp->port);
+    wp->port = MX_HANDLE_INVALID;
+
+    mxio_wait_entry_t* entry;
+    while ((entry = list_peek_head_type(&wp->entries, mxio_wait_entry_t, node))) {
+        free_entry(wp, entry);
+    }
+    mtx_destroy(&wp->lock);
+}
+
+mx_status_t mxio_waitport_add(mxio_waitport_t* wp, int fd, mxio_t* io,
+                              uint32_t events, uint32_t mode, uint64_t data) {
+    if (fd < 0 || fd >= MAX_MXIO_FD) {
+        return ERR_INVALID_ARGS;
+    }
+    mxio_wait_entry_t* entry = calloc(1, sizeof(*entry));
+    if (entry == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    entry->io = io;
+    entry->fd = fd;
+    entry->mode = mode;
+    entry->data = data;
+
+    mx_status_t r;
+    mtx_lock(&wp->lock);
+    if (wp->fds[fd] != NULL) {
+        r = ERR_ALREADY_EXISTS;
+        goto fail;
+    }
+    if ((r = prepare(wp, entry, events)) < 0) {
+        goto fail;
+    }
+    if ((r = arm(wp, entry)) < 0) {
+        goto fail;
+    }
+    mxio_acquire(io);
+    list_add_tail(&wp->entries, &entry->node);
+    wp->fds[fd] = entry;
+    mtx_unlock(&wp->lock);
+    return NO_ERROR;
+
+fail:
+    mtx_unlock(&wp->lock);
+    free(entry);
+    return r;
+}
+
+mx_status_t mxio_waitport_modify(mxio_waitport_t* wp, int fd,
+                                 uint32_t events, uint32_t mode, uint64_t data) {
+    if (fd < 0 || fd >= MAX_MXIO_FD) {
+        return ERR_INVALID_ARGS;
+    }
+    mx_status_t r;
+    mtx_lock(&wp->lock);
+    mxio_wait_entry_t* entry = wp->fds[fd];
+    if (entry == NULL) {
+        r = ERR_NOT_FOUND;
+        goto done;
+    }
+    disarm(wp, entry);
+    entry->mode = mode;
+    entry->data = data;
+    if ((r = prepare(wp, entry, events)) < 0) {
+        goto done;
+    }
+    r = arm(wp, entry);
+done:
+    mtx_unlock(&wp->lock);
+    return r;
+}
+
+mx_status_t mxio_waitport_remove(mxio_waitport_t* wp, int fd) {
+    if (fd < 0 || fd >= MAX_MXIO_FD) {
+        return ERR_INVALID_ARGS;
+    }
+    mtx_lock(&wp->lock);
+    mxio_wait_entry_t* entry = wp->fds[fd];
+    if (entry != NULL) {
+        disarm(wp, entry);
+        free_entry(wp, entry);
+    }
+    mtx_unlock(&wp->lock);
+    return (entry != NULL) ? NO_ERROR : ERR_NOT_FOUND;
+}
+
+mxio_wait_entry_t* mxio_waitport_lookup(mxio_waitport_t* wp, int fd) {
+    if (fd < 0 || fd >= MAX_MXIO_FD) {
+        return NULL;
+    }
+    mtx_lock(&wp->lock);
+    mxio_wait_entry_t* entry = wp->fds[fd];
+    mtx_unlock(&wp->lock);
+    return entry;
+}
+
+void mxio_waitport_prune(mxio_waitport_t* wp,
+                         bool (*keep)(const mxio_wait_entry_t* entry, void* arg), void* arg) {
+    mxio_wait_entry_t* entry;
+    mxio_wait_entry_t* tmp;
+    mtx_lock(&wp->lock);
+    list_for_every_entry_safe(&wp->entries, entry, tmp, mxio_wait_entry_t, node) {
+        if (!keep(entry, arg)) {
+            disarm(wp, entry);
+            free_entry(wp, entry);
+        }
+    }
+    mtx_unlock(&wp->lock);
+}
+
+void mxio_waitport_rearm(mxio_waitport_t* wp) {
+    mxio_wait_entry_t* entry;
+    mtx_lock(&wp->lock);
+    while ((entry = list_remove_head_type(&wp->rearm, mxio_wait_entry_t, rearm_node))) {
+        // if this fails the handle has gone away, and there is nothing
+        // left to wait for
+        arm(wp, entry);
+    }
+    mtx_unlock(&wp->lock);
+}
+
+// Turns packets into results, dropping the ones for registrations that have
+// since been removed or modified.  Returns the number of results.
+static size_t deliver(mxio_waitport_t* wp, const mx_port_packet_t* packets, uint32_t count,
+                      mxio_wait_result_t* results) {
+    size_t n = 0;
+    mtx_lock(&wp->lock);
+    for (uint32_t i = 0; i < count; i++) {
+        const mx_port_packet_t* packet = &packets[i];
+        if (packet->type != MX_PKT_TYPE_SIGNAL_ONE && packet->type != MX_PKT_TYPE_SIGNAL_REP) {
+            continue;
+        }
+        uint32_t fd = (uint32_t)packet->key;
+        mxio_wait_entry_t* entry = (fd < MAX_MXIO_FD) ? wp->fds[fd] : NULL;
+        if (entry == NULL || entry->key != packet->key) {
+            continue;
+        }
+
+        mx_signals_t observed = packet->signal.observed;
+        if (entry->mode != MXIO_WAIT_EDGE) {
+            // the one-shot wait is used up
+            entry->armed = false;
+        }
+        if (entry->mode == MXIO_WAIT_LEVEL) {
+            // The packet may have been queued well before this wait, and the
+            // descriptor drained since.  Report the state as it is now, and
+            // if it is no longer ready just go back to waiting on it.
+            mx_object_wait_one(entry->handle, entry->signals, 0, &observed);
+            if (!(observed & entry->signals)) {
+                arm(wp, entry);
+                continue;
+            }
+            list_add_tail(&wp->rearm, &entry->rearm_node);
+        }
+
+        uint32_t events = 0;
+        entry->io->ops->wait_end(entry->io, observed, &events);
+        results[n].fd = entry->fd;
+        results[n].events = events;
+        results[n].requested = entry->events;
+        results[n].data = entry->data;
+        n++;
+    }
+    mtx_unlock(&wp->lock);
+    return n;
+}
+
+mx_status_t mxio_waitport_wait(mxio_waitport_t* wp, mx_time_t deadline,
+                               mxio_wait_result_t* results, size_t count, size_t* actual) {
+    mx_port_packet_t packets[WAITPORT_BATCH];
+    size_t n = 0;
+
+    while (n < count) {
+        uint32_t max = (count - n < WAITPORT_BATCH) ? (uint32_t)(count - n) : WAITPORT_BATCH;
+        uint32_t got;
+        // block only until something is ready, then pick up whatever else
+        // is already queued
+        mx_status_t r = mx_port_wait_many(wp->port, (n == 0) ? deadline : 0, packets, max, &got);
+        if (r == ERR_TIMED_OUT && n > 0) {
+            break;
+        } else if (r < 0) {
+            return r;
+        }
+        n += deliver(wp, packets, got, results + n);
+        if (n > 0 && got < max) {
+            break;
+        }
+    }
+
+    *actual = n;
+    return NO_ERROR;
+}
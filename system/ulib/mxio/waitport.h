@@ -0,0 +1,103 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <threads.h>
+
+#include <magenta/listnode.h>
+#include <magenta/types.h>
+#include <mxio/io.h>
+#include <mxio/limits.h>
+
+// A waitport is a set of file descriptors with async waits on a port that
+// stay registered between waits.  A wait costs one port wait plus work for
+// the descriptors that turned out to be ready, instead of setting up and
+// tearing down a kernel wait for every registered descriptor on every call.
+//
+// Level triggered entries use one-shot async waits.  After an entry fires
+// it is re-armed by the next mxio_waitport_rearm(), and since arming a wait
+// whose signals are already asserted queues a packet right away, the entry
+// keeps getting reported for as long as it stays ready.  Edge triggered
+// entries use a repeating async wait and are reported each time one of
+// their signals becomes asserted.  One-shot entries are reported once and
+// then stay quiet until they are modified.
+
+#define MXIO_WAIT_LEVEL   0u
+#define MXIO_WAIT_EDGE    1u
+#define MXIO_WAIT_ONESHOT 2u
+
+typedef struct mxio_wait_entry {
+    // in mxio_waitport_t::entries
+    list_node_t node;
+    // in mxio_waitport_t::rearm while waiting to be re-armed
+    list_node_t rearm_node;
+
+    mxio_t* io;
+    int fd;
+    uint32_t events;
+    uint32_t mode;
+    uint64_t data;
+
+    // from io->ops->wait_begin()
+    mx_handle_t handle;
+    mx_signals_t signals;
+
+    // port packet key of the current registration; the fd is in the low
+    // 32 bits, so a packet can be matched to its entry without a search
+    uint64_t key;
+    bool armed;
+} mxio_wait_entry_t;
+
+typedef struct mxio_waitport {
+    mtx_t lock;
+    mx_handle_t port;
+    uint32_t gen;
+    list_node_t entries;
+    list_node_t rearm;
+    mxio_wait_entry_t* fds[MAX_MXIO_FD];
+} mxio_waitport_t;
+
+typedef struct mxio_wait_result {
+    int fd;
+    // events reported by the io's wait_end(), and the ones asked for
+    uint32_t events;
+    uint32_t requested;
+    uint64_t data;
+} mxio_wait_result_t;
+
+mx_status_t mxio_waitport_init(mxio_waitport_t* wp);
+
+// Closes the port and drops every entry.
+void mxio_waitport_destroy(mxio_waitport_t* wp);
+
+// Starts waiting for |events| on |io|, which is open as |fd|.  Takes a
+// reference to |io| on success.
+mx_status_t mxio_waitport_add(mxio_waitport_t* wp, int fd, mxio_t* io,
+                              uint32_t events, uint32_t mode, uint64_t data);
+
+// Replaces the events, mode and data of the entry for |fd| and arms it again.
+mx_status_t mxio_waitport_modify(mxio_waitport_t* wp, int fd,
+                                 uint32_t events, uint32_t mode, uint64_t data);
+
+mx_status_t mxio_waitport_remove(mxio_waitport_t* wp, int fd);
+
+// Returns the entry for |fd|, or NULL.  The entry is only safe to look at
+// while nothing else can remove it.
+mxio_wait_entry_t* mxio_waitport_lookup(mxio_waitport_t* wp, int fd);
+
+// Removes every entry for which |keep| returns false.
+void mxio_waitport_prune(mxio_waitport_t* wp,
+                         bool (*keep)(const mxio_wait_entry_t* entry, void* arg), void* arg);
+
+// Re-arms the level triggered entries that fired since the last call.
+// Call this once before each round of mxio_waitport_wait()s.
+void mxio_waitport_rearm(mxio_waitport_t* wp);
+
+// Waits until |deadline| for at least one entry to be ready, and returns up
+// to |count| of them.  Returns ERR_TIMED_OUT if nothing became ready.
+mx_status_t mxio_waitport_wait(mxio_waitport_t* wp, mx_time_t deadline,
+                               mxio_wait_result_t* results, size_t count, size_t* actual);
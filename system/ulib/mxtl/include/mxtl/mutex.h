@@ -28,6 +28,8 @@
 class __TA_CAPABILITY("mutex") Mutex {
 public:
     constexpr Mutex() : mutex_(MUTEX_INITIAL_VALUE(mutex_)) { }
+    constexpr Mutex(uint32_t flags, mutex_class_t* lock_class)
+        : mutex_(MUTEX_INITIAL_VALUE_ETC(mutex_, flags, lock_class)) { }
     ~Mutex() { mutex_destroy(&mutex_); }
     void Acquire() __TA_ACQUIRE() { mutex_acquire(&mutex_); }
     void Release() __TA_RELEASE() { mutex_release(&mutex_); }
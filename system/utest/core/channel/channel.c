@@ -3,7 +3,9 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <limits.h>
 #include <magenta/compiler.h>
+#include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/object.h>
 #include <unittest/unittest.h>
@@ -773,6 +775,168 @@ static bool channel_nest(void) {
     END_TEST;
 }
 
+static bool channel_batch(void) {
+    BEGIN_TEST;
+
+    mx_handle_t a[2], b[2];
+    ASSERT_EQ(mx_channel_create(0, &a[0], &a[1]), NO_ERROR, "");
+    ASSERT_EQ(mx_channel_create(0, &b[0], &b[1]), NO_ERROR, "");
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+
+    // Two writes, one carrying a handle, and one bogus operation.
+    uint32_t msg_a = 0xaaaa, msg_b = 0xbbbb;
+    mx_channel_batch_item_t writes[3] = {
+        { .handle = a[0], .op = MX_CHANNEL_BATCH_WRITE,
+          .bytes = &msg_a, .num_bytes = sizeof(msg_a) },
+        { .handle = b[0], .op = MX_CHANNEL_BATCH_WRITE,
+          .bytes = &msg_b, .num_bytes = sizeof(msg_b), .handles = &event, .num_handles = 1u },
+        { .handle = a[0], .op = 42u },
+    };
+    ASSERT_EQ(mx_channel_batch(0u, writes, 3u), NO_ERROR, "");
+    EXPECT_EQ(writes[0].status, NO_ERROR, "");
+    EXPECT_EQ(writes[1].status, NO_ERROR, "");
+    EXPECT_EQ(writes[2].status, ERR_INVALID_ARGS, "");
+
+    // Read both messages back, plus one from an empty channel and one into
+    // a buffer that is too small.
+    ASSERT_EQ(mx_channel_write(a[0], 0u, &msg_a, sizeof(msg_a), NULL, 0u), NO_ERROR, "");
+    uint32_t in_a = 0, in_b = 0, in_small = 0;
+    mx_handle_t in_handle = MX_HANDLE_INVALID;
+    mx_channel_batch_item_t reads[4] = {
+        { .handle = a[1], .op = MX_CHANNEL_BATCH_READ,
+          .bytes = &in_a, .num_bytes = sizeof(in_a) },
+        { .handle = b[1], .op = MX_CHANNEL_BATCH_READ,
+          .bytes = &in_b, .num_bytes = sizeof(in_b), .handles = &in_handle, .num_handles = 1u },
+        { .handle = b[1], .op = MX_CHANNEL_BATCH_READ },
+        { .handle = a[1], .op = MX_CHANNEL_BATCH_READ,
+          .bytes = &in_small, .num_bytes = 1u },
+    };
+    ASSERT_EQ(mx_channel_batch(0u, reads, 4u), NO_ERROR, "");
+    EXPECT_EQ(reads[0].status, NO_ERROR, "");
+    EXPECT_EQ(reads[0].num_bytes, sizeof(in_a), "");
+    EXPECT_EQ(in_a, msg_a, "");
+    EXPECT_EQ(reads[1].status, NO_ERROR, "");
+    EXPECT_EQ(reads[1].num_handles, 1u, "");
+    EXPECT_EQ(in_b, msg_b, "");
+    EXPECT_NEQ(in_handle, MX_HANDLE_INVALID, "");
+    EXPECT_EQ(reads[2].status, ERR_SHOULD_WAIT, "");
+    EXPECT_EQ(reads[3].status, ERR_BUFFER_TOO_SMALL, "");
+    EXPECT_EQ(reads[3].num_bytes, sizeof(msg_a), "");
+
+    // The message that did not fit is still there.
+    EXPECT_EQ(mx_channel_read(a[1], 0u, &in_a, NULL, sizeof(in_a), 0u, NULL, NULL), NO_ERROR, "");
+
+    EXPECT_EQ(mx_channel_batch(1u, reads, 1u), ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_channel_batch(0u, reads, MX_CHANNEL_BATCH_MAX_ITEMS + 1u), ERR_INVALID_ARGS, "");
+
+    EXPECT_EQ(mx_handle_close(in_handle), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(a[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(a[1]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(b[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(b[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool channel_move_pages(void) {
+    BEGIN_TEST;
+
+    mx_handle_t ch[2];
+    ASSERT_EQ(mx_channel_create(0, &ch[0], &ch[1]), NO_ERROR, "");
+
+    const size_t size = 4 * PAGE_SIZE;
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(size, 0u, &vmo), NO_ERROR, "");
+    uintptr_t addr;
+    ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &addr), NO_ERROR, "");
+    uint8_t* buf = (uint8_t*)addr;
+    for (size_t i = 0; i < size; i++)
+        buf[i] = (uint8_t)(i * 7);
+
+    // A page aligned buffer has its pages moved into the message; the
+    // reader sees the same bytes either way.
+    ASSERT_EQ(mx_channel_write(ch[0], MX_CHANNEL_WRITE_MOVE_PAGES, buf, (uint32_t)size, NULL, 0u),
+              NO_ERROR, "");
+    uint8_t* in = malloc(size);
+    ASSERT_NONNULL(in, "");
+    uint32_t actual = 0;
+    ASSERT_EQ(mx_channel_read(ch[1], 0u, in, NULL, (uint32_t)size, 0u, &actual, NULL),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, size, "");
+    for (size_t i = 0; i < size; i++) {
+        if (in[i] != (uint8_t)(i * 7)) {
+            EXPECT_EQ(in[i], (uint8_t)(i * 7), "moved payload mismatch");
+            break;
+        }
+    }
+
+    // Buffers that can't be moved are silently copied instead.
+    uint32_t small = 0x12345678, in_small = 0;
+    EXPECT_EQ(mx_channel_write(ch[0], MX_CHANNEL_WRITE_MOVE_PAGES, &small, sizeof(small), NULL, 0u),
+              NO_ERROR, "");
+    EXPECT_EQ(mx_channel_read(ch[1], 0u, &in_small, NULL, sizeof(in_small), 0u, NULL, NULL),
+              NO_ERROR, "");
+    EXPECT_EQ(in_small, small, "");
+
+    EXPECT_EQ(mx_channel_write(ch[0], 2u, &small, sizeof(small), NULL, 0u), ERR_INVALID_ARGS, "");
+
+    free(in);
+    EXPECT_EQ(mx_vmar_unmap(mx_vmar_root_self(), addr, size), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(ch[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(ch[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+// Returns true if every byte of |buf| still matches the pattern written by
+// channel_move_pages_failed_write().
+static bool move_pages_buffer_intact(const uint8_t* buf, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (buf[i] != (uint8_t)(i * 5 + 1))
+            return false;
+    }
+    return true;
+}
+
+static bool channel_move_pages_failed_write(void) {
+    BEGIN_TEST;
+
+    mx_handle_t ch[2];
+    ASSERT_EQ(mx_channel_create(0, &ch[0], &ch[1]), NO_ERROR, "");
+
+    const size_t size = 4 * PAGE_SIZE;
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(size, 0u, &vmo), NO_ERROR, "");
+    uintptr_t addr;
+    ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &addr), NO_ERROR, "");
+    uint8_t* buf = (uint8_t*)addr;
+    for (size_t i = 0; i < size; i++)
+        buf[i] = (uint8_t)(i * 5 + 1);
+
+    // A bad handle fails the write after the pages have been taken; they
+    // must be put back.
+    mx_handle_t bad = MX_HANDLE_INVALID;
+    EXPECT_EQ(mx_channel_write(ch[0], MX_CHANNEL_WRITE_MOVE_PAGES, buf, (uint32_t)size, &bad, 1u),
+              ERR_BAD_HANDLE, "");
+    EXPECT_TRUE(move_pages_buffer_intact(buf, size), "buffer changed by failed write");
+
+    // So does writing to a channel whose peer is gone.
+    EXPECT_EQ(mx_handle_close(ch[1]), NO_ERROR, "");
+    EXPECT_EQ(mx_channel_write(ch[0], MX_CHANNEL_WRITE_MOVE_PAGES, buf, (uint32_t)size, NULL, 0u),
+              ERR_PEER_CLOSED, "");
+    EXPECT_TRUE(move_pages_buffer_intact(buf, size), "buffer changed by failed write");
+
+    EXPECT_EQ(mx_vmar_unmap(mx_vmar_root_self(), addr, size), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(ch[0]), NO_ERROR, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(channel_tests)
 RUN_TEST(channel_test)
 RUN_TEST(channel_read_error_test)
@@ -784,6 +948,9 @@ RUN_TEST(channel_may_discard)
 RUN_TEST(channel_call)
 RUN_TEST(channel_call2)
 RUN_TEST(channel_nest)
+RUN_TEST(channel_batch)
+RUN_TEST(channel_move_pages)
+RUN_TEST(channel_move_pages_failed_write)
 END_TEST_CASE(channel_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -7,6 +7,7 @@
 #include <magenta/syscalls.h>
 #include <magenta/threads.h>
 #include <unittest/unittest.h>
+#include <pthread.h>
 #include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -497,6 +498,73 @@ static bool test_event_signaling() {
     END_TEST;
 }
 
+// pthread mutex contention benchmark.  Threads are split into groups, each
+// group hammering its own mutex.  With one group, every futex operation is on
+// the same address; with many, the futexes are unrelated and their kernel
+// operations should not contend with each other.
+constexpr uint32_t kMutexBenchMaxThreads = 16;
+constexpr uint32_t kMutexBenchIterations = 100000;
+
+struct MutexBenchGroup {
+    pthread_mutex_t mutex;
+    uint64_t counter;
+};
+
+static int mutex_bench_thread(void* arg) {
+    MutexBenchGroup* group = static_cast<MutexBenchGroup*>(arg);
+    for (uint32_t i = 0; i < kMutexBenchIterations; i++) {
+        pthread_mutex_lock(&group->mutex);
+        group->counter++;
+        pthread_mutex_unlock(&group->mutex);
+    }
+    return 0;
+}
+
+static bool mutex_bench(uint32_t num_threads, uint32_t threads_per_mutex) {
+    BEGIN_HELPER;
+    MutexBenchGroup groups[kMutexBenchMaxThreads];
+    thrd_t threads[kMutexBenchMaxThreads];
+    uint32_t num_groups = num_threads / threads_per_mutex;
+
+    for (uint32_t i = 0; i < num_groups; i++) {
+        ASSERT_EQ(pthread_mutex_init(&groups[i].mutex, NULL), 0, "");
+        groups[i].counter = 0;
+    }
+
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (uint32_t i = 0; i < num_threads; i++) {
+        ASSERT_EQ(thrd_create_with_name(&threads[i], mutex_bench_thread,
+                                        &groups[i / threads_per_mutex], "mutex bench"),
+                  thrd_success, "");
+    }
+    for (uint32_t i = 0; i < num_threads; i++) {
+        ASSERT_EQ(thrd_join(threads[i], NULL), thrd_success, "");
+    }
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    for (uint32_t i = 0; i < num_groups; i++) {
+        EXPECT_EQ(groups[i].counter, (uint64_t)threads_per_mutex * kMutexBenchIterations, "");
+        pthread_mutex_destroy(&groups[i].mutex);
+    }
+
+    uint64_t ops = (uint64_t)num_threads * kMutexBenchIterations;
+    printf("%2u threads, %2u per mutex: %" PRIu64 " ns per lock/unlock, %" PRIu64 " ms total\n",
+           num_threads, threads_per_mutex, elapsed / ops, elapsed / MX_MSEC(1));
+    END_HELPER;
+}
+
+static bool test_futex_mutex_contention_benchmark() {
+    BEGIN_TEST;
+    printf("\n");
+    for (uint32_t n = 2; n <= kMutexBenchMaxThreads; n *= 2) {
+        EXPECT_TRUE(mutex_bench(n, n), "");
+        if (n > 2) {
+            EXPECT_TRUE(mutex_bench(n, 2), "");
+        }
+    }
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(futex_tests)
 RUN_TEST(test_futex_wait_value_mismatch);
 RUN_TEST(test_futex_wait_timeout);
@@ -515,6 +583,7 @@ RUN_TEST(test_futex_requeue_unqueued_on_timeout);
 RUN_TEST(test_futex_thread_killed);
 RUN_TEST(test_futex_misaligned);
 RUN_TEST(test_event_signaling);
+RUN_TEST_PERFORMANCE(test_futex_mutex_contention_benchmark);
 END_TEST_CASE(futex_tests)
 
 #ifndef BUILD_COMBINED_TESTS
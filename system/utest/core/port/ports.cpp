@@ -412,6 +412,41 @@ static bool cancel_event_key_repeat() {
     return cancel_event(MX_WAIT_ASYNC_REPEATING);
 }
 
+static bool wait_many_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t port;
+    EXPECT_EQ(mx_port_create(MX_PORT_OPT_V2, &port), NO_ERROR, "");
+
+    for (uint64_t key = 0; key != 5u; ++key) {
+        const mx_port_packet_t in = { key, MX_PKT_TYPE_USER, 0, { {} } };
+        EXPECT_EQ(mx_port_queue(port, &in, 0u), NO_ERROR, "");
+    }
+
+    // Packets come out in FIFO order, at most |count| at a time.
+    mx_port_packet_t out[8] = {};
+    uint32_t actual = 0u;
+    EXPECT_EQ(mx_port_wait_many(port, MX_TIME_INFINITE, out, 3u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 3u, "");
+    for (uint32_t ix = 0; ix != actual; ++ix)
+        EXPECT_EQ(out[ix].key, ix, "");
+
+    // Only what is already queued is returned past the first packet.
+    EXPECT_EQ(mx_port_wait_many(port, MX_TIME_INFINITE, out, countof(out), &actual),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, 2u, "");
+    EXPECT_EQ(out[0].key, 3u, "");
+    EXPECT_EQ(out[1].key, 4u, "");
+
+    EXPECT_EQ(mx_port_wait_many(port, mx_deadline_after(MX_USEC(1)), out, countof(out), &actual),
+              ERR_TIMED_OUT, "");
+    EXPECT_EQ(mx_port_wait_many(port, MX_TIME_INFINITE, out, 0u, &actual), ERR_INVALID_ARGS, "");
+
+    EXPECT_EQ(mx_handle_close(port), NO_ERROR, "");
+
+    END_TEST;
+}
+
 struct test_context {
     mx_handle_t port;
     uint32_t count;
@@ -475,6 +510,75 @@ static bool threads_event_repeat() {
     return threads_event(MX_WAIT_ASYNC_REPEATING);
 }
 
+static int port_batch_reader_thread(void* arg) {
+    auto ctx = reinterpret_cast<test_context*>(arg);
+    mx_port_packet_t out[4];
+    uint32_t received = 0u;
+    for (;;) {
+        uint32_t actual;
+        auto st = mx_port_wait_many(ctx->port, MX_TIME_INFINITE, out, countof(out), &actual);
+        if (st < 0)
+            return st;
+        // A zero key tells one reader to stop; hand any others in this
+        // batch back to the port for the remaining readers.
+        bool stop = false;
+        for (uint32_t ix = 0; ix != actual; ++ix) {
+            if (out[ix].key != 0u) {
+                ++received;
+            } else if (!stop) {
+                stop = true;
+            } else {
+                st = mx_port_queue(ctx->port, &out[ix], 0u);
+                if (st < 0)
+                    return st;
+            }
+        }
+        if (stop) {
+            ctx->count = received;
+            return 0;
+        }
+    }
+}
+
+static bool threads_wait_many(void) {
+    BEGIN_TEST;
+
+    mx_handle_t port;
+    EXPECT_EQ(mx_port_create(MX_PORT_OPT_V2, &port), NO_ERROR, "");
+
+    thrd_t threads[4];
+    test_context ctx[4];
+    for (size_t ix = 0; ix != countof(threads); ++ix) {
+        ctx[ix] = { port, 0u };
+        EXPECT_EQ(thrd_create(&threads[ix], port_batch_reader_thread, &ctx[ix]),
+                  thrd_success, "");
+    }
+
+    const uint32_t kPackets = 1000u;
+    for (uint64_t key = 1u; key <= kPackets; ++key) {
+        const mx_port_packet_t in = { key, MX_PKT_TYPE_USER, 0, { {} } };
+        EXPECT_EQ(mx_port_queue(port, &in, 0u), NO_ERROR, "");
+    }
+
+    // One stop packet per reader, queued behind all the data.
+    uint32_t total = 0u;
+    for (size_t ix = 0; ix != countof(threads); ++ix) {
+        const mx_port_packet_t stop = { 0u, MX_PKT_TYPE_USER, 0, { {} } };
+        EXPECT_EQ(mx_port_queue(port, &stop, 0u), NO_ERROR, "");
+    }
+    for (size_t ix = 0; ix != countof(threads); ++ix) {
+        int res;
+        EXPECT_EQ(thrd_join(threads[ix], &res), thrd_success, "");
+        EXPECT_EQ(res, 0, "");
+        total += ctx[ix].count;
+    }
+    EXPECT_EQ(total, kPackets, "");
+
+    EXPECT_EQ(mx_handle_close(port), NO_ERROR, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(port_tests)
 RUN_TEST(basic_test)
 RUN_TEST(queue_and_close_test)
@@ -493,6 +597,8 @@ RUN_TEST(cancel_event_key_once)
 RUN_TEST(cancel_event_key_repeat)
 RUN_TEST(threads_event_once)
 RUN_TEST(threads_event_repeat)
+RUN_TEST(wait_many_test)
+RUN_TEST(threads_wait_many)
 END_TEST_CASE(port_tests)
 
 #ifndef BUILD_COMBINED_TESTS
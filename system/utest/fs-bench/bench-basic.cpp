@@ -90,6 +90,55 @@ bool benchmark_write_read(void) {
     END_TEST;
 }
 
+// Writes a file, flushes it to disk, and reads it back after reopening it, so
+// the read has to come from the block device rather than the file's own cache.
+// This is dominated by how well the filesystem batches its block I/O.
+bool benchmark_cold_read(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Sync + Cold Read\n");
+    int fd = open(MOUNT_POINT "/coldfile", O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Cannot create file (FS benchmarks assume mounted FS exists at '/benchmark')");
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kDataSize]);
+    ASSERT_EQ(ac.check(), true, "");
+    memset(data.get(), kMagicByte, kDataSize);
+
+    uint64_t start, end;
+    size_t count;
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+
+    start = mx_ticks_get();
+    count = kNumOps;
+    while (count--) {
+        ASSERT_EQ(write(fd, data.get(), kDataSize), kDataSize, "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark write: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    start = mx_ticks_get();
+    ASSERT_EQ(fsync(fd), 0, "");
+    end = mx_ticks_get();
+    printf("Benchmark fsync: [%10lu] msec\n", (end - start) / ticks_per_msec);
+    ASSERT_EQ(close(fd), 0, "");
+
+    start = mx_ticks_get();
+    fd = open(MOUNT_POINT "/coldfile", O_RDONLY);
+    ASSERT_GT(fd, 0, "");
+    count = kNumOps;
+    while (count--) {
+        ASSERT_EQ(read(fd, data.get(), kDataSize), kDataSize, "");
+        ASSERT_EQ(data[0], kMagicByte, "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark cold read: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink(MOUNT_POINT "/coldfile"), 0, "");
+
+    END_TEST;
+}
+
 #define START_STRING "/aaa"
 
 size_t constexpr cStrlen(const char* str) {
@@ -183,5 +232,6 @@ bool benchmark_path_walk(void) {
 
 BEGIN_TEST_CASE(basic_benchmarks)
 RUN_TEST_PERFORMANCE(benchmark_write_read)
+RUN_TEST_PERFORMANCE(benchmark_cold_read)
 RUN_TEST_PERFORMANCE(benchmark_path_walk)
 END_TEST_CASE(basic_benchmarks)
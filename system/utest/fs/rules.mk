@@ -22,6 +22,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/test-basic.c \
     $(LOCAL_DIR)/test-directory.c \
     $(LOCAL_DIR)/test-dot-dot.c \
+    $(LOCAL_DIR)/test-large-io.c \
     $(LOCAL_DIR)/test-link.c \
     $(LOCAL_DIR)/test-maxfile.c \
     $(LOCAL_DIR)/test-overflow.c \
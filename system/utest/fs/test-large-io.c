@@ -0,0 +1,85 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "filesystems.h"
+#include "misc.h"
+
+// Large enough to take several bulk transfers, and not a multiple of any
+// block or page size.
+#define LARGE_SIZE ((3 * 1024 * 1024) + 4321)
+
+static void fill_pattern(uint8_t* buf, size_t len, unsigned seed) {
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)((i * 7 + seed) ^ (i >> 13));
+    }
+}
+
+bool test_large_read_write(void) {
+    BEGIN_TEST;
+
+    uint8_t* wbuf = malloc(LARGE_SIZE);
+    uint8_t* rbuf = malloc(LARGE_SIZE);
+    ASSERT_NONNULL(wbuf, "");
+    ASSERT_NONNULL(rbuf, "");
+    fill_pattern(wbuf, LARGE_SIZE, 1);
+
+    int fd = open("::alpha", O_RDWR | O_CREAT, 0644);
+    ASSERT_GT(fd, 0, "");
+
+    // Whole file in one call each way; the seek pointer follows both
+    ASSERT_STREAM_ALL(write, fd, wbuf, LARGE_SIZE);
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), LARGE_SIZE, "");
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0, "");
+    ASSERT_STREAM_ALL(read, fd, rbuf, LARGE_SIZE);
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), LARGE_SIZE, "");
+    ASSERT_EQ(memcmp(wbuf, rbuf, LARGE_SIZE), 0, "");
+
+    // Reads past the end are short
+    ASSERT_EQ(lseek(fd, LARGE_SIZE / 2, SEEK_SET), LARGE_SIZE / 2, "");
+    ASSERT_EQ(read(fd, rbuf, LARGE_SIZE), LARGE_SIZE - LARGE_SIZE / 2, "");
+    ASSERT_EQ(memcmp(wbuf + LARGE_SIZE / 2, rbuf, LARGE_SIZE - LARGE_SIZE / 2), 0, "");
+
+    // Positional I/O leaves the seek pointer alone
+    const off_t off = 12345;
+    const size_t len = LARGE_SIZE - 2 * off;
+    fill_pattern(wbuf + off, len, 2);
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0, "");
+    ASSERT_EQ(pwrite(fd, wbuf + off, len, off), (ssize_t)len, "");
+    ASSERT_EQ(pread(fd, rbuf, len, off), (ssize_t)len, "");
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 0, "");
+    ASSERT_EQ(memcmp(wbuf + off, rbuf, len), 0, "");
+    ASSERT_STREAM_ALL(read, fd, rbuf, LARGE_SIZE);
+    ASSERT_EQ(memcmp(wbuf, rbuf, LARGE_SIZE), 0, "");
+
+    ASSERT_EQ(close(fd), 0, "");
+
+    // Appends land at the end of the file
+    fd = open("::alpha", O_RDWR | O_APPEND, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_STREAM_ALL(write, fd, wbuf, LARGE_SIZE);
+    struct stat st;
+    ASSERT_EQ(fstat(fd, &st), 0, "");
+    ASSERT_EQ(st.st_size, 2 * LARGE_SIZE, "");
+    ASSERT_EQ(pread(fd, rbuf, LARGE_SIZE, LARGE_SIZE), LARGE_SIZE, "");
+    ASSERT_EQ(memcmp(wbuf, rbuf, LARGE_SIZE), 0, "");
+
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink("::alpha"), 0, "");
+    free(wbuf);
+    free(rbuf);
+
+    END_TEST;
+}
+
+RUN_FOR_ALL_FILESYSTEMS(large_io_tests,
+    RUN_TEST_MEDIUM(test_large_read_write)
+)
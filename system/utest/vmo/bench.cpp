@@ -7,6 +7,7 @@
 #include <inttypes.h>
 #include <sys/types.h>
 #include <stdlib.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <magenta/compiler.h>
@@ -32,6 +33,69 @@ inline mx_time_t time_it(T func) {
     return mx_time_get(MX_CLOCK_MONOTONIC) - t;
 }
 
+struct fault_thread_args {
+    uintptr_t ptr;
+    size_t size;
+    const volatile bool* go;
+};
+
+// write fault in every page of a private mapping once told to go
+static int fault_thread(void* arg) {
+    auto args = static_cast<fault_thread_args*>(arg);
+
+    while (!*args->go)
+        ;
+
+    for (size_t i = 0; i < args->size; i += PAGE_SIZE) {
+        ((volatile char *)args->ptr)[i] = 99;
+    }
+    return 0;
+}
+
+// N threads each write faulting in their own vmo mapped into the same process
+static void fault_scaling_benchmark() {
+    const size_t size = 16*1024*1024;
+    const size_t thread_counts[] = { 1, 2, 4, 8 };
+    uint64_t base_rate = 0;
+
+    for (size_t nthreads : thread_counts) {
+        mx_handle_t vmos[8];
+        fault_thread_args args[8];
+        thrd_t threads[8];
+        volatile bool go = false;
+
+        for (size_t i = 0; i < nthreads; i++) {
+            mx_vmo_create(size, 0, &vmos[i]);
+            mx_vmar_map(mx_vmar_root_self(), 0, vmos[i], 0, size,
+                        MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &args[i].ptr);
+            args[i].size = size;
+            args[i].go = &go;
+            thrd_create_with_name(&threads[i], fault_thread, &args[i], "fault-bench");
+        }
+
+        mx_time_t t = time_it([&](){
+            go = true;
+            for (size_t i = 0; i < nthreads; i++) {
+                thrd_join(threads[i], nullptr);
+            }
+        });
+
+        uint64_t pages = nthreads * (size / PAGE_SIZE);
+        uint64_t rate = pages * MX_SEC(1) / (t ? t : 1);
+        if (nthreads == 1)
+            base_rate = rate;
+        printf("\ttook %" PRIu64 " nsecs for %zu threads to write fault in %zu private vmos of size %zu "
+               "(%" PRIu64 " pages/sec, %" PRIu64 ".%02" PRIu64 "x one thread)\n",
+               t, nthreads, nthreads, size, rate,
+               rate / (base_rate ? base_rate : 1), rate * 100 / (base_rate ? base_rate : 1) % 100);
+
+        for (size_t i = 0; i < nthreads; i++) {
+            mx_vmar_unmap(mx_vmar_root_self(), args[i].ptr, size);
+            mx_handle_close(vmos[i]);
+        }
+    }
+}
+
 int vmo_run_benchmark() {
     mx_time_t t;
     //mx_handle_t vmo;
@@ -157,6 +221,44 @@ int vmo_run_benchmark() {
 
     mx_handle_close(vmo);
 
+    // page fault throughput, with and without committing around write faults
+    const uint32_t extra_flags[] = { 0u, MX_VM_FLAG_COMMIT_AROUND };
+    for (uint32_t extra : extra_flags) {
+        const char* how = extra ? "with commit-around" : "one page per fault";
+
+        mx_vmo_create(size, 0, &vmo);
+        mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE | extra, &ptr);
+
+        t = time_it([&](){
+            for (size_t i = 0; i < size; i += PAGE_SIZE) {
+                ((volatile char *)ptr)[i] = 99;
+            }
+        });
+        printf("\ttook %" PRIu64 " nsecs to write fault in vmo of size %zu %s (%" PRIu64 " pages/sec)\n",
+               t, size, how, (size / PAGE_SIZE) * MX_SEC(1) / (t ? t : 1));
+
+        mx_vmar_unmap(mx_vmar_root_self(), ptr, size);
+
+        // the pages are resident now, so a new mapping should fault around them
+        mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE | extra, &ptr);
+
+        t = time_it([&](){
+            for (size_t i = 0; i < size; i += PAGE_SIZE) {
+                __UNUSED char a = ((volatile char *)ptr)[i];
+            }
+        });
+        printf("\ttook %" PRIu64 " nsecs to read fault in resident vmo of size %zu %s (%" PRIu64 " pages/sec)\n",
+               t, size, how, (size / PAGE_SIZE) * MX_SEC(1) / (t ? t : 1));
+
+        mx_vmar_unmap(mx_vmar_root_self(), ptr, size);
+        mx_handle_close(vmo);
+    }
+
+    // page fault scaling across threads faulting on unrelated mappings
+    fault_scaling_benchmark();
+
     printf("done with benchmark\n");
 
     return 0;
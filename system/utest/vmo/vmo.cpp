@@ -8,12 +8,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <hexdump/hexdump.h>
 #include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/object.h>
+#include <magenta/syscalls/port.h>
 #include <unittest/unittest.h>
 
 #include "bench.h"
@@ -614,6 +616,112 @@ bool vmo_clone_test_1() {
     END_TEST;
 }
 
+// fault-around must not let writes through a clone's mapping reach its parent,
+// whether or not missing pages are committed around the fault
+bool vmo_fault_around_clone_test() {
+    BEGIN_TEST;
+
+    const size_t size = PAGE_SIZE * 16;
+    size_t bytes_handled;
+
+    const uint32_t extra_flags[] = { 0u, MX_VM_FLAG_COMMIT_AROUND };
+    for (uint32_t extra : extra_flags) {
+        mx_handle_t vmo;
+        EXPECT_EQ(NO_ERROR, mx_vmo_create(size, 0, &vmo), "vm_object_create");
+
+        // fill the original so all its pages are resident
+        for (size_t off = 0; off < size; off += PAGE_SIZE) {
+            mx_vmo_write(vmo, &off, off, sizeof(off), &bytes_handled);
+        }
+
+        mx_handle_t clone_vmo = MX_HANDLE_INVALID;
+        EXPECT_EQ(NO_ERROR, mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0, size, &clone_vmo),
+                  "vm_clone");
+
+        uintptr_t ptr;
+        EXPECT_EQ(NO_ERROR, mx_vmar_map(mx_vmar_root_self(), 0, clone_vmo, 0, size,
+                                        MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE | extra,
+                                        &ptr), "map");
+
+        // read fault one page, which may map its neighbours from the parent
+        EXPECT_EQ(0u, *(volatile size_t*)ptr, "read back clone");
+
+        // write to every other page, then check each side sees its own data
+        for (size_t off = PAGE_SIZE; off < size; off += PAGE_SIZE * 2) {
+            *(volatile size_t*)(ptr + off) = off + 1;
+        }
+        for (size_t off = 0; off < size; off += PAGE_SIZE) {
+            size_t val;
+            mx_vmo_read(vmo, &val, off, sizeof(val), &bytes_handled);
+            EXPECT_EQ(off, val, "parent unchanged");
+            size_t expected = (off / PAGE_SIZE) % 2 ? off + 1 : off;
+            EXPECT_EQ(expected, *(volatile size_t*)(ptr + off), "read back clone");
+        }
+
+        EXPECT_EQ(NO_ERROR, mx_vmar_unmap(mx_vmar_root_self(), ptr, size), "unmap");
+        EXPECT_EQ(NO_ERROR, mx_handle_close(clone_vmo), "handle_close");
+        EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+    }
+
+    END_TEST;
+}
+
+// a vmo's fault-around hint is rounded like vm.fault_around, and mappings of
+// it still work whatever the window
+bool vmo_fault_around_property_test() {
+    BEGIN_TEST;
+
+    const size_t size = PAGE_SIZE * 16;
+    mx_handle_t vmo;
+    EXPECT_EQ(NO_ERROR, mx_vmo_create(size, 0, &vmo), "vm_object_create");
+
+    uint32_t pages = 1234;
+    EXPECT_EQ(NO_ERROR, mx_object_get_property(vmo, MX_PROP_VMO_FAULT_AROUND, &pages,
+                                               sizeof(pages)), "get property");
+    EXPECT_EQ(0u, pages, "defaults to the system window");
+
+    const struct { uint32_t set, get; } cases[] = {
+        { 1u, 1u }, { 6u, 4u }, { 100000u, 512u }, { 0u, 0u }, { 4u, 4u },
+    };
+    for (const auto& c : cases) {
+        EXPECT_EQ(NO_ERROR, mx_object_set_property(vmo, MX_PROP_VMO_FAULT_AROUND, &c.set,
+                                                   sizeof(c.set)), "set property");
+        EXPECT_EQ(NO_ERROR, mx_object_get_property(vmo, MX_PROP_VMO_FAULT_AROUND, &pages,
+                                                   sizeof(pages)), "get property");
+        EXPECT_EQ(c.get, pages, "rounded window");
+    }
+
+    uint64_t too_big = 4;
+    EXPECT_EQ(ERR_BUFFER_TOO_SMALL, mx_object_set_property(vmo, MX_PROP_VMO_FAULT_AROUND,
+                                                           &too_big, sizeof(too_big)),
+              "wrong size");
+
+    mx_handle_t event;
+    EXPECT_EQ(NO_ERROR, mx_event_create(0u, &event), "event_create");
+    EXPECT_EQ(ERR_WRONG_TYPE, mx_object_set_property(event, MX_PROP_VMO_FAULT_AROUND, &pages,
+                                                     sizeof(pages)), "not a vmo");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(event), "handle_close");
+
+    // with a 4 page window, touch every page through a mapping
+    uintptr_t ptr;
+    EXPECT_EQ(NO_ERROR, mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                                    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &ptr), "map");
+    for (size_t off = 0; off < size; off += PAGE_SIZE) {
+        *(volatile size_t*)(ptr + off) = off;
+    }
+    for (size_t off = 0; off < size; off += PAGE_SIZE) {
+        size_t val;
+        size_t bytes_read;
+        EXPECT_EQ(NO_ERROR, mx_vmo_read(vmo, &val, off, sizeof(val), &bytes_read), "read");
+        EXPECT_EQ(off, val, "read back");
+    }
+
+    EXPECT_EQ(NO_ERROR, mx_vmar_unmap(mx_vmar_root_self(), ptr, size), "unmap");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+
+    END_TEST;
+}
+
 // test set 2: create a clone, verify that it COWs via the read/write interface
 bool vmo_clone_test_2() {
     BEGIN_TEST;
@@ -866,6 +974,110 @@ bool vmo_clone_test_4() {
     END_TEST;
 }
 
+struct PagerReadArgs {
+    mx_handle_t vmo;
+    uint64_t offset;
+    uint8_t buf[PAGE_SIZE];
+    mx_status_t status;
+};
+
+static int pager_read_thread(void* arg) {
+    auto args = static_cast<PagerReadArgs*>(arg);
+    size_t actual;
+    args->status = mx_vmo_read(args->vmo, args->buf, args->offset, sizeof(args->buf), &actual);
+    return 0;
+}
+
+bool vmo_pager_test() {
+    BEGIN_TEST;
+
+    mx_handle_t port;
+    ASSERT_EQ(NO_ERROR, mx_port_create(MX_PORT_OPT_V2, &port), "port_create");
+
+    const uint64_t kKey = 42;
+    mx_handle_t vmo;
+    ASSERT_EQ(NO_ERROR, mx_vmo_create_paged(port, kKey, PAGE_SIZE * 4, 0, &vmo),
+              "vmo_create_paged");
+
+    // the pager owns the contents: no committing, decommitting or resizing behind its back
+    EXPECT_EQ(ERR_NOT_SUPPORTED, mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, PAGE_SIZE, nullptr, 0),
+              "commit");
+    EXPECT_EQ(ERR_NOT_SUPPORTED, mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, 0, PAGE_SIZE, nullptr, 0),
+              "decommit");
+    EXPECT_EQ(ERR_NOT_SUPPORTED, mx_vmo_set_size(vmo, PAGE_SIZE * 8), "set_size");
+
+    // a read of a missing page blocks until the pager supplies it
+    PagerReadArgs args = {};
+    args.vmo = vmo;
+    args.offset = PAGE_SIZE;
+    thrd_t thread;
+    ASSERT_EQ(thrd_success, thrd_create(&thread, pager_read_thread, &args), "thrd_create");
+
+    mx_port_packet_t packet;
+    ASSERT_EQ(NO_ERROR, mx_port_wait(port, MX_TIME_INFINITE, &packet, sizeof(packet)), "port_wait");
+    EXPECT_EQ(MX_PKT_TYPE_PAGE_REQUEST, packet.type, "packet type");
+    EXPECT_EQ(kKey, packet.key, "packet key");
+    EXPECT_EQ(MX_PAGER_VMO_READ, packet.page_request.command, "command");
+    EXPECT_EQ(PAGE_SIZE, packet.page_request.offset, "request offset");
+    EXPECT_EQ(PAGE_SIZE, packet.page_request.length, "request length");
+
+    uint8_t contents[PAGE_SIZE];
+    memset(contents, 0x5a, sizeof(contents));
+
+    // only a writable handle may supply pages
+    mx_handle_t ro_vmo;
+    ASSERT_EQ(NO_ERROR, mx_handle_duplicate(vmo, MX_RIGHT_READ | MX_RIGHT_MAP, &ro_vmo),
+              "duplicate");
+    EXPECT_EQ(ERR_ACCESS_DENIED, mx_vmo_op_range(ro_vmo, MX_VMO_OP_SUPPLY, PAGE_SIZE, PAGE_SIZE,
+                                                 contents, sizeof(contents)),
+              "supply through read-only handle");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(ro_vmo), "handle_close");
+
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_SUPPLY, PAGE_SIZE, PAGE_SIZE,
+                                        contents, sizeof(contents)),
+              "supply");
+    ASSERT_EQ(thrd_success, thrd_join(thread, nullptr), "thrd_join");
+    EXPECT_EQ(NO_ERROR, args.status, "read after supply");
+    EXPECT_EQ(0, memcmp(args.buf, contents, sizeof(contents)), "supplied contents");
+
+    // a supplied page stays put; reading it again doesn't ask the pager
+    size_t actual;
+    EXPECT_EQ(NO_ERROR, mx_vmo_read(vmo, args.buf, PAGE_SIZE, sizeof(args.buf), &actual), "reread");
+    EXPECT_EQ(ERR_TIMED_OUT, mx_port_wait(port, 0, &packet, sizeof(packet)), "no new request");
+
+    // failing a request fails the read waiting on it
+    args.offset = PAGE_SIZE * 2;
+    ASSERT_EQ(thrd_success, thrd_create(&thread, pager_read_thread, &args), "thrd_create");
+    ASSERT_EQ(NO_ERROR, mx_port_wait(port, MX_TIME_INFINITE, &packet, sizeof(packet)), "port_wait");
+    EXPECT_EQ(PAGE_SIZE * 2, packet.page_request.offset, "request offset");
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_SUPPLY_ERROR, PAGE_SIZE * 2, PAGE_SIZE,
+                                        nullptr, 0),
+              "supply error");
+    ASSERT_EQ(thrd_success, thrd_join(thread, nullptr), "thrd_join");
+    EXPECT_EQ(ERR_IO, args.status, "read after failed supply");
+
+    // the pager hears when the last clone goes away, and how many there were
+    mx_handle_t clones[2];
+    for (auto& clone : clones) {
+        ASSERT_EQ(NO_ERROR, mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0, PAGE_SIZE * 4,
+                                         &clone),
+                  "vmo_clone");
+    }
+    EXPECT_EQ(NO_ERROR, mx_handle_close(clones[0]), "handle_close");
+    EXPECT_EQ(ERR_TIMED_OUT, mx_port_wait(port, 0, &packet, sizeof(packet)), "clone left");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(clones[1]), "handle_close");
+    ASSERT_EQ(NO_ERROR, mx_port_wait(port, 0, &packet, sizeof(packet)), "port_wait");
+    EXPECT_EQ(MX_PKT_TYPE_PAGE_REQUEST, packet.type, "packet type");
+    EXPECT_EQ(kKey, packet.key, "packet key");
+    EXPECT_EQ(MX_PAGER_VMO_ZERO_CHILDREN, packet.page_request.command, "command");
+    EXPECT_EQ(2u, packet.page_request.clone_count, "clone count");
+
+    EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(port), "handle_close");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(vmo_tests)
 RUN_TEST(vmo_create_test);
 RUN_TEST(vmo_read_write_test);
@@ -880,6 +1092,9 @@ RUN_TEST(vmo_clone_test_1);
 RUN_TEST(vmo_clone_test_2);
 RUN_TEST(vmo_clone_test_3);
 RUN_TEST(vmo_clone_test_4);
+RUN_TEST(vmo_fault_around_clone_test);
+RUN_TEST(vmo_fault_around_property_test);
+RUN_TEST(vmo_pager_test);
 END_TEST_CASE(vmo_tests)
 
 int main(int argc, char** argv) {